@@ -44,7 +44,7 @@ typedef bool lto_bool_t;
  * @{
  */
 
-#define LTO_API_VERSION 19
+#define LTO_API_VERSION 21
 
 /**
  * \since prior to LTO_API_VERSION=3
@@ -692,6 +692,17 @@ extern void thinlto_codegen_set_cache_pruning_interval(thinlto_code_gen_t cg,
 extern void thinlto_codegen_set_final_cache_size_relative_to_available_space(
     thinlto_code_gen_t cg, unsigned percentage);
 
+/**
+ * Sets the maximum size of the cache, in bytes. When the limit relative to the
+ * available space is also in effect, the smaller of the two is enforced. The
+ * least recently used entries are pruned first. A value of 0 (default)
+ * disables this limit.
+ *
+ * \since LTO_API_VERSION=20
+ */
+extern void thinlto_codegen_set_cache_size_bytes(thinlto_code_gen_t cg,
+                                                 unsigned long long bytes);
+
 /**
  * Sets the expiration (in seconds) for an entry in the cache. An unspecified
  * default value will be applied. A value of 0 will be ignored.
@@ -739,6 +750,16 @@ extern void thinlto_codegen_disable_codegen(thinlto_code_gen_t cg,
 extern void thinlto_codegen_set_codegen_only(thinlto_code_gen_t cg,
                                              lto_bool_t codegen_only);
 
+/**
+ * Sets the estimated memory, in bytes, that the backends running in parallel
+ * may use. Modules are started largest first, and only once their estimated
+ * footprint fits in the budget. A value of 0 (default) disables the limit.
+ *
+ * \since LTO_API_VERSION=21
+ */
+extern void thinlto_codegen_set_memory_budget(thinlto_code_gen_t cg,
+                                              unsigned long long bytes);
+
 /**
  * Parse -mllvm style debug options.
  *
@@ -20,6 +20,7 @@
 
 namespace llvm {
 template<typename T> class SmallVectorImpl;
+class raw_ostream;
 
 /// hexdigit - Return the hexadecimal character for the
 /// given number \p X (which should be less than 16).
@@ -118,6 +119,10 @@ void SplitString(StringRef Source,
                  SmallVectorImpl<StringRef> &OutFragments,
                  StringRef Delimiters = " \t\n\v\f\r");
 
+/// PrintJSONString - Print the specified string to \p Out as a quoted JSON
+/// string, escaping quotes, backslashes and control characters.
+void PrintJSONString(StringRef Str, raw_ostream &Out);
+
 /// HashString - Hash function for strings.
 ///
 /// This is the Bernstein hash function.
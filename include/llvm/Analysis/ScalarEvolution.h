@@ -748,9 +748,9 @@ namespace llvm {
       /// Get the max backedge taken count for the loop.
       const SCEV *getMax(ScalarEvolution *SE) const;
 
-      /// Return true if any backedge taken count expressions refer to the given
-      /// subexpression.
-      bool hasOperand(const SCEV *S, ScalarEvolution *SE) const;
+      /// Append the computed backedge taken count expressions to Exprs.
+      void getExprs(SmallVectorImpl<const SCEV *> &Exprs,
+                    ScalarEvolution *SE) const;
 
       /// Invalidate this result and free associated memory.
       void clear();
@@ -764,6 +764,24 @@ namespace llvm {
     /// function as they are computed.
     DenseMap<const Loop *, BackedgeTakenInfo> PredicatedBackedgeTakenCounts;
 
+    /// A loop whose backedge-taken count is cached, together with whether it
+    /// is the predicated count.
+    typedef PointerIntPair<const Loop *, 1, bool> BECountUser;
+
+    /// Map each subexpression of a cached backedge-taken count to the loops
+    /// whose count uses it, so forgetMemoizedResults only drops the counts
+    /// that refer to the forgotten expression instead of scanning all of
+    /// them.
+    DenseMap<const SCEV *, SmallPtrSet<BECountUser, 4>> BECountUsers;
+
+    /// Add (or, if Add is false, remove) the loop L as a user of each
+    /// subexpression of its backedge-taken count BTI in BECountUsers.
+    void updateBECountUsers(const Loop *L, bool Predicated,
+                            const BackedgeTakenInfo &BTI, bool Add);
+
+    /// Drop the cached (predicated) backedge-taken count of the loop L.
+    void forgetBackedgeTakenCount(const Loop *L, bool Predicated);
+
     /// This map contains entries for all of the PHI instructions that we
     /// attempt to compute constant evolutions for.  This allows us to avoid
     /// potentially expensive recomputation of these properties.  An instruction
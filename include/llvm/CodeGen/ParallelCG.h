@@ -14,6 +14,7 @@
 #ifndef LLVM_CODEGEN_PARALLELCG_H
 #define LLVM_CODEGEN_PARALLELCG_H
 
+#include "llvm/IR/LLVMContext.h"
 #include "llvm/Support/CodeGen.h"
 #include "llvm/Target/TargetMachine.h"
 
@@ -26,22 +27,42 @@ class Module;
 class TargetOptions;
 class raw_pwrite_stream;
 
+namespace legacy {
+class PassManagerBase;
+}
+
 /// Split M into OSs.size() partitions, and generate code for each. Takes a
 /// factory function for the TargetMachine TMFactory. Writes OSs.size() output
 /// files to the output streams in OSs. The resulting output files if linked
 /// together are intended to be equivalent to the single output file that would
-/// have been code generated from M.
+/// have been code generated from M. Partitions are balanced by instruction
+/// count, and the last one is code generated in the context of M on the calling
+/// thread.
 ///
 /// Writes bitcode for individual partitions into output streams in BCOSs, if
 /// BCOSs is not empty.
 ///
+/// AddPasses, if set, is called on the pass manager of each partition before
+/// the code generation passes are added to it, for instance to add the
+/// TargetLibraryInfo they should use. It may be called from several threads
+/// at once.
+///
+/// The other partitions are code generated in contexts of their own. If
+/// DiagHandler is set, it is installed with DiagContext in each of them, and
+/// is then called from several threads at once; otherwise their diagnostics go
+/// to the default handler, which exits on errors.
+///
 /// \returns M if OSs.size() == 1, otherwise returns std::unique_ptr<Module>().
 std::unique_ptr<Module>
 splitCodeGen(std::unique_ptr<Module> M, ArrayRef<raw_pwrite_stream *> OSs,
              ArrayRef<llvm::raw_pwrite_stream *> BCOSs,
              const std::function<std::unique_ptr<TargetMachine>()> &TMFactory,
              TargetMachine::CodeGenFileType FT = TargetMachine::CGFT_ObjectFile,
-             bool PreserveLocals = false);
+             bool PreserveLocals = false,
+             const std::function<void(legacy::PassManagerBase &)> &AddPasses =
+                 nullptr,
+             LLVMContext::DiagnosticHandlerTy DiagHandler = nullptr,
+             void *DiagContext = nullptr);
 
 } // namespace llvm
 
@@ -22,6 +22,7 @@
 #include "llvm/DebugInfo/DWARF/DWARFDebugRangeList.h"
 #include "llvm/DebugInfo/DWARF/DWARFSection.h"
 #include "llvm/DebugInfo/DWARF/DWARFTypeUnit.h"
+#include <mutex>
 
 namespace llvm {
 
@@ -36,6 +37,12 @@ typedef DenseMap<uint64_t, std::pair<uint8_t, int64_t> > RelocAddrMap;
 /// This data structure is the top level entity that deals with dwarf debug
 /// information parsing. The actual data is supplied through pure virtual
 /// methods that a concrete implementation provides.
+///
+/// Address lookups (getLineInfoForAddress, getLineInfoForAddressRange and
+/// getInliningInfoForAddress) go through an address range index built from
+/// .debug_aranges, or synthesized from the unit DIEs for the units it doesn't
+/// describe. Only the units a lookup touches have their headers and DIEs
+/// extracted, and lookups may be performed concurrently from several threads.
 class DWARFContext : public DIContext {
 
   DWARFUnitSection<DWARFCompileUnit> CUs;
@@ -55,6 +62,12 @@ class DWARFContext : public DIContext {
   std::unique_ptr<DWARFDebugAbbrev> AbbrevDWO;
   std::unique_ptr<DWARFDebugLocDWO> LocDWO;
 
+  /// Guard the lazily parsed data used by address lookups: the abbreviations
+  /// and unit indexes, the address ranges, and the line tables.
+  std::mutex AbbrevLock;
+  std::mutex ArangesLock;
+  std::mutex LineLock;
+
   DWARFContext(DWARFContext &) = delete;
   DWARFContext &operator=(DWARFContext &) = delete;
 
@@ -142,6 +155,11 @@ public:
     return CUs[index].get();
   }
 
+  /// Get the compile unit whose header starts at the specified offset in
+  /// .debug_info. Only this unit's header is extracted if the compile units
+  /// haven't all been parsed yet.
+  DWARFCompileUnit *getCompileUnitAtOffset(uint32_t Offset);
+
   /// Get the compile unit at the specified index for the DWO compile units.
   DWARFCompileUnit *getDWOCompileUnitAtIndex(unsigned index) {
     parseDWOCompileUnits();
@@ -17,6 +17,9 @@
 #include "llvm/DebugInfo/DWARF/DWARFRelocMap.h"
 #include "llvm/DebugInfo/DWARF/DWARFSection.h"
 #include "llvm/DebugInfo/DWARF/DWARFUnitIndex.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include <vector>
 
 namespace llvm {
@@ -43,11 +46,22 @@ public:
   void parseDWO(DWARFContext &C, const DWARFSection &DWOSection,
                 DWARFUnitIndex *Index = nullptr);
 
+  /// Returns the Unit whose header starts at the given section offset. If the
+  /// section hasn't been fully parsed yet, only the header of this Unit is
+  /// extracted. Returns null if there is no valid unit header at \p Offset.
+  DWARFUnit *parseUnitAtOffset(DWARFContext &C, const DWARFSection &Section,
+                               uint32_t Offset);
+
 protected:
   virtual void parseImpl(DWARFContext &Context, const DWARFSection &Section,
                          const DWARFDebugAbbrev *DA, StringRef RS, StringRef SS,
                          StringRef SOS, StringRef AOS, StringRef LS,
                          bool isLittleEndian, bool isDWO) = 0;
+  virtual DWARFUnit *
+  parseUnitAtOffsetImpl(DWARFContext &Context, const DWARFSection &Section,
+                        const DWARFDebugAbbrev *DA, StringRef RS, StringRef SS,
+                        StringRef SOS, StringRef AOS, StringRef LS,
+                        bool isLittleEndian, bool isDWO, uint32_t Offset) = 0;
 
   ~DWARFUnitSectionBase() = default;
 };
@@ -56,10 +70,22 @@ const DWARFUnitIndex &getDWARFUnitIndex(DWARFContext &Context,
                                         DWARFSectionKind Kind);
 
 /// Concrete instance of DWARFUnitSection, specialized for one Unit type.
+///
+/// Units can either be parsed all at once, or one at a time through
+/// parseUnitAtOffset(). Until the section is fully parsed, the vector of units
+/// is only accessed under Lock; afterwards it is never modified again.
 template<typename UnitType>
 class DWARFUnitSection final : public SmallVector<std::unique_ptr<UnitType>, 1>,
                                public DWARFUnitSectionBase {
-  bool Parsed = false;
+  std::atomic<bool> Parsed{false};
+  mutable std::mutex Lock;
+  /// Completes the parsing of a section that has been parsed lazily, for
+  /// lookups of offsets that aren't the start of a unit.
+  std::function<void()> ParseRemaining;
+  /// Lazily parsed units that turned out not to be on the chain of unit
+  /// headers. They are kept alive as pointers to them may have been handed
+  /// out already.
+  SmallVector<std::unique_ptr<UnitType>, 0> Orphans;
 
 public:
   typedef llvm::SmallVectorImpl<std::unique_ptr<UnitType>> UnitVector;
@@ -67,27 +93,62 @@ public:
   typedef llvm::iterator_range<typename UnitVector::iterator> iterator_range;
 
   UnitType *getUnitForOffset(uint32_t Offset) const override {
+    if (!Parsed) {
+      std::lock_guard<std::mutex> Guard(Lock);
+      if (UnitType *U = findUnitForOffset(Offset))
+        return U;
+      if (!ParseRemaining)
+        return nullptr;
+      ParseRemaining();
+    }
+    return findUnitForOffset(Offset);
+  }
+
+private:
+  UnitType *findUnitForOffset(uint32_t Offset) const {
     auto *CU = std::upper_bound(
         this->begin(), this->end(), Offset,
         [](uint32_t LHS, const std::unique_ptr<UnitType> &RHS) {
           return LHS < RHS->getNextUnitOffset();
         });
-    if (CU != this->end())
+    if (CU != this->end() && (*CU)->getOffset() <= Offset)
       return CU->get();
     return nullptr;
   }
 
-private:
   void parseImpl(DWARFContext &Context, const DWARFSection &Section,
                  const DWARFDebugAbbrev *DA, StringRef RS, StringRef SS,
                  StringRef SOS, StringRef AOS, StringRef LS, bool LE,
                  bool IsDWO) override {
     if (Parsed)
       return;
+    std::lock_guard<std::mutex> Guard(Lock);
+    parseAll(Context, Section, DA, RS, SS, SOS, AOS, LS, LE, IsDWO);
+  }
+
+  /// Parse all the units of the section, reusing the ones that have already
+  /// been parsed lazily. Must be called with Lock held.
+  void parseAll(DWARFContext &Context, const DWARFSection &Section,
+                const DWARFDebugAbbrev *DA, StringRef RS, StringRef SS,
+                StringRef SOS, StringRef AOS, StringRef LS, bool LE,
+                bool IsDWO) {
+    if (Parsed)
+      return;
+    SmallVector<std::unique_ptr<UnitType>, 1> LazyUnits(std::move(*this));
+    this->clear();
+    auto LazyI = LazyUnits.begin(), LazyE = LazyUnits.end();
+
     const auto &Index = getDWARFUnitIndex(Context, UnitType::Section);
     DataExtractor Data(Section.Data, LE, 0);
     uint32_t Offset = 0;
     while (Data.isValidOffset(Offset)) {
+      while (LazyI != LazyE && (*LazyI)->getOffset() < Offset)
+        Orphans.push_back(std::move(*LazyI++));
+      if (LazyI != LazyE && (*LazyI)->getOffset() == Offset) {
+        this->push_back(std::move(*LazyI++));
+        Offset = this->back()->getNextUnitOffset();
+        continue;
+      }
       auto U = llvm::make_unique<UnitType>(Context, Section, DA, RS, SS, SOS,
                                            AOS, LS, LE, IsDWO, *this,
                                            Index.getFromOffset(Offset));
@@ -96,8 +157,43 @@ private:
       this->push_back(std::move(U));
       Offset = this->back()->getNextUnitOffset();
     }
+    for (; LazyI != LazyE; ++LazyI)
+      Orphans.push_back(std::move(*LazyI));
     Parsed = true;
   }
+
+  DWARFUnit *parseUnitAtOffsetImpl(DWARFContext &Context,
+                                   const DWARFSection &Section,
+                                   const DWARFDebugAbbrev *DA, StringRef RS,
+                                   StringRef SS, StringRef SOS, StringRef AOS,
+                                   StringRef LS, bool LE, bool IsDWO,
+                                   uint32_t Offset) override {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto I = std::lower_bound(
+        this->begin(), this->end(), Offset,
+        [](const std::unique_ptr<UnitType> &LHS, uint32_t RHS) {
+          return LHS->getOffset() < RHS;
+        });
+    if (I != this->end() && (*I)->getOffset() == Offset)
+      return I->get();
+    if (Parsed)
+      return nullptr;
+
+    if (!ParseRemaining)
+      ParseRemaining = [=, &Context, &Section]() {
+        parseAll(Context, Section, DA, RS, SS, SOS, AOS, LS, LE, IsDWO);
+      };
+
+    const auto &Index = getDWARFUnitIndex(Context, UnitType::Section);
+    DataExtractor Data(Section.Data, LE, 0);
+    auto U = llvm::make_unique<UnitType>(Context, Section, DA, RS, SS, SOS,
+                                         AOS, LS, LE, IsDWO, *this,
+                                         Index.getFromOffset(Offset));
+    uint32_t NextOffset = Offset;
+    if (!U->extract(Data, &NextOffset))
+      return nullptr;
+    return this->insert(I, std::move(U))->get();
+  }
 };
 
 class DWARFUnit {
@@ -125,6 +221,9 @@ class DWARFUnit {
   uint64_t BaseAddr;
   // The compile unit debug information entry items.
   std::vector<DWARFDebugInfoEntryMinimal> DieArray;
+  /// Guards the extraction of DieArray. Once all DIEs have been extracted,
+  /// DieArray is not modified anymore and can be read without locking.
+  std::mutex DIEsLock;
 
   class DWOHolder {
     object::OwningBinary<object::ObjectFile> DWOFile;
@@ -135,6 +234,8 @@ class DWARFUnit {
     DWARFUnit *getUnit() const { return DWOU; }
   };
   std::unique_ptr<DWOHolder> DWO;
+  /// Guards the lazy loading of DWO.
+  std::mutex DWOLock;
 
   const DWARFUnitIndex::Entry *IndexEntry;
 
@@ -278,10 +379,13 @@ private:
   /// setDIERelations - We read in all of the DIE entries into our flat list
   /// of DIE entries and now we need to go back through all of them and set the
   /// parent, sibling and child pointers for quick DIE navigation.
-  void setDIERelations();
+  static void setDIERelations(std::vector<DWARFDebugInfoEntryMinimal> &Dies);
   /// clearDIEs - Clear parsed DIEs to keep memory usage low.
   void clearDIEs(bool KeepCUDie);
 
+  /// loadDWO - Opens the .dwo file for current compile unit and checks that
+  /// it matches this unit. Returns null if there is no such file.
+  std::unique_ptr<DWOHolder> loadDWO();
   /// parseDWO - Parses .dwo file for current compile unit. Returns true if
   /// it was actually constructed.
   bool parseDWO();
@@ -13,13 +13,17 @@
 #ifndef LLVM_DEBUGINFO_SYMBOLIZE_SYMBOLIZE_H
 #define LLVM_DEBUGINFO_SYMBOLIZE_SYMBOLIZE_H
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/DebugInfo/Symbolize/SymbolizableModule.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/ErrorOr.h"
-#include <map>
+#include <list>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace llvm {
 namespace symbolize {
@@ -36,12 +40,24 @@ public:
     bool RelativeAddresses : 1;
     std::string DefaultArch;
     std::vector<std::string> DsymHints;
+    /// Approximate upper bound, in bytes, on the memory used by cached
+    /// modules. When it is exceeded, the least recently used modules are
+    /// evicted. 0 means no limit.
+    uint64_t MaxCacheSize;
     Options(FunctionNameKind PrintFunctions = FunctionNameKind::LinkageName,
             bool UseSymbolTable = true, bool Demangle = true,
-            bool RelativeAddresses = false, std::string DefaultArch = "")
+            bool RelativeAddresses = false, std::string DefaultArch = "",
+            uint64_t MaxCacheSize = 0)
         : PrintFunctions(PrintFunctions), UseSymbolTable(UseSymbolTable),
           Demangle(Demangle), RelativeAddresses(RelativeAddresses),
-          DefaultArch(std::move(DefaultArch)) {}
+          DefaultArch(std::move(DefaultArch)), MaxCacheSize(MaxCacheSize) {}
+  };
+
+  /// Counters describing how the module cache behaved so far.
+  struct CacheStats {
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Evictions = 0;
   };
 
   LLVMSymbolizer(const Options &Opts = Options()) : Opts(Opts) {}
@@ -55,7 +71,23 @@ public:
                                                 uint64_t ModuleOffset);
   Expected<DIGlobal> symbolizeData(const std::string &ModuleName,
                                    uint64_t ModuleOffset);
+
+  /// Batched versions of symbolizeCode() and symbolizeInlinedCode(). The
+  /// module is looked up once, and the offsets are visited in ascending order
+  /// so that lookups in the debug info stay local. The results are returned
+  /// in the order of \p ModuleOffsets.
+  Expected<std::vector<DILineInfo>>
+  symbolizeCodeBatch(const std::string &ModuleName,
+                     ArrayRef<uint64_t> ModuleOffsets);
+  Expected<std::vector<DIInliningInfo>>
+  symbolizeInlinedCodeBatch(const std::string &ModuleName,
+                            ArrayRef<uint64_t> ModuleOffsets);
+
   void flush();
+  const CacheStats &getCacheStats() const { return Stats; }
+  /// Number of binaries currently held by the cache, including the ones that
+  /// failed to load.
+  size_t getNumCachedBinaries() const { return BinaryForPath.size(); }
   static std::string DemangleName(const std::string &Name,
                                   const SymbolizableModule *ModInfo);
 
@@ -64,6 +96,25 @@ private:
   // corresponding debug info. These objects can be the same.
   typedef std::pair<ObjectFile*, ObjectFile*> ObjectPair;
 
+  struct ModuleEntry {
+    /// Null if the module failed to load.
+    std::unique_ptr<SymbolizableModule> Module;
+    /// Keys into BinaryForPath of the binaries the module was created from.
+    SmallVector<std::string, 2> BinaryPaths;
+    /// Approximate memory footprint of the module.
+    uint64_t Size = 0;
+    /// Position of the module in LRUModules.
+    std::list<StringMapEntry<ModuleEntry> *>::iterator LRUPos;
+  };
+
+  /// \brief Result of getOrCreateObjectPair(), along with the paths the two
+  /// objects were loaded from.
+  struct CachedObjectPair {
+    ObjectPair Objects;
+    std::string ObjPath;
+    std::string DbgObjPath;
+  };
+
   /// Returns a SymbolizableModule or an error if loading debug info failed.
   /// Only one attempt is made to load a module, and errors during loading are
   /// only reported once. Subsequent calls to get module info for a module that
@@ -71,16 +122,19 @@ private:
   Expected<SymbolizableModule *>
   getOrCreateModuleInfo(const std::string &ModuleName);
 
+  /// Both set \p DbgPath to the path of the returned debug object, if any.
   ObjectFile *lookUpDsymFile(const std::string &Path,
                              const MachOObjectFile *ExeObj,
-                             const std::string &ArchName);
+                             const std::string &ArchName,
+                             std::string &DbgPath);
   ObjectFile *lookUpDebuglinkObject(const std::string &Path,
                                     const ObjectFile *Obj,
-                                    const std::string &ArchName);
+                                    const std::string &ArchName,
+                                    std::string &DbgPath);
 
   /// \brief Returns pair of pointers to object and debug object.
-  Expected<ObjectPair> getOrCreateObjectPair(const std::string &Path,
-                                            const std::string &ArchName);
+  Expected<const CachedObjectPair *>
+  getOrCreateObjectPair(const std::string &Path, const std::string &ArchName);
 
   /// \brief Return a pointer to object file at specified path, for a specified
   /// architecture (e.g. if path refers to a Mach-O universal binary, only one
@@ -88,21 +142,57 @@ private:
   Expected<ObjectFile *> getOrCreateObject(const std::string &Path,
                                           const std::string &ArchName);
 
-  std::map<std::string, std::unique_ptr<SymbolizableModule>> Modules;
+  /// \brief Returns the key used for caches indexed by a path/architecture
+  /// pair.
+  static std::string getPathArchKey(StringRef Path, StringRef ArchName);
+
+  /// \brief Moves the module to the front of the LRU list.
+  void touchModule(StringMapEntry<ModuleEntry> &Entry);
+
+  /// \brief Evicts least recently used modules until the cache fits in
+  /// Opts.MaxCacheSize again. The most recently used module is never evicted.
+  void pruneModules();
+
+  /// \brief Makes \p M reference the binary at \p Path, which has been loaded
+  /// or failed to load, and accounts for its size.
+  void addBinaryRef(ModuleEntry &M, const std::string &Path);
+
+  /// \brief Drops the reference of an evicted module on a binary, and frees
+  /// the binary and the objects created from it when it was the last one.
+  void releaseBinary(StringRef Path);
+
+  /// \brief Frees a binary that was only loaded to be probed, e.g. a dSYM
+  /// candidate that turned out not to match, unless a module references it.
+  void releaseBinaryIfUnused(StringRef Path);
+
+  /// \brief Frees the binary at \p Path and everything cached from it.
+  void freeBinary(StringRef Path);
+
+  StringMap<ModuleEntry> Modules;
+
+  /// \brief Modules, from the most recently used to the least recently used.
+  std::list<StringMapEntry<ModuleEntry> *> LRUModules;
+
+  /// \brief Sum of the sizes of all the cached modules.
+  uint64_t CacheSize = 0;
+
+  /// \brief Number of cached modules referencing each binary in
+  /// BinaryForPath.
+  StringMap<unsigned> BinaryRefCount;
 
-  /// \brief Contains cached results of getOrCreateObjectPair().
-  std::map<std::pair<std::string, std::string>, ObjectPair>
-      ObjectPairForPathArch;
+  /// \brief Contains cached results of getOrCreateObjectPair(), keyed by
+  /// getPathArchKey().
+  StringMap<CachedObjectPair> ObjectPairForPathArch;
 
   /// \brief Contains parsed binary for each path, or parsing error.
-  std::map<std::string, OwningBinary<Binary>> BinaryForPath;
+  StringMap<OwningBinary<Binary>> BinaryForPath;
 
   /// \brief Parsed object file for path/architecture pair, where "path" refers
-  /// to Mach-O universal binary.
-  std::map<std::pair<std::string, std::string>, std::unique_ptr<ObjectFile>>
-      ObjectForUBPathAndArch;
+  /// to Mach-O universal binary. Keyed by getPathArchKey().
+  StringMap<std::unique_ptr<ObjectFile>> ObjectForUBPathAndArch;
 
   Options Opts;
+  CacheStats Stats;
 };
 
 } // namespace symbolize
@@ -543,6 +543,12 @@ protected:
   Instruction(Type *Ty, unsigned iType, Use *Ops, unsigned NumOps,
               BasicBlock *InsertAtEnd);
 
+  /// Allocate an instruction like User's operator new does, but in the
+  /// InstructionArena that is current on this thread, if any.
+  void *operator new(size_t Size);
+  void *operator new(size_t Size, unsigned Us);
+  void *operator new(size_t Size, unsigned Us, unsigned DescBytes);
+
 private:
   /// Create a copy of this instruction.
   Instruction *cloneImpl() const;
@@ -0,0 +1,93 @@
+//===- llvm/IR/InstructionArena.h - Arena for instructions ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+/// \file
+///
+/// This file declares InstructionArena, an opt-in allocator for the
+/// instructions of large modules.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_IR_INSTRUCTIONARENA_H
+#define LLVM_IR_INSTRUCTIONARENA_H
+
+#include "llvm/Support/Allocator.h"
+#include <cstddef>
+
+namespace llvm {
+
+/// \brief An allocator for instructions and their co-allocated operands.
+///
+/// Instructions created on a thread while an InstructionArena::Scope is active
+/// on it are carved out of the slabs of the scope's arena, which keeps them
+/// close together in memory and makes creating them much cheaper than with
+/// operator new. Deleting one of them puts its memory on a free list of the
+/// arena, where instructions of the same size created later reuse it.
+/// Destroying the arena frees all of its slabs at once.
+///
+/// Only instructions are placed in an arena. Constants, globals and other
+/// users are not, and neither are instructions bigger than the largest size
+/// class nor the hung-off operand lists of PHI nodes, switches and the like.
+///
+/// Clients choose the granularity: an arena may hold the instructions of a
+/// whole module, or those of one function, to be released once the function
+/// is deleted. Either way, it must outlive every instruction placed in it,
+/// including those moved to other functions or modules.
+///
+/// An arena is not thread-safe. Only one thread may have a scope active on it
+/// at a time. Instructions of the arena deleted on other threads, or while no
+/// scope is active on it, are not reused until the arena is destroyed.
+class InstructionArena {
+public:
+  /// Places the instructions created on this thread in an arena for the
+  /// lifetime of this object. Scopes may be nested.
+  class Scope {
+    InstructionArena *Previous;
+
+  public:
+    explicit Scope(InstructionArena &Arena);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+  InstructionArena();
+  InstructionArena(const InstructionArena &) = delete;
+  InstructionArena &operator=(const InstructionArena &) = delete;
+
+  /// Return the arena of the innermost scope active on this thread, or null.
+  static InstructionArena *getCurrent();
+
+  /// Allocate \p Size bytes, aligned like a pointer. Return null if \p Size
+  /// is too big for the arena.
+  void *allocate(size_t Size);
+
+  /// Free memory returned by allocate() on any arena.
+  static void deallocate(void *Ptr);
+
+  /// Return the number of bytes of the slabs the arena has allocated.
+  size_t getTotalMemory() const { return Allocator.getTotalMemory(); }
+
+private:
+  /// The free allocations of one size. Every allocation is preceded by a
+  /// pointer to its size class.
+  struct SizeClass {
+    InstructionArena *Arena;
+    void *FreeList = nullptr;
+  };
+
+  static const size_t Granularity = sizeof(void *);
+  static const unsigned NumSizeClasses = 64;
+
+  BumpPtrAllocator Allocator;
+  SizeClass SizeClasses[NumSizeClasses];
+};
+
+} // end namespace llvm
+
+#endif // LLVM_IR_INSTRUCTIONARENA_H
@@ -38,8 +38,8 @@ class OptBisect;
 /// This is an important class for using LLVM in a threaded context.  It
 /// (opaquely) owns and manages the core "global" data of LLVM's core
 /// infrastructure, including the type and constant uniquing tables.
-/// LLVMContext itself provides no locking guarantees, so you should be careful
-/// to have one context per thread.
+/// LLVMContext itself provides no locking guarantees unless setThreadSafe is
+/// used, so you should be careful to have one context per thread.
 class LLVMContext {
 public:
   LLVMContextImpl *const pImpl;
@@ -118,6 +118,46 @@ public:
   /// especially in release mode.
   void setDiscardValueNames(bool Discard);
 
+  /// Return true if the state shared between the functions of this context's
+  /// modules is currently guarded by a lock.
+  bool isThreadSafe() const;
+
+  /// Guard the state shared between the functions of this context's modules,
+  /// like the uniquing tables, the value names and handles, the metadata
+  /// attachments, the module symbol tables and the use lists of constants and
+  /// globals, with locks. Function passes may then run on different functions
+  /// of one module in parallel. The locks cost time even on one thread, so
+  /// this should only be set while that happens, and only be changed while no
+  /// other thread uses the context. The hottest uniquing tables, for integer
+  /// and floating-point constants, metadata strings and uniqued metadata
+  /// nodes, are split into shards that are locked separately.
+  ///
+  /// If LLVM is built without thread support, this does nothing.
+  void setThreadSafe(bool ThreadSafe);
+
+  /// Holds the lock of a thread-safe context for its lifetime, so that a
+  /// sequence of changes to the shared state, like adding a declaration and
+  /// then its attributes, appears atomic to the other threads. Does nothing
+  /// if the context isn't thread-safe.
+  class SharedStateLock {
+    LLVMContextImpl *Impl;
+
+  public:
+    explicit SharedStateLock(LLVMContext &Context);
+    SharedStateLock(const SharedStateLock &) = delete;
+    SharedStateLock &operator=(const SharedStateLock &) = delete;
+    ~SharedStateLock();
+  };
+
+  /// Promise that the IR of this context will not be used again, other than
+  /// by the destructors of its modules and of the context itself. Those then
+  /// free the IR without keeping its use lists and symbol tables consistent
+  /// along the way, which makes destroying large modules much cheaper. Value
+  /// handles and metadata are still told about each value that is destroyed.
+  /// There is no way back: this is meant to be called by tools that are done
+  /// with the IR and are about to exit.
+  void enableFastTeardown();
+
   /// Whether there is a string map for uniquing debug info
   /// identifiers across the context.  Off by default.
   bool isODRUniquingDebugTypes() const;
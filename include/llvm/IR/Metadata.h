@@ -566,22 +566,40 @@ dyn_extract_or_null(Y &&MD) {
 /// These are used to efficiently contain a byte sequence for metadata.
 /// MDString is always unnamed.
 class MDString : public Metadata {
-  friend class StringMapEntry<MDString>;
-
   MDString(const MDString &) = delete;
   MDString &operator=(MDString &&) = delete;
   MDString &operator=(const MDString &) = delete;
 
-  StringMapEntry<MDString> *Entry;
-  MDString() : Metadata(MDStringKind, Uniqued), Entry(nullptr) {}
+  StringRef Str;
+  MDString(StringRef Str) : Metadata(MDStringKind, Uniqued), Str(Str) {}
+
+  static MDString *getImpl(LLVMContext &Context, StringRef Str, bool Copy);
 
 public:
-  static MDString *get(LLVMContext &Context, StringRef Str);
+  static MDString *get(LLVMContext &Context, StringRef Str) {
+    return getImpl(Context, Str, /* Copy */ true);
+  }
   static MDString *get(LLVMContext &Context, const char *Str) {
     return get(Context, Str ? StringRef(Str) : StringRef());
   }
 
-  StringRef getString() const;
+  /// \brief Get the MDString for \p Str, without copying the characters if
+  /// it doesn't exist yet.
+  ///
+  /// Then the string points to the characters of \p Str, which need not be
+  /// null terminated. They must stay put until \a copyToContext() is called
+  /// on it.
+  static MDString *getUncopied(LLVMContext &Context, StringRef Str) {
+    return getImpl(Context, Str, /* Copy */ false);
+  }
+
+  /// \brief Copy the characters of a string from \a getUncopied() into its
+  /// context.
+  ///
+  /// No other thread may read the string meanwhile.
+  void copyToContext(LLVMContext &Context);
+
+  StringRef getString() const { return Str; }
 
   unsigned getLength() const { return (unsigned)getString().size(); }
 
@@ -779,6 +779,13 @@ public:
   /// that has "dropped all references", except operator delete.
   void dropAllReferences();
 
+private:
+  /// Forget the uses and names of all values in the module, for a fast
+  /// teardown of the whole context. See LLVMContext::enableFastTeardown.
+  void forgetUsesForTeardown();
+
+public:
+
 /// @}
 /// @name Utility functions for querying Debug information.
 /// @{
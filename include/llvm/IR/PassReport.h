@@ -0,0 +1,70 @@
+//===- llvm/IR/PassReport.h - Per-pass time and memory report ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file declares the interface for recording the resources used by each
+/// pass run, which both pass managers report to the JSON file given with
+/// -pass-report=<filename>.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_IR_PASSREPORT_H
+#define LLVM_IR_PASSREPORT_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Timer.h"
+#include <functional>
+
+namespace llvm {
+
+class Function;
+class Module;
+
+/// Returns true if -pass-report was given, in which case pass managers record
+/// each pass they run with a PassReportRegion.
+bool isPassReportEnabled();
+
+/// Measures the run of one pass over a function, a module or the functions of
+/// a call graph SCC: wall and CPU time, change in resident memory and change in
+/// the number of instructions. The measurement is added to the report when the
+/// region goes out of scope. If the report isn't enabled, this does nothing.
+class PassReportRegion {
+  StringRef PassName;
+  const Module *M = nullptr;
+  const Function *F = nullptr;
+  /// Collects the functions of the SCC, if this is a run over an SCC. They
+  /// are collected again at the end, as the pass may have replaced some.
+  std::function<void(SmallVectorImpl<const Function *> &)> GetSCC;
+  TimeRecord StartTime;
+  size_t StartMemory = 0;
+  unsigned StartInstructions = 0;
+
+  void start();
+  unsigned getInstructionCount(SmallVectorImpl<const Function *> &SCC) const;
+
+public:
+  PassReportRegion(StringRef PassName, const Module &M);
+  PassReportRegion(StringRef PassName, const Function &F);
+  /// A run of a legacy CallGraphSCCPass over an SCC of \p M, whose functions
+  /// \p GetSCC collects. Only the instructions of these functions are counted.
+  PassReportRegion(
+      StringRef PassName, const Module &M,
+      std::function<void(SmallVectorImpl<const Function *> &)> GetSCC);
+  /// Runs over other units of IR, like loops or the SCCs of the new pass
+  /// manager, are not reported on their own but as part of the function or
+  /// module pass containing them.
+  template <typename IRUnitT>
+  PassReportRegion(StringRef PassName, const IRUnitT &) {}
+  ~PassReportRegion();
+};
+
+} // end namespace llvm
+
+#endif // LLVM_IR_PASSREPORT_H
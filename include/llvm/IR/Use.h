@@ -27,6 +27,8 @@
 
 #include "llvm/ADT/PointerIntPair.h"
 #include "llvm/Support/CBindingWrapping.h"
+#include "llvm/Support/Compiler.h"
+#include <atomic>
 #include <cstddef>
 
 namespace llvm {
@@ -73,12 +75,21 @@ public:
   // a pointer back to their User with the bottom bit set.
   typedef PointerIntPair<User *, 1, unsigned> UserRef;
 
+  /// The number of thread-safe contexts (see LLVMContext::setThreadSafe).
+  /// While it is nonzero, changes to the use lists of values that may be used
+  /// from several functions, like constants and globals, take a lock.
+  static std::atomic<unsigned> NumThreadSafeContexts;
+
 private:
   Use(const Use &U) = delete;
 
   /// Destructor - Only for zap()
   ~Use() {
-    if (Val)
+    if (!Val)
+      return;
+    if (LLVM_UNLIKELY(NumThreadSafeContexts.load(std::memory_order_relaxed)))
+      removeFromListLocked();
+    else
       removeFromList();
   }
 
@@ -142,6 +153,11 @@ private:
       Next->setPrev(StrippedPrev);
   }
 
+  /// Versions of set() and removeFromList() for while NumThreadSafeContexts
+  /// is nonzero.
+  void setLocked(Value *V);
+  void removeFromListLocked();
+
   friend class Value;
 };
 
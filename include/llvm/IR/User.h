@@ -27,6 +27,7 @@
 
 namespace llvm {
 
+class InstructionArena;
 template <typename T> class ArrayRef;
 template <typename T> class MutableArrayRef;
 
@@ -42,10 +43,19 @@ class User : public Value {
   friend struct HungoffOperandTraits;
   virtual void anchor();
 
-  LLVM_ATTRIBUTE_ALWAYS_INLINE inline static void *
-  allocateFixedOperandUser(size_t, unsigned, unsigned);
-
 protected:
+  /// Allocate a User with the operands co-allocated, in \p Arena if it is
+  /// non-null and has room for the User, and on the heap otherwise.
+  static void *allocateFixedOperandUser(size_t Size, unsigned Us,
+                                        unsigned DescBytes,
+                                        InstructionArena *Arena);
+
+  /// Allocate a User with an operand pointer co-allocated, in \p Arena if it
+  /// is non-null and has room for the User, and on the heap otherwise. The
+  /// hung off uses themselves are always allocated on the heap.
+  static void *allocateHungOffOperandUser(size_t Size,
+                                          InstructionArena *Arena);
+
   /// Allocate a User with an operand pointer co-allocated.
   ///
   /// This is used for subclasses which need to allocate a variable number
@@ -74,6 +74,7 @@ class Value {
 
   friend class ValueAsMetadata; // Allow access to IsUsedByMD.
   friend class ValueHandleBase;
+  friend class ValueSymbolTable; // Allow access to HasName.
 
   const unsigned char SubclassID;   // Subclass identifier (for isa/dyn_cast)
   unsigned char HasValueHandle : 1; // Has a ValueHandle pointing to this?
@@ -106,7 +107,7 @@ protected:
   ///
   /// Note, this should *NOT* be used directly by any class other than User.
   /// User uses this value to find the Use list.
-  enum : unsigned { NumUserOperandsBits = 28 };
+  enum : unsigned { NumUserOperandsBits = 27 };
   unsigned NumUserOperands : NumUserOperandsBits;
 
   // Use the same type as the bitfield above so that MSVC will pack them.
@@ -114,6 +115,9 @@ protected:
   unsigned HasName : 1;
   unsigned HasHungOffUses : 1;
   unsigned HasDescriptor : 1;
+  /// Set by User's operator new if the User was placed in an
+  /// InstructionArena.
+  unsigned IsInArena : 1;
 
 private:
   template <typename UseT> // UseT == 'Use' or 'const Use'
@@ -274,6 +278,15 @@ public:
   /// values or constant users.
   void replaceUsesOutsideBlock(Value *V, BasicBlock *BB);
 
+  /// \brief Forget all uses of this value, and all operands of it if it is a
+  /// User, without unlinking any of them from their use lists.
+  ///
+  /// This leaves dangling pointers in the use lists of the operands, so it is
+  /// only for the fast teardown of a whole context, where every value those
+  /// lists belong to is forgotten too before it is destroyed. See
+  /// LLVMContext::enableFastTeardown.
+  void forgetUsesForTeardown();
+
   //----------------------------------------------------------------------
   // Methods for handling the chain of uses of this Value.
   //
@@ -611,6 +624,10 @@ inline raw_ostream &operator<<(raw_ostream &OS, const Value &V) {
 }
 
 void Use::set(Value *V) {
+  if (LLVM_UNLIKELY(NumThreadSafeContexts.load(std::memory_order_relaxed))) {
+    setLocked(V);
+    return;
+  }
   if (Val) removeFromList();
   Val = V;
   if (V) V->addUse(*this);
@@ -81,6 +81,13 @@ public:
   /// @brief Print out symbol table on stderr
   void dump() const;
 
+  /// Detach all values in the symbol table from their names and destroy the
+  /// names at once, rather than one by one as the values are destroyed. Only
+  /// for the fast teardown of a whole context, see
+  /// LLVMContext::enableFastTeardown.
+  /// @brief Drop all names for a fast teardown
+  void discardNamesForTeardown();
+
 /// @}
 /// @name Iteration
 /// @{
@@ -103,7 +103,11 @@ public:
    *  - The pruning expiration time indicates to the garbage collector how old
    *    an entry needs to be to be removed.
    *  - Finally, the garbage collector can be instructed to prune the cache till
-   *    the occupied space goes below a threshold.
+   *    the occupied space goes below a threshold, expressed as a percentage of
+   *    the available space and/or as a number of bytes. The least recently
+   *    used entries are pruned first.
+   * Entries are written atomically, so that several processes can share the
+   * same cache directory. Hits and misses are reported through statistics.
    * @{
    */
 
@@ -112,6 +116,7 @@ public:
     int PruningInterval = 1200;          // seconds, -1 to disable pruning.
     unsigned int Expiration = 7 * 24 * 3600;     // seconds (1w default).
     unsigned MaxPercentageOfAvailableSpace = 75; // percentage.
+    uint64_t MaxSizeBytes = 0;           // bytes, 0 for no limit.
   };
 
   /// Provide a path to a directory where to store the cached files for
@@ -150,6 +155,13 @@ public:
       CacheOptions.MaxPercentageOfAvailableSpace = Percentage;
   }
 
+  /// Cache policy: the maximum size of the cache directory, in bytes. When the
+  /// relative limit above is also in effect, the smaller of the two applies.
+  /// A value of 0 (default) disables this limit.
+  void setMaxCacheSizeBytes(uint64_t Bytes) {
+    CacheOptions.MaxSizeBytes = Bytes;
+  }
+
   /**@}*/
 
   /// Set the path to a directory where to save temporaries at various stages of
@@ -184,6 +196,13 @@ public:
   /// Perform CodeGen only: disable all other stages.
   void setCodeGenOnly(bool CGOnly) { CodeGenOnly = CGOnly; }
 
+  /// Bound the estimated memory used by the backends running concurrently, in
+  /// bytes. The footprint of each module is estimated from its bitcode size and
+  /// the functions it imports, and a module is only started once it fits in
+  /// the budget next to the modules in flight. A value of 0 (default) disables
+  /// the limit.
+  void setMemoryBudget(uint64_t Bytes) { MemoryBudget = Bytes; }
+
   /**@}*/
 
   /**
@@ -271,6 +290,10 @@ private:
   /// Flag to indicate that only the CodeGen will be performed, no cross-module
   /// importing or optimization.
   bool CodeGenOnly = false;
+
+  /// Estimated memory, in bytes, the concurrent backends may use. 0 means no
+  /// limit.
+  uint64_t MemoryBudget = 0;
 };
 }
 #endif
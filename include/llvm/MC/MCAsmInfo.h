@@ -18,6 +18,7 @@
 
 #include "llvm/MC/MCDirectives.h"
 #include "llvm/MC/MCDwarf.h"
+#include "llvm/Support/Compression.h"
 #include <cassert>
 #include <vector>
 
@@ -365,6 +366,10 @@ protected:
   /// Compress DWARF debug sections. Defaults to no compression.
   DebugCompressionType CompressDebugSections;
 
+  /// The zlib level DWARF debug sections are compressed with. Defaults to
+  /// zlib's default.
+  zlib::CompressionLevel CompressDebugSectionsLevel;
+
   /// True if the integrated assembler should interpret 'a >> b' constant
   /// expressions as logical rather than arithmetic.
   bool UseLogicalShr;
@@ -583,6 +588,14 @@ public:
     this->CompressDebugSections = CompressDebugSections;
   }
 
+  zlib::CompressionLevel compressDebugSectionsLevel() const {
+    return CompressDebugSectionsLevel;
+  }
+
+  void setCompressDebugSectionsLevel(zlib::CompressionLevel Level) {
+    CompressDebugSectionsLevel = Level;
+  }
+
   bool shouldUseLogicalShr() const { return UseLogicalShr; }
 
   bool canRelaxRelocations() const { return RelaxELFRelocations; }
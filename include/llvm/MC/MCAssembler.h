@@ -174,13 +174,23 @@ private:
   bool fragmentNeedsRelaxation(const MCRelaxableFragment *IF,
                                const MCAsmLayout &Layout) const;
 
+  /// The fragments that relaxation still has to look at, see
+  /// layoutSectionOnce().
+  struct RelaxationState;
+
   /// \brief Perform one layout iteration and return true if any offsets
   /// were adjusted.
-  bool layoutOnce(MCAsmLayout &Layout);
+  bool layoutOnce(MCAsmLayout &Layout, RelaxationState &State);
 
   /// \brief Perform one layout iteration of the given section and return true
-  /// if any offsets were adjusted.
-  bool layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec);
+  /// if any offsets were adjusted. Only the fragments whose fixups may have
+  /// changed value since the previous iteration are looked at.
+  bool layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec,
+                         RelaxationState &State);
+
+  /// \brief Relax the given fragment if it needs it, and return true if its
+  /// size changed.
+  bool relaxFragment(MCAsmLayout &Layout, MCFragment &F);
 
   bool relaxInstruction(MCAsmLayout &Layout, MCRelaxableFragment &IF);
 
@@ -219,6 +229,12 @@ public:
   void writeSectionData(const MCSection *Section,
                         const MCAsmLayout &Layout) const;
 
+  /// Emit the section contents using \p OW rather than the assembler's own
+  /// object writer. This does not modify the assembler or the layout, so
+  /// different sections may be emitted concurrently.
+  void writeSectionData(const MCSection *Section, const MCAsmLayout &Layout,
+                        MCObjectWriter &OW) const;
+
   /// Check whether a given symbol has been flagged with .thumb_func.
   bool isThumbFunc(const MCSymbol *Func) const;
 
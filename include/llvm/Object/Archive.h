@@ -14,6 +14,7 @@
 #ifndef LLVM_OBJECT_ARCHIVE_H
 #define LLVM_OBJECT_ARCHIVE_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/iterator_range.h"
 #include "llvm/Object/Binary.h"
@@ -21,6 +22,7 @@
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
 
 namespace llvm {
 namespace object {
@@ -137,6 +139,7 @@ public:
   };
 
   class Symbol {
+    friend class Archive;
     const Archive *Parent;
     uint32_t SymbolIndex;
     uint32_t StringIndex; // Extra index to the string.
@@ -208,6 +211,10 @@ public:
   }
 
   // check if a symbol is in the archive
+  //
+  // The first call indexes the symbol table by name, so that every lookup
+  // takes constant time rather than a scan of the symbol table. The index is
+  // built once, even when several threads look symbols up at the same time.
   child_iterator findSym(StringRef name) const;
 
   bool hasSymbolTable() const;
@@ -229,6 +236,13 @@ private:
   unsigned Format : 3;
   unsigned IsThin : 1;
   mutable std::vector<std::unique_ptr<MemoryBuffer>> ThinBuffers;
+
+  /// The symbol and string indices of the first symbol of each name in the
+  /// symbol table, built by the first call to findSym. Archives are searched
+  /// from several threads at once, so it is built only once.
+  mutable DenseMap<StringRef, std::pair<uint32_t, uint32_t>> SymbolsByName;
+  mutable once_flag SymbolIndexFlag{};
+  void buildSymbolIndex() const;
 };
 
 }
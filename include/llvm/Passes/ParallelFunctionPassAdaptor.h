@@ -0,0 +1,87 @@
+//===- ParallelFunctionPassAdaptor.h - Threaded function passes -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+/// \file
+///
+/// This file provides an adaptor that runs a function pass pipeline over the
+/// functions of a module on several threads at once. It is an opt-in
+/// alternative to \c ModuleToFunctionPassAdaptor.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PASSES_PARALLELFUNCTIONPASSADAPTOR_H
+#define LLVM_PASSES_PARALLELFUNCTIONPASSADAPTOR_H
+
+#include "llvm/Analysis/LoopPassManager.h"
+#include "llvm/IR/PassManager.h"
+#include <functional>
+
+namespace llvm {
+
+/// \brief Adaptor that runs a function pass pipeline over the functions of a
+/// module on several threads.
+///
+/// Neither passes nor analysis managers are thread-safe, so each thread gets
+/// its own copy of the pipeline and its own function and loop analysis
+/// managers, built anew for each run. The threads share the module analysis
+/// manager of the run, which they may only read cached results from. The
+/// function analyses cached by the module's own function analysis manager are
+/// dropped before the run, since the threads don't keep them up to date.
+///
+/// The LLVMContext of the module is made thread-safe for the duration of the
+/// run (see \c LLVMContext::setThreadSafe). Function passes run within this
+/// adaptor have to follow the contract of \c ModuleToFunctionPassAdaptor
+/// strictly: they may only modify the function they are run over, and add
+/// declarations and globals to the module. Additions are serialized, and a
+/// declaration is complete, attributes included, before other threads can
+/// see it (see \c LLVMContext::SharedStateLock); the attributes of a
+/// declaration must not be changed once it is in the module. The use lists of
+/// constants and globals are only locked while they are changed: reading one,
+/// even just to test whether it has a single use, races with the other
+/// threads, so passes that do must not be run within this adaptor. This
+/// rules out most passes that simplify instructions; \c PassBuilder only
+/// accepts the few that are known not to.
+///
+/// The output is the same as with \c ModuleToFunctionPassAdaptor, except for
+/// the order in which globals added by the passes appear in the module and
+/// the numbering of their names.
+class ParallelFunctionPassAdaptor
+    : public PassInfoMixin<ParallelFunctionPassAdaptor> {
+public:
+  /// Builds the copy of the pipeline that one thread runs.
+  typedef std::function<FunctionPassManager()> PipelineBuilderT;
+
+  /// Registers the analyses of one thread with its function and loop analysis
+  /// managers, which may also refer to the module analysis manager of the
+  /// run.
+  typedef std::function<void(FunctionAnalysisManager &, LoopAnalysisManager &,
+                             ModuleAnalysisManager &)>
+      AnalysisRegistrarT;
+
+  /// Runs the pipelines built by \p BuildPipeline on \p NumThreads threads,
+  /// or on one per hardware thread if it is zero.
+  ParallelFunctionPassAdaptor(PipelineBuilderT BuildPipeline,
+                              AnalysisRegistrarT RegisterAnalyses,
+                              unsigned NumThreads, bool DebugLogging = false)
+      : BuildPipeline(std::move(BuildPipeline)),
+        RegisterAnalyses(std::move(RegisterAnalyses)), NumThreads(NumThreads),
+        DebugLogging(DebugLogging) {}
+
+  /// \brief Runs the function pipeline across every function in the module.
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+
+private:
+  PipelineBuilderT BuildPipeline;
+  AnalysisRegistrarT RegisterAnalyses;
+  unsigned NumThreads;
+  bool DebugLogging;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_PASSES_PARALLELFUNCTIONPASSADAPTOR_H
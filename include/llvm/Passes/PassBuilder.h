@@ -19,6 +19,7 @@
 #include "llvm/Analysis/CGSCCPassManager.h"
 #include "llvm/Analysis/LoopPassManager.h"
 #include "llvm/IR/PassManager.h"
+#include <string>
 
 namespace llvm {
 class StringRef;
@@ -33,6 +34,8 @@ class TargetMachine;
 /// construction.
 class PassBuilder {
   TargetMachine *TM;
+  unsigned FunctionPassThreads = 1;
+  std::string FunctionPassThreadsAAPipeline;
 
 public:
   /// \brief LLVM-provided high-level optimization levels.
@@ -241,7 +244,23 @@ public:
   /// returns false.
   bool parseAAPipeline(AAManager &AA, StringRef PipelineText);
 
+  /// \brief Run the function pipelines parsed after this call over the
+  /// functions of a module on \p NumThreads threads at once, or on one thread
+  /// per hardware thread if it is zero.
+  ///
+  /// The pipelines are wrapped in a \c ParallelFunctionPassAdaptor instead of
+  /// a \c ModuleToFunctionPassAdaptor. Its threads build their own copies of
+  /// the pipeline and of the function and loop analyses from this builder on
+  /// each run, so the builder must outlive the pass managers it fills. Their
+  /// alias analyses are parsed from \p AAPipeline. Only the few passes known
+  /// to keep to the contract of the adaptor are accepted in these pipelines;
+  /// a pipeline with any other pass fails to parse.
+  void setFunctionPassThreads(unsigned NumThreads, StringRef AAPipeline = "");
+
 private:
+  bool addFunctionPipeline(ModulePassManager &MPM, FunctionPassManager FPM,
+                           StringRef PipelineText, bool VerifyEachPass,
+                           bool DebugLogging);
   bool parseModulePassName(ModulePassManager &MPM, StringRef Name,
                            bool DebugLogging);
   bool parseCGSCCPassName(CGSCCPassManager &CGPM, StringRef Name);
@@ -16,6 +16,7 @@
 #define LLVM_PROFILEDATA_INSTRPROFWRITER_H
 
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ProfileData/InstrProf.h"
 #include "llvm/Support/DataTypes.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -47,6 +48,15 @@ public:
   /// for this function and the hash and number of counts match, each counter is
   /// summed. Optionally scale counts by \p Weight.
   Error addRecord(InstrProfRecord &&I, uint64_t Weight = 1);
+
+  /// Merge existing function counts from the given writer, as if its records
+  /// were added after the ones of this writer. Per-record merge errors are
+  /// passed to \p Warn together with the name of the function. Returns an
+  /// error if the two writers hold profiles of a different kind (FE versus IR
+  /// level).
+  Error mergeRecordsFromWriter(InstrProfWriter &&IPW,
+                               function_ref<void(Error, StringRef)> Warn);
+
   /// Write the profile to \c OS
   void write(raw_fd_ostream &OS);
   /// Write the profile in text format to \c OS
@@ -75,6 +85,10 @@ public:
 
 private:
   bool shouldEncodeData(const ProfilingData &PD);
+  /// Collect the functions to be written, ordered by name so that the output
+  /// does not depend on the order in which records were added.
+  void getOrderedFunctionData(
+      std::vector<StringMapConstIterator<ProfilingData>> &Ordered);
   void writeImpl(ProfOStream &OS);
 };
 
@@ -16,6 +16,7 @@
 #define LLVM_SUPPORT_CACHE_PRUNING_H
 
 #include "llvm/ADT/StringRef.h"
+#include <cstdint>
 
 namespace llvm {
 
@@ -52,8 +53,17 @@ public:
     return *this;
   }
 
+  /// Define the maximum size for the cache directory, in bytes. A value of 0
+  /// disable this limit. When both this and the percentage of available space
+  /// are set, the smaller of the two limits is enforced.
+  CachePruning &setMaxSizeBytes(uint64_t Bytes) {
+    MaxSizeBytes = Bytes;
+    return *this;
+  }
+
   /// Peform pruning using the supplied options, returns true if pruning
-  /// occured, i.e. if PruningInterval was expired.
+  /// occured, i.e. if PruningInterval was expired. Size-based pruning removes
+  /// the least recently accessed files first.
   bool prune();
 
 private:
@@ -62,6 +72,7 @@ private:
   unsigned Expiration = 0;
   unsigned Interval = 0;
   unsigned PercentageOfAvailableSpace = 0;
+  uint64_t MaxSizeBytes = 0;
 };
 
 } // namespace llvm
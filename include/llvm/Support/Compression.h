@@ -19,6 +19,7 @@
 namespace llvm {
 template <typename T> class SmallVectorImpl;
 class StringRef;
+class ThreadPool;
 
 namespace zlib {
 
@@ -43,6 +44,18 @@ bool isAvailable();
 Status compress(StringRef InputBuffer, SmallVectorImpl<char> &CompressedBuffer,
                 CompressionLevel Level = DefaultCompression);
 
+/// Compress \p InputBuffer into a single zlib stream, like compress(), but
+/// deflate blocks of it independently, the way pigz does. Each block is primed
+/// with the end of the previous one and ends on a byte boundary, so the blocks
+/// concatenate into one deflate stream that any zlib can inflate. The blocks
+/// are deflated in parallel on \p Pool if there is one, and on this thread
+/// otherwise; the output is the same either way. This may be called from a
+/// task running on \p Pool.
+Status compressParallel(StringRef InputBuffer,
+                        SmallVectorImpl<char> &CompressedBuffer,
+                        ThreadPool *Pool,
+                        CompressionLevel Level = DefaultCompression);
+
 Status uncompress(StringRef InputBuffer,
                   SmallVectorImpl<char> &UncompressedBuffer,
                   size_t UncompressedSize);
@@ -52,6 +52,10 @@ public:
   /// allocated space.
   static size_t GetMallocUsage();
 
+  /// \brief Return the amount of memory, in bytes, that the process currently
+  /// has resident in physical memory, or 0 if the operating system can't tell.
+  static size_t GetResidentMemory();
+
   /// This static function will set \p user_time to the amount of CPU time
   /// spent in user (non-kernel) mode and \p sys_time to the amount of CPU
   /// time spent in system (kernel) mode.  If the operating system does not
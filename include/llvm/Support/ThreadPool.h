@@ -7,7 +7,8 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file defines a crude C++11 based thread pool.
+// This file defines a C++11 based work-stealing thread pool, and a TaskGroup
+// to wait on a subset of the tasks submitted to it.
 //
 //===----------------------------------------------------------------------===//
 
@@ -35,19 +36,26 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <utility>
+#include <vector>
 
 namespace llvm {
 
+class TaskGroup;
+
 /// A ThreadPool for asynchronous parallel execution on a defined number of
 /// threads.
 ///
-/// The pool keeps a vector of threads alive, waiting on a condition variable
-/// for some work to become available.
+/// Each worker thread owns a double-ended queue of tasks. Tasks submitted from
+/// a worker are pushed to the back of its own queue and popped from there in
+/// LIFO order; idle workers steal from the front of the other queues. Tasks
+/// submitted from outside of the pool are distributed round-robin. Workers
+/// with nothing to run or steal wait on a condition variable for some work to
+/// become available.
 class ThreadPool {
 public:
 #ifndef _MSC_VER
@@ -101,37 +109,121 @@ public:
 #endif
   }
 
-  /// Blocking wait for all the threads to complete and the queue to be empty.
-  /// It is an error to try to add new tasks while blocking on this call.
+  /// Blocking wait for all the threads to complete and the queues to be
+  /// empty. It is an error to try to add new tasks while blocking on this
+  /// call, and to call it from a task running on this pool: use a TaskGroup
+  /// to wait on tasks from within a task.
   void wait();
 
+  /// Returns the number of worker threads of this pool.
+  unsigned getThreadCount() const { return Threads.size(); }
+
 private:
+  friend class TaskGroup;
+
+  /// A queue of tasks owned by a worker thread. The owner pushes and pops at
+  /// the back, other threads steal from the front.
+  struct WorkQueue {
+    std::mutex Lock;
+    std::deque<PackagedTaskTy> Tasks;
+  };
+
   /// Asynchronous submission of a task to the pool. The returned future can be
   /// used to wait for the task to finish and is *non-blocking* on destruction.
   std::shared_future<VoidTy> asyncImpl(TaskTy F);
 
+  /// Push \p Task on the queue of the calling worker, or on the next queue in
+  /// round-robin order if the caller is not a worker of this pool, and wake up
+  /// a sleeping thread.
+  void enqueue(PackagedTaskTy Task);
+
+  /// Pop a task from the calling worker's own queue, or steal one from another
+  /// queue, and run it on the calling thread. Returns false if there was no
+  /// task to run.
+  bool runQueuedTask();
+
+  /// Pop a task from \p Queue, from the back if \p Owner and from the front
+  /// otherwise.
+  bool tryPop(WorkQueue &Queue, bool Owner, PackagedTaskTy &Task);
+
+  /// Returns the index of the queue owned by the calling thread, or -1 if it
+  /// is not a worker of this pool.
+  int getCurrentWorkerIndex() const;
+
   /// Threads in flight
   std::vector<llvm::thread> Threads;
 
-  /// Tasks waiting for execution in the pool.
-  std::queue<PackagedTaskTy> Tasks;
+  /// Per-worker task queues. There is always at least one queue, even if the
+  /// pool has no threads.
+  std::vector<std::unique_ptr<WorkQueue>> Queues;
+
+  /// Index of the queue receiving the next task submitted from outside of the
+  /// pool.
+  std::atomic<unsigned> NextQueue;
+
+  /// Number of tasks sitting in the queues, not yet picked up by a thread.
+  std::atomic<unsigned> QueuedTasks;
+
+  /// Number of tasks queued or running; wait() returns when this drops to 0.
+  std::atomic<unsigned> OutstandingTasks;
 
-  /// Locking and signaling for accessing the Tasks queue.
-  std::mutex QueueLock;
-  std::condition_variable QueueCondition;
+  /// Locking and signaling for threads waiting for some work to be queued,
+  /// or for a TaskGroup to complete. Threads that are not workers of the pool
+  /// wait for their TaskGroup on GroupCondition, so that they don't swallow
+  /// the notifications meant for the workers.
+  std::mutex WakeLock;
+  std::condition_variable WakeCondition;
+  std::condition_variable GroupCondition;
 
   /// Locking and signaling for job completion
   std::mutex CompletionLock;
   std::condition_variable CompletionCondition;
 
-  /// Keep track of the number of thread actually busy
-  std::atomic<unsigned> ActiveThreads;
-
 #if LLVM_ENABLE_THREADS // avoids warning for unused variable
   /// Signal for the destruction of the pool, asking thread to exit.
   bool EnableFlag;
 #endif
 };
+
+/// A set of tasks submitted to a ThreadPool that can be waited on as a unit.
+///
+/// Unlike ThreadPool::wait(), TaskGroup::wait() only waits for the tasks of
+/// this group and can be called from a task running on the pool: rather than
+/// blocking, the waiting thread runs other queued tasks until the group
+/// completes. Tasks can therefore spawn subtasks and wait on them without
+/// deadlocking the pool. The destructor waits for the group to complete.
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool &Pool) : Pool(Pool), PendingTasks(0) {}
+  ~TaskGroup() { wait(); }
+
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  /// Asynchronous submission of a task to the group's pool.
+  template <typename Function, typename... Args>
+  void async(Function &&F, Args &&... ArgList) {
+    asyncImpl(
+        std::bind(std::forward<Function>(F), std::forward<Args>(ArgList)...));
+  }
+
+  /// Asynchronous submission of a task to the group's pool.
+  template <typename Function> void async(Function &&F) {
+    asyncImpl(std::forward<Function>(F));
+  }
+
+  /// Wait for all the tasks of this group to complete, running queued tasks
+  /// of the pool on the calling thread in the meantime.
+  void wait();
+
+private:
+  void asyncImpl(std::function<void()> F);
+
+  ThreadPool &Pool;
+
+  /// Number of tasks of this group that have not completed yet.
+  std::atomic<unsigned> PendingTasks;
+};
 }
 
 #endif // LLVM_SUPPORT_THREAD_POOL_H
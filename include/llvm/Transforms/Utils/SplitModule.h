@@ -27,6 +27,11 @@ class StringRef;
 /// Splits the module M into N linkable partitions. The function ModuleCallback
 /// is called N times passing each individual partition as the MPart argument.
 ///
+/// By default, globals that do not have to stay together are distributed by
+/// hashing their names. If BalanceByCost is set, every global is instead
+/// assigned so as to balance the number of instructions in each partition,
+/// which better balances the code generation work of the partitions.
+///
 /// FIXME: This function does not deal with the somewhat subtle symbol
 /// visibility issues around module splitting, including (but not limited to):
 ///
@@ -37,7 +42,7 @@ class StringRef;
 void SplitModule(
     std::unique_ptr<Module> M, unsigned N,
     function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback,
-    bool PreserveLocals = false);
+    bool PreserveLocals = false, bool BalanceByCost = false);
 
 } // End llvm namespace
 
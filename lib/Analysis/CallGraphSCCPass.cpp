@@ -24,6 +24,7 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManagers.h"
 #include "llvm/IR/OptBisect.h"
+#include "llvm/IR/PassReport.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Timer.h"
@@ -124,6 +125,12 @@ bool CGPassManager::RunPassOnSCC(Pass *P, CallGraphSCC &CurSCC,
 
     {
       TimeRegion PassTimer(getPassTimer(CGSP));
+      auto GetSCC = [&](SmallVectorImpl<const Function *> &SCC) {
+        for (CallGraphNode *CGN : CurSCC)
+          if (Function *F = CGN->getFunction())
+            SCC.push_back(F);
+      };
+      PassReportRegion Report(CGSP->getPassName(), CG.getModule(), GetSCC);
       Changed = CGSP->runOnSCC(CurSCC);
     }
     
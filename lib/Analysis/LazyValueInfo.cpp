@@ -15,6 +15,7 @@
 #include "llvm/Analysis/LazyValueInfo.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AssumptionCache.h"
 #include "llvm/Analysis/ConstantFolding.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
@@ -29,15 +30,33 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/PatternMatch.h"
 #include "llvm/IR/ValueHandle.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
-#include <map>
 #include <stack>
 using namespace llvm;
 using namespace PatternMatch;
 
 #define DEBUG_TYPE "lazy-value-info"
 
+STATISTIC(NumSolverStepLimitHits,
+          "Number of queries made overdefined after too many solver steps");
+STATISTIC(NumCacheEvictions,
+          "Number of times the cache was evicted to stay within its budget");
+
+// Functions with thousands of blocks can take the solver through a large part
+// of the CFG for a single query. Give up and use overdefined values instead.
+static cl::opt<unsigned> MaxSolverSteps(
+    "lvi-max-solver-steps", cl::Hidden, cl::init(500),
+    cl::desc("Maximum number of block values the solver processes for one "
+             "query before making the remaining ones overdefined"));
+
+static cl::opt<unsigned> MaxCacheSize(
+    "lvi-max-cache-size", cl::Hidden, cl::init(64 * 1024),
+    cl::desc("Maximum approximate size in kilobytes of the cached lattice "
+             "values of a function, above which they are evicted (0 = no "
+             "limit)"));
+
 char LazyValueInfoWrapperPass::ID = 0;
 INITIALIZE_PASS_BEGIN(LazyValueInfoWrapperPass, "lazy-value-info",
                 "Lazy Value Information Analysis", false, true)
@@ -383,16 +402,23 @@ namespace {
   /// maintains information about queries across the clients' queries.
   class LazyValueInfoCache {
     /// This is all of the cached block information for exactly one Value*.
-    /// The entries are sorted by the BasicBlock* of the
-    /// entries, allowing us to do a lookup with a binary search.
     /// Over-defined lattice values are recorded in OverDefinedCache to reduce
     /// memory overhead.
     typedef SmallDenseMap<AssertingVH<BasicBlock>, LVILatticeVal, 4>
-        ValueCacheEntryTy;
+        BlockValsTy;
+
+    /// The cached block information for one Value*, along with the handle
+    /// that drops it when the value is deleted.
+    struct ValueCacheEntryTy {
+      ValueCacheEntryTy(Value *V, LazyValueInfoCache *P) : Handle(V, P) {}
+      LVIValueHandle Handle;
+      BlockValsTy BlockVals;
+    };
 
-    /// This is all of the cached information for all values,
-    /// mapped from Value* to key information.
-    std::map<LVIValueHandle, ValueCacheEntryTy> ValueCache;
+    /// This is all of the cached information for all values, mapped from
+    /// Value* to key information. It is keyed on the plain Value* so that
+    /// lookups don't have to create a value handle.
+    DenseMap<Value *, std::unique_ptr<ValueCacheEntryTy>> ValueCache;
 
     /// This tracks, on a per-block basis, the set of values that are
     /// over-defined at the end of that block.
@@ -404,6 +430,34 @@ namespace {
     /// don't spend time removing unused blocks from our caches.
     DenseSet<AssertingVH<BasicBlock> > SeenBlocks;
 
+    /// The number of lattice values in ValueCache and of values in
+    /// OverDefinedCache, used to keep the caches within the
+    /// -lvi-max-cache-size budget.
+    unsigned NumCachedValues = 0;
+    unsigned NumOverdefinedValues = 0;
+
+    /// The ranges of the condition of the switch ending a block on the edges
+    /// to each of its successors. Computing the range on one edge takes a
+    /// walk over all the cases, so they are computed for all the edges at
+    /// once.
+    ///
+    /// Retargeting the edges of a switch makes its ranges stale. Passes that
+    /// keep LVI up to date report that through threadEdge() or eraseBlock(),
+    /// which drop the ranges of the switches branching from or to the block.
+    struct SwitchEdgeRanges {
+      /// The switch the ranges were computed for, and its shape then. If the
+      /// switch has been deleted or its cases added or removed, the ranges are
+      /// stale.
+      WeakVH Switch;
+      BasicBlock *DefaultDest;
+      unsigned NumCases;
+      SmallDenseMap<BasicBlock *, ConstantRange, 8> Ranges;
+    };
+
+    /// The switch edge ranges, keyed on the block ending with the switch.
+    /// The value they are the ranges of is the switch condition.
+    DenseMap<BasicBlock *, SwitchEdgeRanges> SwitchEdgeCache;
+
     /// This stack holds the state of the value solver during a query.
     /// It basically emulates the callstack of the naive
     /// recursive value lookup process.
@@ -435,15 +489,28 @@ namespace {
 
       // Insert over-defined values into their own cache to reduce memory
       // overhead.
-      if (Result.isOverdefined())
-        OverDefinedCache[BB].insert(Val);
-      else
-        lookup(Val)[BB] = Result;
+      if (Result.isOverdefined()) {
+        if (OverDefinedCache[BB].insert(Val).second)
+          ++NumOverdefinedValues;
+      } else if (lookup(Val).insert({BB, Result}).second) {
+        ++NumCachedValues;
+      }
     }
 
+    /// Evict all the cached lattice values if they are over the budget. This
+    /// must only happen between queries, since the solver expects the values
+    /// it has computed to stay in the cache until the query is answered.
+    void enforceCacheBudget();
+
+    /// Return the range of the condition of the switch SI on the edge to
+    /// BBTo.
+    const ConstantRange &getSwitchEdgeRange(SwitchInst *SI, BasicBlock *BBTo);
+
   LVILatticeVal getBlockValue(Value *Val, BasicBlock *BB);
   bool getEdgeValue(Value *V, BasicBlock *F, BasicBlock *T,
                     LVILatticeVal &Result, Instruction *CxtI = nullptr);
+  bool getEdgeValueLocal(Value *Val, BasicBlock *BBFrom, BasicBlock *BBTo,
+                         LVILatticeVal &Result);
   bool hasBlockValue(Value *Val, BasicBlock *BB);
 
   // These methods process one work item and may add more. A false value
@@ -463,8 +530,11 @@ namespace {
 
   void solve();
 
-  ValueCacheEntryTy &lookup(Value *V) {
-    return ValueCache[LVIValueHandle(V, this)];
+  BlockValsTy &lookup(Value *V) {
+    std::unique_ptr<ValueCacheEntryTy> &Entry = ValueCache[V];
+    if (!Entry)
+      Entry = make_unique<ValueCacheEntryTy>(V, this);
+    return Entry->BlockVals;
   }
 
     bool isOverdefined(Value *V, BasicBlock *BB) const {
@@ -480,12 +550,11 @@ namespace {
       if (isOverdefined(V, BB))
         return true;
 
-      LVIValueHandle ValHandle(V, this);
-      auto I = ValueCache.find(ValHandle);
+      auto I = ValueCache.find(V);
       if (I == ValueCache.end())
         return false;
 
-      return I->second.count(BB);
+      return I->second->BlockVals.count(BB);
     }
 
     LVILatticeVal getCachedValueInfo(Value *V, BasicBlock *BB) {
@@ -524,6 +593,9 @@ namespace {
       SeenBlocks.clear();
       ValueCache.clear();
       OverDefinedCache.clear();
+      SwitchEdgeCache.clear();
+      NumCachedValues = 0;
+      NumOverdefinedValues = 0;
     }
 
     LazyValueInfoCache(AssumptionCache *AC, const DataLayout &DL,
@@ -536,20 +608,33 @@ void LVIValueHandle::deleted() {
   SmallVector<AssertingVH<BasicBlock>, 4> ToErase;
   for (auto &I : Parent->OverDefinedCache) {
     SmallPtrSetImpl<Value *> &ValueSet = I.second;
-    if (ValueSet.count(getValPtr()))
-      ValueSet.erase(getValPtr());
+    if (ValueSet.erase(getValPtr()))
+      --Parent->NumOverdefinedValues;
     if (ValueSet.empty())
       ToErase.push_back(I.first);
   }
   for (auto &BB : ToErase)
     Parent->OverDefinedCache.erase(BB);
 
+  auto VI = Parent->ValueCache.find(getValPtr());
+  if (VI == Parent->ValueCache.end())
+    return;
+  Parent->NumCachedValues -= VI->second->BlockVals.size();
+
   // This erasure deallocates *this, so it MUST happen after we're done
   // using any and all members of *this.
-  Parent->ValueCache.erase(*this);
+  Parent->ValueCache.erase(VI);
 }
 
 void LazyValueInfoCache::eraseBlock(BasicBlock *BB) {
+  // The edges into the block are about to be retargeted or deleted, which
+  // makes the ranges of the switches on them stale.
+  if (!SwitchEdgeCache.empty()) {
+    SwitchEdgeCache.erase(BB);
+    for (BasicBlock *Pred : predecessors(BB))
+      SwitchEdgeCache.erase(Pred);
+  }
+
   // Shortcut if we have never seen this block.
   DenseSet<AssertingVH<BasicBlock> >::iterator I = SeenBlocks.find(BB);
   if (I == SeenBlocks.end())
@@ -557,15 +642,53 @@ void LazyValueInfoCache::eraseBlock(BasicBlock *BB) {
   SeenBlocks.erase(I);
 
   auto ODI = OverDefinedCache.find(BB);
-  if (ODI != OverDefinedCache.end())
+  if (ODI != OverDefinedCache.end()) {
+    NumOverdefinedValues -= ODI->second.size();
     OverDefinedCache.erase(ODI);
+  }
 
   for (auto &I : ValueCache)
-    I.second.erase(BB);
+    if (I.second->BlockVals.erase(BB))
+      --NumCachedValues;
+}
+
+void LazyValueInfoCache::enforceCacheBudget() {
+  assert(BlockValueStack.empty() && "Evicting the cache during a query!");
+  if (!MaxCacheSize)
+    return;
+
+  // Approximate the size of the caches by the size of their entries, the
+  // overdefined ones only taking a pointer.
+  uint64_t Size = uint64_t(NumCachedValues) * sizeof(BlockValsTy::value_type) +
+                  uint64_t(NumOverdefinedValues) * sizeof(Value *);
+  if (Size <= uint64_t(MaxCacheSize) * 1024)
+    return;
+
+  DEBUG(dbgs() << "LVI evicting " << NumCachedValues + NumOverdefinedValues
+               << " cached values\n");
+  clear();
+  ++NumCacheEvictions;
 }
 
 void LazyValueInfoCache::solve() {
+  unsigned NumSteps = 0;
   while (!BlockValueStack.empty()) {
+    // Rather than spending time quadratic in the size of the function on
+    // queries that reach far through its CFG, give up after a number of
+    // steps: everything still on the stack is overdefined, and cached as such
+    // so that the other queries needing it don't start over.
+    if (++NumSteps > MaxSolverSteps) {
+      DEBUG(dbgs() << "LVI giving up after " << MaxSolverSteps << " steps\n");
+      ++NumSolverStepLimitHits;
+      while (!BlockValueStack.empty()) {
+        std::pair<BasicBlock *, Value *> e = BlockValueStack.top();
+        insertResult(e.second, e.first, LVILatticeVal::getOverdefined());
+        BlockValueStack.pop();
+        BlockValueSet.erase(e);
+      }
+      return;
+    }
+
     std::pair<BasicBlock*, Value*> &e = BlockValueStack.top();
     assert(BlockValueSet.count(e) && "Stack value should be in BlockValueSet!");
 
@@ -1210,8 +1333,9 @@ bool getValueFromFromCondition(Value *Val, ICmpInst *ICI,
 /// \brief Compute the value of Val on the edge BBFrom -> BBTo. Returns false if
 /// Val is not constrained on the edge.  Result is unspecified if return value
 /// is false.
-static bool getEdgeValueLocal(Value *Val, BasicBlock *BBFrom,
-                              BasicBlock *BBTo, LVILatticeVal &Result) {
+bool LazyValueInfoCache::getEdgeValueLocal(Value *Val, BasicBlock *BBFrom,
+                                           BasicBlock *BBTo,
+                                           LVILatticeVal &Result) {
   // TODO: Handle more complex conditionals. If (v == 0 || v2 < 1) is false, we
   // know that v != 0.
   if (BranchInst *BI = dyn_cast<BranchInst>(BBFrom->getTerminator())) {
@@ -1245,26 +1369,58 @@ static bool getEdgeValueLocal(Value *Val, BasicBlock *BBFrom,
     if (SI->getCondition() != Val)
       return false;
 
-    bool DefaultCase = SI->getDefaultDest() == BBTo;
-    unsigned BitWidth = Val->getType()->getIntegerBitWidth();
-    ConstantRange EdgesVals(BitWidth, DefaultCase/*isFullSet*/);
-
-    for (SwitchInst::CaseIt i : SI->cases()) {
-      ConstantRange EdgeVal(i.getCaseValue()->getValue());
-      if (DefaultCase) {
-        // It is possible that the default destination is the destination of
-        // some cases. There is no need to perform difference for those cases.
-        if (i.getCaseSuccessor() != BBTo)
-          EdgesVals = EdgesVals.difference(EdgeVal);
-      } else if (i.getCaseSuccessor() == BBTo)
-        EdgesVals = EdgesVals.unionWith(EdgeVal);
-    }
-    Result = LVILatticeVal::getRange(std::move(EdgesVals));
+    Result = LVILatticeVal::getRange(getSwitchEdgeRange(SI, BBTo));
     return true;
   }
   return false;
 }
 
+const ConstantRange &LazyValueInfoCache::getSwitchEdgeRange(SwitchInst *SI,
+                                                            BasicBlock *BBTo) {
+  BasicBlock *BB = SI->getParent();
+  auto I = SwitchEdgeCache.find(BB);
+  if (I != SwitchEdgeCache.end()) {
+    SwitchEdgeRanges &Entry = I->second;
+    if (Entry.Switch == SI && Entry.DefaultDest == SI->getDefaultDest() &&
+        Entry.NumCases == SI->getNumCases()) {
+      auto RI = Entry.Ranges.find(BBTo);
+      if (RI != Entry.Ranges.end())
+        return RI->second;
+    }
+    // The switch has changed since: compute the ranges again.
+    SwitchEdgeCache.erase(I);
+  }
+
+  BasicBlock *DefaultDest = SI->getDefaultDest();
+  unsigned BitWidth = SI->getCondition()->getType()->getIntegerBitWidth();
+  SwitchEdgeRanges &Entry = SwitchEdgeCache[BB];
+  Entry.Switch = SI;
+  Entry.DefaultDest = DefaultDest;
+  Entry.NumCases = SI->getNumCases();
+
+  // The condition takes the values of the cases on the edges to their
+  // successors, and any other value on the edge to the default destination.
+  // It is possible that the default destination is the destination of some
+  // cases. There is no need to perform difference for those cases.
+  ConstantRange DefaultVals(BitWidth, /*isFullSet=*/true);
+  for (SwitchInst::CaseIt i : SI->cases()) {
+    BasicBlock *Succ = i.getCaseSuccessor();
+    if (Succ == DefaultDest)
+      continue;
+    ConstantRange EdgeVal(i.getCaseValue()->getValue());
+    DefaultVals = DefaultVals.difference(EdgeVal);
+    auto RI = Entry.Ranges.find(Succ);
+    if (RI == Entry.Ranges.end())
+      Entry.Ranges.insert({Succ, EdgeVal});
+    else
+      RI->second = RI->second.unionWith(EdgeVal);
+  }
+  Entry.Ranges.insert({DefaultDest, DefaultVals});
+  // BBTo isn't a successor of the switch: no value flows there.
+  Entry.Ranges.insert({BBTo, ConstantRange(BitWidth, /*isFullSet=*/false)});
+  return Entry.Ranges.find(BBTo)->second;
+}
+
 /// \brief Compute the value of Val on the edge BBFrom -> BBTo or the value at
 /// the basic block if the edge does not constrain Val.
 bool LazyValueInfoCache::getEdgeValue(Value *Val, BasicBlock *BBFrom,
@@ -1319,6 +1475,7 @@ LVILatticeVal LazyValueInfoCache::getValueInBlock(Value *V, BasicBlock *BB,
         << BB->getName() << "'\n");
 
   assert(BlockValueStack.empty() && BlockValueSet.empty());
+  enforceCacheBudget();
   if (!hasBlockValue(V, BB)) {
     pushBlockValue(std::make_pair(BB, V)); 
     solve();
@@ -1352,6 +1509,7 @@ getValueOnEdge(Value *V, BasicBlock *FromBB, BasicBlock *ToBB,
   DEBUG(dbgs() << "LVI Getting edge value " << *V << " from '"
         << FromBB->getName() << "' to '" << ToBB->getName() << "'\n");
 
+  enforceCacheBudget();
   LVILatticeVal Result;
   if (!getEdgeValue(V, FromBB, ToBB, Result, CxtI)) {
     solve();
@@ -1379,6 +1537,9 @@ void LazyValueInfoCache::threadEdge(BasicBlock *PredBB, BasicBlock *OldSucc,
   std::vector<BasicBlock*> worklist;
   worklist.push_back(OldSucc);
 
+  // PredBB's terminator now branches to NewSucc.
+  SwitchEdgeCache.erase(PredBB);
+
   auto I = OverDefinedCache.find(OldSucc);
   if (I == OverDefinedCache.end())
     return; // Nothing to process here.
@@ -1406,6 +1567,7 @@ void LazyValueInfoCache::threadEdge(BasicBlock *PredBB, BasicBlock *OldSucc,
         continue;
 
       ValueSet.erase(V);
+      --NumOverdefinedValues;
       if (ValueSet.empty())
         OverDefinedCache.erase(OI);
 
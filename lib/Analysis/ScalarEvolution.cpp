@@ -103,6 +103,14 @@ STATISTIC(NumTripCountsNotComputed,
           "Number of loops without predictable loop counts");
 STATISTIC(NumBruteForceTripCountsComputed,
           "Number of loops with trip counts computed by force");
+STATISTIC(NumSCEVCacheHits,
+          "Number of SCEVs for values found in the cache");
+STATISTIC(NumSCEVsForgotten,
+          "Number of SCEVs for values evicted from the cache");
+STATISTIC(NumBECountCacheHits,
+          "Number of backedge-taken counts found in the cache");
+STATISTIC(NumBECountsForgotten,
+          "Number of backedge-taken counts evicted from the cache");
 
 static cl::opt<unsigned>
 MaxBruteForceIterations("scalar-evolution-max-iterations", cl::ReallyHidden,
@@ -3415,7 +3423,9 @@ const SCEV *ScalarEvolution::getSCEV(Value *V) {
   assert(isSCEVable(V->getType()) && "Value is not SCEVable!");
 
   const SCEV *S = getExistingSCEV(V);
-  if (S == nullptr) {
+  if (S) {
+    ++NumSCEVCacheHits;
+  } else {
     S = createSCEV(V);
     // During PHI resolution, it is possible to create two SCEVs for the same
     // V, so it is needed to double check whether V->S is inserted into
@@ -3438,6 +3448,7 @@ const SCEV *ScalarEvolution::getExistingSCEV(Value *V) {
       return S;
     forgetMemoizedResults(S);
     ValueExprMap.erase(I);
+    ++NumSCEVsForgotten;
   }
   return nullptr;
 }
@@ -5366,13 +5377,18 @@ ScalarEvolution::getPredicatedBackedgeTakenInfo(const Loop *L) {
 
   auto Pair = PredicatedBackedgeTakenCounts.insert({L, BackedgeTakenInfo()});
 
-  if (!Pair.second)
+  if (!Pair.second) {
+    ++NumBECountCacheHits;
     return Pair.first->second;
+  }
 
   BackedgeTakenInfo Result =
       computeBackedgeTakenCount(L, /*AllowPredicates=*/true);
 
-  return PredicatedBackedgeTakenCounts.find(L)->second = Result;
+  BackedgeTakenInfo &PredBTI = PredicatedBackedgeTakenCounts.find(L)->second;
+  PredBTI = Result;
+  updateBECountUsers(L, /*Predicated=*/true, PredBTI, /*Add=*/true);
+  return PredBTI;
 }
 
 const ScalarEvolution::BackedgeTakenInfo &
@@ -5384,8 +5400,10 @@ ScalarEvolution::getBackedgeTakenInfo(const Loop *L) {
   // backedge-taken count, which could result in infinite recursion.
   std::pair<DenseMap<const Loop *, BackedgeTakenInfo>::iterator, bool> Pair =
       BackedgeTakenCounts.insert({L, BackedgeTakenInfo()});
-  if (!Pair.second)
+  if (!Pair.second) {
+    ++NumBECountCacheHits;
     return Pair.first->second;
+  }
 
   // computeBackedgeTakenCount may allocate memory for its result. Inserting it
   // into the BackedgeTakenCounts map transfers ownership. Otherwise, the result
@@ -5447,51 +5465,99 @@ ScalarEvolution::getBackedgeTakenInfo(const Loop *L) {
   // recusive call to getBackedgeTakenInfo (on a different
   // loop), which would invalidate the iterator computed
   // earlier.
-  return BackedgeTakenCounts.find(L)->second = Result;
+  BackedgeTakenInfo &BTI = BackedgeTakenCounts.find(L)->second;
+  BTI = Result;
+  updateBECountUsers(L, /*Predicated=*/false, BTI, /*Add=*/true);
+  return BTI;
 }
 
-void ScalarEvolution::forgetLoop(const Loop *L) {
-  // Drop any stored trip count value.
-  auto RemoveLoopFromBackedgeMap =
-      [L](DenseMap<const Loop *, BackedgeTakenInfo> &Map) {
-        auto BTCPos = Map.find(L);
-        if (BTCPos != Map.end()) {
-          BTCPos->second.clear();
-          Map.erase(BTCPos);
-        }
-      };
+void ScalarEvolution::updateBECountUsers(const Loop *L, bool Predicated,
+                                         const BackedgeTakenInfo &BTI,
+                                         bool Add) {
+  struct FindUsedExprs {
+    SmallPtrSet<const SCEV *, 16> Visited;
+    SmallVector<const SCEV *, 16> Exprs;
 
-  RemoveLoopFromBackedgeMap(BackedgeTakenCounts);
-  RemoveLoopFromBackedgeMap(PredicatedBackedgeTakenCounts);
+    bool follow(const SCEV *S) {
+      if (!Visited.insert(S).second)
+        return false;
+      Exprs.push_back(S);
+      return true;
+    }
+    bool isDone() const { return false; }
+  };
 
-  // Drop information about expressions based on loop-header PHIs.
-  SmallVector<Instruction *, 16> Worklist;
-  PushLoopPHIs(L, Worklist);
+  SmallVector<const SCEV *, 4> Roots;
+  BTI.getExprs(Roots, this);
+  FindUsedExprs Finder;
+  for (const SCEV *Root : Roots)
+    visitAll(Root, Finder);
 
-  SmallPtrSet<Instruction *, 8> Visited;
-  while (!Worklist.empty()) {
-    Instruction *I = Worklist.pop_back_val();
-    if (!Visited.insert(I).second)
+  BECountUser User(L, Predicated);
+  for (const SCEV *S : Finder.Exprs) {
+    if (Add) {
+      BECountUsers[S].insert(User);
       continue;
-
-    ValueExprMapType::iterator It =
-      ValueExprMap.find_as(static_cast<Value *>(I));
-    if (It != ValueExprMap.end()) {
-      forgetMemoizedResults(It->second);
-      ValueExprMap.erase(It);
-      if (PHINode *PN = dyn_cast<PHINode>(I))
-        ConstantEvolutionLoopExitValue.erase(PN);
     }
-
-    PushDefUseChildren(I, Worklist);
+    auto It = BECountUsers.find(S);
+    if (It == BECountUsers.end())
+      continue;
+    It->second.erase(User);
+    if (It->second.empty())
+      BECountUsers.erase(It);
   }
+}
 
-  // Forget all contained loops too, to avoid dangling entries in the
-  // ValuesAtScopes map.
-  for (Loop *I : *L)
-    forgetLoop(I);
+void ScalarEvolution::forgetBackedgeTakenCount(const Loop *L,
+                                               bool Predicated) {
+  auto &Map = Predicated ? PredicatedBackedgeTakenCounts : BackedgeTakenCounts;
+  auto BTCPos = Map.find(L);
+  if (BTCPos == Map.end())
+    return;
 
-  LoopHasNoAbnormalExits.erase(L);
+  updateBECountUsers(L, Predicated, BTCPos->second, /*Add=*/false);
+  BTCPos->second.clear();
+  Map.erase(BTCPos);
+  ++NumBECountsForgotten;
+}
+
+void ScalarEvolution::forgetLoop(const Loop *L) {
+  // Drop the stored trip counts and information about expressions based on
+  // the loop-header PHIs of L and of all the loops contained in it, to avoid
+  // dangling entries in the ValuesAtScopes map. The walk is shared between
+  // the loops, since the users of an inner loop's PHIs are usually users of
+  // the outer loop's PHIs as well.
+  SmallVector<const Loop *, 8> LoopWorklist(1, L);
+  SmallVector<Instruction *, 16> Worklist;
+  SmallPtrSet<Instruction *, 16> Visited;
+  while (!LoopWorklist.empty()) {
+    const Loop *CurrL = LoopWorklist.pop_back_val();
+
+    forgetBackedgeTakenCount(CurrL, /*Predicated=*/false);
+    forgetBackedgeTakenCount(CurrL, /*Predicated=*/true);
+
+    PushLoopPHIs(CurrL, Worklist);
+    while (!Worklist.empty()) {
+      Instruction *I = Worklist.pop_back_val();
+      if (!Visited.insert(I).second)
+        continue;
+
+      ValueExprMapType::iterator It =
+        ValueExprMap.find_as(static_cast<Value *>(I));
+      if (It != ValueExprMap.end()) {
+        forgetMemoizedResults(It->second);
+        ValueExprMap.erase(It);
+        ++NumSCEVsForgotten;
+        if (PHINode *PN = dyn_cast<PHINode>(I))
+          ConstantEvolutionLoopExitValue.erase(PN);
+      }
+
+      PushDefUseChildren(I, Worklist);
+    }
+
+    LoopHasNoAbnormalExits.erase(CurrL);
+    LoopWorklist.append(CurrL->begin(), CurrL->end());
+  }
 }
 
 void ScalarEvolution::forgetValue(Value *V) {
@@ -5513,6 +5579,7 @@ void ScalarEvolution::forgetValue(Value *V) {
     if (It != ValueExprMap.end()) {
       forgetMemoizedResults(It->second);
       ValueExprMap.erase(It);
+      ++NumSCEVsForgotten;
       if (PHINode *PN = dyn_cast<PHINode>(I))
         ConstantEvolutionLoopExitValue.erase(PN);
     }
@@ -5579,20 +5646,17 @@ ScalarEvolution::BackedgeTakenInfo::getMax(ScalarEvolution *SE) const {
   return Max ? Max : SE->getCouldNotCompute();
 }
 
-bool ScalarEvolution::BackedgeTakenInfo::hasOperand(const SCEV *S,
-                                                    ScalarEvolution *SE) const {
-  if (Max && Max != SE->getCouldNotCompute() && SE->hasOperand(Max, S))
-    return true;
+void ScalarEvolution::BackedgeTakenInfo::getExprs(
+    SmallVectorImpl<const SCEV *> &Exprs, ScalarEvolution *SE) const {
+  if (Max && Max != SE->getCouldNotCompute())
+    Exprs.push_back(Max);
 
   if (!ExitNotTaken.ExitingBlock)
-    return false;
+    return;
 
   for (auto &ENT : ExitNotTaken)
-    if (ENT.ExactNotTaken != SE->getCouldNotCompute() &&
-        SE->hasOperand(ENT.ExactNotTaken, S))
-      return true;
-
-  return false;
+    if (ENT.ExactNotTaken != SE->getCouldNotCompute())
+      Exprs.push_back(ENT.ExactNotTaken);
 }
 
 /// Allocate memory for BackedgeTakenInfo and copy the not-taken count of each
@@ -9493,6 +9557,7 @@ ScalarEvolution::ScalarEvolution(ScalarEvolution &&Arg)
       BackedgeTakenCounts(std::move(Arg.BackedgeTakenCounts)),
       PredicatedBackedgeTakenCounts(
           std::move(Arg.PredicatedBackedgeTakenCounts)),
+      BECountUsers(std::move(Arg.BECountUsers)),
       ConstantEvolutionLoopExitValue(
           std::move(Arg.ConstantEvolutionLoopExitValue)),
       ValuesAtScopes(std::move(Arg.ValuesAtScopes)),
@@ -9908,20 +9973,15 @@ void ScalarEvolution::forgetMemoizedResults(const SCEV *S) {
   ExprValueMap.erase(S);
   HasRecMap.erase(S);
 
-  auto RemoveSCEVFromBackedgeMap =
-      [S, this](DenseMap<const Loop *, BackedgeTakenInfo> &Map) {
-        for (auto I = Map.begin(), E = Map.end(); I != E;) {
-          BackedgeTakenInfo &BEInfo = I->second;
-          if (BEInfo.hasOperand(S, this)) {
-            BEInfo.clear();
-            Map.erase(I++);
-          } else
-            ++I;
-        }
-      };
-
-  RemoveSCEVFromBackedgeMap(BackedgeTakenCounts);
-  RemoveSCEVFromBackedgeMap(PredicatedBackedgeTakenCounts);
+  // Drop the backedge-taken counts that refer to S. Forgetting a count
+  // updates BECountUsers, so work on a copy of the users of S.
+  auto UsersIt = BECountUsers.find(S);
+  if (UsersIt != BECountUsers.end()) {
+    SmallVector<BECountUser, 4> Users(UsersIt->second.begin(),
+                                      UsersIt->second.end());
+    for (BECountUser User : Users)
+      forgetBackedgeTakenCount(User.getPointer(), User.getInt());
+  }
 }
 
 typedef DenseMap<const Loop *, std::string> VerifyMap;
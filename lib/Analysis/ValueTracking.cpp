@@ -421,10 +421,12 @@ static bool isEphemeralValueOf(Instruction *I, const Value *E) {
         return true;
 
       EphValues.insert(V);
+      // A constant only leads to more constants, none of which can be E, so
+      // don't walk the use lists of constants, which every function shares.
       if (const User *U = dyn_cast<User>(V))
         for (User::const_op_iterator J = U->op_begin(), JE = U->op_end();
              J != JE; ++J) {
-          if (isSafeToSpeculativelyExecute(*J))
+          if (!isa<Constant>(*J) && isSafeToSpeculativelyExecute(*J))
             WorkSet.push_back(*J);
         }
     }
@@ -28,6 +28,7 @@
 #include "llvm/IR/Operator.h"
 #include "llvm/IR/UseListOrder.h"
 #include "llvm/IR/ValueSymbolTable.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/Program.h"
@@ -37,6 +38,11 @@
 #include <map>
 using namespace llvm;
 
+static cl::opt<unsigned>
+    IndexThreshold("bitcode-mdindex-threshold", cl::Hidden, cl::init(25),
+                   cl::desc("Number of metadatas above which we emit an index "
+                            "to enable lazy-loading"));
+
 namespace {
 /// These are manifest constants used by the bitcode writer. They do not need to
 /// be kept in sync with the reader, but need to be consistent within this file.
@@ -220,7 +226,14 @@ private:
   void writeMetadataStrings(ArrayRef<const Metadata *> Strings,
                             SmallVectorImpl<uint64_t> &Record);
   void writeMetadataRecords(ArrayRef<const Metadata *> MDs,
-                            SmallVectorImpl<uint64_t> &Record);
+                            SmallVectorImpl<uint64_t> &Record,
+                            unsigned LocationAbbrev = 0,
+                            unsigned GenericAbbrev = 0,
+                            std::vector<uint64_t> *IndexPos = nullptr);
+  void writeIndexedMetadataRecords(ArrayRef<const Metadata *> MDs,
+                                   SmallVectorImpl<uint64_t> &Record,
+                                   uint64_t &IndexOffsetRecordBitPos,
+                                   uint64_t &IndexBitPos);
   void writeModuleMetadata();
   void writeFunctionMetadata(const Function &F);
   void writeFunctionMetadataAttachment(const Function &F);
@@ -1800,15 +1813,21 @@ void ModuleBitcodeWriter::writeMetadataStrings(
 }
 
 void ModuleBitcodeWriter::writeMetadataRecords(
-    ArrayRef<const Metadata *> MDs, SmallVectorImpl<uint64_t> &Record) {
+    ArrayRef<const Metadata *> MDs, SmallVectorImpl<uint64_t> &Record,
+    unsigned LocationAbbrev, unsigned GenericAbbrev,
+    std::vector<uint64_t> *IndexPos) {
   if (MDs.empty())
     return;
 
   // Initialize MDNode abbreviations.
 #define HANDLE_MDNODE_LEAF(CLASS) unsigned CLASS##Abbrev = 0;
 #include "llvm/IR/Metadata.def"
+  DILocationAbbrev = LocationAbbrev;
+  GenericDINodeAbbrev = GenericAbbrev;
 
   for (const Metadata *MD : MDs) {
+    if (IndexPos)
+      IndexPos->push_back(Stream.GetCurrentBitNo());
     if (const MDNode *N = dyn_cast<MDNode>(MD)) {
       assert(N->isResolved() && "Expected forward references to be resolved");
 
@@ -1826,14 +1845,68 @@ void ModuleBitcodeWriter::writeMetadataRecords(
   }
 }
 
+/// Write out the module-level metadata records along with an index of their
+/// bit positions, so that the reader can load them on demand.
+///
+/// The records are preceded by a METADATA_INDEX_OFFSET record meant to hold
+/// the distance to the METADATA_INDEX record that follows them.  Every
+/// abbreviation the records use is defined before the offset record, since
+/// the reader jumps over everything in between.  The offset is left zero, and
+/// the positions needed to backpatch it are returned in
+/// \p IndexOffsetRecordBitPos and \p IndexBitPos.
+void ModuleBitcodeWriter::writeIndexedMetadataRecords(
+    ArrayRef<const Metadata *> MDs, SmallVectorImpl<uint64_t> &Record,
+    uint64_t &IndexOffsetRecordBitPos, uint64_t &IndexBitPos) {
+  unsigned LocationAbbrev = createDILocationAbbrev();
+  unsigned GenericAbbrev = createGenericDINodeAbbrev();
+
+  // The offset is a fixed-width placeholder, backpatched below.
+  BitCodeAbbrev *Abbv = new BitCodeAbbrev();
+  Abbv->Add(BitCodeAbbrevOp(bitc::METADATA_INDEX_OFFSET));
+  Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::Fixed, 32));
+  Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::Fixed, 32));
+  unsigned OffsetAbbrev = Stream.EmitAbbrev(Abbv);
+
+  Abbv = new BitCodeAbbrev();
+  Abbv->Add(BitCodeAbbrevOp(bitc::METADATA_INDEX));
+  Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::Array));
+  Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::VBR, 6));
+  unsigned IndexAbbrev = Stream.EmitAbbrev(Abbv);
+
+  uint64_t Vals[] = {0, 0};
+  Stream.EmitRecord(bitc::METADATA_INDEX_OFFSET, Vals, OffsetAbbrev);
+  IndexOffsetRecordBitPos = Stream.GetCurrentBitNo();
+
+  std::vector<uint64_t> IndexPos;
+  IndexPos.reserve(MDs.size());
+  writeMetadataRecords(MDs, Record, LocationAbbrev, GenericAbbrev, &IndexPos);
+
+  // Delta-encode the positions, starting from the end of the offset record.
+  uint64_t PreviousPos = IndexOffsetRecordBitPos;
+  for (uint64_t &Pos : IndexPos) {
+    uint64_t Delta = Pos - PreviousPos;
+    PreviousPos = Pos;
+    Pos = Delta;
+  }
+  IndexBitPos = Stream.GetCurrentBitNo();
+  Stream.EmitRecord(bitc::METADATA_INDEX, IndexPos, IndexAbbrev);
+}
+
 void ModuleBitcodeWriter::writeModuleMetadata() {
   if (!VE.hasMDs() && M.named_metadata_empty())
     return;
 
-  Stream.EnterSubblock(bitc::METADATA_BLOCK_ID, 3);
+  // The abbreviations of the index take two more IDs.
+  bool EmitIndex = VE.getNonMDStrings().size() > IndexThreshold;
+  Stream.EnterSubblock(bitc::METADATA_BLOCK_ID, EmitIndex ? 4 : 3);
   SmallVector<uint64_t, 64> Record;
   writeMetadataStrings(VE.getMDStrings(), Record);
-  writeMetadataRecords(VE.getNonMDStrings(), Record);
+  uint64_t IndexOffsetRecordBitPos = 0, IndexBitPos = 0;
+  if (EmitIndex)
+    writeIndexedMetadataRecords(VE.getNonMDStrings(), Record,
+                                IndexOffsetRecordBitPos, IndexBitPos);
+  else
+    writeMetadataRecords(VE.getNonMDStrings(), Record);
   writeNamedMetadata(Record);
 
   auto AddDeclAttachedMetadata = [&](const GlobalObject &GO) {
@@ -1852,6 +1925,19 @@ void ModuleBitcodeWriter::writeModuleMetadata() {
       AddDeclAttachedMetadata(GV);
 
   Stream.ExitBlock();
+  if (!EmitIndex)
+    return;
+
+  // Backpatch the offset to the index now that the block has been flushed to
+  // the buffer. Patching the two words reads up to 32 bits past the offset
+  // record, which at least one node record, the index and the end of the block
+  // always cover.
+  assert(Stream.GetCurrentBitNo() >= IndexOffsetRecordBitPos + 32 &&
+         "Metadata index offset not flushed");
+  uint64_t OffsetBitPos = IndexOffsetRecordBitPos - 64;
+  uint64_t Offset = IndexBitPos - IndexOffsetRecordBitPos;
+  Stream.BackpatchWord(OffsetBitPos, Offset & 0xffffffff);
+  Stream.BackpatchWord(OffsetBitPos + 32, Offset >> 32);
 }
 
 void ModuleBitcodeWriter::writeFunctionMetadata(const Function &F) {
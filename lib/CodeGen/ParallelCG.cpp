@@ -25,11 +25,15 @@
 
 using namespace llvm;
 
-static void codegen(Module *M, llvm::raw_pwrite_stream &OS,
-                    function_ref<std::unique_ptr<TargetMachine>()> TMFactory,
-                    TargetMachine::CodeGenFileType FileType) {
+static void
+codegen(Module *M, llvm::raw_pwrite_stream &OS,
+        function_ref<std::unique_ptr<TargetMachine>()> TMFactory,
+        TargetMachine::CodeGenFileType FileType,
+        const std::function<void(legacy::PassManagerBase &)> &AddPasses) {
   std::unique_ptr<TargetMachine> TM = TMFactory();
   legacy::PassManager CodeGenPasses;
+  if (AddPasses)
+    AddPasses(CodeGenPasses);
   if (TM->addPassesToEmitFile(CodeGenPasses, OS, FileType))
     report_fatal_error("Failed to setup codegen");
   CodeGenPasses.run(*M);
@@ -39,25 +43,37 @@ std::unique_ptr<Module> llvm::splitCodeGen(
     std::unique_ptr<Module> M, ArrayRef<llvm::raw_pwrite_stream *> OSs,
     ArrayRef<llvm::raw_pwrite_stream *> BCOSs,
     const std::function<std::unique_ptr<TargetMachine>()> &TMFactory,
-    TargetMachine::CodeGenFileType FileType, bool PreserveLocals) {
+    TargetMachine::CodeGenFileType FileType, bool PreserveLocals,
+    const std::function<void(legacy::PassManagerBase &)> &AddPasses,
+    LLVMContext::DiagnosticHandlerTy DiagHandler, void *DiagContext) {
   assert(BCOSs.empty() || BCOSs.size() == OSs.size());
 
   if (OSs.size() == 1) {
     if (!BCOSs.empty())
       WriteBitcodeToFile(M.get(), *BCOSs[0]);
-    codegen(M.get(), *OSs[0], TMFactory, FileType);
+    codegen(M.get(), *OSs[0], TMFactory, FileType, AddPasses);
     return M;
   }
 
+  // The last partition stays in the context of M and is code generated on this
+  // thread, once the other partitions have been handed over to the pool.
+  std::unique_ptr<Module> LastPart;
+
   // Create ThreadPool in nested scope so that threads will be joined
   // on destruction.
   {
-    ThreadPool CodegenThreadPool(OSs.size());
+    ThreadPool CodegenThreadPool(OSs.size() - 1);
     int ThreadCount = 0;
 
     SplitModule(
         std::move(M), OSs.size(),
         [&](std::unique_ptr<Module> MPart) {
+          bool IsLastPart = ThreadCount + 1 == (int)OSs.size();
+          if (IsLastPart && BCOSs.empty()) {
+            LastPart = std::move(MPart);
+            return;
+          }
+
           // We want to clone the module in a new context to multi-thread the
           // codegen. We do it by serializing partition modules to bitcode
           // (while still on the main thread, in order to avoid data races) and
@@ -73,11 +89,19 @@ std::unique_ptr<Module> llvm::splitCodeGen(
             BCOSs[ThreadCount]->flush();
           }
 
+          if (IsLastPart) {
+            LastPart = std::move(MPart);
+            return;
+          }
+
           llvm::raw_pwrite_stream *ThreadOS = OSs[ThreadCount++];
           // Enqueue the task
           CodegenThreadPool.async(
-              [TMFactory, FileType, ThreadOS](const SmallString<0> &BC) {
+              [TMFactory, FileType, ThreadOS, AddPasses, DiagHandler,
+               DiagContext](const SmallString<0> &BC) {
                 LLVMContext Ctx;
+                if (DiagHandler)
+                  Ctx.setDiagnosticHandler(DiagHandler, DiagContext);
                 ErrorOr<std::unique_ptr<Module>> MOrErr = parseBitcodeFile(
                     MemoryBufferRef(StringRef(BC.data(), BC.size()),
                                     "<split-module>"),
@@ -86,13 +110,16 @@ std::unique_ptr<Module> llvm::splitCodeGen(
                   report_fatal_error("Failed to read bitcode");
                 std::unique_ptr<Module> MPartInCtx = std::move(MOrErr.get());
 
-                codegen(MPartInCtx.get(), *ThreadOS, TMFactory, FileType);
+                codegen(MPartInCtx.get(), *ThreadOS, TMFactory, FileType,
+                        AddPasses);
               },
               // Pass BC using std::move to ensure that it get moved rather than
               // copied into the thread's context.
               std::move(BC));
         },
-        PreserveLocals);
+        PreserveLocals, /*BalanceByCost=*/true);
+
+    codegen(LastPart.get(), *OSs.back(), TMFactory, FileType, AddPasses);
   }
 
   return {};
@@ -274,6 +274,7 @@ void DWARFContext::dump(raw_ostream &OS, DIDumpType DumpType, bool DumpEH) {
 }
 
 const DWARFUnitIndex &DWARFContext::getCUIndex() {
+  std::lock_guard<std::mutex> Guard(AbbrevLock);
   if (CUIndex)
     return *CUIndex;
 
@@ -285,6 +286,7 @@ const DWARFUnitIndex &DWARFContext::getCUIndex() {
 }
 
 const DWARFUnitIndex &DWARFContext::getTUIndex() {
+  std::lock_guard<std::mutex> Guard(AbbrevLock);
   if (TUIndex)
     return *TUIndex;
 
@@ -296,6 +298,7 @@ const DWARFUnitIndex &DWARFContext::getTUIndex() {
 }
 
 const DWARFDebugAbbrev *DWARFContext::getDebugAbbrev() {
+  std::lock_guard<std::mutex> Guard(AbbrevLock);
   if (Abbrev)
     return Abbrev.get();
 
@@ -339,11 +342,13 @@ const DWARFDebugLocDWO *DWARFContext::getDebugLocDWO() {
 }
 
 const DWARFDebugAranges *DWARFContext::getDebugAranges() {
+  std::lock_guard<std::mutex> Guard(ArangesLock);
   if (Aranges)
     return Aranges.get();
 
-  Aranges.reset(new DWARFDebugAranges());
-  Aranges->generate(this);
+  std::unique_ptr<DWARFDebugAranges> NewAranges(new DWARFDebugAranges());
+  NewAranges->generate(this);
+  Aranges = std::move(NewAranges);
   return Aranges.get();
 }
 
@@ -390,6 +395,7 @@ const DWARFDebugMacro *DWARFContext::getDebugMacro() {
 
 const DWARFLineTable *
 DWARFContext::getLineTableForUnit(DWARFUnit *U) {
+  std::lock_guard<std::mutex> Guard(LineLock);
   if (!Line)
     Line.reset(new DWARFDebugLine(&getLineSection().Relocs));
 
@@ -444,11 +450,28 @@ DWARFCompileUnit *DWARFContext::getCompileUnitForOffset(uint32_t Offset) {
   return CUs.getUnitForOffset(Offset);
 }
 
+DWARFCompileUnit *DWARFContext::getCompileUnitAtOffset(uint32_t Offset) {
+  return static_cast<DWARFCompileUnit *>(
+      CUs.parseUnitAtOffset(*this, getInfoSection(), Offset));
+}
+
 DWARFCompileUnit *DWARFContext::getCompileUnitForAddress(uint64_t Address) {
   // First, get the offset of the compile unit.
   uint32_t CUOffset = getDebugAranges()->findAddress(Address);
-  // Retrieve the compile unit.
-  return getCompileUnitForOffset(CUOffset);
+  if (CUOffset == -1U)
+    return nullptr;
+  // Retrieve the compile unit. The offset should be the start of a unit
+  // header, but fall back to a search in case .debug_aranges is off.
+  DWARFCompileUnit *CU = getCompileUnitAtOffset(CUOffset);
+  if (!CU)
+    CU = getCompileUnitForOffset(CUOffset);
+  if (!CU)
+    return nullptr;
+  // Extract all the DIEs of the unit up front: DIE pointers handed out by
+  // lookups running on other threads would be invalidated if the DIE array
+  // was extended later on.
+  CU->getUnitDIE(/*ExtractUnitDIEOnly=*/false);
+  return CU;
 }
 
 static bool getFunctionNameForAddress(DWARFCompileUnit *CU, uint64_t Address,
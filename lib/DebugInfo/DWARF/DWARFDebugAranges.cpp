@@ -46,16 +46,26 @@ void DWARFDebugAranges::generate(DWARFContext *CTX) {
 
   // Generate aranges from DIEs: even if .debug_aranges section is present,
   // it may describe only a small subset of compilation units, so we need to
-  // manually build aranges for the rest of them.
-  for (const auto &CU : CTX->compile_units()) {
-    uint32_t CUOffset = CU->getOffset();
+  // manually build aranges for the rest of them. Walk the chain of unit
+  // lengths so that only the units missing from .debug_aranges get parsed.
+  DataExtractor InfoData(CTX->getInfoSection().Data, CTX->isLittleEndian(), 0);
+  uint32_t Offset = 0;
+  while (InfoData.isValidOffset(Offset)) {
+    uint32_t CUOffset = Offset;
+    uint64_t NextCUOffset = uint64_t(CUOffset) + InfoData.getU32(&Offset) + 4;
     if (ParsedCUOffsets.insert(CUOffset).second) {
+      DWARFCompileUnit *CU = CTX->getCompileUnitAtOffset(CUOffset);
+      if (!CU)
+        break;
       DWARFAddressRangesVector CURanges;
       CU->collectAddressRanges(CURanges);
       for (const auto &R : CURanges) {
         appendRange(CUOffset, R.first, R.second);
       }
     }
+    if (NextCUOffset > UINT32_MAX)
+      break;
+    Offset = NextCUOffset;
   }
 
   construct();
@@ -32,6 +32,16 @@ void DWARFUnitSectionBase::parseDWO(DWARFContext &C,
             true);
 }
 
+DWARFUnit *DWARFUnitSectionBase::parseUnitAtOffset(DWARFContext &C,
+                                                   const DWARFSection &Section,
+                                                   uint32_t Offset) {
+  return parseUnitAtOffsetImpl(C, Section, C.getDebugAbbrev(),
+                               C.getRangeSection(), C.getStringSection(),
+                               StringRef(), C.getAddrSection(),
+                               C.getLineSection().Data, C.isLittleEndian(),
+                               false, Offset);
+}
+
 DWARFUnit::DWARFUnit(DWARFContext &DC, const DWARFSection &Section,
                      const DWARFDebugAbbrev *DA, StringRef RS, StringRef SS,
                      StringRef SOS, StringRef AOS, StringRef LS, bool LE,
@@ -137,6 +147,7 @@ void DWARFUnit::clear() {
   RangeSectionBase = 0;
   AddrOffsetSectionBase = 0;
   clearDIEs(false);
+  std::lock_guard<std::mutex> Guard(DWOLock);
   DWO.reset();
 }
 
@@ -156,13 +167,14 @@ uint64_t DWARFUnit::getDWOId() {
       .getAttributeValueAsUnsignedConstant(this, DW_AT_GNU_dwo_id, FailValue);
 }
 
-void DWARFUnit::setDIERelations() {
-  if (DieArray.size() <= 1)
+void DWARFUnit::setDIERelations(
+    std::vector<DWARFDebugInfoEntryMinimal> &Dies) {
+  if (Dies.size() <= 1)
     return;
 
   std::vector<DWARFDebugInfoEntryMinimal *> ParentChain;
   DWARFDebugInfoEntryMinimal *SiblingChain = nullptr;
-  for (auto &DIE : DieArray) {
+  for (auto &DIE : Dies) {
     if (SiblingChain) {
       SiblingChain->setSibling(&DIE);
     }
@@ -181,7 +193,7 @@ void DWARFUnit::setDIERelations() {
       ParentChain.pop_back();
     }
   }
-  assert(SiblingChain == nullptr || SiblingChain == &DieArray[0]);
+  assert(SiblingChain == nullptr || SiblingChain == &Dies[0]);
   assert(ParentChain.empty());
 }
 
@@ -237,6 +249,7 @@ void DWARFUnit::extractDIEsToVector(
 }
 
 size_t DWARFUnit::extractDIEsIfNeeded(bool CUDieOnly) {
+  std::lock_guard<std::mutex> Guard(DIEsLock);
   if ((CUDieOnly && DieArray.size() > 0) ||
       DieArray.size() > 1)
     return 0; // Already parsed.
@@ -262,7 +275,7 @@ size_t DWARFUnit::extractDIEsIfNeeded(bool CUDieOnly) {
     // skeleton CU DIE, so that DWARF users not aware of it are not broken.
   }
 
-  setDIERelations();
+  setDIERelations(DieArray);
   return DieArray.size();
 }
 
@@ -281,18 +294,16 @@ DWARFUnit::DWOHolder::DWOHolder(StringRef DWOPath)
     DWOU = DWOContext->getDWOCompileUnitAtIndex(0);
 }
 
-bool DWARFUnit::parseDWO() {
+std::unique_ptr<DWARFUnit::DWOHolder> DWARFUnit::loadDWO() {
   if (isDWO)
-    return false;
-  if (DWO.get())
-    return false;
+    return nullptr;
   extractDIEsIfNeeded(true);
   if (DieArray.empty())
-    return false;
+    return nullptr;
   const char *DWOFileName =
       DieArray[0].getAttributeValueAsString(this, DW_AT_GNU_dwo_name, nullptr);
   if (!DWOFileName)
-    return false;
+    return nullptr;
   const char *CompilationDir =
       DieArray[0].getAttributeValueAsString(this, DW_AT_comp_dir, nullptr);
   SmallString<16> AbsolutePath;
@@ -300,21 +311,30 @@ bool DWARFUnit::parseDWO() {
     sys::path::append(AbsolutePath, CompilationDir);
   }
   sys::path::append(AbsolutePath, DWOFileName);
-  DWO = llvm::make_unique<DWOHolder>(AbsolutePath);
-  DWARFUnit *DWOCU = DWO->getUnit();
+  auto Holder = llvm::make_unique<DWOHolder>(AbsolutePath);
+  DWARFUnit *DWOCU = Holder->getUnit();
   // Verify that compile unit in .dwo file is valid.
-  if (!DWOCU || DWOCU->getDWOId() != getDWOId()) {
-    DWO.reset();
-    return false;
-  }
+  if (!DWOCU || DWOCU->getDWOId() != getDWOId())
+    return nullptr;
   // Share .debug_addr and .debug_ranges section with compile unit in .dwo
   DWOCU->setAddrOffsetSection(AddrOffsetSection, AddrOffsetSectionBase);
   uint32_t DWORangesBase = DieArray[0].getRangesBaseAttribute(this, 0);
   DWOCU->setRangesSection(RangeSection, DWORangesBase);
-  return true;
+  return Holder;
+}
+
+bool DWARFUnit::parseDWO() {
+  if (isDWO)
+    return false;
+  std::lock_guard<std::mutex> Guard(DWOLock);
+  if (DWO.get())
+    return false;
+  DWO = loadDWO();
+  return DWO != nullptr;
 }
 
 void DWARFUnit::clearDIEs(bool KeepCUDie) {
+  std::lock_guard<std::mutex> Guard(DIEsLock);
   if (DieArray.size() > (unsigned)KeepCUDie) {
     // std::vectors never get any smaller when resized to a smaller size,
     // or when clear() or erase() are called, the size will report that it
@@ -345,23 +365,37 @@ void DWARFUnit::collectAddressRanges(DWARFAddressRangesVector &CURanges) {
   // This function is usually called if there in no .debug_aranges section
   // in order to produce a compile unit level set of address ranges that
   // is accurate. If the DIEs weren't parsed, then we don't want all dies for
-  // all compile units to stay loaded when they weren't needed. So we can end
-  // up parsing the DWARF and then throwing them all away to keep memory usage
-  // down.
-  const bool ClearDIEs = extractDIEsIfNeeded(false) > 1;
-  DieArray[0].collectChildrenAddressRanges(this, CURanges);
-
-  // Collect address ranges from DIEs in .dwo if necessary.
-  bool DWOCreated = parseDWO();
-  if (DWO.get())
-    DWO->getUnit()->collectAddressRanges(CURanges);
-  if (DWOCreated)
-    DWO.reset();
-
-  // Keep memory down by clearing DIEs if this generate function
-  // caused them to be parsed.
-  if (ClearDIEs)
-    clearDIEs(true);
+  // all compile units to stay loaded when they weren't needed. Other threads
+  // may be using the DIEs of the unit, so they can't be thrown away
+  // afterwards: extract them into a temporary vector instead.
+  std::vector<DWARFDebugInfoEntryMinimal> TmpDies;
+  const DWARFDebugInfoEntryMinimal *UnitDie;
+  {
+    std::lock_guard<std::mutex> Guard(DIEsLock);
+    if (DieArray.size() > 1) {
+      // All the DIEs have been extracted, and won't change anymore.
+      UnitDie = &DieArray[0];
+    } else {
+      extractDIEsToVector(true, true, TmpDies);
+      setDIERelations(TmpDies);
+      UnitDie = &TmpDies[0];
+    }
+  }
+  UnitDie->collectChildrenAddressRanges(this, CURanges);
+
+  // Collect address ranges from DIEs in .dwo if necessary. The .dwo file is
+  // only kept if it was already loaded.
+  DWARFUnit *DWOCU = nullptr;
+  {
+    std::lock_guard<std::mutex> Guard(DWOLock);
+    if (DWO)
+      DWOCU = DWO->getUnit();
+  }
+  std::unique_ptr<DWOHolder> TmpDWO;
+  if (!DWOCU && (TmpDWO = loadDWO()))
+    DWOCU = TmpDWO->getUnit();
+  if (DWOCU)
+    DWOCU->collectAddressRanges(CURanges);
 }
 
 const DWARFDebugInfoEntryMinimal *
@@ -131,11 +131,175 @@ Expected<DIGlobal> LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
   return Global;
 }
 
+namespace {
+
+// Returns the indices of Offsets, ordered by increasing offset.
+std::vector<size_t> getSortedOrder(ArrayRef<uint64_t> Offsets) {
+  std::vector<size_t> Order(Offsets.size());
+  for (size_t I = 0, E = Order.size(); I != E; ++I)
+    Order[I] = I;
+  std::stable_sort(Order.begin(), Order.end(), [&](size_t LHS, size_t RHS) {
+    return Offsets[LHS] < Offsets[RHS];
+  });
+  return Order;
+}
+
+// Memoizes LLVMSymbolizer::DemangleName() for the names of one module, as
+// batched queries tend to resolve to the same few functions.
+class CachingDemangler {
+  bool Enabled;
+  const SymbolizableModule *ModInfo;
+  StringMap<std::string> Cache;
+
+public:
+  CachingDemangler(bool Enabled, const SymbolizableModule *ModInfo)
+      : Enabled(Enabled), ModInfo(ModInfo) {}
+
+  void demangle(std::string &Name) {
+    if (!Enabled)
+      return;
+    auto R = Cache.insert(std::make_pair(Name, std::string()));
+    if (R.second)
+      R.first->second = LLVMSymbolizer::DemangleName(Name, ModInfo);
+    Name = R.first->second;
+  }
+};
+
+} // end anonymous namespace
+
+Expected<std::vector<DILineInfo>>
+LLVMSymbolizer::symbolizeCodeBatch(const std::string &ModuleName,
+                                   ArrayRef<uint64_t> ModuleOffsets) {
+  SymbolizableModule *Info;
+  if (auto InfoOrErr = getOrCreateModuleInfo(ModuleName))
+    Info = InfoOrErr.get();
+  else
+    return InfoOrErr.takeError();
+
+  std::vector<DILineInfo> Result(ModuleOffsets.size());
+  // A null module means an error has already been reported. Return empty
+  // results.
+  if (!Info)
+    return std::move(Result);
+
+  uint64_t Base = Opts.RelativeAddresses ? Info->getModulePreferredBase() : 0;
+  CachingDemangler Demangler(Opts.Demangle, Info);
+  for (size_t I : getSortedOrder(ModuleOffsets)) {
+    DILineInfo &LineInfo = Result[I];
+    LineInfo = Info->symbolizeCode(ModuleOffsets[I] + Base, Opts.PrintFunctions,
+                                   Opts.UseSymbolTable);
+    Demangler.demangle(LineInfo.FunctionName);
+  }
+  return std::move(Result);
+}
+
+Expected<std::vector<DIInliningInfo>>
+LLVMSymbolizer::symbolizeInlinedCodeBatch(const std::string &ModuleName,
+                                          ArrayRef<uint64_t> ModuleOffsets) {
+  SymbolizableModule *Info;
+  if (auto InfoOrErr = getOrCreateModuleInfo(ModuleName))
+    Info = InfoOrErr.get();
+  else
+    return InfoOrErr.takeError();
+
+  std::vector<DIInliningInfo> Result(ModuleOffsets.size());
+  // A null module means an error has already been reported. Return empty
+  // results.
+  if (!Info)
+    return std::move(Result);
+
+  uint64_t Base = Opts.RelativeAddresses ? Info->getModulePreferredBase() : 0;
+  CachingDemangler Demangler(Opts.Demangle, Info);
+  for (size_t I : getSortedOrder(ModuleOffsets)) {
+    DIInliningInfo &InlinedContext = Result[I];
+    InlinedContext = Info->symbolizeInlinedCode(
+        ModuleOffsets[I] + Base, Opts.PrintFunctions, Opts.UseSymbolTable);
+    for (int i = 0, n = InlinedContext.getNumberOfFrames(); i < n; i++)
+      Demangler.demangle(InlinedContext.getMutableFrame(i)->FunctionName);
+  }
+  return std::move(Result);
+}
+
 void LLVMSymbolizer::flush() {
+  LRUModules.clear();
+  Modules.clear();
+  CacheSize = 0;
+  BinaryRefCount.clear();
+  ObjectPairForPathArch.clear();
   ObjectForUBPathAndArch.clear();
   BinaryForPath.clear();
-  ObjectPairForPathArch.clear();
-  Modules.clear();
+}
+
+std::string LLVMSymbolizer::getPathArchKey(StringRef Path,
+                                           StringRef ArchName) {
+  // Paths can't contain a nul character, so this can't be ambiguous.
+  return (Path + Twine('\0') + ArchName).str();
+}
+
+void LLVMSymbolizer::touchModule(StringMapEntry<ModuleEntry> &Entry) {
+  LRUModules.splice(LRUModules.begin(), LRUModules, Entry.second.LRUPos);
+}
+
+void LLVMSymbolizer::pruneModules() {
+  if (!Opts.MaxCacheSize)
+    return;
+  while (CacheSize > Opts.MaxCacheSize && LRUModules.size() > 1) {
+    StringMapEntry<ModuleEntry> *Entry = LRUModules.back();
+    LRUModules.pop_back();
+    ModuleEntry &M = Entry->second;
+    CacheSize -= M.Size;
+    // The module refers to the objects owned by the binaries, so it has to go
+    // first.
+    M.Module.reset();
+    for (const std::string &Path : M.BinaryPaths)
+      releaseBinary(Path);
+    Modules.remove(Entry);
+    Entry->Destroy(Modules.getAllocator());
+    ++Stats.Evictions;
+  }
+}
+
+void LLVMSymbolizer::addBinaryRef(ModuleEntry &M, const std::string &Path) {
+  M.BinaryPaths.push_back(Path);
+  ++BinaryRefCount[Path];
+  auto I = BinaryForPath.find(Path);
+  if (I != BinaryForPath.end())
+    if (Binary *Bin = I->second.getBinary())
+      M.Size += Bin->getData().size();
+}
+
+void LLVMSymbolizer::releaseBinary(StringRef Path) {
+  auto I = BinaryRefCount.find(Path);
+  assert(I != BinaryRefCount.end() && "Binary isn't referenced");
+  if (--I->second)
+    return;
+  BinaryRefCount.erase(I);
+  freeBinary(Path);
+}
+
+void LLVMSymbolizer::releaseBinaryIfUnused(StringRef Path) {
+  if (!BinaryRefCount.count(Path))
+    freeBinary(Path);
+}
+
+void LLVMSymbolizer::freeBinary(StringRef Path) {
+  // Removing entries from a StringMap doesn't invalidate other iterators.
+  for (auto J = ObjectPairForPathArch.begin(), E = ObjectPairForPathArch.end();
+       J != E;) {
+    auto Cur = J;
+    ++J;
+    if (Cur->second.ObjPath == Path || Cur->second.DbgObjPath == Path)
+      ObjectPairForPathArch.erase(Cur);
+  }
+  for (auto J = ObjectForUBPathAndArch.begin(),
+            E = ObjectForUBPathAndArch.end();
+       J != E;) {
+    auto Cur = J;
+    ++J;
+    if (Cur->getKey().split('\0').first == Path)
+      ObjectForUBPathAndArch.erase(Cur);
+  }
+  BinaryForPath.erase(Path);
 }
 
 namespace {
@@ -240,7 +404,8 @@ bool darwinDsymMatchesBinary(const MachOObjectFile *DbgObj,
 } // end anonymous namespace
 
 ObjectFile *LLVMSymbolizer::lookUpDsymFile(const std::string &ExePath,
-    const MachOObjectFile *MachExeObj, const std::string &ArchName) {
+    const MachOObjectFile *MachExeObj, const std::string &ArchName,
+    std::string &DbgPath) {
   // On Darwin we may find DWARF in separate object file in
   // resource directory.
   std::vector<std::string> DsymPaths;
@@ -254,23 +419,28 @@ ObjectFile *LLVMSymbolizer::lookUpDsymFile(const std::string &ExePath,
     if (!DbgObjOrErr) {
       // Ignore errors, the file might not exist.
       consumeError(DbgObjOrErr.takeError());
+      if (Path != ExePath)
+        releaseBinaryIfUnused(Path);
       continue;
     }
     ObjectFile *DbgObj = DbgObjOrErr.get();
-    if (!DbgObj)
-      continue;
-    const MachOObjectFile *MachDbgObj = dyn_cast<const MachOObjectFile>(DbgObj);
-    if (!MachDbgObj)
-      continue;
-    if (darwinDsymMatchesBinary(MachDbgObj, MachExeObj))
+    const MachOObjectFile *MachDbgObj =
+        dyn_cast_or_null<const MachOObjectFile>(DbgObj);
+    if (MachDbgObj && darwinDsymMatchesBinary(MachDbgObj, MachExeObj)) {
+      DbgPath = Path;
       return DbgObj;
+    }
+    // Only the binaries of the object pair end up referenced by the module.
+    if (Path != ExePath)
+      releaseBinaryIfUnused(Path);
   }
   return nullptr;
 }
 
 ObjectFile *LLVMSymbolizer::lookUpDebuglinkObject(const std::string &Path,
                                                   const ObjectFile *Obj,
-                                                  const std::string &ArchName) {
+                                                  const std::string &ArchName,
+                                                  std::string &DbgPath) {
   std::string DebuglinkName;
   uint32_t CRCHash;
   std::string DebugBinaryPath;
@@ -282,40 +452,52 @@ ObjectFile *LLVMSymbolizer::lookUpDebuglinkObject(const std::string &Path,
   if (!DbgObjOrErr) {
     // Ignore errors, the file might not exist.
     consumeError(DbgObjOrErr.takeError());
+    if (DebugBinaryPath != Path)
+      releaseBinaryIfUnused(DebugBinaryPath);
     return nullptr;
   }
+  DbgPath = DebugBinaryPath;
   return DbgObjOrErr.get();
 }
 
-Expected<LLVMSymbolizer::ObjectPair>
+Expected<const LLVMSymbolizer::CachedObjectPair *>
 LLVMSymbolizer::getOrCreateObjectPair(const std::string &Path,
                                       const std::string &ArchName) {
-  const auto &I = ObjectPairForPathArch.find(std::make_pair(Path, ArchName));
+  std::string Key = getPathArchKey(Path, ArchName);
+  const auto &I = ObjectPairForPathArch.find(Key);
   if (I != ObjectPairForPathArch.end()) {
-    return I->second;
+    return &I->second;
   }
 
   auto ObjOrErr = getOrCreateObject(Path, ArchName);
   if (!ObjOrErr) {
-    ObjectPairForPathArch.insert(std::make_pair(std::make_pair(Path, ArchName),
-                                                ObjectPair(nullptr, nullptr)));
+    // Keep the failure along with the binary, so that both are freed with the
+    // modules referencing it.
+    CachedObjectPair Failed;
+    Failed.ObjPath = Path;
+    ObjectPairForPathArch.insert(std::make_pair(Key, std::move(Failed)));
     return ObjOrErr.takeError();
   }
 
   ObjectFile *Obj = ObjOrErr.get();
   assert(Obj != nullptr);
   ObjectFile *DbgObj = nullptr;
+  std::string DbgPath;
 
   if (auto MachObj = dyn_cast<const MachOObjectFile>(Obj))
-    DbgObj = lookUpDsymFile(Path, MachObj, ArchName);
-  if (!DbgObj)
-    DbgObj = lookUpDebuglinkObject(Path, Obj, ArchName);
+    DbgObj = lookUpDsymFile(Path, MachObj, ArchName, DbgPath);
   if (!DbgObj)
+    DbgObj = lookUpDebuglinkObject(Path, Obj, ArchName, DbgPath);
+  if (!DbgObj) {
     DbgObj = Obj;
-  ObjectPair Res = std::make_pair(Obj, DbgObj);
-  ObjectPairForPathArch.insert(
-      std::make_pair(std::make_pair(Path, ArchName), Res));
-  return Res;
+    DbgPath = Path;
+  }
+  CachedObjectPair Res;
+  Res.Objects = std::make_pair(Obj, DbgObj);
+  Res.ObjPath = Path;
+  Res.DbgObjPath = std::move(DbgPath);
+  return &ObjectPairForPathArch.insert(std::make_pair(Key, std::move(Res)))
+              .first->second;
 }
 
 Expected<ObjectFile *>
@@ -339,20 +521,21 @@ LLVMSymbolizer::getOrCreateObject(const std::string &Path,
     return static_cast<ObjectFile *>(nullptr);
 
   if (MachOUniversalBinary *UB = dyn_cast_or_null<MachOUniversalBinary>(Bin)) {
-    const auto &I = ObjectForUBPathAndArch.find(std::make_pair(Path, ArchName));
+    std::string Key = getPathArchKey(Path, ArchName);
+    const auto &I = ObjectForUBPathAndArch.find(Key);
     if (I != ObjectForUBPathAndArch.end()) {
       return I->second.get();
     }
     Expected<std::unique_ptr<ObjectFile>> ObjOrErr =
         UB->getObjectForArch(ArchName);
     if (!ObjOrErr) {
-      ObjectForUBPathAndArch.insert(std::make_pair(
-          std::make_pair(Path, ArchName), std::unique_ptr<ObjectFile>()));
+      ObjectForUBPathAndArch.insert(
+          std::make_pair(Key, std::unique_ptr<ObjectFile>()));
       return ObjOrErr.takeError();
     }
     ObjectFile *Res = ObjOrErr->get();
-    ObjectForUBPathAndArch.insert(std::make_pair(std::make_pair(Path, ArchName),
-                                                 std::move(ObjOrErr.get())));
+    ObjectForUBPathAndArch.insert(
+        std::make_pair(Key, std::move(ObjOrErr.get())));
     return Res;
   }
   if (Bin->isObject()) {
@@ -365,8 +548,19 @@ Expected<SymbolizableModule *>
 LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
   const auto &I = Modules.find(ModuleName);
   if (I != Modules.end()) {
-    return I->second.get();
+    ++Stats.Hits;
+    touchModule(*I);
+    return I->second.Module.get();
   }
+  ++Stats.Misses;
+
+  // Register the module right away, so that failures are cached as well.
+  auto &Entry =
+      *Modules.insert(std::make_pair(ModuleName, ModuleEntry())).first;
+  LRUModules.push_front(&Entry);
+  ModuleEntry &M = Entry.second;
+  M.LRUPos = LRUModules.begin();
+
   std::string BinaryName = ModuleName;
   std::string ArchName = Opts.DefaultArch;
   size_t ColonPos = ModuleName.find_last_of(':');
@@ -378,14 +572,32 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
       ArchName = ArchStr;
     }
   }
-  auto ObjectsOrErr = getOrCreateObjectPair(BinaryName, ArchName);
-  if (!ObjectsOrErr) {
-    // Failed to find valid object file.
-    Modules.insert(
-        std::make_pair(ModuleName, std::unique_ptr<SymbolizableModule>()));
-    return ObjectsOrErr.takeError();
+  auto PairOrErr = getOrCreateObjectPair(BinaryName, ArchName);
+  if (!PairOrErr) {
+    // Failed to find valid object file. The module keeps the failure cached
+    // until it is evicted.
+    addBinaryRef(M, BinaryName);
+    CacheSize += M.Size;
+    pruneModules();
+    return PairOrErr.takeError();
   }
-  ObjectPair Objects = ObjectsOrErr.get();
+  const CachedObjectPair &Pair = *PairOrErr.get();
+  // The failure to load this object pair was reported for another module
+  // name already.
+  if (!Pair.Objects.first) {
+    addBinaryRef(M, BinaryName);
+    CacheSize += M.Size;
+    pruneModules();
+    return nullptr;
+  }
+  ObjectPair Objects = Pair.Objects;
+
+  // Account for the binaries backing the module, so that they are only freed
+  // along with the last module using them.
+  addBinaryRef(M, Pair.ObjPath);
+  if (Pair.DbgObjPath != Pair.ObjPath)
+    addBinaryRef(M, Pair.DbgObjPath);
+  CacheSize += M.Size;
 
   std::unique_ptr<DIContext> Context;
   // If this is a COFF object containing PDB info, use a PDBContext to
@@ -399,8 +611,7 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
       std::unique_ptr<IPDBSession> Session;
       if (auto Err = loadDataForEXE(PDB_ReaderType::DIA,
                                     Objects.first->getFileName(), Session)) {
-        Modules.insert(
-            std::make_pair(ModuleName, std::unique_ptr<SymbolizableModule>()));
+        pruneModules();
         return std::move(Err);
       }
       Context.reset(new PDBContext(*CoffObject, std::move(Session)));
@@ -411,15 +622,12 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
   assert(Context);
   auto InfoOrErr =
       SymbolizableObjectFile::create(Objects.first, std::move(Context));
-  std::unique_ptr<SymbolizableModule> SymMod;
   if (InfoOrErr)
-    SymMod = std::move(InfoOrErr.get());
-  auto InsertResult =
-      Modules.insert(std::make_pair(ModuleName, std::move(SymMod)));
-  assert(InsertResult.second);
+    M.Module = std::move(InfoOrErr.get());
+  pruneModules();
   if (auto EC = InfoOrErr.getError())
     return errorCodeToError(EC);
-  return InsertResult.first->second.get();
+  return M.Module.get();
 }
 
 namespace {
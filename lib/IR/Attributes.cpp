@@ -64,6 +64,7 @@ unpackAllocSizeArgs(uint64_t Num) {
 Attribute Attribute::get(LLVMContext &Context, Attribute::AttrKind Kind,
                          uint64_t Val) {
   LLVMContextImpl *pImpl = Context.pImpl;
+  ContextLockGuard Guard(pImpl);
   FoldingSetNodeID ID;
   ID.AddInteger(Kind);
   if (Val) ID.AddInteger(Val);
@@ -87,6 +88,7 @@ Attribute Attribute::get(LLVMContext &Context, Attribute::AttrKind Kind,
 
 Attribute Attribute::get(LLVMContext &Context, StringRef Kind, StringRef Val) {
   LLVMContextImpl *pImpl = Context.pImpl;
+  ContextLockGuard Guard(pImpl);
   FoldingSetNodeID ID;
   ID.AddString(Kind);
   if (!Val.empty()) ID.AddString(Val);
@@ -547,6 +549,7 @@ AttributeSetNode *AttributeSetNode::get(LLVMContext &C,
 
   // Otherwise, build a key to look up the existing attributes.
   LLVMContextImpl *pImpl = C.pImpl;
+  ContextLockGuard Guard(pImpl);
   FoldingSetNodeID ID;
 
   SmallVector<Attribute, 8> SortedAttrs(Attrs.begin(), Attrs.end());
@@ -690,6 +693,7 @@ AttributeSet
 AttributeSet::getImpl(LLVMContext &C,
                       ArrayRef<std::pair<unsigned, AttributeSetNode*> > Attrs) {
   LLVMContextImpl *pImpl = C.pImpl;
+  ContextLockGuard Guard(pImpl);
   FoldingSetNodeID ID;
   AttributeSetImpl::Profile(ID, Attrs);
 
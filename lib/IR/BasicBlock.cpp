@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/IR/BasicBlock.h"
+#include "LLVMContextImpl.h"
 #include "SymbolTableListTraitsImpl.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/CFG.h"
@@ -68,7 +69,8 @@ BasicBlock::~BasicBlock() {
   // expecting the address of a label to keep the block alive even though there
   // is no indirect branch).  Handle these cases by zapping the BlockAddress
   // nodes.  There are no other possible uses at this point.
-  if (hasAddressTaken()) {
+  // After a fast teardown, the block addresses are left to the context.
+  if (hasAddressTaken() && !getContext().pImpl->FastTeardown) {
     assert(!use_empty() && "There should be at least one blockaddress!");
     Constant *Replacement =
       ConstantInt::get(llvm::Type::getInt32Ty(getContext()), 1);
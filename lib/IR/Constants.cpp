@@ -286,6 +286,7 @@ Constant *Constant::getAggregateElement(Constant *Elt) const {
 }
 
 void Constant::destroyConstant() {
+  ContextLockGuard Guard(getContext());
   /// First call destroyConstantImpl on the subclass.  This gives the subclass
   /// a chance to remove the constant from any maps/pools it's contained in.
   switch (getValueID()) {
@@ -463,6 +464,7 @@ static bool removeDeadUsersOfConstant(const Constant *C) {
 
 
 void Constant::removeDeadConstantUsers() const {
+  ContextLockGuard Guard(getContext());
   Value::const_user_iterator I = user_begin(), E = user_end();
   Value::const_user_iterator LastNonDeadUser = E;
   while (I != E) {
@@ -507,6 +509,7 @@ ConstantInt::ConstantInt(IntegerType *Ty, const APInt &V)
 
 ConstantInt *ConstantInt::getTrue(LLVMContext &Context) {
   LLVMContextImpl *pImpl = Context.pImpl;
+  ContextLockGuard Guard(pImpl);
   if (!pImpl->TheTrueVal)
     pImpl->TheTrueVal = ConstantInt::get(Type::getInt1Ty(Context), 1);
   return pImpl->TheTrueVal;
@@ -514,6 +517,7 @@ ConstantInt *ConstantInt::getTrue(LLVMContext &Context) {
 
 ConstantInt *ConstantInt::getFalse(LLVMContext &Context) {
   LLVMContextImpl *pImpl = Context.pImpl;
+  ContextLockGuard Guard(pImpl);
   if (!pImpl->TheFalseVal)
     pImpl->TheFalseVal = ConstantInt::get(Type::getInt1Ty(Context), 0);
   return pImpl->TheFalseVal;
@@ -545,15 +549,18 @@ Constant *ConstantInt::getFalse(Type *Ty) {
 
 // Get a ConstantInt from an APInt.
 ConstantInt *ConstantInt::get(LLVMContext &Context, const APInt &V) {
+  // Get the corresponding integer type for the bit width of the value. This
+  // may take the context lock, so it can't be done with the shard locked.
+  IntegerType *ITy = IntegerType::get(Context, V.getBitWidth());
+
   // get an existing value or the insertion position
   LLVMContextImpl *pImpl = Context.pImpl;
-  ConstantInt *&Slot = pImpl->IntConstants[V];
-  if (!Slot) {
-    // Get the corresponding integer type for the bit width of the value.
-    IntegerType *ITy = IntegerType::get(Context, V.getBitWidth());
+  ShardedTable<LLVMContextImpl::IntMapTy>::LockedShard Shard(
+      pImpl->IntConstants, DenseMapAPIntKeyInfo::getHashValue(V));
+  ConstantInt *&Slot = Shard.Table[V];
+  if (!Slot)
     Slot = new ConstantInt(ITy, V);
-  }
-  assert(Slot->getType() == IntegerType::get(Context, V.getBitWidth()));
+  assert(Slot->getType() == ITy);
   return Slot;
 }
 
@@ -686,8 +693,10 @@ Constant *ConstantFP::getZeroValueForNegation(Type *Ty) {
 // ConstantFP accessors.
 ConstantFP* ConstantFP::get(LLVMContext &Context, const APFloat& V) {
   LLVMContextImpl* pImpl = Context.pImpl;
+  ShardedTable<LLVMContextImpl::FPMapTy>::LockedShard Shard(
+      pImpl->FPConstants, DenseMapAPFloatKeyInfo::getHashValue(V));
 
-  ConstantFP *&Slot = pImpl->FPConstants[V];
+  ConstantFP *&Slot = Shard.Table[V];
 
   if (!Slot) {
     Type *Ty;
@@ -892,6 +901,7 @@ ConstantArray::ConstantArray(ArrayType *T, ArrayRef<Constant *> V)
 Constant *ConstantArray::get(ArrayType *Ty, ArrayRef<Constant*> V) {
   if (Constant *C = getImpl(Ty, V))
     return C;
+  ContextLockGuard Guard(Ty->getContext());
   return Ty->getContext().pImpl->ArrayConstants.getOrCreate(Ty, V);
 }
 
@@ -975,6 +985,7 @@ Constant *ConstantStruct::get(StructType *ST, ArrayRef<Constant*> V) {
   if (isUndef)
     return UndefValue::get(ST);
 
+  ContextLockGuard Guard(ST->getContext());
   return ST->getContext().pImpl->StructConstants.getOrCreate(ST, V);
 }
 
@@ -999,6 +1010,7 @@ Constant *ConstantVector::get(ArrayRef<Constant*> V) {
   if (Constant *C = getImpl(V))
     return C;
   VectorType *Ty = VectorType::get(V.front()->getType(), V.size());
+  ContextLockGuard Guard(Ty->getContext());
   return Ty->getContext().pImpl->VectorConstants.getOrCreate(Ty, V);
 }
 
@@ -1048,6 +1060,7 @@ Constant *ConstantVector::getSplat(unsigned NumElts, Constant *V) {
 
 ConstantTokenNone *ConstantTokenNone::get(LLVMContext &Context) {
   LLVMContextImpl *pImpl = Context.pImpl;
+  ContextLockGuard Guard(pImpl);
   if (!pImpl->TheNoneToken)
     pImpl->TheNoneToken.reset(new ConstantTokenNone(Context));
   return pImpl->TheNoneToken.get();
@@ -1262,6 +1275,7 @@ ConstantAggregateZero *ConstantAggregateZero::get(Type *Ty) {
   assert((Ty->isStructTy() || Ty->isArrayTy() || Ty->isVectorTy()) &&
          "Cannot create an aggregate zero of non-aggregate type!");
   
+  ContextLockGuard Guard(Ty->getContext());
   ConstantAggregateZero *&Entry = Ty->getContext().pImpl->CAZConstants[Ty];
   if (!Entry)
     Entry = new ConstantAggregateZero(Ty);
@@ -1327,6 +1341,7 @@ const APInt &Constant::getUniqueInteger() const {
 //
 
 ConstantPointerNull *ConstantPointerNull::get(PointerType *Ty) {
+  ContextLockGuard Guard(Ty->getContext());
   ConstantPointerNull *&Entry = Ty->getContext().pImpl->CPNConstants[Ty];
   if (!Entry)
     Entry = new ConstantPointerNull(Ty);
@@ -1340,6 +1355,7 @@ void ConstantPointerNull::destroyConstantImpl() {
 }
 
 UndefValue *UndefValue::get(Type *Ty) {
+  ContextLockGuard Guard(Ty->getContext());
   UndefValue *&Entry = Ty->getContext().pImpl->UVConstants[Ty];
   if (!Entry)
     Entry = new UndefValue(Ty);
@@ -1359,6 +1375,7 @@ BlockAddress *BlockAddress::get(BasicBlock *BB) {
 }
 
 BlockAddress *BlockAddress::get(Function *F, BasicBlock *BB) {
+  ContextLockGuard Guard(F->getContext());
   BlockAddress *&BA =
     F->getContext().pImpl->BlockAddresses[std::make_pair(F, BB)];
   if (!BA)
@@ -1382,6 +1399,7 @@ BlockAddress *BlockAddress::lookup(const BasicBlock *BB) {
 
   const Function *F = BB->getParent();
   assert(F && "Block must have a parent");
+  ContextLockGuard Guard(F->getContext());
   BlockAddress *BA =
       F->getContext().pImpl->BlockAddresses.lookup(std::make_pair(F, BB));
   assert(BA && "Refcount and block address map disagree!");
@@ -1451,6 +1469,7 @@ static Constant *getFoldedCast(Instruction::CastOps opc, Constant *C, Type *Ty,
   // Look up the constant in the table first to ensure uniqueness.
   ConstantExprKeyType Key(opc, C);
 
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(Ty, Key);
 }
 
@@ -1807,6 +1826,7 @@ Constant *ConstantExpr::get(unsigned Opcode, Constant *C1, Constant *C2,
   ConstantExprKeyType Key(Opcode, ArgVec, 0, Flags);
 
   LLVMContextImpl *pImpl = C1->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(C1->getType(), Key);
 }
 
@@ -1888,6 +1908,7 @@ Constant *ConstantExpr::getSelect(Constant *C, Constant *V1, Constant *V2,
   ConstantExprKeyType Key(Instruction::Select, ArgVec);
 
   LLVMContextImpl *pImpl = C->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(V1->getType(), Key);
 }
 
@@ -1942,6 +1963,7 @@ Constant *ConstantExpr::getGetElementPtr(Type *Ty, Constant *C,
                                 Ty);
 
   LLVMContextImpl *pImpl = C->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(ReqTy, Key);
 }
 
@@ -1967,6 +1989,7 @@ Constant *ConstantExpr::getICmp(unsigned short pred, Constant *LHS,
     ResultTy = VectorType::get(ResultTy, VT->getNumElements());
 
   LLVMContextImpl *pImpl = LHS->getType()->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(ResultTy, Key);
 }
 
@@ -1991,6 +2014,7 @@ Constant *ConstantExpr::getFCmp(unsigned short pred, Constant *LHS,
     ResultTy = VectorType::get(ResultTy, VT->getNumElements());
 
   LLVMContextImpl *pImpl = LHS->getType()->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(ResultTy, Key);
 }
 
@@ -2013,6 +2037,7 @@ Constant *ConstantExpr::getExtractElement(Constant *Val, Constant *Idx,
   const ConstantExprKeyType Key(Instruction::ExtractElement, ArgVec);
 
   LLVMContextImpl *pImpl = Val->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(ReqTy, Key);
 }
 
@@ -2036,6 +2061,7 @@ Constant *ConstantExpr::getInsertElement(Constant *Val, Constant *Elt,
   const ConstantExprKeyType Key(Instruction::InsertElement, ArgVec);
 
   LLVMContextImpl *pImpl = Val->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(Val->getType(), Key);
 }
 
@@ -2059,6 +2085,7 @@ Constant *ConstantExpr::getShuffleVector(Constant *V1, Constant *V2,
   const ConstantExprKeyType Key(Instruction::ShuffleVector, ArgVec);
 
   LLVMContextImpl *pImpl = ShufTy->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(ShufTy, Key);
 }
 
@@ -2083,6 +2110,7 @@ Constant *ConstantExpr::getInsertValue(Constant *Agg, Constant *Val,
   const ConstantExprKeyType Key(Instruction::InsertValue, ArgVec, 0, 0, Idxs);
 
   LLVMContextImpl *pImpl = Agg->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(ReqTy, Key);
 }
 
@@ -2107,6 +2135,7 @@ Constant *ConstantExpr::getExtractValue(Constant *Agg, ArrayRef<unsigned> Idxs,
   const ConstantExprKeyType Key(Instruction::ExtractValue, ArgVec, 0, 0, Idxs);
 
   LLVMContextImpl *pImpl = Agg->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   return pImpl->ExprConstants.getOrCreate(ReqTy, Key);
 }
 
@@ -2349,6 +2378,7 @@ Constant *ConstantDataSequential::getImpl(StringRef Elements, Type *Ty) {
     return ConstantAggregateZero::get(Ty);
 
   // Do a lookup to see if we have already formed one of these.
+  ContextLockGuard Guard(Ty->getContext());
   auto &Slot =
       *Ty->getContext()
            .pImpl->CDSConstants.insert(std::make_pair(Elements, nullptr))
@@ -2691,6 +2721,7 @@ Constant *ConstantDataVector::getSplatValue() const {
 /// array instance.
 ///
 void Constant::handleOperandChange(Value *From, Value *To) {
+  ContextLockGuard Guard(getContext());
   Value *Replacement = nullptr;
   switch (getValueID()) {
   default:
@@ -14,6 +14,7 @@
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/InstructionArena.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Operator.h"
@@ -49,6 +50,19 @@ Instruction::~Instruction() {
     clearMetadataHashEntries();
 }
 
+void *Instruction::operator new(size_t Size) {
+  return allocateHungOffOperandUser(Size, InstructionArena::getCurrent());
+}
+
+void *Instruction::operator new(size_t Size, unsigned Us) {
+  return allocateFixedOperandUser(Size, Us, 0, InstructionArena::getCurrent());
+}
+
+void *Instruction::operator new(size_t Size, unsigned Us, unsigned DescBytes) {
+  return allocateFixedOperandUser(Size, Us, DescBytes,
+                                  InstructionArena::getCurrent());
+}
+
 
 void Instruction::setParent(BasicBlock *P) {
   Parent = P;
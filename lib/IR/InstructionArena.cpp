@@ -0,0 +1,61 @@
+//===-- InstructionArena.cpp - Implement the InstructionArena class -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/InstructionArena.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/MathExtras.h"
+#include <cassert>
+
+using namespace llvm;
+
+/// The arena of the innermost scope active on this thread.
+static LLVM_THREAD_LOCAL InstructionArena *CurrentArena = nullptr;
+
+InstructionArena::Scope::Scope(InstructionArena &Arena)
+    : Previous(CurrentArena) {
+  CurrentArena = &Arena;
+}
+
+InstructionArena::Scope::~Scope() { CurrentArena = Previous; }
+
+InstructionArena::InstructionArena() {
+  for (SizeClass &SC : SizeClasses)
+    SC.Arena = this;
+}
+
+InstructionArena *InstructionArena::getCurrent() { return CurrentArena; }
+
+void *InstructionArena::allocate(size_t Size) {
+  assert(Size && "Cannot allocate an empty object in the arena!");
+  size_t Index = alignTo(Size, Granularity) / Granularity;
+  if (Index >= NumSizeClasses)
+    return nullptr;
+
+  SizeClass &SC = SizeClasses[Index];
+  if (void *Ptr = SC.FreeList) {
+    SC.FreeList = *static_cast<void **>(Ptr);
+    return Ptr;
+  }
+
+  auto **Header = static_cast<SizeClass **>(
+      Allocator.Allocate(Granularity + Index * Granularity, alignof(void *)));
+  *Header = &SC;
+  return Header + 1;
+}
+
+void InstructionArena::deallocate(void *Ptr) {
+  SizeClass *SC = static_cast<SizeClass **>(Ptr)[-1];
+  // The free lists are not synchronized, so only the thread that has the
+  // arena in scope may reuse the memory. Anything else is left to the arena's
+  // destructor.
+  if (SC->Arena != CurrentArena)
+    return;
+  *static_cast<void **>(Ptr) = SC->FreeList;
+  SC->FreeList = Ptr;
+}
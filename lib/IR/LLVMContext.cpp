@@ -24,6 +24,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
 #include <cstdlib>
@@ -251,6 +252,9 @@ LLVMContext::getDiagnosticMessagePrefix(DiagnosticSeverity Severity) {
 }
 
 void LLVMContext::diagnose(const DiagnosticInfo &DI) {
+  // Handlers and the error stream aren't expected to be thread-safe.
+  ContextLockGuard Guard(pImpl);
+
   // If there is a report handler, use it.
   if (pImpl->DiagnosticHandler) {
     if (!pImpl->RespectDiagnosticFilters || isDiagnosticEnabled(DI))
@@ -280,6 +284,7 @@ void LLVMContext::emitError(unsigned LocCookie, const Twine &ErrorStr) {
 
 /// Return a unique non-zero ID for the specified metadata kind.
 unsigned LLVMContext::getMDKindID(StringRef Name) const {
+  ContextLockGuard Guard(pImpl);
   // If this is new, assign it its ID.
   return pImpl->CustomMDKindNames.insert(
                                      std::make_pair(
@@ -290,6 +295,7 @@ unsigned LLVMContext::getMDKindID(StringRef Name) const {
 /// getHandlerNames - Populate client-supplied smallvector using custom
 /// metadata name and ID.
 void LLVMContext::getMDKindNames(SmallVectorImpl<StringRef> &Names) const {
+  ContextLockGuard Guard(pImpl);
   Names.resize(pImpl->CustomMDKindNames.size());
   for (StringMap<unsigned>::const_iterator I = pImpl->CustomMDKindNames.begin(),
        E = pImpl->CustomMDKindNames.end(); I != E; ++I)
@@ -305,6 +311,7 @@ uint32_t LLVMContext::getOperandBundleTagID(StringRef Tag) const {
 }
 
 void LLVMContext::setGC(const Function &Fn, std::string GCName) {
+  ContextLockGuard Guard(pImpl);
   auto It = pImpl->GCNames.find(&Fn);
 
   if (It == pImpl->GCNames.end()) {
@@ -315,10 +322,12 @@ void LLVMContext::setGC(const Function &Fn, std::string GCName) {
 }
 
 const std::string &LLVMContext::getGC(const Function &Fn) {
+  ContextLockGuard Guard(pImpl);
   return pImpl->GCNames[&Fn];
 }
 
 void LLVMContext::deleteGC(const Function &Fn) {
+  ContextLockGuard Guard(pImpl);
   pImpl->GCNames.erase(&Fn);
 }
 
@@ -326,6 +335,32 @@ bool LLVMContext::shouldDiscardValueNames() const {
   return pImpl->DiscardValueNames;
 }
 
+bool LLVMContext::isThreadSafe() const { return pImpl->ThreadSafe; }
+
+void LLVMContext::setThreadSafe(bool ThreadSafe) {
+  // Without threads, nothing can use the context concurrently.
+  if (pImpl->ThreadSafe == ThreadSafe || !llvm_is_multithreaded())
+    return;
+  pImpl->ThreadSafe = ThreadSafe;
+  if (ThreadSafe)
+    ++Use::NumThreadSafeContexts;
+  else
+    --Use::NumThreadSafeContexts;
+}
+
+LLVMContext::SharedStateLock::SharedStateLock(LLVMContext &Context)
+    : Impl(Context.pImpl->ThreadSafe ? Context.pImpl : nullptr) {
+  if (Impl)
+    Impl->Lock.lock();
+}
+
+LLVMContext::SharedStateLock::~SharedStateLock() {
+  if (Impl)
+    Impl->Lock.unlock();
+}
+
+void LLVMContext::enableFastTeardown() { pImpl->FastTeardown = true; }
+
 bool LLVMContext::isODRUniquingDebugTypes() const { return !!pImpl->DITypeMap; }
 
 void LLVMContext::enableDebugTypeODRUniquing() {
@@ -57,13 +57,18 @@ LLVMContextImpl::~LLVMContextImpl() {
   while (!OwnedModules.empty())
     delete *OwnedModules.begin();
 
+  // Whatever the modules left in the use lists of the constants is gone.
+  if (FastTeardown)
+    forgetUsesForTeardown();
+
   // Drop references for MDNodes.  Do this before Values get deleted to avoid
   // unnecessary RAUW when nodes are still unresolved.
   for (auto *I : DistinctMDNodes)
     I->dropAllReferences();
 #define HANDLE_MDNODE_LEAF_UNIQUABLE(CLASS)                                    \
-  for (auto *I : CLASS##s)                                                     \
-    I->dropAllReferences();
+  for (auto &Shard : CLASS##s)                                                 \
+    for (auto *I : Shard.Table)                                                \
+      I->dropAllReferences();
 #include "llvm/IR/Metadata.def"
 
   // Also drop references that come from the Value bridges.
@@ -76,8 +81,9 @@ LLVMContextImpl::~LLVMContextImpl() {
   for (MDNode *I : DistinctMDNodes)
     I->deleteAsSubclass();
 #define HANDLE_MDNODE_LEAF_UNIQUABLE(CLASS)                                    \
-  for (CLASS * I : CLASS##s)                                                   \
-    delete I;
+  for (auto &Shard : CLASS##s)                                                 \
+    for (CLASS * I : Shard.Table)                                              \
+      delete I;
 #include "llvm/IR/Metadata.def"
 
   // Free the constants.
@@ -93,12 +99,16 @@ LLVMContextImpl::~LLVMContextImpl() {
   ArrayConstants.freeConstants();
   StructConstants.freeConstants();
   VectorConstants.freeConstants();
+  // Block addresses outlive their blocks only after a fast teardown.
+  DeleteContainerSeconds(BlockAddresses);
   DeleteContainerSeconds(CAZConstants);
   DeleteContainerSeconds(CPNConstants);
   DeleteContainerSeconds(UVConstants);
   InlineAsms.freeConstants();
-  DeleteContainerSeconds(IntConstants);
-  DeleteContainerSeconds(FPConstants);
+  for (auto &Shard : IntConstants)
+    DeleteContainerSeconds(Shard.Table);
+  for (auto &Shard : FPConstants)
+    DeleteContainerSeconds(Shard.Table);
 
   for (auto &CDSConstant : CDSConstants)
     delete CDSConstant.second;
@@ -157,6 +167,40 @@ void LLVMContextImpl::dropTriviallyDeadConstantArrays() {
   } while (Changed);
 }
 
+void LLVMContextImpl::forgetUsesForTeardown() {
+  for (auto &Shard : IntConstants)
+    for (auto &I : Shard.Table)
+      I.second->forgetUsesForTeardown();
+  for (auto &Shard : FPConstants)
+    for (auto &I : Shard.Table)
+      I.second->forgetUsesForTeardown();
+  for (auto &I : CAZConstants)
+    I.second->forgetUsesForTeardown();
+  for (auto *I : ArrayConstants)
+    I->forgetUsesForTeardown();
+  for (auto *I : StructConstants)
+    I->forgetUsesForTeardown();
+  for (auto *I : VectorConstants)
+    I->forgetUsesForTeardown();
+  for (auto &I : CPNConstants)
+    I.second->forgetUsesForTeardown();
+  for (auto &I : UVConstants)
+    I.second->forgetUsesForTeardown();
+  for (auto &I : CDSConstants)
+    for (ConstantDataSequential *C = I.second; C; C = C->Next)
+      C->forgetUsesForTeardown();
+  for (auto &I : BlockAddresses)
+    I.second->forgetUsesForTeardown();
+  for (auto *I : ExprConstants)
+    I->forgetUsesForTeardown();
+  for (auto *I : InlineAsms)
+    I->forgetUsesForTeardown();
+  if (TheNoneToken)
+    TheNoneToken->forgetUsesForTeardown();
+  for (auto &I : MetadataAsValues)
+    I.second->forgetUsesForTeardown();
+}
+
 void Module::dropTriviallyDeadConstantArrays() {
   Context.pImpl->dropTriviallyDeadConstantArrays();
 }
@@ -33,6 +33,8 @@
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/ValueHandle.h"
 #include "llvm/Support/Dwarf.h"
+#include "llvm/Support/Mutex.h"
+#include <mutex>
 #include <vector>
 
 namespace llvm {
@@ -966,6 +968,28 @@ template <class NodeTy> struct MDNodeInfo {
 #define HANDLE_MDNODE_LEAF(CLASS) typedef MDNodeInfo<CLASS> CLASS##Info;
 #include "llvm/IR/Metadata.def"
 
+/// \brief DenseMapInfo for MDString, looked up by its characters.
+struct MDStringInfo {
+  static inline MDString *getEmptyKey() {
+    return DenseMapInfo<MDString *>::getEmptyKey();
+  }
+  static inline MDString *getTombstoneKey() {
+    return DenseMapInfo<MDString *>::getTombstoneKey();
+  }
+  static unsigned getHashValue(StringRef Str) { return hash_value(Str); }
+  static unsigned getHashValue(const MDString *S) {
+    return hash_value(S->getString());
+  }
+  static bool isEqual(StringRef LHS, const MDString *RHS) {
+    if (RHS == getEmptyKey() || RHS == getTombstoneKey())
+      return false;
+    return LHS == RHS->getString();
+  }
+  static bool isEqual(const MDString *LHS, const MDString *RHS) {
+    return LHS == RHS;
+  }
+};
+
 /// \brief Map-like storage for metadata attachments.
 class MDAttachmentMap {
   SmallVector<std::pair<unsigned, TrackingMDNodeRef>, 2> Attachments;
@@ -1031,6 +1055,101 @@ public:
   void getAll(SmallVectorImpl<std::pair<unsigned, MDNode *>> &Result) const;
 };
 
+/// A uniquing table split by hash into shards, each with its own lock, so that
+/// threads of a thread-safe context rarely wait for each other to unique
+/// different keys. The locks are only taken while the context is thread-safe,
+/// and no other lock is ever taken while one of them is held.
+template <class TableTy> class ShardedTable {
+public:
+  struct Shard {
+    std::mutex Lock;
+    TableTy Table;
+  };
+
+  /// The table of the shard for a hash, locked for the lifetime of this object
+  /// if the context is thread-safe.
+  class LockedShard {
+    Shard &S;
+    bool Locked;
+
+  public:
+    TableTy &Table;
+
+    LockedShard(ShardedTable &T, unsigned Hash)
+        : S(T.getShard(Hash)), Locked(T.ThreadSafe), Table(S.Table) {
+      if (Locked)
+        S.Lock.lock();
+    }
+    LockedShard(const LockedShard &) = delete;
+    LockedShard &operator=(const LockedShard &) = delete;
+    ~LockedShard() {
+      if (Locked)
+        S.Lock.unlock();
+    }
+  };
+
+  explicit ShardedTable(const bool &ThreadSafe) : ThreadSafe(ThreadSafe) {}
+
+  /// Iterate over the shards. This takes no locks.
+  Shard *begin() { return Shards; }
+  Shard *end() { return Shards + NumShards; }
+
+  /// Return the number of entries in all the shards. This takes no locks.
+  size_t size() const {
+    size_t Size = 0;
+    for (const Shard &S : Shards)
+      Size += S.Table.size();
+    return Size;
+  }
+
+private:
+  static const unsigned Log2NumShards = 4;
+  static const unsigned NumShards = 1 << Log2NumShards;
+
+  Shard Shards[NumShards];
+  const bool &ThreadSafe;
+
+  Shard &getShard(unsigned Hash) {
+    // The tables pick buckets by the low bits of the same hash, so pick the
+    // shard by the high bits of a multiplicative hash instead. Otherwise every
+    // key of a shard would land in the same few buckets.
+    return Shards[(Hash * 0x9E3779B9U) >> (32 - Log2NumShards)];
+  }
+};
+
+/// A sharded set of uniqued metadata nodes of one class.
+template <class NodeTy, class InfoT>
+class ShardedNodeSet : public ShardedTable<DenseSet<NodeTy *, InfoT>> {
+  typedef ShardedTable<DenseSet<NodeTy *, InfoT>> BaseT;
+  typedef typename BaseT::LockedShard LockedShard;
+
+public:
+  explicit ShardedNodeSet(const bool &ThreadSafe) : BaseT(ThreadSafe) {}
+
+  NodeTy *lookup(const typename InfoT::KeyTy &Key) {
+    LockedShard S(*this, InfoT::getHashValue(Key));
+    auto I = S.Table.find_as(Key);
+    return I == S.Table.end() ? nullptr : *I;
+  }
+
+  /// Insert \p N unless an equal node is already in the set. Return the node
+  /// that is in the set.
+  NodeTy *insert(NodeTy *N) {
+    LockedShard S(*this, InfoT::getHashValue(N));
+    // Nodes compare equal to themselves only, so look for an equal one by key.
+    auto I = S.Table.find_as(typename InfoT::KeyTy(N));
+    if (I != S.Table.end())
+      return *I;
+    S.Table.insert(N);
+    return N;
+  }
+
+  void erase(NodeTy *N) {
+    LockedShard S(*this, InfoT::getHashValue(N));
+    S.Table.erase(N);
+  }
+};
+
 class LLVMContextImpl {
 public:
   /// OwnedModules - The set of modules instantiated in this context, and which
@@ -1048,23 +1167,36 @@ public:
   void *YieldOpaqueHandle;
 
   typedef DenseMap<APInt, ConstantInt *, DenseMapAPIntKeyInfo> IntMapTy;
-  IntMapTy IntConstants;
+  ShardedTable<IntMapTy> IntConstants{ThreadSafe};
 
   typedef DenseMap<APFloat, ConstantFP *, DenseMapAPFloatKeyInfo> FPMapTy;
-  FPMapTy FPConstants;
+  ShardedTable<FPMapTy> FPConstants{ThreadSafe};
 
   FoldingSet<AttributeImpl> AttrsSet;
   FoldingSet<AttributeSetImpl> AttrsLists;
   FoldingSet<AttributeSetNode> AttrsSetNodes;
 
-  StringMap<MDString, BumpPtrAllocator> MDStringCache;
+  /// Each shard allocates its strings from its own allocator.
+  struct MDStringTable {
+    DenseSet<MDString *, MDStringInfo> Strings;
+    BumpPtrAllocator Alloc;
+
+    /// Copy \p Str, null terminated, into the allocator.
+    StringRef copy(StringRef Str) {
+      char *Chars = Alloc.Allocate<char>(Str.size() + 1);
+      std::copy(Str.begin(), Str.end(), Chars);
+      Chars[Str.size()] = '\0';
+      return StringRef(Chars, Str.size());
+    }
+  };
+  ShardedTable<MDStringTable> MDStringCache{ThreadSafe};
   DenseMap<Value *, ValueAsMetadata *> ValuesAsMetadata;
   DenseMap<Metadata *, MetadataAsValue *> MetadataAsValues;
 
   DenseMap<const Value*, ValueName*> ValueNames;
 
 #define HANDLE_MDNODE_LEAF_UNIQUABLE(CLASS)                                    \
-  DenseSet<CLASS *, CLASS##Info> CLASS##s;
+  ShardedNodeSet<CLASS, CLASS##Info> CLASS##s{ThreadSafe};
 #include "llvm/IR/Metadata.def"
 
   // Optional map for looking up composite types by identifier.
@@ -1173,17 +1305,57 @@ public:
   /// not.
   bool DiscardValueNames = false;
 
+  /// Set while function passes may run on several functions of this context
+  /// at once; see LLVMContext::setThreadSafe.
+  bool ThreadSafe = false;
+
+  /// Set once the IR of this context is only going to be destroyed; see
+  /// LLVMContext::enableFastTeardown.
+  bool FastTeardown = false;
+
+  /// Guards the state above that is shared between all the functions of the
+  /// context while it is thread-safe, except for the sharded tables, which
+  /// have their own locks. Recursive, since uniquing a constant or a node
+  /// often uniques its operands as well.
+  sys::SmartMutex<true> Lock;
+
   LLVMContextImpl(LLVMContext &C);
   ~LLVMContextImpl();
 
   /// Destroy the ConstantArrays if they are not used.
   void dropTriviallyDeadConstantArrays();
 
+  /// Forget the uses and operands of all values owned by the context, whose
+  /// use lists may still point to the uses of modules destroyed by a fast
+  /// teardown.
+  void forgetUsesForTeardown();
+
   /// \brief Access the object which manages optimization bisection for failure
   /// analysis.
   OptBisect &getOptBisect();
 };
 
+/// Holds the lock of a context for its lifetime if the context is
+/// thread-safe, and does nothing otherwise.
+class ContextLockGuard {
+  LLVMContextImpl *Impl;
+
+public:
+  explicit ContextLockGuard(LLVMContextImpl *Impl)
+      : Impl(Impl->ThreadSafe ? Impl : nullptr) {
+    if (this->Impl)
+      this->Impl->Lock.lock();
+  }
+  explicit ContextLockGuard(LLVMContext &Context)
+      : ContextLockGuard(Context.pImpl) {}
+  ContextLockGuard(const ContextLockGuard &) = delete;
+  ContextLockGuard &operator=(const ContextLockGuard &) = delete;
+  ~ContextLockGuard() {
+    if (Impl)
+      Impl->Lock.unlock();
+  }
+};
+
 }
 
 #endif
@@ -33,6 +33,7 @@ MetadataAsValue::MetadataAsValue(Type *Ty, Metadata *MD)
 }
 
 MetadataAsValue::~MetadataAsValue() {
+  ContextLockGuard Guard(getContext());
   getType()->getContext().pImpl->MetadataAsValues.erase(MD);
   untrack();
 }
@@ -72,6 +73,7 @@ static Metadata *canonicalizeMetadataForValue(LLVMContext &Context,
 
 MetadataAsValue *MetadataAsValue::get(LLVMContext &Context, Metadata *MD) {
   MD = canonicalizeMetadataForValue(Context, MD);
+  ContextLockGuard Guard(Context);
   auto *&Entry = Context.pImpl->MetadataAsValues[MD];
   if (!Entry)
     Entry = new MetadataAsValue(Type::getMetadataTy(Context), MD);
@@ -81,6 +83,7 @@ MetadataAsValue *MetadataAsValue::get(LLVMContext &Context, Metadata *MD) {
 MetadataAsValue *MetadataAsValue::getIfExists(LLVMContext &Context,
                                               Metadata *MD) {
   MD = canonicalizeMetadataForValue(Context, MD);
+  ContextLockGuard Guard(Context);
   auto &Store = Context.pImpl->MetadataAsValues;
   return Store.lookup(MD);
 }
@@ -88,6 +91,7 @@ MetadataAsValue *MetadataAsValue::getIfExists(LLVMContext &Context,
 void MetadataAsValue::handleChangedMetadata(Metadata *MD) {
   LLVMContext &Context = getContext();
   MD = canonicalizeMetadataForValue(Context, MD);
+  ContextLockGuard Guard(Context);
   auto &Store = Context.pImpl->MetadataAsValues;
 
   // Stop tracking the old metadata.
@@ -163,6 +167,7 @@ bool MetadataTracking::isReplaceable(const Metadata &MD) {
 }
 
 void ReplaceableMetadataImpl::addRef(void *Ref, OwnerTy Owner) {
+  ContextLockGuard Guard(Context);
   bool WasInserted =
       UseMap.insert(std::make_pair(Ref, std::make_pair(Owner, NextIndex)))
           .second;
@@ -174,6 +179,7 @@ void ReplaceableMetadataImpl::addRef(void *Ref, OwnerTy Owner) {
 }
 
 void ReplaceableMetadataImpl::dropRef(void *Ref) {
+  ContextLockGuard Guard(Context);
   bool WasErased = UseMap.erase(Ref);
   (void)WasErased;
   assert(WasErased && "Expected to drop a reference");
@@ -181,6 +187,7 @@ void ReplaceableMetadataImpl::dropRef(void *Ref) {
 
 void ReplaceableMetadataImpl::moveRef(void *Ref, void *New,
                                       const Metadata &MD) {
+  ContextLockGuard Guard(Context);
   auto I = UseMap.find(Ref);
   assert(I != UseMap.end() && "Expected to move a reference");
   auto OwnerAndIndex = I->second;
@@ -198,6 +205,7 @@ void ReplaceableMetadataImpl::moveRef(void *Ref, void *New,
 }
 
 void ReplaceableMetadataImpl::replaceAllUsesWith(Metadata *MD) {
+  ContextLockGuard Guard(Context);
   if (UseMap.empty())
     return;
 
@@ -246,6 +254,7 @@ void ReplaceableMetadataImpl::replaceAllUsesWith(Metadata *MD) {
 }
 
 void ReplaceableMetadataImpl::resolveAllUses(bool ResolveUsers) {
+  ContextLockGuard Guard(Context);
   if (UseMap.empty())
     return;
 
@@ -309,6 +318,7 @@ ValueAsMetadata *ValueAsMetadata::get(Value *V) {
   assert(V && "Unexpected null Value");
 
   auto &Context = V->getContext();
+  ContextLockGuard Guard(Context);
   auto *&Entry = Context.pImpl->ValuesAsMetadata[V];
   if (!Entry) {
     assert((isa<Constant>(V) || isa<Argument>(V) || isa<Instruction>(V)) &&
@@ -327,12 +337,14 @@ ValueAsMetadata *ValueAsMetadata::get(Value *V) {
 
 ValueAsMetadata *ValueAsMetadata::getIfExists(Value *V) {
   assert(V && "Unexpected null Value");
+  ContextLockGuard Guard(V->getContext());
   return V->getContext().pImpl->ValuesAsMetadata.lookup(V);
 }
 
 void ValueAsMetadata::handleDeletion(Value *V) {
   assert(V && "Expected valid value");
 
+  ContextLockGuard Guard(V->getContext());
   auto &Store = V->getType()->getContext().pImpl->ValuesAsMetadata;
   auto I = Store.find(V);
   if (I == Store.end())
@@ -356,6 +368,7 @@ void ValueAsMetadata::handleRAUW(Value *From, Value *To) {
   assert(From->getType() == To->getType() && "Unexpected type change");
 
   LLVMContext &Context = From->getType()->getContext();
+  ContextLockGuard Guard(Context);
   auto &Store = Context.pImpl->ValuesAsMetadata;
   auto I = Store.find(From);
   if (I == Store.end()) {
@@ -414,19 +427,26 @@ void ValueAsMetadata::handleRAUW(Value *From, Value *To) {
 // MDString implementation.
 //
 
-MDString *MDString::get(LLVMContext &Context, StringRef Str) {
-  auto &Store = Context.pImpl->MDStringCache;
-  auto I = Store.emplace_second(Str);
-  auto &MapEntry = I.first->getValue();
-  if (!I.second)
-    return &MapEntry;
-  MapEntry.Entry = &*I.first;
-  return &MapEntry;
+MDString *MDString::getImpl(LLVMContext &Context, StringRef Str, bool Copy) {
+  ShardedTable<LLVMContextImpl::MDStringTable>::LockedShard Shard(
+      Context.pImpl->MDStringCache, hash_value(Str));
+  auto &Store = Shard.Table;
+  auto I = Store.Strings.find_as(Str);
+  if (I != Store.Strings.end())
+    return *I;
+
+  if (Copy)
+    Str = Store.copy(Str);
+  MDString *S = new (Store.Alloc.Allocate<MDString>()) MDString(Str);
+  Store.Strings.insert(S);
+  return S;
 }
 
-StringRef MDString::getString() const {
-  assert(Entry && "Expected to find string map entry");
-  return Entry->first();
+void MDString::copyToContext(LLVMContext &Context) {
+  // The hash is unchanged, so the string stays where it is in the set.
+  ShardedTable<LLVMContextImpl::MDStringTable>::LockedShard Shard(
+      Context.pImpl->MDStringCache, hash_value(Str));
+  Str = Shard.Table.copy(Str);
 }
 
 //===----------------------------------------------------------------------===//
@@ -722,12 +742,8 @@ void MDNode::deleteAsSubclass() {
 }
 
 template <class T, class InfoT>
-static T *uniquifyImpl(T *N, DenseSet<T *, InfoT> &Store) {
-  if (T *U = getUniqued(Store, N))
-    return U;
-
-  Store.insert(N);
-  return N;
+static T *uniquifyImpl(T *N, ShardedNodeSet<T, InfoT> &Store) {
+  return Store.insert(N);
 }
 
 template <class NodeTy> struct MDNode::HasCachedHash {
@@ -816,6 +832,7 @@ void MDNode::storeDistinctInContext() {
 #include "llvm/IR/Metadata.def"
   }
 
+  ContextLockGuard Guard(getContext());
   getContext().pImpl->DistinctMDNodes.push_back(this);
 }
 
@@ -1179,6 +1196,7 @@ void Instruction::dropUnknownNonDebugMetadata(ArrayRef<unsigned> KnownIDs) {
   if (!hasMetadataHashEntry())
     return; // Nothing to remove!
 
+  ContextLockGuard Guard(getContext());
   auto &InstructionMetadata = getContext().pImpl->InstructionMetadata;
 
   if (KnownSet.empty()) {
@@ -1211,6 +1229,7 @@ void Instruction::setMetadata(unsigned KindID, MDNode *Node) {
   }
   
   // Handle the case when we're adding/updating metadata on an instruction.
+  ContextLockGuard Guard(getContext());
   if (Node) {
     auto &Info = getContext().pImpl->InstructionMetadata[this];
     assert(!Info.empty() == hasMetadataHashEntry() &&
@@ -1252,6 +1271,7 @@ MDNode *Instruction::getMetadataImpl(unsigned KindID) const {
 
   if (!hasMetadataHashEntry())
     return nullptr;
+  ContextLockGuard Guard(getContext());
   auto &Info = getContext().pImpl->InstructionMetadata[this];
   assert(!Info.empty() && "bit out of sync with hash table");
 
@@ -1269,6 +1289,7 @@ void Instruction::getAllMetadataImpl(
     if (!hasMetadataHashEntry()) return;
   }
 
+  ContextLockGuard Guard(getContext());
   assert(hasMetadataHashEntry() &&
          getContext().pImpl->InstructionMetadata.count(this) &&
          "Shouldn't have called this");
@@ -1280,6 +1301,7 @@ void Instruction::getAllMetadataImpl(
 void Instruction::getAllMetadataOtherThanDebugLocImpl(
     SmallVectorImpl<std::pair<unsigned, MDNode *>> &Result) const {
   Result.clear();
+  ContextLockGuard Guard(getContext());
   assert(hasMetadataHashEntry() &&
          getContext().pImpl->InstructionMetadata.count(this) &&
          "Shouldn't have called this");
@@ -1314,14 +1336,17 @@ bool Instruction::extractProfMetadata(uint64_t &TrueVal, uint64_t &FalseVal) {
 
 void Instruction::clearMetadataHashEntries() {
   assert(hasMetadataHashEntry() && "Caller should check");
+  ContextLockGuard Guard(getContext());
   getContext().pImpl->InstructionMetadata.erase(this);
   setHasMetadataHashEntry(false);
 }
 
 void GlobalObject::getMetadata(unsigned KindID,
                                SmallVectorImpl<MDNode *> &MDs) const {
-  if (hasMetadata())
-    getContext().pImpl->GlobalObjectMetadata[this].get(KindID, MDs);
+  if (!hasMetadata())
+    return;
+  ContextLockGuard Guard(getContext());
+  getContext().pImpl->GlobalObjectMetadata[this].get(KindID, MDs);
 }
 
 void GlobalObject::getMetadata(StringRef Kind,
@@ -1334,6 +1359,7 @@ void GlobalObject::addMetadata(unsigned KindID, MDNode &MD) {
   if (!hasMetadata())
     setHasMetadataHashEntry(true);
 
+  ContextLockGuard Guard(getContext());
   getContext().pImpl->GlobalObjectMetadata[this].insert(KindID, MD);
 }
 
@@ -1346,6 +1372,7 @@ void GlobalObject::eraseMetadata(unsigned KindID) {
   if (!hasMetadata())
     return;
 
+  ContextLockGuard Guard(getContext());
   auto &Store = getContext().pImpl->GlobalObjectMetadata[this];
   Store.erase(KindID);
   if (Store.empty())
@@ -1359,12 +1386,14 @@ void GlobalObject::getAllMetadata(
   if (!hasMetadata())
     return;
 
+  ContextLockGuard Guard(getContext());
   getContext().pImpl->GlobalObjectMetadata[this].getAll(MDs);
 }
 
 void GlobalObject::clearMetadata() {
   if (!hasMetadata())
     return;
+  ContextLockGuard Guard(getContext());
   getContext().pImpl->GlobalObjectMetadata.erase(this);
   setHasMetadataHashEntry(false);
 }
@@ -14,16 +14,15 @@
 #ifndef LLVM_IR_METADATAIMPL_H
 #define LLVM_IR_METADATAIMPL_H
 
-#include "llvm/ADT/DenseSet.h"
+#include "LLVMContextImpl.h"
 #include "llvm/IR/Metadata.h"
 
 namespace llvm {
 
 template <class T, class InfoT>
-static T *getUniqued(DenseSet<T *, InfoT> &Store,
+static T *getUniqued(ShardedNodeSet<T, InfoT> &Store,
                      const typename InfoT::KeyTy &Key) {
-  auto I = Store.find_as(Key);
-  return I == Store.end() ? nullptr : *I;
+  return Store.lookup(Key);
 }
 
 template <class T> T *MDNode::storeImpl(T *N, StorageType Storage) {
@@ -42,9 +41,17 @@ template <class T> T *MDNode::storeImpl(T *N, StorageType Storage) {
 template <class T, class StoreT>
 T *MDNode::storeImpl(T *N, StorageType Storage, StoreT &Store) {
   switch (Storage) {
-  case Uniqued:
-    Store.insert(N);
+  case Uniqued: {
+    // In a thread-safe context, another thread may have stored an equal node
+    // since the caller looked for one. Use that node instead.
+    T *Existing = Store.insert(N);
+    if (Existing != N) {
+      N->dropAllReferences();
+      delete N;
+      return Existing;
+    }
     break;
+  }
   case Distinct:
     N->storeDistinctInContext();
     break;
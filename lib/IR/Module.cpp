@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/IR/Module.h"
+#include "LLVMContextImpl.h"
 #include "SymbolTableListTraitsImpl.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallPtrSet.h"
@@ -57,6 +58,8 @@ Module::Module(StringRef MID, LLVMContext &C)
 
 Module::~Module() {
   Context.removeModule(this);
+  if (Context.pImpl->FastTeardown)
+    forgetUsesForTeardown();
   dropAllReferences();
   GlobalList.clear();
   FunctionList.clear();
@@ -89,6 +92,7 @@ RandomNumberGenerator *Module::createRNG(const Pass* P) const {
 /// the specified name, of arbitrary type.  This method returns null
 /// if a global with the specified name is not found.
 GlobalValue *Module::getNamedValue(StringRef Name) const {
+  ContextLockGuard Guard(Context);
   return cast_or_null<GlobalValue>(getValueSymbolTable().lookup(Name));
 }
 
@@ -121,6 +125,7 @@ void Module::getOperandBundleTags(SmallVectorImpl<StringRef> &Result) const {
 Constant *Module::getOrInsertFunction(StringRef Name,
                                       FunctionType *Ty,
                                       AttributeSet AttributeList) {
+  ContextLockGuard Guard(Context);
   // See if we have a definition for the specified function already.
   GlobalValue *F = getNamedValue(Name);
   if (!F) {
@@ -221,6 +226,7 @@ GlobalVariable *Module::getGlobalVariable(StringRef Name, bool AllowLocal) {
 ///   3. Finally, if the existing global is the correct declaration, return the
 ///      existing global.
 Constant *Module::getOrInsertGlobal(StringRef Name, Type *Ty) {
+  ContextLockGuard Guard(Context);
   // See if we have a definition for the specified global already.
   GlobalVariable *GV = dyn_cast_or_null<GlobalVariable>(getNamedValue(Name));
   if (!GV) {
@@ -463,6 +469,50 @@ void Module::dropAllReferences() {
     GIF.dropAllReferences();
 }
 
+/// Forget the uses of \p V. A value used as metadata still tells its metadata
+/// when it is destroyed, which then replaces the uses of the metadata as a
+/// value. Those uses are in the module, so forget them as well.
+static void forgetUsesForTeardown(LLVMContextImpl *Impl, Value &V) {
+  V.forgetUsesForTeardown();
+  if (!V.isUsedByMetadata())
+    return;
+  ContextLockGuard Guard(Impl);
+  auto VAM = Impl->ValuesAsMetadata.find(&V);
+  if (VAM == Impl->ValuesAsMetadata.end())
+    return;
+  auto MAV = Impl->MetadataAsValues.find(VAM->second);
+  if (MAV != Impl->MetadataAsValues.end())
+    MAV->second->forgetUsesForTeardown();
+}
+
+void Module::forgetUsesForTeardown() {
+  // All uses of the values below are either in the module, or in constants
+  // that are forgotten when the context goes away. Dropping the uses and the
+  // names then only touches each value, not its operands or its symbol table.
+  LLVMContextImpl *Impl = Context.pImpl;
+  for (Function &F : *this) {
+    if (!F.isDeclaration()) {
+      for (Argument &A : F.args())
+        ::forgetUsesForTeardown(Impl, A);
+      for (BasicBlock &BB : F) {
+        BB.forgetUsesForTeardown();
+        for (Instruction &I : BB)
+          ::forgetUsesForTeardown(Impl, I);
+      }
+    }
+    ::forgetUsesForTeardown(Impl, F);
+    F.getValueSymbolTable().discardNamesForTeardown();
+  }
+
+  for (GlobalVariable &GV : globals())
+    ::forgetUsesForTeardown(Impl, GV);
+  for (GlobalAlias &GA : aliases())
+    ::forgetUsesForTeardown(Impl, GA);
+  for (GlobalIFunc &GIF : ifuncs())
+    ::forgetUsesForTeardown(Impl, GIF);
+  ValSymTab->discardNamesForTeardown();
+}
+
 unsigned Module::getDwarfVersion() const {
   auto *Val = cast_or_null<ConstantAsMetadata>(getModuleFlag("Dwarf Version"));
   if (!Val)
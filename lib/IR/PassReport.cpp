@@ -0,0 +1,192 @@
+//===- PassReport.cpp - Per-pass time and memory report -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file implements the report of the resources used by each pass run,
+/// written as JSON to the file given with -pass-report=<filename> when LLVM
+/// shuts down.
+///
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/PassReport.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string> PassReportFile(
+    "pass-report", cl::value_desc("filename"),
+    cl::desc("Write the time, memory and instruction count change of each "
+             "pass run on each function or module to <filename>, as JSON"));
+
+namespace {
+
+struct PassRunRecord {
+  std::string PassName;
+  std::string ModuleName;
+  /// Empty for module and SCC passes.
+  std::string FunctionName;
+  /// The functions of the SCC, for the passes run over one.
+  std::vector<std::string> SCCFunctionNames;
+  bool IsSCC;
+  TimeRecord Time;
+  int64_t MemoryDelta;
+  unsigned Instructions;
+  int64_t InstructionsDelta;
+};
+
+/// Collects the records of all the threads, and writes them out on
+/// destruction, like the -time-passes TimerGroup does.
+class PassReport {
+  sys::SmartMutex<true> Lock;
+  std::vector<PassRunRecord> Records;
+
+public:
+  ~PassReport();
+
+  void add(PassRunRecord Record) {
+    sys::SmartScopedLock<true> Guard(Lock);
+    Records.push_back(std::move(Record));
+  }
+};
+
+} // end anonymous namespace
+
+static ManagedStatic<PassReport> TheReport;
+
+PassReport::~PassReport() {
+  std::error_code EC;
+  raw_fd_ostream OS(PassReportFile, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "Error opening pass report file '" << PassReportFile
+           << "': " << EC.message() << '\n';
+    return;
+  }
+
+  OS << "{\n  \"passes\": [";
+  for (unsigned I = 0, E = Records.size(); I != E; ++I) {
+    const PassRunRecord &R = Records[I];
+    OS << (I ? ",\n" : "\n") << "    {\"pass\": ";
+    PrintJSONString(R.PassName, OS);
+    OS << ", \"module\": ";
+    PrintJSONString(R.ModuleName, OS);
+    if (!R.FunctionName.empty()) {
+      OS << ", \"function\": ";
+      PrintJSONString(R.FunctionName, OS);
+    }
+    if (R.IsSCC) {
+      OS << ", \"scc\": [";
+      for (unsigned J = 0, N = R.SCCFunctionNames.size(); J != N; ++J) {
+        if (J)
+          OS << ", ";
+        PrintJSONString(R.SCCFunctionNames[J], OS);
+      }
+      OS << ']';
+    }
+    OS << format(", \"wall\": %.6f, \"user\": %.6f, \"system\": %.6f",
+                 R.Time.getWallTime(), R.Time.getUserTime(),
+                 R.Time.getSystemTime())
+       << ", \"memory_delta\": " << R.MemoryDelta
+       << ", \"instructions\": " << R.Instructions
+       << ", \"instructions_delta\": " << R.InstructionsDelta << '}';
+  }
+  OS << "\n  ]\n}\n";
+}
+
+bool llvm::isPassReportEnabled() { return !PassReportFile.empty(); }
+
+static unsigned getInstructionCount(const Function &F) {
+  unsigned Count = 0;
+  for (const BasicBlock &BB : F)
+    Count += BB.size();
+  return Count;
+}
+
+static unsigned getInstructionCount(const Module &M) {
+  unsigned Count = 0;
+  for (const Function &F : M)
+    Count += getInstructionCount(F);
+  return Count;
+}
+
+PassReportRegion::PassReportRegion(StringRef PassName, const Module &M)
+    : PassName(PassName), M(&M) {
+  start();
+}
+
+PassReportRegion::PassReportRegion(StringRef PassName, const Function &F)
+    : PassName(PassName), F(&F) {
+  start();
+}
+
+PassReportRegion::PassReportRegion(
+    StringRef PassName, const Module &M,
+    std::function<void(SmallVectorImpl<const Function *> &)> GetSCC)
+    : PassName(PassName), M(&M), GetSCC(std::move(GetSCC)) {
+  start();
+}
+
+unsigned PassReportRegion::getInstructionCount(
+    SmallVectorImpl<const Function *> &SCC) const {
+  if (F)
+    return ::getInstructionCount(*F);
+  if (!GetSCC)
+    return ::getInstructionCount(*M);
+  SCC.clear();
+  GetSCC(SCC);
+  unsigned Count = 0;
+  for (const Function *SCCF : SCC)
+    Count += ::getInstructionCount(*SCCF);
+  return Count;
+}
+
+void PassReportRegion::start() {
+  if (!isPassReportEnabled()) {
+    M = nullptr;
+    F = nullptr;
+    return;
+  }
+  SmallVector<const Function *, 4> SCC;
+  StartInstructions = getInstructionCount(SCC);
+  StartMemory = sys::Process::GetResidentMemory();
+  StartTime = TimeRecord::getCurrentTime(true);
+}
+
+PassReportRegion::~PassReportRegion() {
+  if (!M && !F)
+    return;
+
+  PassRunRecord Record;
+  Record.Time = TimeRecord::getCurrentTime(false);
+  Record.Time -= StartTime;
+  Record.MemoryDelta =
+      int64_t(sys::Process::GetResidentMemory()) - int64_t(StartMemory);
+  SmallVector<const Function *, 4> SCC;
+  Record.Instructions = getInstructionCount(SCC);
+  Record.InstructionsDelta =
+      int64_t(Record.Instructions) - int64_t(StartInstructions);
+  Record.PassName = PassName;
+  Record.ModuleName = (F ? F->getParent() : M)->getModuleIdentifier();
+  if (F)
+    Record.FunctionName = F->getName();
+  Record.IsSCC = bool(GetSCC);
+  for (const Function *SCCF : SCC)
+    Record.SCCFunctionNames.push_back(SCCF->getName());
+  TheReport->add(std::move(Record));
+}
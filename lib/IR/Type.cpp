@@ -247,6 +247,7 @@ IntegerType *IntegerType::get(LLVMContext &C, unsigned NumBits) {
     break;
   }
   
+  ContextLockGuard Guard(C);
   IntegerType *&Entry = C.pImpl->IntegerTypes[NumBits];
 
   if (!Entry)
@@ -291,6 +292,7 @@ FunctionType::FunctionType(Type *Result, ArrayRef<Type*> Params,
 FunctionType *FunctionType::get(Type *ReturnType,
                                 ArrayRef<Type*> Params, bool isVarArg) {
   LLVMContextImpl *pImpl = ReturnType->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   FunctionTypeKeyInfo::KeyTy Key(ReturnType, Params, isVarArg);
   auto I = pImpl->FunctionTypes.find_as(Key);
   FunctionType *FT;
@@ -330,6 +332,7 @@ bool FunctionType::isValidArgumentType(Type *ArgTy) {
 StructType *StructType::get(LLVMContext &Context, ArrayRef<Type*> ETypes, 
                             bool isPacked) {
   LLVMContextImpl *pImpl = Context.pImpl;
+  ContextLockGuard Guard(pImpl);
   AnonStructTypeKeyInfo::KeyTy Key(ETypes, isPacked);
   auto I = pImpl->AnonStructTypes.find_as(Key);
   StructType *ST;
@@ -361,12 +364,14 @@ void StructType::setBody(ArrayRef<Type*> Elements, bool isPacked) {
     return;
   }
 
+  ContextLockGuard Guard(getContext());
   ContainedTys = Elements.copy(getContext().pImpl->TypeAllocator).data();
 }
 
 void StructType::setName(StringRef Name) {
   if (Name == getName()) return;
 
+  ContextLockGuard Guard(getContext());
   StringMap<StructType *> &SymbolTable = getContext().pImpl->NamedStructTypes;
   typedef StringMap<StructType *>::MapEntryTy EntryTy;
 
@@ -415,6 +420,7 @@ void StructType::setName(StringRef Name) {
 // StructType Helper functions.
 
 StructType *StructType::create(LLVMContext &Context, StringRef Name) {
+  ContextLockGuard Guard(Context);
   StructType *ST = new (Context.pImpl->TypeAllocator) StructType(Context);
   if (!Name.empty())
     ST->setName(Name);
@@ -543,6 +549,7 @@ bool StructType::isLayoutIdentical(StructType *Other) const {
 }
 
 StructType *Module::getTypeByName(StringRef Name) const {
+  ContextLockGuard Guard(getContext());
   return getContext().pImpl->NamedStructTypes.lookup(Name);
 }
 
@@ -609,6 +616,7 @@ ArrayType *ArrayType::get(Type *ElementType, uint64_t NumElements) {
   assert(isValidElementType(ElementType) && "Invalid type for array element!");
 
   LLVMContextImpl *pImpl = ElementType->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   ArrayType *&Entry = 
     pImpl->ArrayTypes[std::make_pair(ElementType, NumElements)];
 
@@ -639,6 +647,7 @@ VectorType *VectorType::get(Type *ElementType, unsigned NumElements) {
                                             "pointer type.");
 
   LLVMContextImpl *pImpl = ElementType->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   VectorType *&Entry = ElementType->getContext().pImpl
     ->VectorTypes[std::make_pair(ElementType, NumElements)];
 
@@ -661,7 +670,8 @@ PointerType *PointerType::get(Type *EltTy, unsigned AddressSpace) {
   assert(isValidElementType(EltTy) && "Invalid type for pointer element!");
   
   LLVMContextImpl *CImpl = EltTy->getContext().pImpl;
-  
+  ContextLockGuard Guard(CImpl);
+
   // Since AddressSpace #0 is the common case, we special case it.
   PointerType *&Entry = AddressSpace == 0 ? CImpl->PointerTypes[EltTy]
      : CImpl->ASPointerTypes[std::make_pair(EltTy, AddressSpace)];
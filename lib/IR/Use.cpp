@@ -8,16 +8,66 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/IR/Use.h"
+#include "llvm/IR/Argument.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Instruction.h"
 #include "llvm/IR/User.h"
 #include "llvm/IR/Value.h"
+#include <mutex>
 #include <new>
 
 namespace llvm {
 
+std::atomic<unsigned> Use::NumThreadSafeContexts(0);
+
+// The use lists of values that can be used from several functions are guarded
+// by one of these locks while a context is thread-safe. The use lists of
+// instructions, arguments and blocks are only changed by the thread running
+// passes on their function.
+static const unsigned NumUseListLocks = 64;
+static std::mutex UseListLocks[NumUseListLocks];
+
+static std::mutex *getUseListLock(const Value *V) {
+  if (isa<Instruction>(V) || isa<Argument>(V) || isa<BasicBlock>(V))
+    return nullptr;
+  return &UseListLocks[(reinterpret_cast<uintptr_t>(V) >> 4) %
+                       NumUseListLocks];
+}
+
+void Use::setLocked(Value *V) {
+  if (Val)
+    removeFromListLocked();
+  Val = V;
+  if (!V)
+    return;
+  if (std::mutex *Lock = getUseListLock(V)) {
+    std::lock_guard<std::mutex> Guard(*Lock);
+    V->addUse(*this);
+    return;
+  }
+  V->addUse(*this);
+}
+
+void Use::removeFromListLocked() {
+  if (std::mutex *Lock = getUseListLock(Val)) {
+    std::lock_guard<std::mutex> Guard(*Lock);
+    removeFromList();
+    return;
+  }
+  removeFromList();
+}
+
 void Use::swap(Use &RHS) {
   if (Val == RHS.Val)
     return;
 
+  if (LLVM_UNLIKELY(NumThreadSafeContexts.load(std::memory_order_relaxed))) {
+    Value *OldVal = Val;
+    setLocked(RHS.Val);
+    RHS.setLocked(OldVal);
+    return;
+  }
+
   if (Val)
     removeFromList();
 
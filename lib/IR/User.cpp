@@ -10,6 +10,7 @@
 #include "llvm/IR/User.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/InstructionArena.h"
 #include "llvm/IR/Operator.h"
 
 namespace llvm {
@@ -114,8 +115,30 @@ MutableArrayRef<uint8_t> User::getDescriptor() {
 //                         User operator new Implementations
 //===----------------------------------------------------------------------===//
 
+/// Allocate \p Size bytes in \p Arena, or on the heap if that fails, and
+/// record where in \p IsInArena.
+static void *allocateStorage(size_t Size, InstructionArena *Arena,
+                             bool &IsInArena) {
+  if (Arena)
+    if (void *Storage = Arena->allocate(Size)) {
+      IsInArena = true;
+      return Storage;
+    }
+  IsInArena = false;
+  return ::operator new(Size);
+}
+
+/// Free storage returned by allocateStorage.
+static void deallocateStorage(void *Storage, bool IsInArena) {
+  if (IsInArena)
+    InstructionArena::deallocate(Storage);
+  else
+    ::operator delete(Storage);
+}
+
 void *User::allocateFixedOperandUser(size_t Size, unsigned Us,
-                                     unsigned DescBytes) {
+                                     unsigned DescBytes,
+                                     InstructionArena *Arena) {
   assert(Us < (1u << NumUserOperandsBits) && "Too many operands");
 
   static_assert(sizeof(DescriptorInfo) % sizeof(void *) == 0, "Required below");
@@ -125,14 +148,16 @@ void *User::allocateFixedOperandUser(size_t Size, unsigned Us,
   assert(DescBytesToAllocate % sizeof(void *) == 0 &&
          "We need this to satisfy alignment constraints for Uses");
 
-  uint8_t *Storage = static_cast<uint8_t *>(
-      ::operator new(Size + sizeof(Use) * Us + DescBytesToAllocate));
+  bool IsInArena;
+  uint8_t *Storage = static_cast<uint8_t *>(allocateStorage(
+      Size + sizeof(Use) * Us + DescBytesToAllocate, Arena, IsInArena));
   Use *Start = reinterpret_cast<Use *>(Storage + DescBytesToAllocate);
   Use *End = Start + Us;
   User *Obj = reinterpret_cast<User*>(End);
   Obj->NumUserOperands = Us;
   Obj->HasHungOffUses = false;
   Obj->HasDescriptor = DescBytes != 0;
+  Obj->IsInArena = IsInArena;
   Use::initTags(Start, End);
 
   if (DescBytes != 0) {
@@ -143,26 +168,32 @@ void *User::allocateFixedOperandUser(size_t Size, unsigned Us,
   return Obj;
 }
 
-void *User::operator new(size_t Size, unsigned Us) {
-  return allocateFixedOperandUser(Size, Us, 0);
-}
-
-void *User::operator new(size_t Size, unsigned Us, unsigned DescBytes) {
-  return allocateFixedOperandUser(Size, Us, DescBytes);
-}
-
-void *User::operator new(size_t Size) {
+void *User::allocateHungOffOperandUser(size_t Size, InstructionArena *Arena) {
   // Allocate space for a single Use*
-  void *Storage = ::operator new(Size + sizeof(Use *));
+  bool IsInArena;
+  void *Storage = allocateStorage(Size + sizeof(Use *), Arena, IsInArena);
   Use **HungOffOperandList = static_cast<Use **>(Storage);
   User *Obj = reinterpret_cast<User *>(HungOffOperandList + 1);
   Obj->NumUserOperands = 0;
   Obj->HasHungOffUses = true;
   Obj->HasDescriptor = false;
+  Obj->IsInArena = IsInArena;
   *HungOffOperandList = nullptr;
   return Obj;
 }
 
+void *User::operator new(size_t Size, unsigned Us) {
+  return allocateFixedOperandUser(Size, Us, 0, nullptr);
+}
+
+void *User::operator new(size_t Size, unsigned Us, unsigned DescBytes) {
+  return allocateFixedOperandUser(Size, Us, DescBytes, nullptr);
+}
+
+void *User::operator new(size_t Size) {
+  return allocateHungOffOperandUser(Size, nullptr);
+}
+
 //===----------------------------------------------------------------------===//
 //                         User operator delete Implementation
 //===----------------------------------------------------------------------===//
@@ -178,19 +209,19 @@ void User::operator delete(void *Usr) {
     // drop the hung off uses.
     Use::zap(*HungOffOperandList, *HungOffOperandList + Obj->NumUserOperands,
              /* Delete */ true);
-    ::operator delete(HungOffOperandList);
+    deallocateStorage(HungOffOperandList, Obj->IsInArena);
   } else if (Obj->HasDescriptor) {
     Use *UseBegin = static_cast<Use *>(Usr) - Obj->NumUserOperands;
     Use::zap(UseBegin, UseBegin + Obj->NumUserOperands, /* Delete */ false);
 
     auto *DI = reinterpret_cast<DescriptorInfo *>(UseBegin) - 1;
     uint8_t *Storage = reinterpret_cast<uint8_t *>(DI) - DI->SizeInBytes;
-    ::operator delete(Storage);
+    deallocateStorage(Storage, Obj->IsInArena);
   } else {
     Use *Storage = static_cast<Use *>(Usr) - Obj->NumUserOperands;
     Use::zap(Storage, Storage + Obj->NumUserOperands,
              /* Delete */ false);
-    ::operator delete(Storage);
+    deallocateStorage(Storage, Obj->IsInArena);
   }
 }
 
@@ -89,7 +89,16 @@ Value::~Value() {
   destroyValueName();
 }
 
+void Value::forgetUsesForTeardown() {
+  UseList = nullptr;
+  if (auto *U = dyn_cast<User>(this))
+    for (Use &Op : U->operands())
+      Op.Val = nullptr;
+}
+
 void Value::destroyValueName() {
+  if (!HasName)
+    return;
   ValueName *Name = getValueName();
   if (Name)
     Name->Destroy();
@@ -164,6 +173,7 @@ ValueName *Value::getValueName() const {
   if (!HasName) return nullptr;
 
   LLVMContext &Ctx = getContext();
+  ContextLockGuard Guard(Ctx);
   auto I = Ctx.pImpl->ValueNames.find(this);
   assert(I != Ctx.pImpl->ValueNames.end() &&
          "No name entry found!");
@@ -173,6 +183,7 @@ ValueName *Value::getValueName() const {
 
 void Value::setValueName(ValueName *VN) {
   LLVMContext &Ctx = getContext();
+  ContextLockGuard Guard(Ctx);
 
   assert(HasName == Ctx.pImpl->ValueNames.count(this) &&
          "HasName bit out of sync!");
@@ -217,6 +228,12 @@ void Value::setNameImpl(const Twine &NewName) {
 
   assert(!getType()->isVoidTy() && "Cannot assign a name to void values!");
 
+  // Renaming a global changes the symbol table of its module, which is shared
+  // by all functions.
+  Optional<ContextLockGuard> Guard;
+  if (isa<GlobalValue>(this))
+    Guard.emplace(getContext());
+
   // Get the symbol table to update for this object.
   ValueSymbolTable *ST;
   if (getSymTab(this, ST))
@@ -261,6 +278,10 @@ void Value::setName(const Twine &NewName) {
 }
 
 void Value::takeName(Value *V) {
+  Optional<ContextLockGuard> Guard;
+  if (isa<GlobalValue>(this) || isa<GlobalValue>(V))
+    Guard.emplace(getContext());
+
   ValueSymbolTable *ST = nullptr;
   // If this value has a name, drop it.
   if (hasName()) {
@@ -670,6 +691,7 @@ void Value::reverseUseList() {
 
 void ValueHandleBase::AddToExistingUseList(ValueHandleBase **List) {
   assert(List && "Handle list is null?");
+  ContextLockGuard Guard(V->getContext());
 
   // Splice ourselves into the list.
   Next = *List;
@@ -695,6 +717,7 @@ void ValueHandleBase::AddToUseList() {
   assert(V && "Null pointer doesn't have a use list!");
 
   LLVMContextImpl *pImpl = V->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
 
   if (V->HasValueHandle) {
     // If this value already has a ValueHandle, then it must be in the
@@ -738,6 +761,10 @@ void ValueHandleBase::RemoveFromUseList() {
   assert(V && V->HasValueHandle &&
          "Pointer doesn't have a use list!");
 
+  // The handles of a value shared between functions may belong to different
+  // threads.
+  ContextLockGuard Guard(V->getContext());
+
   // Unlink this from its use list.
   ValueHandleBase **PrevPtr = getPrevPtr();
   assert(*PrevPtr == this && "List invariant broken");
@@ -766,6 +793,7 @@ void ValueHandleBase::ValueIsDeleted(Value *V) {
   // Get the linked list base, which is guaranteed to exist since the
   // HasValueHandle flag is set.
   LLVMContextImpl *pImpl = V->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   ValueHandleBase *Entry = pImpl->ValueHandles[V];
   assert(Entry && "Value bit set but no entries exist");
 
@@ -825,6 +853,7 @@ void ValueHandleBase::ValueIsRAUWd(Value *Old, Value *New) {
   // Get the linked list base, which is guaranteed to exist since the
   // HasValueHandle flag is set.
   LLVMContextImpl *pImpl = Old->getContext().pImpl;
+  ContextLockGuard Guard(pImpl);
   ValueHandleBase *Entry = pImpl->ValueHandles[Old];
 
   assert(Entry && "Value bit set but no entries exist");
@@ -77,6 +77,14 @@ void ValueSymbolTable::removeValueName(ValueName *V) {
   vmap.remove(V);
 }
 
+void ValueSymbolTable::discardNamesForTeardown() {
+  // The context's map from values to names keeps stale entries for these
+  // values, but it is going away too.
+  for (auto &VI : vmap)
+    VI.getValue()->HasName = false;
+  vmap.clear();
+}
+
 /// createValueName - This method attempts to create a value name and insert
 /// it into the symbol table with the specified name.  If it conflicts, it
 /// auto-renames the name and returns that instead.
@@ -39,6 +39,7 @@
 #include "llvm/Support/CachePruning.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/SHA1.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/ThreadPool.h"
@@ -50,12 +51,18 @@
 #include "llvm/Transforms/ObjCARC.h"
 #include "llvm/Transforms/Utils/FunctionImportUtils.h"
 
+#include <condition_variable>
+#include <mutex>
 #include <numeric>
 
 using namespace llvm;
 
 #define DEBUG_TYPE "thinlto"
 
+STATISTIC(NumCacheHits, "Number of ThinLTO cache hits");
+STATISTIC(NumCacheMisses, "Number of ThinLTO cache misses");
+STATISTIC(NumCacheWrites, "Number of objects written to the ThinLTO cache");
+
 namespace llvm {
 // Flags -discard-value-names, defined in LTOCodeGenerator.cpp
 extern cl::opt<bool> LTODiscardValueNames;
@@ -139,6 +146,65 @@ generateModuleMap(const std::vector<MemoryBufferRef> &Modules) {
   return ModuleMap;
 }
 
+// Rough ratio between the in-memory size of the IR and the size of its
+// bitcode, used to turn bitcode sizes into memory estimates.
+static const uint64_t IRToBitcodeSizeRatio = 10;
+
+/// Estimate the peak memory needed by the ThinLTO backend for each of the
+/// \p Modules: the module itself, plus for every module it imports from the
+/// share of that module's bitcode that the imported functions account for,
+/// based on the instruction counts recorded in the combined index.
+static std::vector<uint64_t> estimateBackendMemory(
+    const std::vector<MemoryBufferRef> &Modules,
+    const StringMap<MemoryBufferRef> &ModuleMap,
+    const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
+    const StringMap<FunctionImporter::ImportMapTy> &ImportLists) {
+  auto getInstCount = [](const GlobalValueSummary *Summary) -> uint64_t {
+    if (auto *FS = dyn_cast<FunctionSummary>(Summary))
+      return FS->instCount();
+    return 0;
+  };
+
+  // Total number of instructions defined in each module.
+  StringMap<uint64_t> ModuleInstCount;
+  for (auto &DefinedGVSummaries : ModuleToDefinedGVSummaries) {
+    uint64_t &Count = ModuleInstCount[DefinedGVSummaries.first()];
+    for (auto &GVSummary : DefinedGVSummaries.second)
+      Count += getInstCount(GVSummary.second);
+  }
+
+  std::vector<uint64_t> Estimates;
+  Estimates.reserve(Modules.size());
+  for (auto &ModuleBuffer : Modules) {
+    StringRef ModuleIdentifier = ModuleBuffer.getBufferIdentifier();
+    uint64_t BitcodeSize = ModuleBuffer.getBufferSize();
+    auto ImportList = ImportLists.find(ModuleIdentifier);
+    if (ImportList != ImportLists.end()) {
+      for (auto &ImportedFromModule : ImportList->second) {
+        StringRef FromModule = ImportedFromModule.first();
+        auto FromBuffer = ModuleMap.find(FromModule);
+        auto FromDefined = ModuleToDefinedGVSummaries.find(FromModule);
+        if (FromBuffer == ModuleMap.end() ||
+            FromDefined == ModuleToDefinedGVSummaries.end())
+          continue;
+        uint64_t TotalCount = ModuleInstCount.lookup(FromModule);
+        if (!TotalCount)
+          continue;
+        uint64_t ImportedCount = 0;
+        for (auto &Imported : ImportedFromModule.second) {
+          auto Summary = FromDefined->second.find(Imported.first);
+          if (Summary != FromDefined->second.end())
+            ImportedCount += getInstCount(Summary->second);
+        }
+        BitcodeSize +=
+            FromBuffer->second.getBufferSize() * ImportedCount / TotalCount;
+      }
+    }
+    Estimates.push_back(BitcodeSize * IRToBitcodeSizeRatio);
+  }
+  return Estimates;
+}
+
 static void promoteModule(Module &TheModule, const ModuleSummaryIndex &Index) {
   if (renameModuleForThinLTO(TheModule, Index))
     report_fatal_error("renameModuleForThinLTO failed");
@@ -280,11 +346,27 @@ public:
   // Access the path to this entry in the cache.
   StringRef getEntryPath() { return EntryPath; }
 
-  // Try loading the buffer for this cache entry.
+  // Try loading the buffer for this cache entry. On a hit, the access time of
+  // the entry is refreshed so that size-based pruning evicts the least recently
+  // used entries first, even on file systems mounted with noatime.
   ErrorOr<std::unique_ptr<MemoryBuffer>> tryLoadingBuffer() {
     if (EntryPath.empty())
       return std::error_code();
-    return MemoryBuffer::getFile(EntryPath);
+    int FD;
+    if (std::error_code EC = sys::fs::openFileForRead(EntryPath, FD)) {
+      ++NumCacheMisses;
+      return EC;
+    }
+    sys::fs::setLastModificationAndAccessTime(FD, sys::TimeValue::now());
+    auto BufferOrErr = MemoryBuffer::getOpenFile(FD, EntryPath,
+                                                 /*FileSize=*/-1,
+                                                 /*RequiresNullTerminator=*/false);
+    sys::Process::SafelyCloseFileDescriptor(FD);
+    if (BufferOrErr)
+      ++NumCacheHits;
+    else
+      ++NumCacheMisses;
+    return BufferOrErr;
   }
 
   // Cache the Produced object file
@@ -293,11 +375,15 @@ public:
     if (EntryPath.empty())
       return OutputBuffer;
 
-    // Write to a temporary to avoid race condition
-    SmallString<128> TempFilename;
+    // Write to a temporary in the cache directory and atomically rename it to
+    // the final destination. Several processes may share the cache directory:
+    // readers either see a complete entry or none at all, and concurrent
+    // writers of the same entry produce identical content.
+    SmallString<128> TempFilename(sys::path::parent_path(EntryPath));
+    sys::path::append(TempFilename, "Thin-%%%%%%.tmp.o");
     int TempFD;
     std::error_code EC =
-        sys::fs::createTemporaryFile("Thin", "tmp.o", TempFD, TempFilename);
+        sys::fs::createUniqueFile(TempFilename, TempFD, TempFilename);
     if (EC) {
       errs() << "Error: " << EC.message() << "\n";
       report_fatal_error("ThinLTO: Can't get a temporary file");
@@ -306,16 +392,15 @@ public:
       raw_fd_ostream OS(TempFD, /* ShouldClose */ true);
       OS << OutputBuffer->getBuffer();
     }
-    // Rename to final destination (hopefully race condition won't matter here)
     EC = sys::fs::rename(TempFilename, EntryPath);
     if (EC) {
+      // The temporary may have been pruned by a concurrent process, or the
+      // rename failed for another reason; never leave a partial entry behind
+      // and keep using the in-memory buffer.
       sys::fs::remove(TempFilename);
-      raw_fd_ostream OS(EntryPath, EC, sys::fs::F_None);
-      if (EC)
-        report_fatal_error(Twine("Failed to open ") + EntryPath +
-                           " to save cached entry\n");
-      OS << OutputBuffer->getBuffer();
+      return OutputBuffer;
     }
+    ++NumCacheWrites;
     auto ReloadedBufferOrErr = MemoryBuffer::getFile(EntryPath);
     if (auto EC = ReloadedBufferOrErr.getError()) {
       // FIXME diagnose
@@ -757,69 +842,98 @@ void ThinLTOCodeGenerator::run() {
   }
 
   // Compute the ordering we will process the inputs: the rough heuristic here
-  // is to sort them per size so that the largest module get schedule as soon as
-  // possible. This is purely a compile-time optimization.
+  // is to sort them per estimated memory footprint so that the largest module
+  // get schedule as soon as possible. This is purely a compile-time
+  // optimization: it reduces the tail of the parallel phase.
+  auto MemoryEstimates = estimateBackendMemory(
+      Modules, ModuleMap, ModuleToDefinedGVSummaries, ImportLists);
   std::vector<int> ModulesOrdering;
   ModulesOrdering.resize(Modules.size());
   std::iota(ModulesOrdering.begin(), ModulesOrdering.end(), 0);
   std::sort(ModulesOrdering.begin(), ModulesOrdering.end(),
             [&](int LeftIndex, int RightIndex) {
-              auto LSize = Modules[LeftIndex].getBufferSize();
-              auto RSize = Modules[RightIndex].getBufferSize();
-              return LSize > RSize;
+              return MemoryEstimates[LeftIndex] > MemoryEstimates[RightIndex];
             });
 
   // Parallel optimizer + codegen
-  {
-    ThreadPool Pool(ThreadCount);
-    for (auto IndexCount : ModulesOrdering) {
-      auto &ModuleBuffer = Modules[IndexCount];
-      Pool.async([&](int count) {
-        auto ModuleIdentifier = ModuleBuffer.getBufferIdentifier();
-        auto &ExportList = ExportLists[ModuleIdentifier];
+  auto ProcessModule = [&](int count) {
+    auto &ModuleBuffer = Modules[count];
+    auto ModuleIdentifier = ModuleBuffer.getBufferIdentifier();
+    auto &ExportList = ExportLists[ModuleIdentifier];
 
-        auto &DefinedFunctions = ModuleToDefinedGVSummaries[ModuleIdentifier];
+    auto &DefinedFunctions = ModuleToDefinedGVSummaries[ModuleIdentifier];
 
-        // The module may be cached, this helps handling it.
-        ModuleCacheEntry CacheEntry(CacheOptions.Path, *Index, ModuleIdentifier,
-                                    ImportLists[ModuleIdentifier], ExportList,
-                                    ResolvedODR[ModuleIdentifier],
-                                    DefinedFunctions, GUIDPreservedSymbols);
+    // The module may be cached, this helps handling it.
+    ModuleCacheEntry CacheEntry(CacheOptions.Path, *Index, ModuleIdentifier,
+                                ImportLists[ModuleIdentifier], ExportList,
+                                ResolvedODR[ModuleIdentifier],
+                                DefinedFunctions, GUIDPreservedSymbols);
 
-        {
-          auto ErrOrBuffer = CacheEntry.tryLoadingBuffer();
-          DEBUG(dbgs() << "Cache " << (ErrOrBuffer ? "hit" : "miss") << " '"
-                       << CacheEntry.getEntryPath() << "' for buffer " << count
-                       << " " << ModuleIdentifier << "\n");
-
-          if (ErrOrBuffer) {
-            // Cache Hit!
-            ProducedBinaries[count] = std::move(ErrOrBuffer.get());
-            return;
-          }
-        }
+    {
+      auto ErrOrBuffer = CacheEntry.tryLoadingBuffer();
+      DEBUG(dbgs() << "Cache " << (ErrOrBuffer ? "hit" : "miss") << " '"
+                   << CacheEntry.getEntryPath() << "' for buffer " << count
+                   << " " << ModuleIdentifier << "\n");
+
+      if (ErrOrBuffer) {
+        // Cache Hit!
+        ProducedBinaries[count] = std::move(ErrOrBuffer.get());
+        return;
+      }
+    }
 
-        LLVMContext Context;
-        Context.setDiscardValueNames(LTODiscardValueNames);
-        Context.enableDebugTypeODRUniquing();
+    LLVMContext Context;
+    Context.setDiscardValueNames(LTODiscardValueNames);
+    Context.enableDebugTypeODRUniquing();
 
-        // Parse module now
-        auto TheModule = loadModuleFromBuffer(ModuleBuffer, Context, false);
+    // Parse module now
+    auto TheModule = loadModuleFromBuffer(ModuleBuffer, Context, false);
+
+    // Save temps: original file.
+    saveTempBitcode(*TheModule, SaveTempsDir, count, ".0.original.bc");
 
-        // Save temps: original file.
-        saveTempBitcode(*TheModule, SaveTempsDir, count, ".0.original.bc");
+    auto &ImportList = ImportLists[ModuleIdentifier];
+    // Run the main process now, and generates a binary
+    auto OutputBuffer = ProcessThinLTOModule(
+        *TheModule, *Index, ModuleMap, *TMBuilder.create(), ImportList,
+        ExportList, GUIDPreservedSymbols,
+        ModuleToDefinedGVSummaries[ModuleIdentifier], CacheOptions,
+        DisableCodeGen, SaveTempsDir, count);
 
-        auto &ImportList = ImportLists[ModuleIdentifier];
-        // Run the main process now, and generates a binary
-        auto OutputBuffer = ProcessThinLTOModule(
-            *TheModule, *Index, ModuleMap, *TMBuilder.create(), ImportList,
-            ExportList, GUIDPreservedSymbols,
-            ModuleToDefinedGVSummaries[ModuleIdentifier], CacheOptions,
-            DisableCodeGen, SaveTempsDir, count);
+    OutputBuffer = CacheEntry.write(std::move(OutputBuffer));
+    ProducedBinaries[count] = std::move(OutputBuffer);
+  };
 
-        OutputBuffer = CacheEntry.write(std::move(OutputBuffer));
-        ProducedBinaries[count] = std::move(OutputBuffer);
-      }, IndexCount);
+  // When a memory budget is set, a module is only admitted once the estimated
+  // footprint of the modules in flight leaves room for it. A module larger
+  // than the whole budget is processed alone.
+  std::mutex BudgetMutex;
+  std::condition_variable BudgetCond;
+  uint64_t BudgetInUse = 0;
+  {
+    ThreadPool Pool(ThreadCount);
+    for (auto IndexCount : ModulesOrdering) {
+      uint64_t Cost = std::min(MemoryEstimates[IndexCount], MemoryBudget);
+      if (MemoryBudget) {
+        std::unique_lock<std::mutex> Lock(BudgetMutex);
+        BudgetCond.wait(Lock,
+                        [&] { return BudgetInUse + Cost <= MemoryBudget; });
+        BudgetInUse += Cost;
+      }
+      DEBUG(dbgs() << "Schedule buffer " << IndexCount << " "
+                   << Modules[IndexCount].getBufferIdentifier()
+                   << " (estimated " << MemoryEstimates[IndexCount]
+                   << " bytes)\n");
+      Pool.async([&](int count, uint64_t ModuleCost) {
+        ProcessModule(count);
+        if (!MemoryBudget)
+          return;
+        {
+          std::lock_guard<std::mutex> Lock(BudgetMutex);
+          BudgetInUse -= ModuleCost;
+        }
+        BudgetCond.notify_one();
+      }, IndexCount, Cost);
     }
   }
 
@@ -827,6 +941,7 @@ void ThinLTOCodeGenerator::run() {
       .setPruningInterval(CacheOptions.PruningInterval)
       .setEntryExpiration(CacheOptions.Expiration)
       .setMaxSize(CacheOptions.MaxPercentageOfAvailableSpace)
+      .setMaxSizeBytes(CacheOptions.MaxSizeBytes)
       .prune();
 
   // If statistics were requested, print them out now.
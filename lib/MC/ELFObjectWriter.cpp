@@ -28,12 +28,16 @@
 #include "llvm/MC/MCSymbolELF.h"
 #include "llvm/MC/MCValue.h"
 #include "llvm/MC/StringTableBuilder.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compression.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ELF.h"
 #include "llvm/Support/Endian.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/StringSaver.h"
+#include "llvm/Support/ThreadPool.h"
+#include <algorithm>
+#include <thread>
 #include <vector>
 
 using namespace llvm;
@@ -41,6 +45,16 @@ using namespace llvm;
 #undef  DEBUG_TYPE
 #define DEBUG_TYPE "reloc-info"
 
+static cl::opt<unsigned> WriterThreads(
+    "elf-writer-threads", cl::Hidden, cl::init(0),
+    cl::desc("Number of threads used to produce the sections of ELF objects "
+             "(0 = one per core for large objects)"));
+
+// By default, objects with fewer sections or bytes than this are written on
+// a single thread, which saves starting a pool and buffering their contents.
+static const unsigned ParallelWriteMinSections = 4;
+static const uint64_t ParallelWriteMinSize = 1 << 20;
+
 namespace {
 typedef DenseMap<const MCSectionELF *, uint32_t> SectionIndexMapTy;
 
@@ -69,6 +83,30 @@ public:
   ArrayRef<uint32_t> getShndxIndexes() const { return ShndxIndexes; }
 };
 
+/// An object writer that only receives the data of one section, so that
+/// sections can be written to buffers of their own on different threads.
+class SectionDataWriter : public MCObjectWriter {
+public:
+  SectionDataWriter(raw_pwrite_stream &OS, bool IsLittleEndian)
+      : MCObjectWriter(OS, IsLittleEndian) {}
+
+  void executePostLayoutBinding(MCAssembler &Asm,
+                                const MCAsmLayout &Layout) override {
+    llvm_unreachable("Only section data is written to a SectionDataWriter");
+  }
+
+  void recordRelocation(MCAssembler &Asm, const MCAsmLayout &Layout,
+                        const MCFragment *Fragment, const MCFixup &Fixup,
+                        MCValue Target, bool &IsPCRel,
+                        uint64_t &FixedValue) override {
+    llvm_unreachable("Only section data is written to a SectionDataWriter");
+  }
+
+  void writeObject(MCAssembler &Asm, const MCAsmLayout &Layout) override {
+    llvm_unreachable("Only section data is written to a SectionDataWriter");
+  }
+};
+
 class ELFObjectWriter : public MCObjectWriter {
   static uint64_t SymbolValue(const MCSymbol &Sym, const MCAsmLayout &Layout);
   static bool isInSymtab(const MCAsmLayout &Layout, const MCSymbolELF &Symbol,
@@ -135,7 +173,14 @@ class ELFObjectWriter : public MCObjectWriter {
 
   void align(unsigned Alignment);
 
-  bool maybeWriteCompression(uint64_t Size,
+  /// The contents of a section as they appear in the object file.
+  struct SectionContents {
+    SmallVector<char, 0> Data;
+    /// Set if Data holds the compressed form of a debug section.
+    bool Compressed = false;
+  };
+
+  bool maybeWriteCompression(raw_ostream &OS, uint64_t Size,
                              SmallVectorImpl<char> &CompressedContents,
                              bool ZLibStyle, unsigned Alignment);
 
@@ -161,13 +206,15 @@ public:
       write32(W);
   }
 
-  template <typename T> void write(T Val) {
+  template <typename T> void write(raw_ostream &OS, T Val) {
     if (IsLittleEndian)
-      support::endian::Writer<support::little>(getStream()).write(Val);
+      support::endian::Writer<support::little>(OS).write(Val);
     else
-      support::endian::Writer<support::big>(getStream()).write(Val);
+      support::endian::Writer<support::big>(OS).write(Val);
   }
 
+  template <typename T> void write(T Val) { write(getStream(), Val); }
+
   void writeHeader(const MCAssembler &Asm);
 
   void writeSymbol(SymbolTableWriter &Writer, uint32_t StringIndex,
@@ -190,7 +237,8 @@ public:
   // Map from a signature symbol to the group section index
   typedef DenseMap<const MCSymbol *, unsigned> RevGroupMapTy;
 
-  /// Compute the symbol table data
+  /// Compute the symbol table data and write the symbol table sections to
+  /// the stream. The offsets recorded for them are those in the stream.
   ///
   /// \param Asm - The assembler.
   /// \param SectionIndexMap - Maps a section to its index.
@@ -203,8 +251,6 @@ public:
   MCSectionELF *createRelocationSection(MCContext &Ctx,
                                         const MCSectionELF &Sec);
 
-  const MCSectionELF *createStringTable(MCContext &Ctx);
-
   void executePostLayoutBinding(MCAssembler &Asm,
                                 const MCAsmLayout &Layout) override;
 
@@ -212,15 +258,23 @@ public:
                           const SectionIndexMapTy &SectionIndexMap,
                           const SectionOffsetsTy &SectionOffsets);
 
-  void writeSectionData(const MCAssembler &Asm, MCSection &Sec,
-                        const MCAsmLayout &Layout);
+  /// Produce the contents of \p Section, compressing debug sections if
+  /// requested, on \p Pool if there is one. This is safe to call for
+  /// different sections concurrently.
+  void computeSectionContents(const MCAssembler &Asm,
+                              const MCSectionELF &Section,
+                              const MCAsmLayout &Layout, ThreadPool *Pool,
+                              SectionContents &Contents);
 
   void WriteSecHdrEntry(uint32_t Name, uint32_t Type, uint64_t Flags,
                         uint64_t Address, uint64_t Offset, uint64_t Size,
                         uint32_t Link, uint32_t Info, uint64_t Alignment,
                         uint64_t EntrySize);
 
-  void writeRelocations(const MCAssembler &Asm, const MCSectionELF &Sec);
+  /// Write the relocations of \p Sec to \p OS. This is safe to call for
+  /// different sections concurrently.
+  void writeRelocations(raw_ostream &OS, const MCAssembler &Asm,
+                        const MCSectionELF &Sec);
 
   bool isSymbolRefDifferenceFullyResolvedImpl(const MCAssembler &Asm,
                                               const MCSymbol &SymA,
@@ -977,8 +1031,8 @@ ELFObjectWriter::createRelocationSection(MCContext &Ctx,
 
 // Include the debug info compression header.
 bool ELFObjectWriter::maybeWriteCompression(
-    uint64_t Size, SmallVectorImpl<char> &CompressedContents, bool ZLibStyle,
-    unsigned Alignment) {
+    raw_ostream &OS, uint64_t Size, SmallVectorImpl<char> &CompressedContents,
+    bool ZLibStyle, unsigned Alignment) {
   if (ZLibStyle) {
     uint64_t HdrSize =
         is64Bit() ? sizeof(ELF::Elf32_Chdr) : sizeof(ELF::Elf64_Chdr);
@@ -987,15 +1041,15 @@ bool ELFObjectWriter::maybeWriteCompression(
     // Platform specific header is followed by compressed data.
     if (is64Bit()) {
       // Write Elf64_Chdr header.
-      write(static_cast<ELF::Elf64_Word>(ELF::ELFCOMPRESS_ZLIB));
-      write(static_cast<ELF::Elf64_Word>(0)); // ch_reserved field.
-      write(static_cast<ELF::Elf64_Xword>(Size));
-      write(static_cast<ELF::Elf64_Xword>(Alignment));
+      write(OS, static_cast<ELF::Elf64_Word>(ELF::ELFCOMPRESS_ZLIB));
+      write(OS, static_cast<ELF::Elf64_Word>(0)); // ch_reserved field.
+      write(OS, static_cast<ELF::Elf64_Xword>(Size));
+      write(OS, static_cast<ELF::Elf64_Xword>(Alignment));
     } else {
       // Write Elf32_Chdr header otherwise.
-      write(static_cast<ELF::Elf32_Word>(ELF::ELFCOMPRESS_ZLIB));
-      write(static_cast<ELF::Elf32_Word>(Size));
-      write(static_cast<ELF::Elf32_Word>(Alignment));
+      write(OS, static_cast<ELF::Elf32_Word>(ELF::ELFCOMPRESS_ZLIB));
+      write(OS, static_cast<ELF::Elf32_Word>(Size));
+      write(OS, static_cast<ELF::Elf32_Word>(Alignment));
     }
     return true;
   }
@@ -1005,60 +1059,58 @@ bool ELFObjectWriter::maybeWriteCompression(
   const StringRef Magic = "ZLIB";
   if (Size <= Magic.size() + sizeof(Size) + CompressedContents.size())
     return false;
-  write(ArrayRef<char>(Magic.begin(), Magic.size()));
-  writeBE64(Size);
+  write(OS, ArrayRef<char>(Magic.begin(), Magic.size()));
+  support::endian::Writer<support::big>(OS).write(Size);
   return true;
 }
 
-void ELFObjectWriter::writeSectionData(const MCAssembler &Asm, MCSection &Sec,
-                                       const MCAsmLayout &Layout) {
-  MCSectionELF &Section = static_cast<MCSectionELF &>(Sec);
-  StringRef SectionName = Section.getSectionName();
+void ELFObjectWriter::computeSectionContents(const MCAssembler &Asm,
+                                             const MCSectionELF &Section,
+                                             const MCAsmLayout &Layout,
+                                             ThreadPool *Pool,
+                                             SectionContents &Contents) {
+  {
+    raw_svector_ostream VecOS(Contents.Data);
+    SectionDataWriter Writer(VecOS, IsLittleEndian);
+    Asm.writeSectionData(&Section, Layout, Writer);
+  }
 
   // Compressing debug_frame requires handling alignment fragments which is
-  // more work (possibly generalizing MCAssembler.cpp:writeFragment to allow
-  // for writing to arbitrary buffers) for little benefit.
+  // more work for little benefit.
+  StringRef SectionName = Section.getSectionName();
   bool CompressionEnabled =
       Asm.getContext().getAsmInfo()->compressDebugSections() !=
       DebugCompressionType::DCT_None;
   if (!CompressionEnabled || !SectionName.startswith(".debug_") ||
-      SectionName == ".debug_frame") {
-    Asm.writeSectionData(&Section, Layout);
+      SectionName == ".debug_frame")
     return;
-  }
-
-  SmallVector<char, 128> UncompressedData;
-  raw_svector_ostream VecOS(UncompressedData);
-  raw_pwrite_stream &OldStream = getStream();
-  setStream(VecOS);
-  Asm.writeSectionData(&Section, Layout);
-  setStream(OldStream);
 
+  // Large sections are compressed in blocks, on the pool if there is one.
+  // The blocks are the same either way, so the object doesn't depend on the
+  // number of threads.
+  const SmallVectorImpl<char> &UncompressedData = Contents.Data;
+  StringRef Input(UncompressedData.data(), UncompressedData.size());
+  zlib::CompressionLevel Level =
+      Asm.getContext().getAsmInfo()->compressDebugSectionsLevel();
   SmallVector<char, 128> CompressedContents;
-  zlib::Status Success = zlib::compress(
-      StringRef(UncompressedData.data(), UncompressedData.size()),
-      CompressedContents);
-  if (Success != zlib::StatusOK) {
-    getStream() << UncompressedData;
+  zlib::Status Success =
+      zlib::compressParallel(Input, CompressedContents, Pool, Level);
+  if (Success != zlib::StatusOK)
     return;
-  }
 
+  // The section is renamed or flagged by writeObject, which knows that it was
+  // compressed from Contents.Compressed.
   bool ZlibStyle = Asm.getContext().getAsmInfo()->compressDebugSections() ==
                    DebugCompressionType::DCT_Zlib;
-  if (!maybeWriteCompression(UncompressedData.size(), CompressedContents,
-                             ZlibStyle, Sec.getAlignment())) {
-    getStream() << UncompressedData;
+  SmallVector<char, 0> Result;
+  raw_svector_ostream OS(Result);
+  if (!maybeWriteCompression(OS, UncompressedData.size(), CompressedContents,
+                             ZlibStyle, Section.getAlignment()))
     return;
-  }
+  OS << CompressedContents;
 
-  if (ZlibStyle)
-    // Set the compressed flag. That is zlib style.
-    Section.setFlags(Section.getFlags() | ELF::SHF_COMPRESSED);
-  else
-    // Add "z" prefix to section name. This is zlib-gnu style.
-    Asm.getContext().renameELFSection(&Section,
-                                      (".z" + SectionName.drop_front(1)).str());
-  getStream() << CompressedContents;
+  Contents.Data = std::move(Result);
+  Contents.Compressed = true;
 }
 
 void ELFObjectWriter::WriteSecHdrEntry(uint32_t Name, uint32_t Type,
@@ -1079,9 +1131,11 @@ void ELFObjectWriter::WriteSecHdrEntry(uint32_t Name, uint32_t Type,
   WriteWord(EntrySize); // sh_entsize
 }
 
-void ELFObjectWriter::writeRelocations(const MCAssembler &Asm,
+void ELFObjectWriter::writeRelocations(raw_ostream &OS, const MCAssembler &Asm,
                                        const MCSectionELF &Sec) {
-  std::vector<ELFRelocationEntry> &Relocs = Relocations[&Sec];
+  // Look the relocations up without inserting into the map, which other
+  // threads may be reading.
+  std::vector<ELFRelocationEntry> &Relocs = Relocations.find(&Sec)->second;
 
   // We record relocations by pushing to the end of a vector. Reverse the vector
   // to get the relocations in the order they were created.
@@ -1097,40 +1151,34 @@ void ELFObjectWriter::writeRelocations(const MCAssembler &Asm,
     unsigned Index = Entry.Symbol ? Entry.Symbol->getIndex() : 0;
 
     if (is64Bit()) {
-      write(Entry.Offset);
+      write(OS, Entry.Offset);
       if (TargetObjectWriter->isN64()) {
-        write(uint32_t(Index));
+        write(OS, uint32_t(Index));
 
-        write(TargetObjectWriter->getRSsym(Entry.Type));
-        write(TargetObjectWriter->getRType3(Entry.Type));
-        write(TargetObjectWriter->getRType2(Entry.Type));
-        write(TargetObjectWriter->getRType(Entry.Type));
+        write(OS, TargetObjectWriter->getRSsym(Entry.Type));
+        write(OS, TargetObjectWriter->getRType3(Entry.Type));
+        write(OS, TargetObjectWriter->getRType2(Entry.Type));
+        write(OS, TargetObjectWriter->getRType(Entry.Type));
       } else {
         struct ELF::Elf64_Rela ERE64;
         ERE64.setSymbolAndType(Index, Entry.Type);
-        write(ERE64.r_info);
+        write(OS, ERE64.r_info);
       }
       if (hasRelocationAddend())
-        write(Entry.Addend);
+        write(OS, Entry.Addend);
     } else {
-      write(uint32_t(Entry.Offset));
+      write(OS, uint32_t(Entry.Offset));
 
       struct ELF::Elf32_Rela ERE32;
       ERE32.setSymbolAndType(Index, Entry.Type);
-      write(ERE32.r_info);
+      write(OS, ERE32.r_info);
 
       if (hasRelocationAddend())
-        write(uint32_t(Entry.Addend));
+        write(OS, uint32_t(Entry.Addend));
     }
   }
 }
 
-const MCSectionELF *ELFObjectWriter::createStringTable(MCContext &Ctx) {
-  const MCSectionELF *StrtabSection = SectionTable[StringTableIndex - 1];
-  getStream() << StrTabBuilder.data();
-  return StrtabSection;
-}
-
 void ELFObjectWriter::writeSection(const SectionIndexMapTy &SectionIndexMap,
                                    uint32_t GroupSymbolIndex, uint64_t Offset,
                                    uint64_t Size, const MCSectionELF &Section) {
@@ -1223,6 +1271,45 @@ void ELFObjectWriter::writeObject(MCAssembler &Asm,
 
   std::map<const MCSymbol *, std::vector<const MCSectionELF *>> GroupMembers;
 
+  // Lay out every section before the sections are written. Looking up the
+  // offset of a fragment that isn't laid out yet updates the layout, so this
+  // keeps the threads below from doing it concurrently.
+  std::vector<MCSectionELF *> DataSections;
+  uint64_t TotalSize = 0;
+  for (MCSection &Sec : Asm) {
+    DataSections.push_back(static_cast<MCSectionELF *>(&Sec));
+    TotalSize += Layout.getSectionAddressSize(&Sec);
+  }
+
+  // Small objects are written on this thread, each section being produced
+  // right before it is written. Otherwise the contents of the sections and
+  // the relocations are produced in parallel up front, each into a buffer of
+  // its own.
+  unsigned NumThreads = WriterThreads;
+  if (!NumThreads)
+    NumThreads = (DataSections.size() < ParallelWriteMinSections ||
+                  TotalSize < ParallelWriteMinSize)
+                     ? 1
+                     : std::thread::hardware_concurrency();
+  std::unique_ptr<ThreadPool> Pool;
+  if (NumThreads > 1 && DataSections.size() > 1)
+    Pool = llvm::make_unique<ThreadPool>(
+        std::min<size_t>(NumThreads, DataSections.size()));
+
+  // Run Fn(I) for every I below N on the pool.
+  auto ForEach = [&](size_t N, function_ref<void(size_t)> Fn) {
+    for (size_t I = 0; I != N; ++I)
+      Pool->async([Fn, I] { Fn(I); });
+    Pool->wait();
+  };
+
+  std::vector<SectionContents> Contents(DataSections.size());
+  if (Pool)
+    ForEach(DataSections.size(), [&](size_t I) {
+      computeSectionContents(Asm, *DataSections[I], Layout, Pool.get(),
+                             Contents[I]);
+    });
+
   // Write out the ELF header ...
   writeHeader(Asm);
 
@@ -1230,20 +1317,33 @@ void ELFObjectWriter::writeObject(MCAssembler &Asm,
   SectionOffsetsTy SectionOffsets;
   std::vector<MCSectionELF *> Groups;
   std::vector<MCSectionELF *> Relocations;
-  for (MCSection &Sec : Asm) {
-    MCSectionELF &Section = static_cast<MCSectionELF &>(Sec);
+  for (size_t I = 0, E = DataSections.size(); I != E; ++I) {
+    MCSectionELF &Section = *DataSections[I];
+    if (!Pool)
+      computeSectionContents(Asm, Section, Layout, nullptr, Contents[I]);
 
     align(Section.getAlignment());
 
     // Remember the offset into the file for this section.
     uint64_t SecStart = getStream().tell();
-
-    const MCSymbolELF *SignatureSymbol = Section.getGroup();
-    writeSectionData(Asm, Section, Layout);
-
+    getStream().write(Contents[I].Data.data(), Contents[I].Data.size());
     uint64_t SecEnd = getStream().tell();
     SectionOffsets[&Section] = std::make_pair(SecStart, SecEnd);
 
+    if (Contents[I].Compressed) {
+      if (Ctx.getAsmInfo()->compressDebugSections() ==
+          DebugCompressionType::DCT_Zlib)
+        // Set the compressed flag. That is zlib style.
+        Section.setFlags(Section.getFlags() | ELF::SHF_COMPRESSED);
+      else
+        // Add "z" prefix to section name. This is zlib-gnu style.
+        Ctx.renameELFSection(
+            &Section, (".z" + Section.getSectionName().drop_front(1)).str());
+    }
+    // The contents are not needed anymore.
+    Contents[I] = SectionContents();
+
+    const MCSymbolELF *SignatureSymbol = Section.getGroup();
     MCSectionELF *RelSection = createRelocationSection(Ctx, Section);
 
     if (SignatureSymbol) {
@@ -1290,13 +1390,26 @@ void ELFObjectWriter::writeObject(MCAssembler &Asm,
   // Compute symbol table information.
   computeSymbolTable(Asm, Layout, SectionIndexMap, RevGroupMap, SectionOffsets);
 
-  for (MCSectionELF *RelSection : Relocations) {
+  // The relocations refer to the symbols by their index in the symbol table,
+  // so they can only be encoded now.
+  std::vector<SmallVector<char, 0>> RelocationData(Relocations.size());
+  if (Pool)
+    ForEach(Relocations.size(), [&](size_t I) {
+      raw_svector_ostream OS(RelocationData[I]);
+      writeRelocations(OS, Asm, *Relocations[I]->getAssociatedSection());
+    });
+
+  for (size_t I = 0, E = Relocations.size(); I != E; ++I) {
+    MCSectionELF *RelSection = Relocations[I];
     align(RelSection->getAlignment());
 
     // Remember the offset into the file for this section.
     uint64_t SecStart = getStream().tell();
 
-    writeRelocations(Asm, *RelSection->getAssociatedSection());
+    if (Pool)
+      getStream().write(RelocationData[I].data(), RelocationData[I].size());
+    else
+      writeRelocations(getStream(), Asm, *RelSection->getAssociatedSection());
 
     uint64_t SecEnd = getStream().tell();
     SectionOffsets[RelSection] = std::make_pair(SecStart, SecEnd);
@@ -1304,9 +1417,9 @@ void ELFObjectWriter::writeObject(MCAssembler &Asm,
 
   {
     uint64_t SecStart = getStream().tell();
-    const MCSectionELF *Sec = createStringTable(Ctx);
+    getStream() << StrTabBuilder.data();
     uint64_t SecEnd = getStream().tell();
-    SectionOffsets[Sec] = std::make_pair(SecStart, SecEnd);
+    SectionOffsets[StrtabSection] = std::make_pair(SecStart, SecEnd);
   }
 
   uint64_t NaturalAlignment = is64Bit() ? 8 : 4;
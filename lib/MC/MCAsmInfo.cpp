@@ -109,6 +109,7 @@ MCAsmInfo::MCAsmInfo() {
   UseIntegratedAssembler = false;
 
   CompressDebugSections = DebugCompressionType::DCT_None;
+  CompressDebugSectionsLevel = zlib::DefaultCompression;
 }
 
 MCAsmInfo::~MCAsmInfo() {
@@ -30,6 +30,8 @@
 #include "llvm/Support/LEB128.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <iterator>
 #include <tuple>
 using namespace llvm;
 
@@ -58,6 +60,40 @@ STATISTIC(RelaxedInstructions, "Number of relaxed instructions");
 }
 }
 
+namespace {
+/// A fragment that relaxation may still have to change.
+struct RelaxCandidate {
+  MCFragment *F;
+  /// Whether all the fixups of F are PC-relative references to labels of
+  /// its own section. Their values then only change when a fragment between
+  /// F and the labels, in [SpanBegin, SpanEnd] in layout order, changes size.
+  bool HasSpan;
+  unsigned SpanBegin, SpanEnd;
+};
+
+/// The relaxation state of one section.
+struct SectionRelaxation {
+  /// The fragments that may still change size, in layout order.
+  std::vector<RelaxCandidate> Candidates;
+  /// The layout orders of the alignment and org fragments, whose sizes depend
+  /// on their offsets.
+  std::vector<unsigned> Variable;
+  /// The layout orders of the fragments that may have changed size during the
+  /// last iteration over the section, sorted.
+  std::vector<unsigned> Changed;
+  /// The generation of the layout when the section was last looked at.
+  unsigned Generation = 0;
+  bool Visited = false;
+};
+}
+
+struct MCAssembler::RelaxationState {
+  /// The state of every section, by ordinal.
+  std::vector<SectionRelaxation> Sections;
+  /// Bumped whenever a fragment changes size anywhere.
+  unsigned Generation = 0;
+};
+
 // FIXME FIXME FIXME: There are number of places in this file where we convert
 // what is a 64-bit assembler value used for computation into a value in the
 // object file, which may truncate it. We should detect that truncation where
@@ -419,9 +455,7 @@ void MCAssembler::writeFragmentPadding(const MCFragment &F, uint64_t FSize,
 
 /// \brief Write the fragment \p F to the output file.
 static void writeFragment(const MCAssembler &Asm, const MCAsmLayout &Layout,
-                          const MCFragment &F) {
-  MCObjectWriter *OW = &Asm.getWriter();
-
+                          const MCFragment &F, MCObjectWriter *OW) {
   // FIXME: Embed in fragments instead?
   uint64_t FragmentSize = Asm.computeFragmentSize(Layout, F);
 
@@ -562,6 +596,12 @@ static void writeFragment(const MCAssembler &Asm, const MCAsmLayout &Layout,
 
 void MCAssembler::writeSectionData(const MCSection *Sec,
                                    const MCAsmLayout &Layout) const {
+  writeSectionData(Sec, Layout, getWriter());
+}
+
+void MCAssembler::writeSectionData(const MCSection *Sec,
+                                   const MCAsmLayout &Layout,
+                                   MCObjectWriter &OW) const {
   // Ignore virtual sections.
   if (Sec->isVirtualSection()) {
     assert(Layout.getSectionFileSize(Sec) == 0 && "Invalid size for section!");
@@ -604,13 +644,13 @@ void MCAssembler::writeSectionData(const MCSection *Sec,
     return;
   }
 
-  uint64_t Start = getWriter().getStream().tell();
+  uint64_t Start = OW.getStream().tell();
   (void)Start;
 
   for (const MCFragment &F : *Sec)
-    writeFragment(*this, Layout, F);
+    writeFragment(*this, Layout, F, &OW);
 
-  assert(getWriter().getStream().tell() - Start ==
+  assert(OW.getStream().tell() - Start ==
          Layout.getSectionAddressSize(Sec));
 }
 
@@ -659,7 +699,9 @@ void MCAssembler::layout(MCAsmLayout &Layout) {
   }
 
   // Layout until everything fits.
-  while (layoutOnce(Layout))
+  RelaxationState State;
+  State.Sections.resize(SectionIndex);
+  while (layoutOnce(Layout, State))
     continue;
 
   DEBUG_WITH_TYPE("mc-dump", {
@@ -847,62 +889,153 @@ bool MCAssembler::relaxCVDefRange(MCAsmLayout &Layout,
   return OldSize != F.getContents().size();
 }
 
-bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec) {
+static void computeFixupSpan(const MCAssembler &Asm, RelaxCandidate &C) {
+  auto &F = cast<MCRelaxableFragment>(*C.F);
+  C.HasSpan = false;
+  C.SpanBegin = C.SpanEnd = F.getLayoutOrder();
+
+  // Bundle padding may change anywhere.
+  if (Asm.isBundlingEnabled())
+    return;
+
+  for (const MCFixup &Fixup : F.getFixups()) {
+    if (!(Asm.getBackend().getFixupKindInfo(Fixup.getKind()).Flags &
+          MCFixupKindInfo::FKF_IsPCRel))
+      return;
+    MCValue Target;
+    if (!Fixup.getValue()->evaluateAsRelocatable(Target, nullptr, &Fixup))
+      return;
+    const MCSymbolRefExpr *A = Target.getSymA();
+    if (!A || Target.getSymB() || A->getKind() != MCSymbolRefExpr::VK_None)
+      return;
+    const MCSymbol &Sym = A->getSymbol();
+    if (Sym.isVariable() || !Sym.isInSection())
+      return;
+    const MCFragment *TF = Sym.getFragment();
+    if (TF->getParent() != F.getParent())
+      return;
+    C.SpanBegin = std::min(C.SpanBegin, TF->getLayoutOrder());
+    C.SpanEnd = std::max(C.SpanEnd, TF->getLayoutOrder());
+  }
+  C.HasSpan = true;
+}
+
+bool MCAssembler::relaxFragment(MCAsmLayout &Layout, MCFragment &F) {
+  switch(F.getKind()) {
+  default:
+    return false;
+  case MCFragment::FT_Relaxable:
+    assert(!getRelaxAll() &&
+           "Did not expect a MCRelaxableFragment in RelaxAll mode");
+    return relaxInstruction(Layout, cast<MCRelaxableFragment>(F));
+  case MCFragment::FT_Dwarf:
+    return relaxDwarfLineAddr(Layout, cast<MCDwarfLineAddrFragment>(F));
+  case MCFragment::FT_DwarfFrame:
+    return relaxDwarfCallFrameFragment(Layout,
+                                       cast<MCDwarfCallFrameFragment>(F));
+  case MCFragment::FT_LEB:
+    return relaxLEB(Layout, cast<MCLEBFragment>(F));
+  case MCFragment::FT_CVInlineLines:
+    return relaxCVInlineLineTable(Layout, cast<MCCVInlineLineTableFragment>(F));
+  case MCFragment::FT_CVDefRange:
+    return relaxCVDefRange(Layout, cast<MCCVDefRangeFragment>(F));
+  }
+}
+
+bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSection &Sec,
+                                    RelaxationState &State) {
+  SectionRelaxation &SR = State.Sections[Sec.getOrdinal()];
+  if (!SR.Visited) {
+    for (MCFragment &F : Sec) {
+      switch (F.getKind()) {
+      default:
+        break;
+      case MCFragment::FT_Align:
+      case MCFragment::FT_Org:
+        SR.Variable.push_back(F.getLayoutOrder());
+        break;
+      case MCFragment::FT_Relaxable:
+        if (!getBackend().mayNeedRelaxation(
+                cast<MCRelaxableFragment>(F).getInst()))
+          break;
+        // Fallthrough.
+      case MCFragment::FT_Dwarf:
+      case MCFragment::FT_DwarfFrame:
+      case MCFragment::FT_LEB:
+      case MCFragment::FT_CVInlineLines:
+      case MCFragment::FT_CVDefRange:
+        SR.Candidates.push_back({&F, false, 0, 0});
+        if (isa<MCRelaxableFragment>(F))
+          computeFixupSpan(*this, SR.Candidates.back());
+        break;
+      }
+    }
+  }
+
+  // The fragments whose fixups are not bounded by a span may depend on the
+  // size of any fragment of any section.
+  bool VisitAll = !SR.Visited;
+  bool VisitUnbounded = VisitAll || SR.Generation != State.Generation;
+  SR.Visited = true;
+  SR.Generation = State.Generation;
+
   // Holds the first fragment which needed relaxing during this layout. It will
   // remain NULL if none were relaxed.
   // When a fragment is relaxed, all the fragments following it should get
   // invalidated because their offset is going to change.
   MCFragment *FirstRelaxedFragment = nullptr;
+  std::vector<unsigned> Relaxed;
+
+  // Attempt to relax the candidates whose fixups may have changed value, and
+  // drop those which cannot change size anymore.
+  unsigned NumCandidates = 0;
+  for (RelaxCandidate C : SR.Candidates) {
+    bool Visit;
+    if (VisitAll || !C.HasSpan) {
+      Visit = VisitUnbounded;
+    } else {
+      auto I = std::lower_bound(SR.Changed.begin(), SR.Changed.end(),
+                                C.SpanBegin);
+      Visit = I != SR.Changed.end() && *I <= C.SpanEnd;
+    }
 
-  // Attempt to relax all the fragments in the section.
-  for (MCSection::iterator I = Sec.begin(), IE = Sec.end(); I != IE; ++I) {
-    // Check if this is a fragment that needs relaxation.
-    bool RelaxedFrag = false;
-    switch(I->getKind()) {
-    default:
-      break;
-    case MCFragment::FT_Relaxable:
-      assert(!getRelaxAll() &&
-             "Did not expect a MCRelaxableFragment in RelaxAll mode");
-      RelaxedFrag = relaxInstruction(Layout, *cast<MCRelaxableFragment>(I));
-      break;
-    case MCFragment::FT_Dwarf:
-      RelaxedFrag = relaxDwarfLineAddr(Layout,
-                                       *cast<MCDwarfLineAddrFragment>(I));
-      break;
-    case MCFragment::FT_DwarfFrame:
-      RelaxedFrag =
-        relaxDwarfCallFrameFragment(Layout,
-                                    *cast<MCDwarfCallFrameFragment>(I));
-      break;
-    case MCFragment::FT_LEB:
-      RelaxedFrag = relaxLEB(Layout, *cast<MCLEBFragment>(I));
-      break;
-    case MCFragment::FT_CVInlineLines:
-      RelaxedFrag =
-          relaxCVInlineLineTable(Layout, *cast<MCCVInlineLineTableFragment>(I));
-      break;
-    case MCFragment::FT_CVDefRange:
-      RelaxedFrag = relaxCVDefRange(Layout, *cast<MCCVDefRangeFragment>(I));
-      break;
+    if (Visit && relaxFragment(Layout, *C.F)) {
+      if (!FirstRelaxedFragment)
+        FirstRelaxedFragment = C.F;
+      Relaxed.push_back(C.F->getLayoutOrder());
+      if (auto *RF = dyn_cast<MCRelaxableFragment>(C.F)) {
+        if (!getBackend().mayNeedRelaxation(RF->getInst()))
+          continue;
+        computeFixupSpan(*this, C);
+      }
     }
-    if (RelaxedFrag && !FirstRelaxedFragment)
-      FirstRelaxedFragment = &*I;
-  }
-  if (FirstRelaxedFragment) {
-    Layout.invalidateFragmentsFrom(FirstRelaxedFragment);
-    return true;
+    SR.Candidates[NumCandidates++] = C;
   }
-  return false;
+  SR.Candidates.resize(NumCandidates);
+
+  SR.Changed.clear();
+  if (!FirstRelaxedFragment)
+    return false;
+
+  // The alignment and org fragments after the first relaxed fragment may have
+  // changed size as well.
+  auto FirstVariable = std::upper_bound(SR.Variable.begin(), SR.Variable.end(),
+                                        Relaxed.front());
+  std::merge(Relaxed.begin(), Relaxed.end(), FirstVariable, SR.Variable.end(),
+             std::back_inserter(SR.Changed));
+
+  ++State.Generation;
+  Layout.invalidateFragmentsFrom(FirstRelaxedFragment);
+  return true;
 }
 
-bool MCAssembler::layoutOnce(MCAsmLayout &Layout) {
+bool MCAssembler::layoutOnce(MCAsmLayout &Layout, RelaxationState &State) {
   ++stats::RelaxationSteps;
 
   bool WasRelaxed = false;
   for (iterator it = begin(), ie = end(); it != ie; ++it) {
     MCSection &Sec = *it;
-    while (layoutSectionOnce(Layout, Sec))
+    while (layoutSectionOnce(Layout, Sec, State))
       WasRelaxed = true;
   }
 
@@ -665,21 +665,33 @@ uint32_t Archive::getNumberOfSymbols() const {
   return read32le(buf);
 }
 
-Archive::child_iterator Archive::findSym(StringRef name) const {
-  Archive::symbol_iterator bs = symbol_begin();
-  Archive::symbol_iterator es = symbol_end();
-
-  for (; bs != es; ++bs) {
-    StringRef SymName = bs->getName();
-    if (SymName == name) {
-      ErrorOr<Archive::child_iterator> ResultOrErr = bs->getMember();
-      // FIXME: Should we really eat the error?
-      if (ResultOrErr.getError())
-        return child_end();
-      return ResultOrErr.get();
-    }
+void Archive::buildSymbolIndex() const {
+  uint32_t NumSymbols = getNumberOfSymbols();
+  // Every symbol takes at least a terminator and an offset, so a count
+  // bigger than the symbol table is bogus.
+  if (NumSymbols > SymbolTable.size())
+    return;
+  SymbolsByName.reserve(NumSymbols);
+  for (const Symbol &Sym : symbols()) {
+    // Later symbols of the same name do not replace the first one, which is
+    // the one a scan of the symbol table would find.
+    SymbolsByName.insert(std::make_pair(
+        Sym.getName(), std::make_pair(Sym.SymbolIndex, Sym.StringIndex)));
   }
-  return child_end();
+}
+
+Archive::child_iterator Archive::findSym(StringRef name) const {
+  llvm::call_once(SymbolIndexFlag, [this] { buildSymbolIndex(); });
+
+  auto I = SymbolsByName.find(name);
+  if (I == SymbolsByName.end())
+    return child_end();
+  Symbol Sym(this, I->second.first, I->second.second);
+  ErrorOr<Archive::child_iterator> ResultOrErr = Sym.getMember();
+  // FIXME: Should we really eat the error?
+  if (ResultOrErr.getError())
+    return child_end();
+  return ResultOrErr.get();
 }
 
 bool Archive::hasSymbolTable() const { return !SymbolTable.empty(); }
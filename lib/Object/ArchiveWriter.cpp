@@ -21,10 +21,13 @@
 #include "llvm/Support/EndianStream.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileOutputBuffer.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/Path.h"
-#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <thread>
 
 #if !defined(_MSC_VER) && !defined(__MINGW32__)
 #include <unistd.h>
@@ -92,19 +95,19 @@ Expected<NewArchiveMember> NewArchiveMember::getFile(StringRef FileName,
 }
 
 template <typename T>
-static void printWithSpacePadding(raw_fd_ostream &OS, T Data, unsigned Size,
+static void printWithSpacePadding(raw_ostream &OS, T Data, unsigned Size,
                                   bool MayTruncate = false) {
-  uint64_t OldPos = OS.tell();
-  OS << Data;
-  unsigned SizeSoFar = OS.tell() - OldPos;
-  if (Size > SizeSoFar) {
-    OS.indent(Size - SizeSoFar);
-  } else if (Size < SizeSoFar) {
+  SmallString<32> Buf;
+  raw_svector_ostream BufOS(Buf);
+  BufOS << Data;
+  if (Buf.size() > Size) {
     assert(MayTruncate && "Data doesn't fit in Size");
     // Some of the data this is used for (like UID) can be larger than the
     // space available in the archive format. Truncate in that case.
-    OS.seek(OldPos + Size);
+    Buf.resize(Size);
   }
+  OS << Buf;
+  OS.indent(Size - Buf.size());
 }
 
 static void print32(raw_ostream &Out, object::Archive::Kind Kind,
@@ -115,7 +118,7 @@ static void print32(raw_ostream &Out, object::Archive::Kind Kind,
     support::endian::Writer<support::little>(Out).write(Val);
 }
 
-static void printRestOfMemberHeader(raw_fd_ostream &Out,
+static void printRestOfMemberHeader(raw_ostream &Out,
                                     const sys::TimeValue &ModTime, unsigned UID,
                                     unsigned GID, unsigned Perms,
                                     unsigned Size) {
@@ -127,7 +130,7 @@ static void printRestOfMemberHeader(raw_fd_ostream &Out,
   Out << "`\n";
 }
 
-static void printGNUSmallMemberHeader(raw_fd_ostream &Out, StringRef Name,
+static void printGNUSmallMemberHeader(raw_ostream &Out, StringRef Name,
                                       const sys::TimeValue &ModTime,
                                       unsigned UID, unsigned GID,
                                       unsigned Perms, unsigned Size) {
@@ -135,10 +138,11 @@ static void printGNUSmallMemberHeader(raw_fd_ostream &Out, StringRef Name,
   printRestOfMemberHeader(Out, ModTime, UID, GID, Perms, Size);
 }
 
-static void printBSDMemberHeader(raw_fd_ostream &Out, StringRef Name,
+// Pos is the offset of the header in the archive.
+static void printBSDMemberHeader(raw_ostream &Out, uint64_t Pos, StringRef Name,
                                  const sys::TimeValue &ModTime, unsigned UID,
                                  unsigned GID, unsigned Perms, unsigned Size) {
-  uint64_t PosAfterHeader = Out.tell() + 60 + Name.size();
+  uint64_t PosAfterHeader = Pos + 60 + Name.size();
   // Pad so that even 64 bit object files are aligned.
   unsigned Pad = OffsetToAlignment(PosAfterHeader, 8);
   unsigned NameWithPadding = Name.size() + Pad;
@@ -146,7 +150,6 @@ static void printBSDMemberHeader(raw_fd_ostream &Out, StringRef Name,
   printRestOfMemberHeader(Out, ModTime, UID, GID, Perms,
                           NameWithPadding + Size);
   Out << Name;
-  assert(PosAfterHeader == Out.tell());
   while (Pad--)
     Out.write(uint8_t(0));
 }
@@ -156,13 +159,13 @@ static bool useStringTable(bool Thin, StringRef Name) {
 }
 
 static void
-printMemberHeader(raw_fd_ostream &Out, object::Archive::Kind Kind, bool Thin,
-                  StringRef Name,
+printMemberHeader(raw_ostream &Out, uint64_t Pos, object::Archive::Kind Kind,
+                  bool Thin, StringRef Name,
                   std::vector<unsigned>::iterator &StringMapIndexIter,
                   const sys::TimeValue &ModTime, unsigned UID, unsigned GID,
                   unsigned Perms, unsigned Size) {
   if (Kind == object::Archive::K_BSD)
-    return printBSDMemberHeader(Out, Name, ModTime, UID, GID, Perms, Size);
+    return printBSDMemberHeader(Out, Pos, Name, ModTime, UID, GID, Perms, Size);
   if (!useStringTable(Thin, Name))
     return printGNUSmallMemberHeader(Out, Name, ModTime, UID, GID, Perms, Size);
   Out << '/';
@@ -193,38 +196,37 @@ static std::string computeRelativePath(StringRef From, StringRef To) {
   return Relative.str();
 }
 
-static void writeStringTable(raw_fd_ostream &Out, StringRef ArcName,
+static void writeStringTable(raw_ostream &Out, StringRef ArcName,
                              ArrayRef<NewArchiveMember> Members,
                              std::vector<unsigned> &StringMapIndexes,
                              bool Thin) {
-  unsigned StartOffset = 0;
+  std::string Table;
+  raw_string_ostream TableOS(Table);
   for (const NewArchiveMember &M : Members) {
     StringRef Path = M.Buf->getBufferIdentifier();
     StringRef Name = sys::path::filename(Path);
     if (!useStringTable(Thin, Name))
       continue;
-    if (StartOffset == 0) {
-      printWithSpacePadding(Out, "//", 58);
-      Out << "`\n";
-      StartOffset = Out.tell();
-    }
-    StringMapIndexes.push_back(Out.tell() - StartOffset);
+    StringMapIndexes.push_back(TableOS.tell());
 
     if (Thin)
-      Out << computeRelativePath(ArcName, Path);
+      TableOS << computeRelativePath(ArcName, Path);
     else
-      Out << Name;
+      TableOS << Name;
 
-    Out << "/\n";
+    TableOS << "/\n";
   }
-  if (StartOffset == 0)
+  if (StringMapIndexes.empty())
     return;
-  if (Out.tell() % 2)
-    Out << '\n';
-  int Pos = Out.tell();
-  Out.seek(StartOffset - 12);
-  printWithSpacePadding(Out, Pos - StartOffset, 10);
-  Out.seek(Pos);
+
+  // The table starts at an even offset, so padding its size to an even number
+  // keeps the members that follow it aligned.
+  TableOS.flush();
+  if (Table.size() % 2)
+    Table += '\n';
+  printWithSpacePadding(Out, "//", 48);
+  printWithSpacePadding(Out, Table.size(), 10);
+  Out << "`\n" << Table;
 }
 
 static sys::TimeValue now(bool Deterministic) {
@@ -235,87 +237,137 @@ static sys::TimeValue now(bool Deterministic) {
   return TV;
 }
 
-// Returns the offset of the first reference to a member offset.
-static ErrorOr<unsigned>
-writeSymbolTable(raw_fd_ostream &Out, object::Archive::Kind Kind,
-                 ArrayRef<NewArchiveMember> Members,
-                 std::vector<unsigned> &MemberOffsetRefs, bool Deterministic) {
-  unsigned HeaderStartOffset = 0;
-  unsigned BodyStartOffset = 0;
-  SmallString<128> NameBuf;
-  raw_svector_ostream NameOS(NameBuf);
+namespace {
+// The symbols a member contributes to the symbol table.
+struct MemberSymbols {
+  // Whether the member is an object file at all.
+  bool IsSymbolic = false;
+  // The names of the symbols, each followed by a null.
+  std::string Names;
+  unsigned NumSymbols = 0;
+  std::error_code EC;
+};
+}
+
+static void computeMemberSymbols(MemoryBufferRef MemberBuffer,
+                                 MemberSymbols &Syms) {
+  // Each member gets a context of its own so that members can be read in
+  // parallel. Bitcode is loaded lazily: the symbols only need the global
+  // values, not the function bodies or the metadata.
   LLVMContext Context;
-  for (unsigned MemberNum = 0, N = Members.size(); MemberNum < N; ++MemberNum) {
-    MemoryBufferRef MemberBuffer = Members[MemberNum].Buf->getMemBufferRef();
-    Expected<std::unique_ptr<object::SymbolicFile>> ObjOrErr =
-        object::SymbolicFile::createSymbolicFile(
-            MemberBuffer, sys::fs::file_magic::unknown, &Context);
-    if (!ObjOrErr) {
-      // FIXME: check only for "not an object file" errors.
-      consumeError(ObjOrErr.takeError());
-      continue;
-    }
-    object::SymbolicFile &Obj = *ObjOrErr.get();
+  Expected<std::unique_ptr<object::SymbolicFile>> ObjOrErr =
+      object::SymbolicFile::createSymbolicFile(
+          MemberBuffer, sys::fs::file_magic::unknown, &Context);
+  if (!ObjOrErr) {
+    // FIXME: check only for "not an object file" errors.
+    consumeError(ObjOrErr.takeError());
+    return;
+  }
+  Syms.IsSymbolic = true;
 
-    if (!HeaderStartOffset) {
-      HeaderStartOffset = Out.tell();
-      if (Kind == object::Archive::K_GNU)
-        printGNUSmallMemberHeader(Out, "", now(Deterministic), 0, 0, 0, 0);
-      else
-        printBSDMemberHeader(Out, "__.SYMDEF", now(Deterministic), 0, 0, 0, 0);
-      BodyStartOffset = Out.tell();
-      print32(Out, Kind, 0); // number of entries or bytes
-    }
+  raw_string_ostream NameOS(Syms.Names);
+  for (const object::BasicSymbolRef &S : (*ObjOrErr)->symbols()) {
+    uint32_t Symflags = S.getFlags();
+    if (Symflags & object::SymbolRef::SF_FormatSpecific)
+      continue;
+    if (!(Symflags & object::SymbolRef::SF_Global))
+      continue;
+    if (Symflags & object::SymbolRef::SF_Undefined)
+      continue;
 
-    for (const object::BasicSymbolRef &S : Obj.symbols()) {
-      uint32_t Symflags = S.getFlags();
-      if (Symflags & object::SymbolRef::SF_FormatSpecific)
-        continue;
-      if (!(Symflags & object::SymbolRef::SF_Global))
-        continue;
-      if (Symflags & object::SymbolRef::SF_Undefined)
-        continue;
-
-      unsigned NameOffset = NameOS.tell();
-      if (auto EC = S.printName(NameOS))
-        return EC;
-      NameOS << '\0';
-      MemberOffsetRefs.push_back(MemberNum);
-      if (Kind == object::Archive::K_BSD)
-        print32(Out, Kind, NameOffset);
-      print32(Out, Kind, 0); // member offset
+    if (auto EC = S.printName(NameOS)) {
+      Syms.EC = EC;
+      return;
     }
+    NameOS << '\0';
+    ++Syms.NumSymbols;
   }
+  NameOS.flush();
 
-  if (HeaderStartOffset == 0)
-    return 0;
+  // Nothing looks at the module of a bitcode member again.
+  Context.enableFastTeardown();
+}
 
-  StringRef StringTable = NameOS.str();
-  if (Kind == object::Archive::K_BSD)
-    print32(Out, Kind, StringTable.size()); // byte count of the string table
-  Out << StringTable;
+// Find the symbols of all members, reading the members in parallel.
+static std::vector<MemberSymbols>
+computeSymbols(ArrayRef<NewArchiveMember> Members) {
+  std::vector<MemberSymbols> Symbols(Members.size());
+  // There is no point in using more threads than there are members.
+  unsigned NumThreads = std::min(std::thread::hardware_concurrency(),
+                                 unsigned(Members.size()));
+  if (NumThreads <= 1) {
+    for (unsigned MemberNum = 0, N = Members.size(); MemberNum < N;
+         ++MemberNum)
+      computeMemberSymbols(Members[MemberNum].Buf->getMemBufferRef(),
+                           Symbols[MemberNum]);
+    return Symbols;
+  }
 
-  // ld64 requires the next member header to start at an offset that is
-  // 4 bytes aligned.
-  unsigned Pad = OffsetToAlignment(Out.tell(), 4);
-  while (Pad--)
-    Out.write(uint8_t(0));
+  ThreadPool Pool(NumThreads);
+  for (unsigned MemberNum = 0, N = Members.size(); MemberNum < N; ++MemberNum)
+    Pool.async([&Members, &Symbols, MemberNum] {
+      computeMemberSymbols(Members[MemberNum].Buf->getMemBufferRef(),
+                           Symbols[MemberNum]);
+    });
+  Pool.wait();
+  return Symbols;
+}
 
-  // Patch up the size of the symbol table now that we know how big it is.
-  unsigned Pos = Out.tell();
-  const unsigned MemberHeaderSize = 60;
-  Out.seek(HeaderStartOffset + 48); // offset of the size field.
-  printWithSpacePadding(Out, Pos - MemberHeaderSize - HeaderStartOffset, 10);
+// Writes the symbol table with all member offsets set to 0, and returns the
+// offset of the first reference to a member offset. Returns 0 if no member is
+// an object file.
+static unsigned writeSymbolTable(raw_ostream &Out, object::Archive::Kind Kind,
+                                 ArrayRef<MemberSymbols> Symbols,
+                                 std::vector<unsigned> &MemberOffsetRefs,
+                                 bool Deterministic) {
+  bool HasObject = false;
+  std::string StringTable;
+  for (unsigned MemberNum = 0, N = Symbols.size(); MemberNum < N; ++MemberNum) {
+    const MemberSymbols &Syms = Symbols[MemberNum];
+    HasObject |= Syms.IsSymbolic;
+    StringTable += Syms.Names;
+    MemberOffsetRefs.insert(MemberOffsetRefs.end(), Syms.NumSymbols,
+                            MemberNum);
+  }
+  if (!HasObject)
+    return 0;
 
-  // Patch up the number of symbols.
-  Out.seek(BodyStartOffset);
+  // ld64 requires the next member header to start at an offset that is
+  // 4 bytes aligned. The header leaves the body aligned, and the body is a
+  // multiple of 4 bytes up to the string table.
   unsigned NumSyms = MemberOffsetRefs.size();
+  unsigned Pad = OffsetToAlignment(StringTable.size(), 4);
+  unsigned Size = StringTable.size() + Pad;
+  if (Kind == object::Archive::K_GNU) {
+    Size += 4 + NumSyms * 4;
+    printGNUSmallMemberHeader(Out, "", now(Deterministic), 0, 0, 0, Size);
+  } else {
+    Size += 4 + NumSyms * 8 + 4;
+    printBSDMemberHeader(Out, Out.tell(), "__.SYMDEF", now(Deterministic), 0,
+                         0, 0, Size);
+  }
+
+  unsigned BodyStartOffset = Out.tell();
   if (Kind == object::Archive::K_GNU)
     print32(Out, Kind, NumSyms);
   else
     print32(Out, Kind, NumSyms * 8);
 
-  Out.seek(Pos);
+  for (size_t I = 0, NameOffset = 0; I < NumSyms; ++I) {
+    if (Kind == object::Archive::K_BSD) {
+      print32(Out, Kind, NameOffset);
+      NameOffset = StringTable.find('\0', NameOffset) + 1;
+    }
+    print32(Out, Kind, 0); // member offset
+  }
+
+  if (Kind == object::Archive::K_BSD)
+    print32(Out, Kind, StringTable.size()); // byte count of the string table
+  Out << StringTable;
+  while (Pad--)
+    Out.write(uint8_t(0));
+  assert(Out.tell() % 4 == 0 && "Misaligned symbol table");
+
   return BodyStartOffset + 4;
 }
 
@@ -327,69 +379,107 @@ llvm::writeArchive(StringRef ArcName,
                    std::unique_ptr<MemoryBuffer> OldArchiveBuf) {
   assert((!Thin || Kind == object::Archive::K_GNU) &&
          "Only the gnu format has a thin mode");
-  SmallString<128> TmpArchive;
-  int TmpArchiveFD;
-  if (auto EC = sys::fs::createUniqueFile(ArcName + ".temp-archive-%%%%%%%.a",
-                                          TmpArchiveFD, TmpArchive))
-    return std::make_pair(ArcName, EC);
+  std::vector<MemberSymbols> Symbols;
+  if (WriteSymtab) {
+    Symbols = computeSymbols(NewMembers);
+    for (const MemberSymbols &Syms : Symbols)
+      if (Syms.EC)
+        return std::make_pair(ArcName, Syms.EC);
+  }
 
-  tool_output_file Output(TmpArchive, TmpArchiveFD);
-  raw_fd_ostream &Out = Output.os();
+  // Lay out the whole archive before writing any of it. Everything but the
+  // member contents is printed to memory first.
+  SmallString<1024> Head;
+  raw_svector_ostream HeadOS(Head);
   if (Thin)
-    Out << "!<thin>\n";
+    HeadOS << "!<thin>\n";
   else
-    Out << "!<arch>\n";
+    HeadOS << "!<arch>\n";
 
   std::vector<unsigned> MemberOffsetRefs;
-
-  std::vector<std::unique_ptr<MemoryBuffer>> Buffers;
-  std::vector<MemoryBufferRef> Members;
-  std::vector<sys::fs::file_status> NewMemberStatus;
-
   unsigned MemberReferenceOffset = 0;
-  if (WriteSymtab) {
-    ErrorOr<unsigned> MemberReferenceOffsetOrErr = writeSymbolTable(
-        Out, Kind, NewMembers, MemberOffsetRefs, Deterministic);
-    if (auto EC = MemberReferenceOffsetOrErr.getError())
-      return std::make_pair(ArcName, EC);
-    MemberReferenceOffset = MemberReferenceOffsetOrErr.get();
-  }
+  if (WriteSymtab)
+    MemberReferenceOffset = writeSymbolTable(HeadOS, Kind, Symbols,
+                                             MemberOffsetRefs, Deterministic);
 
   std::vector<unsigned> StringMapIndexes;
   if (Kind != object::Archive::K_BSD)
-    writeStringTable(Out, ArcName, NewMembers, StringMapIndexes, Thin);
+    writeStringTable(HeadOS, ArcName, NewMembers, StringMapIndexes, Thin);
 
+  SmallString<0> MemberHeaders;
+  raw_svector_ostream MemberHeadersOS(MemberHeaders);
+  std::vector<size_t> MemberHeaderEnds;
   std::vector<unsigned>::iterator StringMapIndexIter = StringMapIndexes.begin();
   std::vector<unsigned> MemberOffset;
+  uint64_t Pos = Head.size();
   for (const NewArchiveMember &M : NewMembers) {
-    MemoryBufferRef File = M.Buf->getMemBufferRef();
-
-    unsigned Pos = Out.tell();
     MemberOffset.push_back(Pos);
 
-    printMemberHeader(Out, Kind, Thin,
+    size_t HeaderStart = MemberHeaders.size();
+    printMemberHeader(MemberHeadersOS, Pos, Kind, Thin,
                       sys::path::filename(M.Buf->getBufferIdentifier()),
                       StringMapIndexIter, M.ModTime, M.UID, M.GID, M.Perms,
                       M.Buf->getBufferSize());
+    MemberHeaderEnds.push_back(MemberHeaders.size());
+    Pos += MemberHeaders.size() - HeaderStart;
 
     if (!Thin)
-      Out << File.getBuffer();
-
-    if (Out.tell() % 2)
-      Out << '\n';
+      Pos += M.Buf->getBufferSize();
+    Pos += Pos % 2;
   }
 
   if (MemberReferenceOffset) {
-    Out.seek(MemberReferenceOffset);
+    char *Ref = Head.data() + MemberReferenceOffset;
     for (unsigned MemberNum : MemberOffsetRefs) {
       if (Kind == object::Archive::K_BSD)
-        Out.seek(Out.tell() + 4); // skip over the string offset
-      print32(Out, Kind, MemberOffset[MemberNum]);
+        Ref += 4; // skip over the string offset
+      if (Kind == object::Archive::K_GNU)
+        support::endian::write32be(Ref, MemberOffset[MemberNum]);
+      else
+        support::endian::write32le(Ref, MemberOffset[MemberNum]);
+      Ref += 4;
+    }
+  }
+
+  // FileOutputBuffer deletes the file it replaces up front, which fails on
+  // Windows while OldArchiveBuf maps it. Have it write a temporary file that
+  // is renamed over the archive once that mapping is gone.
+  SmallString<128> TmpArchive;
+  if (auto EC = sys::fs::createUniqueFile(ArcName + ".temp-archive-%%%%%%%.a",
+                                          TmpArchive))
+    return std::make_pair(ArcName, EC);
+
+  ErrorOr<std::unique_ptr<FileOutputBuffer>> OutOrErr =
+      FileOutputBuffer::create(TmpArchive, Pos);
+  if (auto EC = OutOrErr.getError()) {
+    sys::fs::remove(TmpArchive);
+    return std::make_pair(ArcName, EC);
+  }
+  FileOutputBuffer &Out = **OutOrErr;
+
+  uint8_t *Buf = std::copy(Head.begin(), Head.end(), Out.getBufferStart());
+  size_t HeaderStart = 0;
+  for (unsigned MemberNum = 0, N = NewMembers.size(); MemberNum < N;
+       ++MemberNum) {
+    size_t HeaderEnd = MemberHeaderEnds[MemberNum];
+    Buf = std::copy(MemberHeaders.begin() + HeaderStart,
+                    MemberHeaders.begin() + HeaderEnd, Buf);
+    HeaderStart = HeaderEnd;
+
+    if (!Thin) {
+      StringRef Contents = NewMembers[MemberNum].Buf->getBuffer();
+      Buf = std::copy(Contents.begin(), Contents.end(), Buf);
     }
+
+    if ((Buf - Out.getBufferStart()) % 2)
+      *Buf++ = '\n';
   }
+  assert(Buf == Out.getBufferEnd() && "Archive layout mismatch");
 
-  Output.keep();
-  Out.close();
+  if (auto EC = Out.commit()) {
+    sys::fs::remove(TmpArchive);
+    return std::make_pair(ArcName, EC);
+  }
 
   // At this point, we no longer need whatever backing memory
   // was used to generate the NewMembers. On Windows, this buffer
@@ -403,6 +493,9 @@ llvm::writeArchive(StringRef ArcName,
   // closed before we attempt to rename.
   OldArchiveBuf.reset();
 
-  sys::fs::rename(TmpArchive, ArcName);
+  if (auto EC = sys::fs::rename(TmpArchive, ArcName)) {
+    sys::fs::remove(TmpArchive);
+    return std::make_pair(ArcName, EC);
+  }
   return std::make_pair("", std::error_code());
 }
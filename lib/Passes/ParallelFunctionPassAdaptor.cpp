@@ -0,0 +1,97 @@
+//===- ParallelFunctionPassAdaptor.cpp - Function passes on threads -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Passes/ParallelFunctionPassAdaptor.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ThreadPool.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+/// The pipeline and analysis managers of one thread.
+struct Worker {
+  FunctionPassManager FPM;
+  // The function analysis manager clears the loop analysis manager through its
+  // proxy when it is destroyed, so it has to be destroyed first.
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  PreservedAnalyses PA = PreservedAnalyses::all();
+
+  Worker(FunctionPassManager FPM, bool DebugLogging)
+      : FPM(std::move(FPM)), LAM(DebugLogging), FAM(DebugLogging) {}
+};
+
+} // end anonymous namespace
+
+PreservedAnalyses ParallelFunctionPassAdaptor::run(Module &M,
+                                                   ModuleAnalysisManager &AM) {
+  std::vector<Function *> Functions;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+
+  // Results cached by the module's function analysis manager would go stale
+  // while the threads change the functions behind its back.
+  FunctionAnalysisManager &FAM =
+      AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  FAM.clear();
+
+  unsigned ThreadCount =
+      NumThreads ? NumThreads : std::thread::hardware_concurrency();
+  ThreadCount = std::max(1u, std::min<unsigned>(ThreadCount, Functions.size()));
+
+  std::vector<std::unique_ptr<Worker>> Workers;
+  for (unsigned I = 0; I != ThreadCount; ++I) {
+    Workers.push_back(llvm::make_unique<Worker>(BuildPipeline(), DebugLogging));
+    RegisterAnalyses(Workers.back()->FAM, Workers.back()->LAM, AM);
+  }
+
+  std::atomic<unsigned> NextFunction(0);
+  auto RunWorker = [&](Worker &W) {
+    for (unsigned I = NextFunction++; I < Functions.size();
+         I = NextFunction++) {
+      Function &F = *Functions[I];
+      PreservedAnalyses PassPA = W.FPM.run(F, W.FAM);
+      W.PA.intersect(W.FAM.invalidate(F, std::move(PassPA)));
+    }
+  };
+
+  if (ThreadCount == 1) {
+    RunWorker(*Workers.front());
+  } else {
+    LLVMContext &Context = M.getContext();
+    bool WasThreadSafe = Context.isThreadSafe();
+    Context.setThreadSafe(true);
+    {
+      ThreadPool Pool(ThreadCount);
+      for (auto &W : Workers) {
+        Worker *ThreadWorker = W.get();
+        Pool.async([&RunWorker, ThreadWorker] { RunWorker(*ThreadWorker); });
+      }
+      Pool.wait();
+    }
+    Context.setThreadSafe(WasThreadSafe);
+  }
+
+  PreservedAnalyses PA = PreservedAnalyses::all();
+  for (auto &W : Workers)
+    PA.intersect(std::move(W->PA));
+
+  // The module's function analysis manager was cleared above, so like
+  // ModuleToFunctionPassAdaptor, we can preserve its proxy.
+  PA.preserve<FunctionAnalysisManagerModuleProxy>();
+  return PA;
+}
@@ -52,6 +52,7 @@
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Passes/ParallelFunctionPassAdaptor.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Regex.h"
 #include "llvm/Target/TargetMachine.h"
@@ -312,6 +313,56 @@ static bool isLoopPassName(StringRef Name) {
   return false;
 }
 
+/// Whether a function pass is known not to read the use lists of constants
+/// and globals, which other functions may change while it runs in a
+/// \c ParallelFunctionPassAdaptor. InstCombine, for one, is not: it tests
+/// whether operands that may be constants have a single use.
+static bool isParallelSafeFunctionPassName(StringRef Name) {
+  return StringSwitch<bool>(Name)
+      .Cases("adce", "dce", "lower-expect", "mem2reg", "sroa", true)
+      .Cases("invalidate<all>", "no-op-function", "verify", true)
+      .Cases("require<assumptions>", "require<domtree>", "require<loops>",
+             "require<postdomtree>", "require<no-op-function>", true)
+      .Cases("invalidate<assumptions>", "invalidate<domtree>",
+             "invalidate<loops>", "invalidate<postdomtree>",
+             "invalidate<no-op-function>", true)
+      .Cases("verify<domtree>", "print<domtree>", "print<postdomtree>",
+             "print<loops>", true)
+      .Default(false);
+}
+
+static bool isParallelSafeLoopPassName(StringRef Name) {
+  return StringSwitch<bool>(Name)
+      .Cases("invalidate<all>", "no-op-loop", "require<no-op-loop>",
+             "invalidate<no-op-loop>", true)
+      .Default(false);
+}
+
+/// Whether every pass of an already parsed function pipeline is safe to run
+/// in a \c ParallelFunctionPassAdaptor.
+static bool isParallelSafeFunctionPipeline(StringRef PipelineText) {
+  // Whether the innermost pipeline around the current pass is a loop one.
+  SmallVector<bool, 4> InLoop(1, false);
+  while (!PipelineText.empty()) {
+    size_t End =
+        std::min(PipelineText.find_first_of(",()"), PipelineText.size());
+    StringRef Name = PipelineText.substr(0, End);
+    char Separator = End < PipelineText.size() ? PipelineText[End] : ',';
+    PipelineText = PipelineText.substr(End + 1);
+
+    if (Separator == '(') {
+      InLoop.push_back(InLoop.back() || Name == "loop");
+      continue;
+    }
+    if (!Name.empty() && !(InLoop.back() ? isParallelSafeLoopPassName(Name)
+                                         : isParallelSafeFunctionPassName(Name)))
+      return false;
+    if (Separator == ')')
+      InLoop.pop_back();
+  }
+  return true;
+}
+
 bool PassBuilder::parseModulePassName(ModulePassManager &MPM, StringRef Name,
                                       bool DebugLogging) {
   // Manually handle aliases for pre-configured pipeline fragments.
@@ -645,15 +696,19 @@ bool PassBuilder::parseModulePassPipeline(ModulePassManager &MPM,
 
       // Parse the inner pipeline inte the nested manager.
       PipelineText = PipelineText.substr(strlen("function("));
+      StringRef NestedText = PipelineText;
       if (!parseFunctionPassPipeline(NestedFPM, PipelineText, VerifyEachPass,
                                      DebugLogging) ||
           PipelineText.empty())
         return false;
       assert(PipelineText[0] == ')');
+      NestedText = NestedText.drop_back(PipelineText.size());
       PipelineText = PipelineText.substr(1);
 
       // Add the nested pass manager with the appropriate adaptor.
-      MPM.addPass(createModuleToFunctionPassAdaptor(std::move(NestedFPM)));
+      if (!addFunctionPipeline(MPM, std::move(NestedFPM), NestedText,
+                               VerifyEachPass, DebugLogging))
+        return false;
     } else {
       // Otherwise try to parse a pass name.
       size_t End = PipelineText.find_first_of(",)");
@@ -709,28 +764,86 @@ bool PassBuilder::parsePassPipeline(ModulePassManager &MPM,
   // a Function pipelien.
   if (PipelineText.startswith("function(") || isFunctionPassName(FirstName)) {
     FunctionPassManager FPM(DebugLogging);
+    StringRef FunctionText = PipelineText;
     if (!parseFunctionPassPipeline(FPM, PipelineText, VerifyEachPass,
                                    DebugLogging) ||
         !PipelineText.empty())
       return false;
-    MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
-    return true;
+    return addFunctionPipeline(MPM, std::move(FPM), FunctionText,
+                               VerifyEachPass, DebugLogging);
   }
 
   // If this looks like a Loop pass, parse the whole thing as a Loop pipeline.
   if (PipelineText.startswith("loop(") || isLoopPassName(FirstName)) {
     LoopPassManager LPM(DebugLogging);
+    std::string FunctionText = ("loop(" + PipelineText + ")").str();
     if (!parseLoopPassPipeline(LPM, PipelineText, VerifyEachPass,
                                DebugLogging) ||
         !PipelineText.empty())
       return false;
     FunctionPassManager FPM(DebugLogging);
     FPM.addPass(createFunctionToLoopPassAdaptor(std::move(LPM)));
+    return addFunctionPipeline(MPM, std::move(FPM), FunctionText,
+                               VerifyEachPass, DebugLogging);
+  }
+
+  return false;
+}
+
+void PassBuilder::setFunctionPassThreads(unsigned NumThreads,
+                                         StringRef AAPipeline) {
+  FunctionPassThreads = NumThreads;
+  FunctionPassThreadsAAPipeline = AAPipeline;
+}
+
+bool PassBuilder::addFunctionPipeline(ModulePassManager &MPM,
+                                      FunctionPassManager FPM,
+                                      StringRef PipelineText,
+                                      bool VerifyEachPass, bool DebugLogging) {
+  if (FunctionPassThreads == 1) {
     MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
     return true;
   }
 
-  return false;
+  // The adaptor doesn't guard reads of the use lists of constants and
+  // globals, so only accept the passes known not to make any.
+  if (!isParallelSafeFunctionPipeline(PipelineText))
+    return false;
+
+  // Passes keep state between the functions they run on, so each thread needs
+  // its own copy of the pipeline. Parse one from the text for each of them.
+  std::string Text = PipelineText;
+  auto BuildPipeline = [this, Text, VerifyEachPass, DebugLogging] {
+    FunctionPassManager FPM(DebugLogging);
+    StringRef Remaining = Text;
+    bool Parsed = parseFunctionPassPipeline(FPM, Remaining, VerifyEachPass,
+                                            DebugLogging);
+    assert(Parsed && Remaining.empty() && "Pipeline parsed once but not now");
+    (void)Parsed;
+    return FPM;
+  };
+
+  std::string AAPipeline = FunctionPassThreadsAAPipeline;
+  auto RegisterAnalyses = [this, AAPipeline](FunctionAnalysisManager &FAM,
+                                             LoopAnalysisManager &LAM,
+                                             ModuleAnalysisManager &MAM) {
+    // Register the AA manager first so that it is the one used.
+    AAManager AA;
+    bool Parsed = parseAAPipeline(AA, AAPipeline);
+    assert(Parsed && "Invalid AA pipeline");
+    (void)Parsed;
+    FAM.registerPass([&] { return std::move(AA); });
+
+    registerFunctionAnalyses(FAM);
+    registerLoopAnalyses(LAM);
+    FAM.registerPass([&] { return ModuleAnalysisManagerFunctionProxy(MAM); });
+    FAM.registerPass([&] { return LoopAnalysisManagerFunctionProxy(LAM); });
+    LAM.registerPass([&] { return FunctionAnalysisManagerLoopProxy(FAM); });
+  };
+
+  MPM.addPass(ParallelFunctionPassAdaptor(BuildPipeline, RegisterAnalyses,
+                                          FunctionPassThreads, DebugLogging));
+  return true;
 }
 
 bool PassBuilder::parseAAPipeline(AAManager &AA, StringRef PipelineText) {
@@ -16,6 +16,7 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/EndianStream.h"
 #include "llvm/Support/OnDiskHashTable.h"
+#include <algorithm>
 #include <tuple>
 
 using namespace llvm;
@@ -182,6 +183,20 @@ Error InstrProfWriter::addRecord(InstrProfRecord &&I, uint64_t Weight) {
   return Dest.takeError();
 }
 
+Error InstrProfWriter::mergeRecordsFromWriter(
+    InstrProfWriter &&IPW, function_ref<void(Error, StringRef)> Warn) {
+  if (IPW.ProfileKind != PF_Unknown)
+    if (Error E = setIsIRLevelProfile(IPW.ProfileKind == PF_IRLevel))
+      return E;
+
+  for (auto &I : IPW.FunctionData)
+    for (auto &Func : I.getValue())
+      if (Error E = addRecord(std::move(Func.second), 1))
+        Warn(std::move(E), I.getKey());
+  IPW.FunctionData.clear();
+  return Error::success();
+}
+
 bool InstrProfWriter::shouldEncodeData(const ProfilingData &PD) {
   if (!Sparse)
     return true;
@@ -194,6 +209,19 @@ bool InstrProfWriter::shouldEncodeData(const ProfilingData &PD) {
   return false;
 }
 
+void InstrProfWriter::getOrderedFunctionData(
+    std::vector<StringMapConstIterator<ProfilingData>> &Ordered) {
+  Ordered.reserve(FunctionData.size());
+  for (auto I = FunctionData.begin(), E = FunctionData.end(); I != E; ++I)
+    if (shouldEncodeData(I->getValue()))
+      Ordered.push_back(I);
+  std::sort(Ordered.begin(), Ordered.end(),
+            [](StringMapConstIterator<ProfilingData> A,
+               StringMapConstIterator<ProfilingData> B) {
+              return A->getKey() < B->getKey();
+            });
+}
+
 static void setSummary(IndexedInstrProf::Summary *TheSummary,
                        ProfileSummary &PS) {
   using namespace IndexedInstrProf;
@@ -218,9 +246,10 @@ void InstrProfWriter::writeImpl(ProfOStream &OS) {
   InfoObj->SummaryBuilder = &ISB;
 
   // Populate the hash table generator.
-  for (const auto &I : FunctionData)
-    if (shouldEncodeData(I.getValue()))
-      Generator.insert(I.getKey(), &I.getValue());
+  std::vector<StringMapConstIterator<ProfilingData>> OrderedFuncData;
+  getOrderedFunctionData(OrderedFuncData);
+  for (const auto &I : OrderedFuncData)
+    Generator.insert(I->getKey(), &I->getValue());
   // Write the header.
   IndexedInstrProf::Header Header;
   Header.Magic = IndexedInstrProf::Magic;
@@ -336,14 +365,15 @@ void InstrProfWriter::writeRecordInText(const InstrProfRecord &Func,
 void InstrProfWriter::writeText(raw_fd_ostream &OS) {
   if (ProfileKind == PF_IRLevel)
     OS << "# IR level Instrumentation Flag\n:ir\n";
+  std::vector<StringMapConstIterator<ProfilingData>> OrderedFuncData;
+  getOrderedFunctionData(OrderedFuncData);
+
   InstrProfSymtab Symtab;
-  for (const auto &I : FunctionData)
-    if (shouldEncodeData(I.getValue()))
-      Symtab.addFuncName(I.getKey());
+  for (const auto &I : OrderedFuncData)
+    Symtab.addFuncName(I->getKey());
   Symtab.finalizeSymtab();
 
-  for (const auto &I : FunctionData)
-    if (shouldEncodeData(I.getValue()))
-      for (const auto &Func : I.getValue())
-        writeRecordInText(Func.second, Symtab, OS);
+  for (const auto &I : OrderedFuncData)
+    for (const auto &Func : I->getValue())
+      writeRecordInText(Func.second, Symtab, OS);
 }
@@ -13,6 +13,7 @@
 
 #include "llvm/Support/CachePruning.h"
 
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/FileSystem.h"
@@ -22,9 +23,13 @@
 #define DEBUG_TYPE "cache-pruning"
 
 #include <set>
+#include <tuple>
 
 using namespace llvm;
 
+STATISTIC(NumExpiredFiles, "Number of cache files pruned for expiration");
+STATISTIC(NumEvictedFiles, "Number of cache files pruned to fit the size limit");
+
 /// Write a new timestamp file with the given path. This is used for the pruning
 /// interval option.
 static void writeTimestampFile(StringRef TimestampFile) {
@@ -44,7 +49,7 @@ bool CachePruning::prune() {
   if (!isPathDir)
     return false;
 
-  if (Expiration == 0 && PercentageOfAvailableSpace == 0) {
+  if (Expiration == 0 && PercentageOfAvailableSpace == 0 && MaxSizeBytes == 0) {
     DEBUG(dbgs() << "No pruning settings set, exit early\n");
     // Nothing will be pruned, early exit
     return false;
@@ -82,20 +87,22 @@ bool CachePruning::prune() {
     writeTimestampFile(TimestampFile);
   }
 
-  bool ShouldComputeSize = (PercentageOfAvailableSpace > 0);
+  bool ShouldComputeSize = (PercentageOfAvailableSpace > 0 || MaxSizeBytes > 0);
 
-  // Keep track of space
-  std::set<std::pair<uint64_t, std::string>> FileSizes;
+  // Keep track of space. Files are ordered by access time so that the least
+  // recently used ones are pruned first.
+  std::set<std::tuple<sys::TimeValue, uint64_t, std::string>> FileAccessTimes;
   uint64_t TotalSize = 0;
   // Helper to add a path to the set of files to consider for size-based
-  // pruning, sorted by size.
+  // pruning, sorted by last access time.
   auto AddToFileListForSizePruning =
       [&](StringRef Path) {
         if (!ShouldComputeSize)
           return;
         TotalSize += FileStatus.getSize();
-        FileSizes.insert(
-            std::make_pair(FileStatus.getSize(), std::string(Path)));
+        FileAccessTimes.insert(std::make_tuple(
+            FileStatus.getLastAccessedTime(), FileStatus.getSize(),
+            std::string(Path)));
       };
 
   // Walk the entire directory cache, looking for unused files.
@@ -120,10 +127,11 @@ bool CachePruning::prune() {
     // If the file hasn't been used recently enough, delete it
     sys::TimeValue FileAccessTime = FileStatus.getLastAccessedTime();
     auto FileAge = CurrentTime - FileAccessTime;
-    if (FileAge > TimeExpiration) {
+    if (Expiration && FileAge > TimeExpiration) {
       DEBUG(dbgs() << "Remove " << File->path() << " (" << FileAge.seconds()
                    << "s old)\n");
       sys::fs::remove(File->path());
+      ++NumExpiredFiles;
       continue;
     }
 
@@ -133,26 +141,32 @@ bool CachePruning::prune() {
 
   // Prune for size now if needed
   if (ShouldComputeSize) {
-    auto ErrOrSpaceInfo = sys::fs::disk_space(Path);
-    if (!ErrOrSpaceInfo) {
-      report_fatal_error("Can't get available size");
+    uint64_t MaxSize = MaxSizeBytes ? MaxSizeBytes : UINT64_MAX;
+    if (PercentageOfAvailableSpace) {
+      auto ErrOrSpaceInfo = sys::fs::disk_space(Path);
+      if (!ErrOrSpaceInfo) {
+        report_fatal_error("Can't get available size");
+      }
+      sys::fs::space_info SpaceInfo = ErrOrSpaceInfo.get();
+      auto AvailableSpace = TotalSize + SpaceInfo.free;
+      MaxSize = std::min(MaxSize,
+                         AvailableSpace / 100 * PercentageOfAvailableSpace);
     }
-    sys::fs::space_info SpaceInfo = ErrOrSpaceInfo.get();
-    auto AvailableSpace = TotalSize + SpaceInfo.free;
-    auto FileAndSize = FileSizes.rbegin();
-    DEBUG(dbgs() << "Occupancy: " << ((100 * TotalSize) / AvailableSpace)
-                 << "% target is: " << PercentageOfAvailableSpace << "\n");
+    DEBUG(dbgs() << "Occupancy: " << TotalSize << " bytes, target is: "
+                 << MaxSize << " bytes\n");
     // Remove the oldest accessed files first, till we get below the threshold
-    while (((100 * TotalSize) / AvailableSpace) > PercentageOfAvailableSpace &&
-           FileAndSize != FileSizes.rend()) {
+    auto FileAndTime = FileAccessTimes.begin();
+    while (TotalSize > MaxSize && FileAndTime != FileAccessTimes.end()) {
+      uint64_t FileSize = std::get<1>(*FileAndTime);
+      const std::string &FilePath = std::get<2>(*FileAndTime);
       // Remove the file.
-      sys::fs::remove(FileAndSize->second);
+      sys::fs::remove(FilePath);
+      ++NumEvictedFiles;
       // Update size
-      TotalSize -= FileAndSize->first;
-      DEBUG(dbgs() << " - Remove " << FileAndSize->second << " (size "
-                   << FileAndSize->first << "), new occupancy is " << TotalSize
-                   << "%\n");
-      ++FileAndSize;
+      TotalSize -= FileSize;
+      DEBUG(dbgs() << " - Remove " << FilePath << " (size " << FileSize
+                   << "), new occupancy is " << TotalSize << " bytes\n");
+      ++FileAndTime;
     }
   }
   return true;
@@ -16,7 +16,11 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Config/config.h"
 #include "llvm/Support/Compiler.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/ThreadPool.h"
+#include <algorithm>
+#include <vector>
 #if LLVM_ENABLE_ZLIB == 1 && HAVE_ZLIB_H
 #include <zlib.h>
 #endif
@@ -62,6 +66,122 @@ zlib::Status zlib::compress(StringRef InputBuffer,
   return Res;
 }
 
+/// Deflate \p Block into a raw deflate stream, priming the compressor with
+/// \p Dictionary. The output ends with the final block if \p Last is set,
+/// and on a byte boundary otherwise.
+static int deflateBlock(StringRef Block, StringRef Dictionary, bool Last,
+                        int CLevel, SmallVectorImpl<char> &Output) {
+  z_stream Stream;
+  Stream.zalloc = Z_NULL;
+  Stream.zfree = Z_NULL;
+  Stream.opaque = Z_NULL;
+  int Res = ::deflateInit2(&Stream, CLevel, Z_DEFLATED, -MAX_WBITS, 8,
+                           Z_DEFAULT_STRATEGY);
+  if (Res != Z_OK)
+    return Res;
+  if (!Dictionary.empty())
+    Res = ::deflateSetDictionary(&Stream, (const Bytef *)Dictionary.data(),
+                                 Dictionary.size());
+
+  // deflateBound does not account for the empty stored block ending a sync
+  // flush, so leave some room for it and grow the buffer if that is not
+  // enough.
+  Output.resize(::deflateBound(&Stream, Block.size()) + 16);
+  Stream.next_in = (Bytef *)Block.data();
+  Stream.avail_in = Block.size();
+  size_t Size = 0;
+  while (Res == Z_OK) {
+    if (Size == Output.size())
+      Output.resize(Output.size() * 2);
+    Stream.next_out = (Bytef *)Output.data() + Size;
+    Stream.avail_out = Output.size() - Size;
+    Res = ::deflate(&Stream, Last ? Z_FINISH : Z_SYNC_FLUSH);
+    Size = Output.size() - Stream.avail_out;
+    if (!Last && Res == Z_OK && Stream.avail_out)
+      break;
+  }
+  if (Res == Z_STREAM_END)
+    Res = Z_OK;
+  ::deflateEnd(&Stream);
+
+  // Tell MemorySanitizer that zlib output buffer is fully initialized.
+  // This avoids a false report when running LLVM with uninstrumented ZLib.
+  __msan_unpoison(Output.data(), Size);
+  Output.resize(Size);
+  return Res;
+}
+
+zlib::Status zlib::compressParallel(StringRef InputBuffer,
+                                    SmallVectorImpl<char> &CompressedBuffer,
+                                    ThreadPool *Pool,
+                                    CompressionLevel Level) {
+  // Blocks are compressed independently, with the last 32K of the previous
+  // block as their dictionary, which is the size of the deflate window.
+  const size_t BlockSize = 128 * 1024;
+  const size_t DictionarySize = 32 * 1024;
+  if (InputBuffer.size() <= BlockSize)
+    return compress(InputBuffer, CompressedBuffer, Level);
+
+  int CLevel = encodeZlibCompressionLevel(Level);
+  size_t NumBlocks = (InputBuffer.size() + BlockSize - 1) / BlockSize;
+  std::vector<SmallVector<char, 0>> Blocks(NumBlocks);
+  std::vector<uLong> Checksums(NumBlocks);
+  std::vector<int> Results(NumBlocks);
+  auto CompressBlock = [&](size_t I) {
+    size_t Start = I * BlockSize;
+    StringRef Block = InputBuffer.substr(Start, BlockSize);
+    StringRef Dictionary =
+        InputBuffer.slice(Start - std::min(Start, DictionarySize), Start);
+    Checksums[I] = ::adler32(::adler32(0, Z_NULL, 0),
+                             (const Bytef *)Block.data(), Block.size());
+    Results[I] = deflateBlock(Block, Dictionary, I + 1 == NumBlocks, CLevel,
+                              Blocks[I]);
+  };
+  if (Pool) {
+    TaskGroup Group(*Pool);
+    for (size_t I = 0; I != NumBlocks; ++I)
+      Group.async([&CompressBlock, I] { CompressBlock(I); });
+    Group.wait();
+  } else {
+    for (size_t I = 0; I != NumBlocks; ++I)
+      CompressBlock(I);
+  }
+  for (int Res : Results)
+    if (Res != Z_OK)
+      return encodeZlibReturnValue(Res);
+
+  // The zlib header: a 32K window and the level, as deflateInit would write.
+  int EffectiveLevel = CLevel == Z_DEFAULT_COMPRESSION ? 6 : CLevel;
+  unsigned LevelFlags;
+  if (EffectiveLevel < 2)
+    LevelFlags = 0;
+  else if (EffectiveLevel < 6)
+    LevelFlags = 1;
+  else if (EffectiveLevel == 6)
+    LevelFlags = 2;
+  else
+    LevelFlags = 3;
+  unsigned Header = (Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8;
+  Header |= LevelFlags << 6;
+  Header += 31 - Header % 31;
+
+  CompressedBuffer.clear();
+  CompressedBuffer.push_back(Header >> 8);
+  CompressedBuffer.push_back(Header & 0xff);
+  uLong Checksum = Checksums[0];
+  for (size_t I = 0; I != NumBlocks; ++I) {
+    CompressedBuffer.append(Blocks[I].begin(), Blocks[I].end());
+    if (I)
+      Checksum = ::adler32_combine(
+          Checksum, Checksums[I],
+          std::min(BlockSize, InputBuffer.size() - I * BlockSize));
+  }
+  char Trailer[4];
+  support::endian::write32be(Trailer, Checksum);
+  CompressedBuffer.append(Trailer, Trailer + 4);
+  return StatusOK;
+}
+
 zlib::Status zlib::uncompress(StringRef InputBuffer,
                               SmallVectorImpl<char> &UncompressedBuffer,
                               size_t UncompressedSize) {
@@ -87,6 +207,12 @@ zlib::Status zlib::compress(StringRef InputBuffer,
                             CompressionLevel Level) {
   return zlib::StatusUnsupported;
 }
+zlib::Status zlib::compressParallel(StringRef InputBuffer,
+                                    SmallVectorImpl<char> &CompressedBuffer,
+                                    ThreadPool *Pool,
+                                    CompressionLevel Level) {
+  return zlib::StatusUnsupported;
+}
 zlib::Status zlib::uncompress(StringRef InputBuffer,
                               SmallVectorImpl<char> &UncompressedBuffer,
                               size_t UncompressedSize) {
@@ -13,6 +13,8 @@
 
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
 using namespace llvm;
 
 /// StrInStrNoCase - Portable version of strcasestr.  Locates the first
@@ -56,3 +58,18 @@ void llvm::SplitString(StringRef Source,
     S = getToken(S.second, Delimiters);
   }
 }
+
+/// PrintJSONString - Print the specified string to \p Out as a quoted JSON
+/// string, escaping quotes, backslashes and control characters.
+void llvm::PrintJSONString(StringRef Str, raw_ostream &Out) {
+  Out << '"';
+  for (unsigned char C : Str) {
+    if (C == '"' || C == '\\')
+      Out << '\\' << C;
+    else if (C < 0x20)
+      Out << format("\\u%04x", C);
+    else
+      Out << C;
+  }
+  Out << '"';
+}
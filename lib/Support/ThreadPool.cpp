@@ -7,105 +7,200 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file implements a crude C++11 based thread pool.
+// This file implements a C++11 based work-stealing thread pool.
 //
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Support/ThreadPool.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Compiler.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+
 using namespace llvm;
 
+bool ThreadPool::tryPop(WorkQueue &Queue, bool Owner, PackagedTaskTy &Task) {
+  std::unique_lock<std::mutex> LockGuard(Queue.Lock);
+  if (Queue.Tasks.empty())
+    return false;
+  if (Owner) {
+    Task = std::move(Queue.Tasks.back());
+    Queue.Tasks.pop_back();
+  } else {
+    Task = std::move(Queue.Tasks.front());
+    Queue.Tasks.pop_front();
+  }
+  --QueuedTasks;
+  return true;
+}
+
+bool ThreadPool::runQueuedTask() {
+  PackagedTaskTy Task;
+  int Self = getCurrentWorkerIndex();
+  bool Found = Self >= 0 && tryPop(*Queues[Self], /*Owner=*/true, Task);
+
+  // Nothing left in our own queue: try to steal from the other queues,
+  // starting with the one following ours.
+  unsigned NumQueues = Queues.size();
+  unsigned Start = Self >= 0 ? Self + 1 : 0;
+  for (unsigned I = 0; !Found && I < NumQueues; ++I) {
+    unsigned Victim = (Start + I) % NumQueues;
+    if (int(Victim) != Self)
+      Found = tryPop(*Queues[Victim], /*Owner=*/false, Task);
+  }
+  if (!Found)
+    return false;
+
+  // Run the task we just grabbed
+#ifndef _MSC_VER
+  Task();
+#else
+  Task(/* unused */ false);
+#endif
+
+  // Notify task completion, in case someone waits on ThreadPool::wait()
+  if (--OutstandingTasks == 0) {
+    std::unique_lock<std::mutex> LockGuard(CompletionLock);
+    CompletionCondition.notify_all();
+  }
+  return true;
+}
+
+void TaskGroup::asyncImpl(std::function<void()> F) {
+  ++PendingTasks;
+  auto Run = [this, F]() {
+    F();
+    // The group may be destroyed as soon as PendingTasks drops to zero, only
+    // touch the pool past that point.
+    ThreadPool &P = Pool;
+    if (--PendingTasks == 0) {
+      std::unique_lock<std::mutex> LockGuard(P.WakeLock);
+      P.WakeCondition.notify_all();
+      P.GroupCondition.notify_all();
+    }
+  };
+#ifndef _MSC_VER
+  Pool.enqueue(ThreadPool::PackagedTaskTy(std::move(Run)));
+#else
+  Pool.enqueue(ThreadPool::PackagedTaskTy([Run](bool) -> bool {
+    Run();
+    return false;
+  }));
+#endif
+}
+
+void TaskGroup::wait() {
+  // Workers run queued tasks instead of blocking: the tasks of this group may
+  // be sitting in the queue of the calling worker, and every other worker may
+  // be waiting on a group as well. Other threads just block, unless there is
+  // no worker to run the tasks at all.
+  bool Help = Pool.getCurrentWorkerIndex() >= 0 || Pool.Threads.empty();
+  while (PendingTasks) {
+    if (Help && Pool.runQueuedTask())
+      continue;
+    std::unique_lock<std::mutex> LockGuard(Pool.WakeLock);
+    if (Help)
+      Pool.WakeCondition.wait(
+          LockGuard, [&] { return !PendingTasks || Pool.QueuedTasks; });
+    else
+      Pool.GroupCondition.wait(LockGuard, [&] { return !PendingTasks; });
+  }
+}
+
 #if LLVM_ENABLE_THREADS
 
+// The pool the calling thread is a worker of, if any, and the index of the
+// queue it owns in that pool.
+static LLVM_THREAD_LOCAL const ThreadPool *CurrentPool = nullptr;
+static LLVM_THREAD_LOCAL unsigned CurrentWorker = 0;
+
 // Default to std::thread::hardware_concurrency
 ThreadPool::ThreadPool() : ThreadPool(std::thread::hardware_concurrency()) {}
 
 ThreadPool::ThreadPool(unsigned ThreadCount)
-    : ActiveThreads(0), EnableFlag(true) {
-  // Create ThreadCount threads that will loop forever, wait on QueueCondition
-  // for tasks to be queued or the Pool to be destroyed.
+    : NextQueue(0), QueuedTasks(0), OutstandingTasks(0), EnableFlag(true) {
+  unsigned NumQueues = std::max(1U, ThreadCount);
+  Queues.reserve(NumQueues);
+  for (unsigned I = 0; I < NumQueues; ++I)
+    Queues.push_back(llvm::make_unique<WorkQueue>());
+
+  // Create ThreadCount threads that will loop forever, running or stealing
+  // tasks when there are some, and otherwise waiting on WakeCondition for
+  // tasks to be queued or the Pool to be destroyed.
   Threads.reserve(ThreadCount);
   for (unsigned ThreadID = 0; ThreadID < ThreadCount; ++ThreadID) {
-    Threads.emplace_back([&] {
+    Threads.emplace_back([this, ThreadID] {
+      CurrentPool = this;
+      CurrentWorker = ThreadID;
       while (true) {
-        PackagedTaskTy Task;
-        {
-          std::unique_lock<std::mutex> LockGuard(QueueLock);
-          // Wait for tasks to be pushed in the queue
-          QueueCondition.wait(LockGuard,
-                              [&] { return !EnableFlag || !Tasks.empty(); });
-          // Exit condition
-          if (!EnableFlag && Tasks.empty())
-            return;
-          // Yeah, we have a task, grab it and release the lock on the queue
-
-          // We first need to signal that we are active before popping the queue
-          // in order for wait() to properly detect that even if the queue is
-          // empty, there is still a task in flight.
-          {
-            ++ActiveThreads;
-            std::unique_lock<std::mutex> LockGuard(CompletionLock);
-          }
-          Task = std::move(Tasks.front());
-          Tasks.pop();
-        }
-        // Run the task we just grabbed
-#ifndef _MSC_VER
-        Task();
-#else
-        Task(/* unused */ false);
-#endif
-
-        {
-          // Adjust `ActiveThreads`, in case someone waits on ThreadPool::wait()
-          std::unique_lock<std::mutex> LockGuard(CompletionLock);
-          --ActiveThreads;
-        }
-
-        // Notify task completion, in case someone waits on ThreadPool::wait()
-        CompletionCondition.notify_all();
+        if (runQueuedTask())
+          continue;
+        std::unique_lock<std::mutex> LockGuard(WakeLock);
+        // Wait for tasks to be pushed in a queue
+        WakeCondition.wait(LockGuard,
+                           [&] { return !EnableFlag || QueuedTasks; });
+        // Exit condition
+        if (!EnableFlag && !QueuedTasks)
+          return;
       }
     });
   }
 }
 
+int ThreadPool::getCurrentWorkerIndex() const {
+  return CurrentPool == this ? int(CurrentWorker) : -1;
+}
+
 void ThreadPool::wait() {
-  // Wait for all threads to complete and the queue to be empty
+  assert(getCurrentWorkerIndex() < 0 &&
+         "ThreadPool::wait() called from a task, use a TaskGroup instead");
+  // Wait for all tasks to complete and the queues to be empty
   std::unique_lock<std::mutex> LockGuard(CompletionLock);
-  // The order of the checks for ActiveThreads and Tasks.empty() matters because
-  // any active threads might be modifying the Tasks queue, and this would be a
-  // race.
-  CompletionCondition.wait(LockGuard,
-                           [&] { return !ActiveThreads && Tasks.empty(); });
+  CompletionCondition.wait(LockGuard, [&] { return !OutstandingTasks; });
 }
 
-std::shared_future<ThreadPool::VoidTy> ThreadPool::asyncImpl(TaskTy Task) {
-  /// Wrap the Task in a packaged_task to return a future object.
-  PackagedTaskTy PackagedTask(std::move(Task));
-  auto Future = PackagedTask.get_future();
+void ThreadPool::enqueue(PackagedTaskTy Task) {
+  int Index = getCurrentWorkerIndex();
+  if (Index < 0)
+    Index = NextQueue++ % Queues.size();
+
+  // Count the task before pushing it, so that it is never seen running
+  // before being accounted for.
+  ++OutstandingTasks;
+  ++QueuedTasks;
+  {
+    WorkQueue &Queue = *Queues[Index];
+    std::unique_lock<std::mutex> LockGuard(Queue.Lock);
+    Queue.Tasks.push_back(std::move(Task));
+  }
   {
-    // Lock the queue and push the new task
-    std::unique_lock<std::mutex> LockGuard(QueueLock);
+    // Synchronize with the threads checking QueuedTasks before going to sleep
+    std::unique_lock<std::mutex> LockGuard(WakeLock);
 
     // Don't allow enqueueing after disabling the pool
     assert(EnableFlag && "Queuing a thread during ThreadPool destruction");
-
-    Tasks.push(std::move(PackagedTask));
   }
-  QueueCondition.notify_one();
+  WakeCondition.notify_one();
+}
+
+std::shared_future<ThreadPool::VoidTy> ThreadPool::asyncImpl(TaskTy Task) {
+  /// Wrap the Task in a packaged_task to return a future object.
+  PackagedTaskTy PackagedTask(std::move(Task));
+  auto Future = PackagedTask.get_future();
+  enqueue(std::move(PackagedTask));
   return Future.share();
 }
 
 // The destructor joins all threads, waiting for completion.
 ThreadPool::~ThreadPool() {
   {
-    std::unique_lock<std::mutex> LockGuard(QueueLock);
+    std::unique_lock<std::mutex> LockGuard(WakeLock);
     EnableFlag = false;
   }
-  QueueCondition.notify_all();
+  WakeCondition.notify_all();
   for (auto &Worker : Threads)
     Worker.join();
 }
@@ -116,24 +211,26 @@ ThreadPool::ThreadPool() : ThreadPool(0) {}
 
 // No threads are launched, issue a warning if ThreadCount is not 0
 ThreadPool::ThreadPool(unsigned ThreadCount)
-    : ActiveThreads(0) {
+    : NextQueue(0), QueuedTasks(0), OutstandingTasks(0) {
+  Queues.push_back(llvm::make_unique<WorkQueue>());
   if (ThreadCount) {
     errs() << "Warning: request a ThreadPool with " << ThreadCount
            << " threads, but LLVM_ENABLE_THREADS has been turned off\n";
   }
 }
 
+int ThreadPool::getCurrentWorkerIndex() const { return -1; }
+
 void ThreadPool::wait() {
   // Sequential implementation running the tasks
-  while (!Tasks.empty()) {
-    auto Task = std::move(Tasks.front());
-    Tasks.pop();
-#ifndef _MSC_VER
-        Task();
-#else
-        Task(/* unused */ false);
-#endif
-  }
+  while (runQueuedTask())
+    ;
+}
+
+void ThreadPool::enqueue(PackagedTaskTy Task) {
+  ++OutstandingTasks;
+  ++QueuedTasks;
+  Queues[0]->Tasks.push_back(std::move(Task));
 }
 
 std::shared_future<ThreadPool::VoidTy> ThreadPool::asyncImpl(TaskTy Task) {
@@ -147,7 +244,7 @@ std::shared_future<ThreadPool::VoidTy> ThreadPool::asyncImpl(TaskTy Task) {
   auto Future = std::async(std::launch::deferred, std::move(Task), false).share();
   PackagedTaskTy PackagedTask([Future](bool) -> bool { Future.get(); return false; });
 #endif
-  Tasks.push(std::move(PackagedTask));
+  enqueue(std::move(PackagedTask));
   return Future;
 }
 
@@ -714,6 +714,24 @@ Value *llvm::castToCStr(Value *V, IRBuilder<> &B) {
   return B.CreateBitCast(V, B.getInt8PtrTy(AS), "cstr");
 }
 
+/// Get or insert the declaration of the library function \p Name, of the type
+/// given by \p Args, and infer its attributes with \p TLI unless it is null.
+///
+/// While function passes run on several functions at once (see
+/// LLVMContext::setThreadSafe), the attributes of declarations are read
+/// without a lock. So a declaration the module already had is left alone, and
+/// a new one gets its attributes before the other threads can look it up.
+template <typename... ArgsTy>
+static Constant *getOrInsertLibFunc(Module *M, const TargetLibraryInfo *TLI,
+                                    StringRef Name, ArgsTy... Args) {
+  LLVMContext::SharedStateLock Lock(M->getContext());
+  bool IsNew = !M->getFunction(Name);
+  Constant *C = M->getOrInsertFunction(Name, Args...);
+  if (TLI && (IsNew || !M->getContext().isThreadSafe()))
+    inferLibFuncAttributes(*M->getFunction(Name), *TLI);
+  return C;
+}
+
 Value *llvm::emitStrLen(Value *Ptr, IRBuilder<> &B, const DataLayout &DL,
                         const TargetLibraryInfo *TLI) {
   if (!TLI->has(LibFunc::strlen))
@@ -721,9 +739,8 @@ Value *llvm::emitStrLen(Value *Ptr, IRBuilder<> &B, const DataLayout &DL,
 
   Module *M = B.GetInsertBlock()->getModule();
   LLVMContext &Context = B.GetInsertBlock()->getContext();
-  Constant *StrLen = M->getOrInsertFunction("strlen", DL.getIntPtrType(Context),
-                                            B.getInt8PtrTy(), nullptr);
-  inferLibFuncAttributes(*M->getFunction("strlen"), *TLI);
+  Constant *StrLen = getOrInsertLibFunc(
+      M, TLI, "strlen", DL.getIntPtrType(Context), B.getInt8PtrTy(), nullptr);
   CallInst *CI = B.CreateCall(StrLen, castToCStr(Ptr, B), "strlen");
   if (const Function *F = dyn_cast<Function>(StrLen->stripPointerCasts()))
     CI->setCallingConv(F->getCallingConv());
@@ -740,8 +757,7 @@ Value *llvm::emitStrChr(Value *Ptr, char C, IRBuilder<> &B,
   Type *I8Ptr = B.getInt8PtrTy();
   Type *I32Ty = B.getInt32Ty();
   Constant *StrChr =
-      M->getOrInsertFunction("strchr", I8Ptr, I8Ptr, I32Ty, nullptr);
-  inferLibFuncAttributes(*M->getFunction("strchr"), *TLI);
+      getOrInsertLibFunc(M, TLI, "strchr", I8Ptr, I8Ptr, I32Ty, nullptr);
   CallInst *CI = B.CreateCall(
       StrChr, {castToCStr(Ptr, B), ConstantInt::get(I32Ty, C)}, "strchr");
   if (const Function *F = dyn_cast<Function>(StrChr->stripPointerCasts()))
@@ -756,10 +772,9 @@ Value *llvm::emitStrNCmp(Value *Ptr1, Value *Ptr2, Value *Len, IRBuilder<> &B,
 
   Module *M = B.GetInsertBlock()->getModule();
   LLVMContext &Context = B.GetInsertBlock()->getContext();
-  Value *StrNCmp = M->getOrInsertFunction("strncmp", B.getInt32Ty(),
-                                          B.getInt8PtrTy(), B.getInt8PtrTy(),
-                                          DL.getIntPtrType(Context), nullptr);
-  inferLibFuncAttributes(*M->getFunction("strncmp"), *TLI);
+  Value *StrNCmp = getOrInsertLibFunc(M, TLI, "strncmp", B.getInt32Ty(),
+                                      B.getInt8PtrTy(), B.getInt8PtrTy(),
+                                      DL.getIntPtrType(Context), nullptr);
   CallInst *CI = B.CreateCall(
       StrNCmp, {castToCStr(Ptr1, B), castToCStr(Ptr2, B), Len}, "strncmp");
 
@@ -776,8 +791,8 @@ Value *llvm::emitStrCpy(Value *Dst, Value *Src, IRBuilder<> &B,
 
   Module *M = B.GetInsertBlock()->getModule();
   Type *I8Ptr = B.getInt8PtrTy();
-  Value *StrCpy = M->getOrInsertFunction(Name, I8Ptr, I8Ptr, I8Ptr, nullptr);
-  inferLibFuncAttributes(*M->getFunction(Name), *TLI);
+  Value *StrCpy =
+      getOrInsertLibFunc(M, TLI, Name, I8Ptr, I8Ptr, I8Ptr, nullptr);
   CallInst *CI =
       B.CreateCall(StrCpy, {castToCStr(Dst, B), castToCStr(Src, B)}, Name);
   if (const Function *F = dyn_cast<Function>(StrCpy->stripPointerCasts()))
@@ -792,9 +807,8 @@ Value *llvm::emitStrNCpy(Value *Dst, Value *Src, Value *Len, IRBuilder<> &B,
 
   Module *M = B.GetInsertBlock()->getModule();
   Type *I8Ptr = B.getInt8PtrTy();
-  Value *StrNCpy = M->getOrInsertFunction(Name, I8Ptr, I8Ptr, I8Ptr,
-                                          Len->getType(), nullptr);
-  inferLibFuncAttributes(*M->getFunction(Name), *TLI);
+  Value *StrNCpy = getOrInsertLibFunc(M, TLI, Name, I8Ptr, I8Ptr, I8Ptr,
+                                      Len->getType(), nullptr);
   CallInst *CI = B.CreateCall(
       StrNCpy, {castToCStr(Dst, B), castToCStr(Src, B), Len}, "strncpy");
   if (const Function *F = dyn_cast<Function>(StrNCpy->stripPointerCasts()))
@@ -832,10 +846,9 @@ Value *llvm::emitMemChr(Value *Ptr, Value *Val, Value *Len, IRBuilder<> &B,
 
   Module *M = B.GetInsertBlock()->getModule();
   LLVMContext &Context = B.GetInsertBlock()->getContext();
-  Value *MemChr = M->getOrInsertFunction("memchr", B.getInt8PtrTy(),
-                                         B.getInt8PtrTy(), B.getInt32Ty(),
-                                         DL.getIntPtrType(Context), nullptr);
-  inferLibFuncAttributes(*M->getFunction("memchr"), *TLI);
+  Value *MemChr = getOrInsertLibFunc(M, TLI, "memchr", B.getInt8PtrTy(),
+                                     B.getInt8PtrTy(), B.getInt32Ty(),
+                                     DL.getIntPtrType(Context), nullptr);
   CallInst *CI = B.CreateCall(MemChr, {castToCStr(Ptr, B), Val, Len}, "memchr");
 
   if (const Function *F = dyn_cast<Function>(MemChr->stripPointerCasts()))
@@ -851,10 +864,9 @@ Value *llvm::emitMemCmp(Value *Ptr1, Value *Ptr2, Value *Len, IRBuilder<> &B,
 
   Module *M = B.GetInsertBlock()->getModule();
   LLVMContext &Context = B.GetInsertBlock()->getContext();
-  Value *MemCmp = M->getOrInsertFunction("memcmp", B.getInt32Ty(),
-                                         B.getInt8PtrTy(), B.getInt8PtrTy(),
-                                         DL.getIntPtrType(Context), nullptr);
-  inferLibFuncAttributes(*M->getFunction("memcmp"), *TLI);
+  Value *MemCmp = getOrInsertLibFunc(M, TLI, "memcmp", B.getInt32Ty(),
+                                     B.getInt8PtrTy(), B.getInt8PtrTy(),
+                                     DL.getIntPtrType(Context), nullptr);
   CallInst *CI = B.CreateCall(
       MemCmp, {castToCStr(Ptr1, B), castToCStr(Ptr2, B), Len}, "memcmp");
 
@@ -937,9 +949,8 @@ Value *llvm::emitPutS(Value *Str, IRBuilder<> &B,
     return nullptr;
 
   Module *M = B.GetInsertBlock()->getModule();
-  Value *PutS =
-      M->getOrInsertFunction("puts", B.getInt32Ty(), B.getInt8PtrTy(), nullptr);
-  inferLibFuncAttributes(*M->getFunction("puts"), *TLI);
+  Value *PutS = getOrInsertLibFunc(M, TLI, "puts", B.getInt32Ty(),
+                                   B.getInt8PtrTy(), nullptr);
   CallInst *CI = B.CreateCall(PutS, castToCStr(Str, B), "puts");
   if (const Function *F = dyn_cast<Function>(PutS->stripPointerCasts()))
     CI->setCallingConv(F->getCallingConv());
@@ -952,10 +963,10 @@ Value *llvm::emitFPutC(Value *Char, Value *File, IRBuilder<> &B,
     return nullptr;
 
   Module *M = B.GetInsertBlock()->getModule();
-  Constant *F = M->getOrInsertFunction("fputc", B.getInt32Ty(), B.getInt32Ty(),
-                                       File->getType(), nullptr);
-  if (File->getType()->isPointerTy())
-    inferLibFuncAttributes(*M->getFunction("fputc"), *TLI);
+  const TargetLibraryInfo *AttrTLI =
+      File->getType()->isPointerTy() ? TLI : nullptr;
+  Constant *F = getOrInsertLibFunc(M, AttrTLI, "fputc", B.getInt32Ty(),
+                                   B.getInt32Ty(), File->getType(), nullptr);
   Char = B.CreateIntCast(Char, B.getInt32Ty(), /*isSigned*/true,
                          "chari");
   CallInst *CI = B.CreateCall(F, {Char, File}, "fputc");
@@ -972,10 +983,11 @@ Value *llvm::emitFPutS(Value *Str, Value *File, IRBuilder<> &B,
 
   Module *M = B.GetInsertBlock()->getModule();
   StringRef FPutsName = TLI->getName(LibFunc::fputs);
-  Constant *F = M->getOrInsertFunction(
-      FPutsName, B.getInt32Ty(), B.getInt8PtrTy(), File->getType(), nullptr);
-  if (File->getType()->isPointerTy())
-    inferLibFuncAttributes(*M->getFunction(FPutsName), *TLI);
+  const TargetLibraryInfo *AttrTLI =
+      File->getType()->isPointerTy() ? TLI : nullptr;
+  Constant *F =
+      getOrInsertLibFunc(M, AttrTLI, FPutsName, B.getInt32Ty(),
+                         B.getInt8PtrTy(), File->getType(), nullptr);
   CallInst *CI = B.CreateCall(F, {castToCStr(Str, B), File}, "fputs");
 
   if (const Function *Fn = dyn_cast<Function>(F->stripPointerCasts()))
@@ -991,12 +1003,12 @@ Value *llvm::emitFWrite(Value *Ptr, Value *Size, Value *File, IRBuilder<> &B,
   Module *M = B.GetInsertBlock()->getModule();
   LLVMContext &Context = B.GetInsertBlock()->getContext();
   StringRef FWriteName = TLI->getName(LibFunc::fwrite);
-  Constant *F = M->getOrInsertFunction(
-      FWriteName, DL.getIntPtrType(Context), B.getInt8PtrTy(),
+  const TargetLibraryInfo *AttrTLI =
+      File->getType()->isPointerTy() ? TLI : nullptr;
+  Constant *F = getOrInsertLibFunc(
+      M, AttrTLI, FWriteName, DL.getIntPtrType(Context), B.getInt8PtrTy(),
       DL.getIntPtrType(Context), DL.getIntPtrType(Context), File->getType(),
       nullptr);
-  if (File->getType()->isPointerTy())
-    inferLibFuncAttributes(*M->getFunction(FWriteName), *TLI);
   CallInst *CI =
       B.CreateCall(F, {castToCStr(Ptr, B), Size,
                        ConstantInt::get(DL.getIntPtrType(Context), 1), File});
@@ -366,14 +366,16 @@ llvm::RecursivelyDeleteTriviallyDeadInstructions(Value *V,
       Value *OpV = I->getOperand(i);
       I->setOperand(i, nullptr);
 
-      if (!OpV->use_empty()) continue;
+      // Only instructions can become dead, so leave the use lists of
+      // constants, which other functions share, alone.
+      Instruction *OpI = dyn_cast<Instruction>(OpV);
+      if (!OpI || !OpI->use_empty()) continue;
 
       // If the operand is an instruction that became dead as we nulled out the
       // operand, and if it is 'trivially' dead, delete it in a future loop
       // iteration.
-      if (Instruction *OpI = dyn_cast<Instruction>(OpV))
-        if (isInstructionTriviallyDead(OpI, TLI))
-          DeadInsts.push_back(OpI);
+      if (isInstructionTriviallyDead(OpI, TLI))
+        DeadInsts.push_back(OpI);
     }
 
     I->eraseFromParent();
@@ -437,15 +439,17 @@ simplifyAndDCEInstruction(Instruction *I,
       Value *OpV = I->getOperand(i);
       I->setOperand(i, nullptr);
 
-      if (!OpV->use_empty() || I == OpV)
+      // Only instructions can become dead, so leave the use lists of
+      // constants, which other functions share, alone.
+      Instruction *OpI = dyn_cast<Instruction>(OpV);
+      if (!OpI || !OpI->use_empty() || I == OpI)
         continue;
 
       // If the operand is an instruction that became dead as we nulled out the
       // operand, and if it is 'trivially' dead, delete it in a future loop
       // iteration.
-      if (Instruction *OpI = dyn_cast<Instruction>(OpV))
-        if (isInstructionTriviallyDead(OpI, TLI))
-          WorkList.insert(OpI);
+      if (isInstructionTriviallyDead(OpI, TLI))
+        WorkList.insert(OpI);
     }
 
     I->eraseFromParent();
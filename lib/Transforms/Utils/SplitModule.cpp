@@ -73,12 +73,25 @@ static void addAllGlobalValueUsers(ClusterMapType &GVtoClusterMap,
   }
 }
 
+// Estimate the code generation cost of a global value: the number of
+// instructions for a function definition, a unit cost otherwise.
+static unsigned getCodeGenCost(const GlobalValue *GV) {
+  unsigned Cost = 1;
+  if (const Function *F = dyn_cast<Function>(GV))
+    for (const BasicBlock &BB : *F)
+      Cost += BB.size();
+  return Cost;
+}
+
 // Find partitions for module in the way that no locals need to be
 // globalized.
 // Try to balance pack those partitions into N files since this roughly equals
 // thread balancing for the backend codegen step.
+// When BalanceByCost is set, every global value definition is assigned to a
+// partition here rather than by name hashing, and the partitions are balanced
+// by code generation cost instead of by number of globals.
 static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
-                           unsigned N) {
+                           unsigned N, bool BalanceByCost) {
   // At this point module should have the proper mix of globals and locals.
   // As we attempt to partition this module, we must not change any
   // locals to globals.
@@ -86,13 +99,17 @@ static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
   ClusterMapType GVtoClusterMap;
   ComdatMembersType ComdatMembers;
 
-  auto recordGVSet = [&GVtoClusterMap, &ComdatMembers](GlobalValue &GV) {
+  auto recordGVSet = [&GVtoClusterMap, &ComdatMembers,
+                      BalanceByCost](GlobalValue &GV) {
     if (GV.isDeclaration())
       return;
 
     if (!GV.hasName())
       GV.setName("__llvmsplit_unnamed");
 
+    if (BalanceByCost)
+      GVtoClusterMap.insert(&GV);
+
     // Comdat groups must not be partitioned. For comdat groups that contain
     // locals, record all their members here so we can keep them together.
     // Comdat groups that only contain external globals are already handled by
@@ -154,11 +171,16 @@ static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
   // To guarantee determinism, we have to sort SCC according to size.
   // When size is the same, use leader's name.
   for (ClusterMapType::iterator I = GVtoClusterMap.begin(),
-                                E = GVtoClusterMap.end(); I != E; ++I)
-    if (I->isLeader())
-      Sets.push_back(
-          std::make_pair(std::distance(GVtoClusterMap.member_begin(I),
-                                       GVtoClusterMap.member_end()), I));
+                                E = GVtoClusterMap.end(); I != E; ++I) {
+    if (!I->isLeader())
+      continue;
+    unsigned Size = 0;
+    for (ClusterMapType::member_iterator MI = GVtoClusterMap.member_begin(I),
+                                         ME = GVtoClusterMap.member_end();
+         MI != ME; ++MI)
+      Size += BalanceByCost ? getCodeGenCost(*MI) : 1;
+    Sets.push_back(std::make_pair(Size, I));
+  }
 
   std::sort(Sets.begin(), Sets.end(), [](const SortType &a, const SortType &b) {
     if (a.first == b.first)
@@ -184,7 +206,7 @@ static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
                    << ((*MI)->hasLocalLinkage() ? " l " : " e ") << "\n");
       Visited.insert(*MI);
       ClusterIDMap[*MI] = CurrentClusterID;
-      CurrentClusterSize++;
+      CurrentClusterSize += BalanceByCost ? getCodeGenCost(*MI) : 1;
     }
     // Add this set size to the number of entries in this cluster.
     BalancinQueue.push(std::make_pair(CurrentClusterID, CurrentClusterSize));
@@ -228,7 +250,7 @@ static bool isInPartition(const GlobalValue *GV, unsigned I, unsigned N) {
 void llvm::SplitModule(
     std::unique_ptr<Module> M, unsigned N,
     function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback,
-    bool PreserveLocals) {
+    bool PreserveLocals, bool BalanceByCost) {
   if (!PreserveLocals) {
     for (Function &F : *M)
       externalize(&F);
@@ -243,7 +265,7 @@ void llvm::SplitModule(
   // This performs splitting without a need for externalization, which might not
   // always be possible.
   ClusterIDMapType ClusterIDMap;
-  findPartitions(M.get(), ClusterIDMap, N);
+  findPartitions(M.get(), ClusterIDMap, N, BalanceByCost);
 
   // FIXME: We should be able to reuse M as the last partition instead of
   // cloning it.
@@ -0,0 +1,46 @@
+; REQUIRES: asserts
+; RUN: opt < %s -loop-unroll -disable-output -stats 2>&1 | FileCheck %s
+
+; The inner loop has a constant trip count and is fully unrolled. Forgetting
+; it evicts only its own backedge-taken counts: the count of the outer loop and
+; of the following loop, which don't depend on it, stay in the cache.
+
+; CHECK: 1 loop-unroll {{.*}} Number of loops completely unrolled
+; CHECK: {{[0-9]+}} scalar-evolution {{.*}} Number of backedge-taken counts found in the cache
+; CHECK-NEXT: 2 scalar-evolution {{.*}} Number of backedge-taken counts evicted from the cache
+; CHECK-NEXT: {{[0-9]+}} scalar-evolution {{.*}} Number of SCEVs for values found in the cache
+; CHECK-NEXT: 2 scalar-evolution {{.*}} Number of SCEVs for values evicted from the cache
+
+define void @f(i32* %p, i32 %n, i32 %m) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  %idx = add i32 %i, %j
+  %gep = getelementptr i32, i32* %p, i32 %idx
+  store i32 %j, i32* %gep
+  %j.next = add nuw nsw i32 %j, 1
+  %c.inner = icmp ult i32 %j.next, 4
+  br i1 %c.inner, label %inner, label %outer.latch
+
+outer.latch:
+  %i.next = add nsw i32 %i, 1
+  %c.outer = icmp slt i32 %i.next, %n
+  br i1 %c.outer, label %outer, label %next
+
+next:
+  %k = phi i32 [ 0, %outer.latch ], [ %k.next, %next ]
+  %gep2 = getelementptr i32, i32* %p, i32 %k
+  store i32 0, i32* %gep2
+  %k.next = add nsw i32 %k, 1
+  %c.next = icmp slt i32 %k.next, %m
+  br i1 %c.next, label %next, label %exit
+
+exit:
+  ret void
+}
@@ -0,0 +1,19 @@
+; RUN: not llc -mtriple=x86_64-unknown-linux-gnu -split-codegen=2 \
+; RUN:   -filetype=obj -o %t.o %s 2>&1 | FileCheck %s
+; RUN: not ls %t.o.0
+; RUN: not ls %t.o.1
+
+; Both partitions report their errors through llc, which removes the outputs.
+
+; CHECK-DAG: error: couldn't allocate output register for constraint '{foo}'
+; CHECK-DAG: error: couldn't allocate output register for constraint '{bar}'
+
+define i32 @foo() {
+  %r = call i32 asm sideeffect "", "={foo}"()
+  ret i32 %r
+}
+
+define i32 @bar() {
+  %r = call i32 asm sideeffect "", "={bar}"()
+  ret i32 %r
+}
@@ -0,0 +1,29 @@
+; RUN: llc -mtriple=x86_64-unknown-linux-gnu -split-codegen=2 -o %t.s %s
+; RUN: cat %t.s.0 %t.s.1 | FileCheck %s
+; RUN: llc -mtriple=x86_64-unknown-linux-gnu -split-codegen=2 \
+; RUN:   -disable-simplify-libcalls -o %t.s %s
+; RUN: cat %t.s.0 %t.s.1 | FileCheck --check-prefix=NOBUILTIN %s
+
+; Every partition uses the library info of llc.
+
+; CHECK-NOT: memcmp
+; NOBUILTIN: callq memcmp
+; NOBUILTIN: callq memcmp
+
+declare i32 @memcmp(i8*, i8*, i64)
+
+define i1 @foo(i8* %x, i8* %y) {
+  %c = call i32 @memcmp(i8* %x, i8* %y, i64 2)
+  %e = icmp eq i32 %c, 0
+  %r = call i1 @bar(i8* %x, i8* %y)
+  %a = and i1 %e, %r
+  ret i1 %a
+}
+
+define i1 @bar(i8* %x, i8* %y) {
+  %c = call i32 @memcmp(i8* %x, i8* %y, i64 2)
+  %e = icmp eq i32 %c, 0
+  %r = call i1 @foo(i8* %x, i8* %y)
+  %a = and i1 %e, %r
+  ret i1 %a
+}
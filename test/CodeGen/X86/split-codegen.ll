@@ -0,0 +1,32 @@
+; RUN: llc -mtriple=x86_64-unknown-linux-gnu -split-codegen=2 -o %t.s %s
+; RUN: FileCheck --check-prefix=CHECK0 %s < %t.s.0
+; RUN: FileCheck --check-prefix=CHECK1 %s < %t.s.1
+; RUN: llc -mtriple=x86_64-unknown-linux-gnu -split-codegen=2 -filetype=obj -o %t.o %s
+; RUN: llvm-nm %t.o.0 | FileCheck --check-prefix=NM0 %s
+; RUN: llvm-nm %t.o.1 | FileCheck --check-prefix=NM1 %s
+; RUN: not llc -mtriple=x86_64-unknown-linux-gnu -split-codegen=2 -o - %s 2>&1 | FileCheck --check-prefix=ERR %s
+; RUN: cp %s %t-noout.ll
+; RUN: not llc -mtriple=x86_64-unknown-linux-gnu -split-codegen=2 %t-noout.ll 2>&1 | FileCheck --check-prefix=ERR %s
+; RUN: not ls %t-noout.s %t-noout.s.0
+
+; CHECK0-NOT: bar:
+; CHECK0: foo:
+; CHECK0-NOT: bar:
+; CHECK1-NOT: foo:
+; CHECK1: bar:
+; CHECK1-NOT: foo:
+
+; NM0: T foo
+; NM1: T bar
+
+; ERR: -split-codegen must be specified with -o
+
+define void @foo() {
+  call void @bar()
+  ret void
+}
+
+define void @bar() {
+  call void @foo()
+  ret void
+}
@@ -13,6 +13,10 @@
 // RUN:     | llvm-readobj -symbols - | FileCheck --check-prefix=386-SYMBOLS-ZLIB %s
 // RUN: llvm-readobj -sections %t | FileCheck --check-prefix=ZLIB-STYLE-FLAGS %s
 
+// Check the compression level
+// RUN: llvm-mc -filetype=obj -compress-debug-sections=zlib -compress-debug-sections-level=best -triple x86_64-pc-linux-gnu < %s -o %t
+// RUN: llvm-dwarfdump -debug-dump=str %t | FileCheck --check-prefix=STR %s
+
 // REQUIRES: zlib
 
 // Don't compress small sections, such as this simple debug_abbrev example
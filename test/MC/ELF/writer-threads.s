@@ -0,0 +1,58 @@
+// Check that the object does not depend on the number of threads writing it.
+// RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu -elf-writer-threads=1 %s -o %t1
+// RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu -elf-writer-threads=4 %s -o %t4
+// RUN: cmp %t1 %t4
+// So does the default, which writes an object this small on one thread.
+// RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu %s -o %t0
+// RUN: cmp %t0 %t4
+// RUN: llvm-mc -filetype=obj -triple i386-pc-linux-gnu -elf-writer-threads=1 %s -o %t1
+// RUN: llvm-mc -filetype=obj -triple i386-pc-linux-gnu -elf-writer-threads=4 %s -o %t4
+// RUN: cmp %t1 %t4
+// RUN: llvm-readobj -sections -relocations %t4 | FileCheck %s
+
+// Debug sections over 128K are compressed in blocks, whether or not there is a
+// pool to compress them on.
+// RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu -compress-debug-sections=zlib -elf-writer-threads=1 %s -o %t1
+// RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu -compress-debug-sections=zlib -elf-writer-threads=4 %s -o %t4
+// RUN: cmp %t1 %t4
+// RUN: llvm-readobj -sections %t4 | FileCheck --check-prefix=ZLIB %s
+// REQUIRES: zlib
+
+// CHECK: Name: .group
+// CHECK: Name: .text.foo
+// CHECK: Name: .rel.text.foo
+// CHECK: Name: .data
+// CHECK: Name: .rel.data
+// CHECK: Name: .bss
+// CHECK: Name: .symtab
+// CHECK: Relocations [
+// CHECK:   Section ({{[0-9]+}}) .rel.text.foo {
+// CHECK:     R_386_PC32 bar
+// CHECK:   Section ({{[0-9]+}}) .rel.data {
+// CHECK:     R_386_32 foo
+
+        .section .text.foo,"axG",@progbits,foo,comdat
+        .globl foo
+foo:
+        call bar
+        .p2align 4
+        ret
+
+        .data
+        .p2align 3
+        .long foo
+        .asciz "data"
+
+        .bss
+        .zero 64
+
+// ZLIB:      Name: .debug_info
+// ZLIB-NEXT: Type: SHT_PROGBITS
+// ZLIB-NEXT: Flags [
+// ZLIB-NEXT:   SHF_COMPRESSED
+// ZLIB-NEXT: ]
+
+        .section .debug_info,"",@progbits
+        .rept 25000
+        .quad 0x0123456789abcdef, 0x1122334455667788
+        .endr
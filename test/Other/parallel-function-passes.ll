@@ -0,0 +1,120 @@
+; RUN: opt -S -passes='function(sroa,dce)' %s -o %t.seq.ll
+; RUN: opt -S -passes='function(sroa,dce)' -function-pass-threads=4 \
+; RUN:   %s -o %t.par.ll
+; RUN: diff %t.seq.ll %t.par.ll
+; RUN: FileCheck %s < %t.par.ll
+; RUN: opt -disable-output -debug-pass-manager -function-pass-threads=2 \
+; RUN:   -passes='sroa,loop(no-op-loop)' %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=PM
+
+; Passes that read the use lists of constants, like InstCombine, are rejected.
+; RUN: not opt -disable-output -function-pass-threads=2 \
+; RUN:   -passes='function(sroa,instcombine)' %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=UNSAFE
+; RUN: not opt -disable-output -function-pass-threads=2 \
+; RUN:   -passes='function(loop(no-op-loop,indvars))' %s 2>&1 \
+; RUN:   | FileCheck %s --check-prefix=UNSAFE
+; RUN: opt -disable-output -passes='function(sroa,instcombine)' %s
+
+; The functions create the same constants and metadata on different threads.
+
+; PM: Running pass: ParallelFunctionPassAdaptor
+; PM: Running pass: SROA
+; PM: Running pass: FunctionToLoopPassAdaptor
+
+; UNSAFE: unable to parse pass pipeline description
+
+; CHECK-LABEL: define i32 @f1(
+; CHECK-NEXT: %b = add i32 %x, 1
+; CHECK-NEXT: ret i32 %b
+
+define i32 @f1(i32 %x) {
+  %p = alloca i32
+  store i32 %x, i32* %p
+  %a = load i32, i32* %p
+  %b = add i32 %a, 1
+  ret i32 %b
+}
+
+; CHECK-LABEL: define i32 @f2(
+; CHECK-NEXT: lshr i64 %x, 32
+; CHECK-NEXT: trunc i64
+define i32 @f2(i64 %x) {
+  %p = alloca i64
+  store i64 %x, i64* %p
+  %q = bitcast i64* %p to i32*
+  %h = getelementptr i32, i32* %q, i32 1
+  %v = load i32, i32* %h
+  ret i32 %v
+}
+
+; CHECK-LABEL: define i32 @f3(
+; CHECK-NEXT: lshr i64 %x, 32
+; CHECK-NEXT: trunc i64
+define i32 @f3(i64 %x) {
+  %p = alloca i64
+  store i64 %x, i64* %p
+  %q = bitcast i64* %p to i32*
+  %h = getelementptr i32, i32* %q, i32 1
+  %v = load i32, i32* %h
+  ret i32 %v
+}
+
+; CHECK-LABEL: define i32 @f4()
+; CHECK-NEXT: call void @llvm.dbg.value(metadata i32 7, i64 0, metadata ![[V4:[0-9]+]], metadata ![[E:[0-9]+]])
+; CHECK-NEXT: ret i32 7
+define i32 @f4() !dbg !4 {
+  %p = alloca i32
+  call void @llvm.dbg.declare(metadata i32* %p, metadata !8, metadata !DIExpression()), !dbg !10
+  store i32 7, i32* %p
+  %v = load i32, i32* %p
+  ret i32 %v
+}
+
+; CHECK-LABEL: define i32 @f5()
+; CHECK-NEXT: call void @llvm.dbg.value(metadata i32 7, i64 0, metadata ![[V5:[0-9]+]], metadata ![[E]])
+; CHECK-NEXT: ret i32 7
+define i32 @f5() !dbg !9 {
+  %p = alloca i32
+  call void @llvm.dbg.declare(metadata i32* %p, metadata !11, metadata !DIExpression()), !dbg !12
+  store i32 7, i32* %p
+  %v = load i32, i32* %p
+  ret i32 %v
+}
+
+; CHECK-LABEL: define i64 @f6(
+; CHECK-NEXT: %y = zext i32 %x to i64
+; CHECK-NEXT: ret i64 %y
+define i64 @f6(i32 %x) {
+  %p = alloca i64
+  %y = zext i32 %x to i64
+  store i64 %y, i64* %p
+  %v = load i64, i64* %p
+  %d = add i64 %y, 0
+  ret i64 %v
+}
+
+declare void @llvm.dbg.declare(metadata, metadata, metadata)
+
+; CHECK-DAG: ![[V4]] = !DILocalVariable(name: "v", scope: ![[F4:[0-9]+]]
+; CHECK-DAG: ![[V5]] = !DILocalVariable(name: "v", scope: ![[F5:[0-9]+]]
+; CHECK-DAG: ![[E]] = !DIExpression()
+; CHECK-DAG: ![[F4]] = distinct !DISubprogram(name: "f4"
+; CHECK-DAG: ![[F5]] = distinct !DISubprogram(name: "f5"
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, isOptimized: false, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "f.c", directory: "/tmp")
+!2 = !{}
+!3 = !{i32 2, !"Debug Info Version", i32 3}
+!4 = distinct !DISubprogram(name: "f4", scope: !1, file: !1, line: 1, type: !5, isLocal: false, isDefinition: true, scopeLine: 1, isOptimized: false, unit: !0)
+!5 = !DISubroutineType(types: !6)
+!6 = !{!7}
+!7 = !DIBasicType(name: "int", size: 32, align: 32, encoding: DW_ATE_signed)
+!8 = !DILocalVariable(name: "v", scope: !4, file: !1, line: 2, type: !7)
+!9 = distinct !DISubprogram(name: "f5", scope: !1, file: !1, line: 5, type: !5, isLocal: false, isDefinition: true, scopeLine: 5, isOptimized: false, unit: !0)
+!10 = !DILocation(line: 2, scope: !4)
+!11 = !DILocalVariable(name: "v", scope: !9, file: !1, line: 6, type: !7)
+!12 = !DILocation(line: 6, scope: !9)
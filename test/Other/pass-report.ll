@@ -0,0 +1,37 @@
+; RUN: opt -instcombine -pass-report=%t.json %s -o /dev/null
+; RUN: FileCheck %s < %t.json
+; RUN: opt -passes=instcombine -pass-report=%t.newpm.json %s -o /dev/null
+; RUN: FileCheck %s < %t.newpm.json
+; RUN: opt -inline -pass-report=%t.inline.json %s -o /dev/null
+; RUN: FileCheck --check-prefix=SCC %s < %t.inline.json
+
+; Each pass run over a function gets a record, with instcombine folding away
+; the two adds.
+; CHECK: {
+; CHECK-NEXT: "passes": [
+; CHECK: {"pass": "{{.*}}", "module": "{{.*}}pass-report.ll", "function": "f", "wall": {{[0-9.]+}}, "user": {{[0-9.]+}}, "system": {{[0-9.]+}}, "memory_delta": {{-?[0-9]+}}, "instructions": 1, "instructions_delta": -2}
+; CHECK: ]
+; CHECK-NEXT: }
+
+; Legacy CGSCC passes get a record per SCC, counting only its functions. The
+; inliner replaces the call to @h by its two instructions besides the ret.
+; SCC: {"pass": "Function Integration/Inlining", "module": "{{.*}}pass-report.ll", "scc": ["h"], "wall": {{.*}}, "instructions": 3, "instructions_delta": 0}
+; SCC: {"pass": "Function Integration/Inlining", "module": "{{.*}}pass-report.ll", "scc": ["g"], "wall": {{.*}}, "instructions": 4, "instructions_delta": 1}
+
+define i32 @f(i32 %x) {
+  %a = add i32 %x, 1
+  %b = add i32 %a, -1
+  ret i32 %b
+}
+
+define i32 @h(i32 %x) {
+  %m = mul i32 %x, 3
+  %n = xor i32 %m, 5
+  ret i32 %n
+}
+
+define i32 @g(i32 %x) {
+  %r = call i32 @h(i32 %x)
+  %s = add i32 %r, 1
+  ret i32 %s
+}
@@ -0,0 +1,40 @@
+target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.11.0"
+
+define void @globalfunc1() !dbg !5 {
+  ret void, !dbg !8, !attach !9
+}
+
+define void @globalfunc2() !dbg !12 {
+  ret void, !dbg !13, !attach !14
+}
+
+define void @globalfunc3() !dbg !20 {
+  ret void, !dbg !21, !attach !14
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "lazyload_metadata.c", directory: "/tmp")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!5 = distinct !DISubprogram(name: "globalfunc1", scope: !1, file: !1, line: 1, type: !6, isLocal: false, isDefinition: true, scopeLine: 1, isOptimized: false, unit: !0, variables: !2)
+!6 = !DISubroutineType(types: !7)
+!7 = !{null}
+!8 = !DILocation(line: 2, column: 1, scope: !5)
+!9 = !{!10}
+!10 = !{!11, !9}
+!11 = !{!"globalfunc1"}
+!12 = distinct !DISubprogram(name: "globalfunc2", scope: !1, file: !1, line: 5, type: !6, isLocal: false, isDefinition: true, scopeLine: 5, isOptimized: false, unit: !0, variables: !2)
+!13 = !DILocation(line: 6, column: 1, scope: !12)
+!14 = !{!15, !16, !17}
+!15 = !{!"globalfunc2", i32 1}
+!16 = !{!"globalfunc2", i32 2}
+!17 = !{!18, !19}
+!18 = !{!"globalfunc2", i32 3}
+!19 = !{!"globalfunc2", i32 4}
+!20 = distinct !DISubprogram(name: "globalfunc3", scope: !1, file: !1, line: 9, type: !6, isLocal: false, isDefinition: true, scopeLine: 9, isOptimized: false, unit: !0, variables: !2)
+!21 = !DILocation(line: 10, column: 1, scope: !20)
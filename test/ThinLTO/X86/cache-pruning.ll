@@ -0,0 +1,32 @@
+; REQUIRES: asserts
+; RUN: opt -module-summary %s -o %t.bc
+; RUN: opt -module-summary %p/Inputs/funcimport.ll -o %t2.bc
+
+; Populate the cache.
+; RUN: rm -Rf %t.cache && mkdir %t.cache
+; RUN: llvm-lto -thinlto-action=run -exported-symbol=globalfunc %t2.bc  %t.bc -thinlto-cache-dir %t.cache -stats 2>&1 | FileCheck %s --check-prefix=MISS
+; RUN: ls %t.cache | count 3
+; MISS-DAG: 2 thinlto - Number of ThinLTO cache misses
+; MISS-DAG: 2 thinlto - Number of objects written to the ThinLTO cache
+
+; Verify that a second run hits the cache and does not leave temporaries.
+; RUN: llvm-lto -thinlto-action=run -exported-symbol=globalfunc %t2.bc  %t.bc -thinlto-cache-dir %t.cache -stats 2>&1 | FileCheck %s --check-prefix=HIT
+; RUN: ls %t.cache | count 3
+; HIT-DAG: 2 thinlto - Number of ThinLTO cache hits
+; HIT-NOT: cache misses
+
+; Verify that the size limit in bytes evicts entries.
+; RUN: rm -Rf %t.cache && mkdir %t.cache
+; RUN: llvm-lto -thinlto-action=run -exported-symbol=globalfunc %t2.bc  %t.bc -thinlto-cache-dir %t.cache -thinlto-cache-max-size-bytes 1 -stats 2>&1 | FileCheck %s --check-prefix=EVICT
+; RUN: ls %t.cache | count 1
+; EVICT-DAG: 2 thinlto - Number of ThinLTO cache misses
+; EVICT-DAG: 2 thinlto - Number of objects written to the ThinLTO cache
+; EVICT-DAG: 2 cache-pruning - Number of cache files pruned to fit the size limit
+
+target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.11.0"
+
+define void @globalfunc() #0 {
+entry:
+  ret void
+}
@@ -0,0 +1,53 @@
+; Do setup work for all below tests: generate bitcode and combined index
+; RUN: opt -module-summary %s -o %t.bc -bitcode-mdindex-threshold=0
+; RUN: opt -module-summary %p/Inputs/lazyload_metadata.ll -o %t2.bc -bitcode-mdindex-threshold=0
+; RUN: llvm-lto -thinlto-action=thinlink -o %t3.bc %t.bc %t2.bc
+; REQUIRES: asserts
+
+; The module-level metadata block carries an index of its records.
+; RUN: llvm-bcanalyzer -dump %t2.bc | FileCheck %s --check-prefix=INDEX
+; INDEX: <METADATA_BLOCK
+; INDEX: <INDEX_OFFSET
+; INDEX: <INDEX
+; INDEX: </METADATA_BLOCK>
+
+; Importing @globalfunc1 only loads the module-level metadata it or the named
+; metadata reference: 10 of the 17 records, skipping those only reachable from
+; the attachment shared by @globalfunc2 and @globalfunc3. Likewise, 5 of the 6
+; strings are loaded, all but "globalfunc2".
+; RUN: llvm-lto -thinlto-action=import %t.bc -thinlto-index=%t3.bc \
+; RUN:          -o %t4.bc -stats 2>&1 | FileCheck %s --check-prefix=LAZY
+; LAZY: 10 bitcode-reader - Number of metadata records loaded on demand
+; LAZY:  5 bitcode-reader - Number of MDStrings loaded on demand
+; RUN: llvm-dis %t4.bc -o - | FileCheck %s --check-prefix=IMPORT
+
+; The same import without the index, or with lazy loading disabled.
+; RUN: opt -module-summary %p/Inputs/lazyload_metadata.ll -o %t5.bc
+; RUN: llvm-bcanalyzer -dump %t5.bc | FileCheck %s --check-prefix=NOINDEX
+; NOINDEX-NOT: INDEX_OFFSET
+; RUN: llvm-lto -thinlto-action=thinlink -o %t6.bc %t.bc %t5.bc
+; RUN: llvm-lto -thinlto-action=import %t.bc -thinlto-index=%t6.bc \
+; RUN:          -o - | llvm-dis -o - | FileCheck %s --check-prefix=IMPORT
+; RUN: llvm-lto -thinlto-action=import %t.bc -thinlto-index=%t3.bc \
+; RUN:          -disable-ondemand-mds-loading -o - | llvm-dis -o - \
+; RUN:          | FileCheck %s --check-prefix=IMPORT
+
+; IMPORT: define available_externally void @globalfunc1() !dbg [[SP:![0-9]+]]
+; IMPORT-NEXT: ret void, !dbg [[LOC:![0-9]+]], !attach [[ATTACH:![0-9]+]]
+; IMPORT-NOT: globalfunc2
+; IMPORT: [[SP]] = distinct !DISubprogram(name: "globalfunc1"
+; IMPORT: [[LOC]] = !DILocation(line: 2, column: 1, scope: [[SP]])
+; IMPORT: [[ATTACH]] = !{[[CYCLE:![0-9]+]]}
+; IMPORT: [[CYCLE]] = !{[[NAME:![0-9]+]], [[ATTACH]]}
+; IMPORT: [[NAME]] = !{!"globalfunc1"}
+; IMPORT-NOT: globalfunc
+
+target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.11.0"
+
+define void @main() {
+  call void @globalfunc1()
+  ret void
+}
+
+declare void @globalfunc1()
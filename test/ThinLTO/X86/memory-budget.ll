@@ -0,0 +1,28 @@
+; REQUIRES: asserts
+; RUN: opt -module-summary %s -o %t.bc
+; RUN: opt -module-summary %p/Inputs/funcimport.ll -o %t2.bc
+
+; Without a budget, every module is scheduled upfront, largest first.
+; RUN: llvm-lto -thinlto-action=run -exported-symbol=globalfunc %t2.bc %t.bc -debug-only=thinlto 2>&1 | FileCheck %s --check-prefix=NOBUDGET
+; RUN: mv %t.bc.thinlto.o %t.nobudget.o
+; RUN: mv %t2.bc.thinlto.o %t2.nobudget.o
+; NOBUDGET: Schedule buffer 0 {{.*}}2.bc (estimated {{[0-9]+}} bytes)
+; NOBUDGET: Schedule buffer 1 {{.*}}.bc (estimated {{[0-9]+}} bytes)
+
+; With a budget smaller than any module, modules are processed one at a time,
+; and the result does not change.
+; RUN: llvm-lto -thinlto-action=run -exported-symbol=globalfunc %t2.bc %t.bc -thinlto-memory-budget 1 -threads 4 -debug-only=thinlto 2>&1 | FileCheck %s --check-prefix=BUDGET
+; RUN: cmp %t.bc.thinlto.o %t.nobudget.o
+; RUN: cmp %t2.bc.thinlto.o %t2.nobudget.o
+; BUDGET: Schedule buffer 0
+; BUDGET-NEXT: Cache miss {{.*}} for buffer 0
+; BUDGET-NEXT: Schedule buffer 1
+; BUDGET-NEXT: Cache miss {{.*}} for buffer 1
+
+target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.11.0"
+
+define void @globalfunc() #0 {
+entry:
+  ret void
+}
@@ -0,0 +1,119 @@
+; REQUIRES: asserts
+; RUN: opt < %s -correlated-propagation -S | FileCheck %s
+; RUN: opt < %s -correlated-propagation -lvi-max-solver-steps=4 -stats -S \
+; RUN:   2>&1 | FileCheck %s --check-prefix=STEPS
+; RUN: opt < %s -correlated-propagation -lvi-max-cache-size=1 -stats -S \
+; RUN:   2>&1 | FileCheck %s --check-prefix=EVICT
+
+; The range of %x is only known at the top of a long chain of blocks. Proving
+; the comparisons at the bottom walks the whole chain.
+
+; With too few solver steps to get to the top, the range of %x is overdefined
+; and nothing is folded.
+; STEPS-LABEL: bottom:
+; STEPS-NEXT: %r1 = icmp ult i32 %x, 20
+; STEPS-NEXT: %r2 = icmp ult i32 %x, 30
+; STEPS: 1 lazy-value-info - Number of queries made overdefined after too many solver steps
+
+; The values of %x cached along the chain for the first comparison are over a
+; 1KB budget, so they are evicted before the second comparison is proved. The
+; comparisons are folded as without a budget.
+; EVICT-LABEL: bottom:
+; EVICT-NEXT: %r = and i1 true, true
+; EVICT: {{[1-9][0-9]*}} lazy-value-info - Number of times the cache was evicted to stay within its budget
+
+; CHECK-LABEL: bottom:
+; CHECK-NEXT: %r = and i1 true, true
+
+define i1 @chain(i32 %x) {
+entry:
+  %c = icmp ult i32 %x, 10
+  br i1 %c, label %b0, label %exit
+b0:
+  br label %b1
+b1:
+  br label %b2
+b2:
+  br label %b3
+b3:
+  br label %b4
+b4:
+  br label %b5
+b5:
+  br label %b6
+b6:
+  br label %b7
+b7:
+  br label %b8
+b8:
+  br label %b9
+b9:
+  br label %b10
+b10:
+  br label %b11
+b11:
+  br label %b12
+b12:
+  br label %b13
+b13:
+  br label %b14
+b14:
+  br label %b15
+b15:
+  br label %b16
+b16:
+  br label %b17
+b17:
+  br label %b18
+b18:
+  br label %b19
+b19:
+  br label %b20
+b20:
+  br label %b21
+b21:
+  br label %b22
+b22:
+  br label %b23
+b23:
+  br label %b24
+b24:
+  br label %b25
+b25:
+  br label %b26
+b26:
+  br label %b27
+b27:
+  br label %b28
+b28:
+  br label %b29
+b29:
+  br label %b30
+b30:
+  br label %b31
+b31:
+  br label %b32
+b32:
+  br label %b33
+b33:
+  br label %b34
+b34:
+  br label %b35
+b35:
+  br label %b36
+b36:
+  br label %b37
+b37:
+  br label %b38
+b38:
+  br label %b39
+b39:
+  br label %bottom
+bottom:
+  %r1 = icmp ult i32 %x, 20
+  %r2 = icmp ult i32 %x, 30
+  %r = and i1 %r1, %r2
+  ret i1 %r
+exit:
+  ret i1 false
+}
@@ -0,0 +1,35 @@
+; RUN: opt -S -jump-threading -jump-threading-threshold=0 < %s | FileCheck %s
+
+; LVI caches the ranges of a switch condition on each of the switch edges.
+; Folding %B into %X retargets the case for 5 from %B to %X, which widens the
+; range on the edge to %X. Reusing the range computed before would fold %c to
+; false, and %x == 5 would return 0.
+
+; CHECK-LABEL: @f(
+; CHECK: i32 5, label %X
+; CHECK: X:
+; CHECK-NEXT: %c = icmp eq i32 %x, 5
+; CHECK-NEXT: br i1 %c, label %T, label %F
+define i32 @f(i32 %x) {
+entry:
+  switch i32 %x, label %Def [
+    i32 5, label %B
+    i32 7, label %X
+  ]
+
+X:
+  %c = icmp eq i32 %x, 5
+  br i1 %c, label %T, label %F
+
+B:
+  br label %X
+
+T:
+  ret i32 1
+
+F:
+  ret i32 0
+
+Def:
+  ret i32 2
+}
@@ -14,6 +14,12 @@
 // RUN: llvm-dsymutil -f -oso-prepend-path=%p/../Inputs/odr-uniquing -y %p/dummy-debug-map.map -o - | llvm-dwarfdump -debug-dump=info - | FileCheck -check-prefix=ODR -check-prefix=CHECK %s
 // RUN: llvm-dsymutil -f -oso-prepend-path=%p/../Inputs/odr-uniquing -y %p/dummy-debug-map.map -no-odr -o - | llvm-dwarfdump -debug-dump=info - | FileCheck -check-prefix=NOODR -check-prefix=CHECK %s
 
+// 2.o is analyzed while 1.o is being cloned, which doesn't change what it
+// uniques against 1.o.
+// RUN: llvm-dsymutil -j 1 -f -oso-prepend-path=%p/../Inputs/odr-uniquing -y %p/dummy-debug-map.map -o %t.serial
+// RUN: llvm-dsymutil -j 3 -f -oso-prepend-path=%p/../Inputs/odr-uniquing -y %p/dummy-debug-map.map -o %t.parallel
+// RUN: cmp %t.serial %t.parallel
+
 // The first compile unit contains all the types:
 // CHECK: TAG_compile_unit
 // CHECK-NOT: DW_TAG
@@ -83,3 +83,9 @@ int main() {         // ALL:         1| [[@LINE]]|int main() {
 
 // HTML-ALL: <td class='uncovered-line'></td><td class='line-number'><pre>[[@LINE-45]]</pre></td><td class='code'><pre>// after
 // HTML-FILTER-NOT: <td class='uncovered-line'></td><td class='line-number'><pre>[[@LINE-46]]</pre></td><td class='code'><pre>// after
+
+// Rendering files on multiple threads produces the same views and index.
+// RUN: llvm-cov show %S/Inputs/templateInstantiations.covmapping -instr-profile %S/Inputs/templateInstantiations.profdata -filename-equivalence %s %s -format html -j 1 -o %t.serial.dir
+// RUN: llvm-cov show %S/Inputs/templateInstantiations.covmapping -instr-profile %S/Inputs/templateInstantiations.profdata -filename-equivalence %s %s -format html -j 3 -o %t.parallel.dir
+// RUN: cmp %t.serial.dir/index.html %t.parallel.dir/index.html
+// RUN: cmp %t.serial.dir/coverage/tmp/showTemplateInstantiations.cpp.html %t.parallel.dir/coverage/tmp/showTemplateInstantiations.cpp.html
@@ -15,6 +15,7 @@
 #include "BinaryHolder.h"
 #include "llvm/Object/MachO.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 
 namespace llvm {
 namespace dsymutil {
@@ -200,5 +201,25 @@ BinaryHolder::GetObjectFiles(StringRef Filename, sys::TimeValue Timestamp) {
 
   return std::move(Objects);
 }
+
+ErrorOr<SharedObjectFile>
+BinaryHolder::GetSharedObjectFile(StringRef Filename, sys::TimeValue Timestamp,
+                                  const Triple &T) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  auto ErrOrObjs = GetObjectFiles(Filename, Timestamp);
+  if (auto Err = ErrOrObjs.getError())
+    return Err;
+  auto ErrOrObj = Get(T);
+  if (auto Err = ErrOrObj.getError())
+    return Err;
+
+  auto It = std::find_if(CurrentObjectFiles.begin(), CurrentObjectFiles.end(),
+                         [&](const std::unique_ptr<object::ObjectFile> &Obj) {
+                           return Obj.get() == &*ErrOrObj;
+                         });
+  SharedObjectFile Shared{CurrentMemoryBuffer, std::move(*It)};
+  CurrentObjectFiles.erase(It);
+  return std::move(Shared);
+}
 }
 }
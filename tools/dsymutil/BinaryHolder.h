@@ -22,10 +22,19 @@
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/TimeValue.h"
+#include <memory>
+#include <mutex>
 
 namespace llvm {
 namespace dsymutil {
 
+/// An object file that shares the ownership of the memory mapping backing
+/// it, so that it stays valid after its BinaryHolder moved to other files.
+struct SharedObjectFile {
+  std::shared_ptr<MemoryBuffer> Buffer;
+  std::unique_ptr<object::ObjectFile> Object;
+};
+
 /// \brief The BinaryHolder class is responsible for creating and
 /// owning ObjectFile objects and their underlying MemoryBuffer. This
 /// is different from a simple OwningBinary in that it handles
@@ -36,14 +45,17 @@ namespace dsymutil {
 /// archive file (Which is always the case in debug maps).
 /// Currently it only owns one memory buffer at any given time,
 /// meaning that a mapping request will invalidate the previous memory
-/// mapping.
+/// mapping, except for the object files handed out by
+/// GetSharedObjectFile().
 class BinaryHolder {
   std::vector<std::unique_ptr<object::Archive>> CurrentArchives;
-  std::unique_ptr<MemoryBuffer> CurrentMemoryBuffer;
+  std::shared_ptr<MemoryBuffer> CurrentMemoryBuffer;
   std::vector<std::unique_ptr<object::ObjectFile>> CurrentObjectFiles;
   std::unique_ptr<object::MachOUniversalBinary> CurrentFatBinary;
   std::string CurrentFatBinaryName;
   bool Verbose;
+  /// Serializes GetSharedObjectFile().
+  std::mutex Mutex;
 
   /// Get the MemoryBufferRefs for the file specification in \p
   /// Filename from the current archive. Multiple buffers are returned
@@ -93,6 +105,15 @@ public:
   GetObjectFiles(StringRef Filename,
                  sys::TimeValue Timestamp = sys::TimeValue::PosixZeroTime());
 
+  /// Get the ObjectFile with architecture \p T designated by \p Filename
+  /// and hand its ownership to the caller, along with a reference to the
+  /// memory backing it. This can be called concurrently: the requests are
+  /// serialized, and successive members of an archive are all extracted
+  /// from the same mapping of it.
+  ErrorOr<SharedObjectFile>
+  GetSharedObjectFile(StringRef Filename, sys::TimeValue Timestamp,
+                      const Triple &T);
+
   /// Wraps GetObjectFiles() to return a derived ObjectFile type.
   template <typename ObjectFileType>
   ErrorOr<std::vector<const ObjectFileType *>>
@@ -36,8 +36,11 @@
 #include "llvm/Support/Dwarf.h"
 #include "llvm/Support/LEB128.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
+#include <future>
+#include <thread>
 #include <string>
 #include <tuple>
 
@@ -1191,6 +1194,47 @@ private:
                           bool isLittleEndian);
   };
 
+  /// An object file of the debug map along with its parsed debug info.
+  ///
+  /// Loading an object and parsing its debug info doesn't depend on the
+  /// other objects, so this is done ahead of time and concurrently with the
+  /// link of the previous objects. So is the analysis of the next object,
+  /// while the current one is being cloned. The rest of the link stays
+  /// sequential, as the ODR uniquing and the output offsets depend on the
+  /// objects cloned before.
+  struct LinkContext {
+    DebugMapObject &DMO;
+    /// Set if the object couldn't be loaded.
+    std::error_code EC;
+    /// The object, which keeps its archive or file mapped while it is alive.
+    SharedObjectFile Object;
+    std::unique_ptr<DWARFContextInMemory> DwarfContext;
+
+    /// Set once \a analyzeLinkContext() ran on the object.
+    bool Analyzed;
+    /// Whether the object has any relocation to a debug map entry.
+    bool HasValidRelocs;
+    RelocationManager RelocMgr;
+    /// The compile units of the object, clang module skeletons aside.
+    std::vector<CompileUnit> Units;
+
+    LinkContext(DwarfLinker &Linker, DebugMapObject &DMO)
+        : DMO(DMO), Analyzed(false), HasValidRelocs(false), RelocMgr(Linker) {}
+  };
+
+  /// \brief Load the object of \p Context through \p BinHolder and parse all
+  /// its compile units, DIEs and line tables. This doesn't report anything,
+  /// so that diagnostics are emitted in debug map order by the link.
+  static void loadLinkContext(LinkContext &Context, BinaryHolder &BinHolder,
+                              const Triple &TheTriple);
+
+  /// \brief Find the valid relocations of the loaded \p Context, create its
+  /// compile units and build their DeclContexts. None of this depends on
+  /// what the objects before it cloned, so it can run while the previous
+  /// object is being cloned, as long as no clang module is being loaded.
+  /// Only unsupported objects get a warning.
+  void analyzeLinkContext(LinkContext &Context);
+
   /// \defgroup FindRootDIEs Find DIEs corresponding to debug map entries.
   ///
   /// @{
@@ -1756,10 +1800,10 @@ bool DwarfLinker::createStreamer(const Triple &TheTriple,
 /// Recursive helper to build the global DeclContext information and
 /// gather the child->parent relationships in the original compile unit.
 ///
-/// \return true when this DIE and all of its children are only
-/// forward declarations to types defined in external clang modules
-/// (i.e., forward declarations that are children of a DW_TAG_module).
-static bool analyzeContextInfo(const DWARFDebugInfoEntryMinimal *DIE,
+/// This only depends on the units analyzed before, not on the ones cloned
+/// before, so it can run ahead of the link. Whether a DIE gets pruned
+/// depends on the latter, and is left to \a analyzePruning().
+static void analyzeContextInfo(const DWARFDebugInfoEntryMinimal *DIE,
                                unsigned ParentIdx, CompileUnit &CU,
                                DeclContext *CurrentDeclContext,
                                NonRelocatableStringpool &StringPool,
@@ -1799,19 +1843,34 @@ static bool analyzeContextInfo(const DWARFDebugInfoEntryMinimal *DIE,
       Info.Ctxt = CurrentDeclContext = nullptr;
   }
 
-  Info.Prune = InImportedModule;
-  if (DIE->hasChildren())
-    for (auto *Child = DIE->getFirstChild(); Child && !Child->isNULL();
-         Child = Child->getSibling())
-      Info.Prune &= analyzeContextInfo(Child, MyIdx, CU, CurrentDeclContext,
-                                       StringPool, Contexts, InImportedModule);
-
   // Prune this DIE if it is either a forward declaration inside a
   // DW_TAG_module or a DW_TAG_module that contains nothing but
   // forward declarations.
-  Info.Prune &= (DIE->getTag() == dwarf::DW_TAG_module) ||
+  Info.Prune = InImportedModule &&
+               ((DIE->getTag() == dwarf::DW_TAG_module) ||
                 DIE->getAttributeValueAsUnsignedConstant(
-                    &CU.getOrigUnit(), dwarf::DW_AT_declaration, 0);
+                    &CU.getOrigUnit(), dwarf::DW_AT_declaration, 0));
+
+  if (DIE->hasChildren())
+    for (auto *Child = DIE->getFirstChild(); Child && !Child->isNULL();
+         Child = Child->getSibling())
+      analyzeContextInfo(Child, MyIdx, CU, CurrentDeclContext, StringPool,
+                         Contexts, InImportedModule);
+}
+
+/// Recursive helper to finish the pruning decision of \a
+/// analyzeContextInfo(), once the units before \p CU have been cloned.
+///
+/// \return true when this DIE and all of its children are only
+/// forward declarations to types defined in external clang modules
+/// (i.e., forward declarations that are children of a DW_TAG_module).
+static bool analyzePruning(const DWARFDebugInfoEntryMinimal *DIE,
+                           CompileUnit &CU) {
+  CompileUnit::DIEInfo &Info = CU.getInfo(CU.getOrigUnit().getDIEIndex(DIE));
+  if (DIE->hasChildren())
+    for (auto *Child = DIE->getFirstChild(); Child && !Child->isNULL();
+         Child = Child->getSibling())
+      Info.Prune &= analyzePruning(Child, CU);
 
   // Don't prune it if there is no definition for the DIE.
   Info.Prune &= Info.Ctxt && Info.Ctxt->getCanonicalDIEOffset();
@@ -1841,7 +1900,6 @@ static unsigned getRefAddrSize(const DWARFUnit &U) {
 }
 
 void DwarfLinker::startDebugObject(DWARFContext &Dwarf, DebugMapObject &Obj) {
-  Units.reserve(Dwarf.getNumCompileUnits());
   // Iterate over the debug map entries and put all the ones that are
   // functions (because they have a size) into the Ranges map. This
   // map is very similar to the FunctionRanges that are stored in each
@@ -3220,14 +3278,28 @@ static uint64_t getDwoId(const DWARFDebugInfoEntryMinimal &CUDie,
   return DwoId;
 }
 
-bool DwarfLinker::registerModuleReference(
-    const DWARFDebugInfoEntryMinimal &CUDie, const DWARFUnit &Unit,
-    DebugMap &ModuleMap, unsigned Indent) {
+/// The path to the clang module of the skeleton CU \p CUDie, or "".
+static std::string getPCMFile(const DWARFDebugInfoEntryMinimal &CUDie,
+                              const DWARFUnit &Unit) {
   std::string PCMfile =
       CUDie.getAttributeValueAsString(&Unit, dwarf::DW_AT_dwo_name, "");
   if (PCMfile.empty())
     PCMfile =
         CUDie.getAttributeValueAsString(&Unit, dwarf::DW_AT_GNU_dwo_name, "");
+  return PCMfile;
+}
+
+/// Whether \a DwarfLinker::registerModuleReference() takes \p CUDie for the
+/// skeleton CU of a clang module.
+static bool isClangModuleSkeleton(const DWARFDebugInfoEntryMinimal &CUDie,
+                                  const DWARFUnit &Unit) {
+  return !getPCMFile(CUDie, Unit).empty();
+}
+
+bool DwarfLinker::registerModuleReference(
+    const DWARFDebugInfoEntryMinimal &CUDie, const DWARFUnit &Unit,
+    DebugMap &ModuleMap, unsigned Indent) {
+  std::string PCMfile = getPCMFile(CUDie, Unit);
   if (PCMfile.empty())
     return false;
 
@@ -3365,6 +3437,7 @@ void DwarfLinker::loadClangModule(StringRef Filename, StringRef ModulePath,
       Unit->setHasInterestingContent();
       analyzeContextInfo(CUDie, 0, *Unit, &ODRContexts.getRoot(), StringPool,
                          ODRContexts);
+      analyzePruning(CUDie, *Unit);
       // Keep everything.
       Unit->markEverythingAsKept();
     }
@@ -3418,6 +3491,46 @@ void DwarfLinker::DIECloner::cloneAllCompileUnits(
   }
 }
 
+void DwarfLinker::loadLinkContext(LinkContext &Context,
+                                  BinaryHolder &BinHolder,
+                                  const Triple &TheTriple) {
+  auto ErrOrObj = BinHolder.GetSharedObjectFile(
+      Context.DMO.getObjectFilename(), Context.DMO.getTimestamp(), TheTriple);
+  if ((Context.EC = ErrOrObj.getError()))
+    return;
+  Context.Object = std::move(*ErrOrObj);
+  Context.DwarfContext =
+      llvm::make_unique<DWARFContextInMemory>(*Context.Object.Object);
+
+  // Extracting the DIEs and line tables is the bulk of the work done on the
+  // input. Do it now, while we are off the critical path.
+  for (const auto &CU : Context.DwarfContext->compile_units()) {
+    CU->getUnitDIE(false);
+    Context.DwarfContext->getLineTableForUnit(CU.get());
+  }
+}
+
+void DwarfLinker::analyzeLinkContext(LinkContext &Context) {
+  Context.Analyzed = true;
+  Context.HasValidRelocs = Context.RelocMgr.findValidRelocsInDebugInfo(
+      *Context.Object.Object, Context.DMO);
+  if (!Context.HasValidRelocs)
+    return;
+
+  // The clang module skeletons are left to the link, which loads the modules
+  // in order.
+  DWARFContextInMemory &DwarfContext = *Context.DwarfContext;
+  Context.Units.reserve(DwarfContext.getNumCompileUnits());
+  for (const auto &CU : DwarfContext.compile_units())
+    if (!isClangModuleSkeleton(*CU->getUnitDIE(false), *CU))
+      Context.Units.emplace_back(*CU, UnitID++, !Options.NoODR, "");
+
+  // Now build the DIE parent links that we will use during the next phase.
+  for (auto &CurrentUnit : Context.Units)
+    analyzeContextInfo(CurrentUnit.getOrigUnit().getUnitDIE(), 0, CurrentUnit,
+                       &ODRContexts.getRoot(), StringPool, ODRContexts);
+}
+
 bool DwarfLinker::link(const DebugMap &Map) {
 
   if (!createStreamer(Map.getTriple(), OutputFilename))
@@ -3429,26 +3542,73 @@ bool DwarfLinker::link(const DebugMap &Map) {
   UnitID = 0;
   DebugMap ModuleMap(Map.getTriple(), Map.getBinaryPath());
 
-  for (const auto &Obj : Map.objects()) {
-    CurrentDebugObject = Obj.get();
+  // The objects are loaded by a pool of threads through the shared BinHolder,
+  // at most NumThreads objects at a time counting the one being linked, to
+  // bound the memory usage. In verbose mode, everything is done in order to
+  // keep the log readable.
+  unsigned NumThreads = Options.Threads;
+  if (NumThreads == 0)
+    NumThreads = std::thread::hardware_concurrency();
+  if (Options.Verbose)
+    NumThreads = 1;
+  std::unique_ptr<ThreadPool> Pool;
+  if (NumThreads > 1)
+    Pool = llvm::make_unique<ThreadPool>(NumThreads);
+
+  std::vector<std::unique_ptr<LinkContext>> Contexts;
+  std::vector<std::shared_future<void>> Loaded;
+  for (const auto &Obj : Map.objects())
+    Contexts.push_back(llvm::make_unique<LinkContext>(*this, *Obj));
+  size_t NumObjects = Contexts.size();
+  size_t NextToLoad = 0;
+  // The analysis of the next object, which runs while the current one is
+  // being cloned.
+  std::shared_future<void> NextAnalyzed;
+
+  for (size_t I = 0; I != NumObjects; ++I) {
+    LinkContext &Context = *Contexts[I];
+    CurrentDebugObject = &Context.DMO;
 
     if (Options.Verbose)
-      outs() << "DEBUG MAP OBJECT: " << Obj->getObjectFilename() << "\n";
-    auto ErrOrObj = loadObject(BinHolder, *Obj, Map);
-    if (!ErrOrObj)
+      outs() << "DEBUG MAP OBJECT: " << Context.DMO.getObjectFilename()
+             << "\n";
+    if (Pool) {
+      for (; NextToLoad != NumObjects && NextToLoad < I + NumThreads;
+           ++NextToLoad) {
+        LinkContext *ToLoad = Contexts[NextToLoad].get();
+        BinaryHolder *Holder = &BinHolder;
+        Triple TheTriple = Map.getTriple();
+        Loaded.push_back(Pool->async([ToLoad, Holder, TheTriple] {
+          loadLinkContext(*ToLoad, *Holder, TheTriple);
+        }));
+      }
+      Loaded[I].wait();
+      if (NextAnalyzed.valid())
+        NextAnalyzed.wait();
+      NextAnalyzed = std::shared_future<void>();
+    } else {
+      loadLinkContext(Context, BinHolder, Map.getTriple());
+    }
+
+    if (Context.EC) {
+      reportWarning(Twine(Context.DMO.getObjectFilename()) + ": " +
+                    Context.EC.message());
+      Contexts[I].reset();
       continue;
+    }
 
-    // Look for relocations that correspond to debug map entries.
-    RelocationManager RelocMgr(*this);
-    if (!RelocMgr.findValidRelocsInDebugInfo(*ErrOrObj, *Obj)) {
+    if (!Context.Analyzed)
+      analyzeLinkContext(Context);
+    if (!Context.HasValidRelocs) {
       if (Options.Verbose)
         outs() << "No valid relocations found. Skipping.\n";
+      Contexts[I].reset();
       continue;
     }
 
     // Setup access to the debug info.
-    DWARFContextInMemory DwarfContext(*ErrOrObj);
-    startDebugObject(DwarfContext, *Obj);
+    DWARFContextInMemory &DwarfContext = *Context.DwarfContext;
+    startDebugObject(DwarfContext, Context.DMO);
 
     // In a first phase, just read in the debug info and load all clang modules.
     for (const auto &CU : DwarfContext.compile_units()) {
@@ -3458,23 +3618,39 @@ bool DwarfLinker::link(const DebugMap &Map) {
         CUDie->dump(outs(), CU.get(), 0);
       }
 
-      if (!registerModuleReference(*CUDie, *CU, ModuleMap))
-        Units.emplace_back(*CU, UnitID++, !Options.NoODR, "");
+      registerModuleReference(*CUDie, *CU, ModuleMap);
     }
+    Units = std::move(Context.Units);
 
-    // Now build the DIE parent links that we will use during the next phase.
+    // The parent links and DeclContexts were built by analyzeLinkContext(),
+    // but the modules and objects cloned since then decide what gets pruned.
     for (auto &CurrentUnit : Units)
-      analyzeContextInfo(CurrentUnit.getOrigUnit().getUnitDIE(), 0, CurrentUnit,
-                         &ODRContexts.getRoot(), StringPool, ODRContexts);
+      analyzePruning(CurrentUnit.getOrigUnit().getUnitDIE(), CurrentUnit);
 
     // Then mark all the DIEs that need to be present in the linked
     // output and collect some information about them. Note that this
     // loop can not be merged with the previous one becaue cross-cu
     // references require the ParentIdx to be setup for every CU in
     // the object file before calling this.
+    RelocationManager &RelocMgr = Context.RelocMgr;
     for (auto &CurrentUnit : Units)
-      lookForDIEsToKeep(RelocMgr, *CurrentUnit.getOrigUnit().getUnitDIE(), *Obj,
-                        CurrentUnit, 0);
+      lookForDIEsToKeep(RelocMgr, *CurrentUnit.getOrigUnit().getUnitDIE(),
+                        Context.DMO, CurrentUnit, 0);
+
+    // Analyze the next object while this one is cloned. Nothing touches the
+    // DeclContexts meanwhile but for their canonical offsets, which the
+    // analysis doesn't read, and the string pool is locked.
+    if (Pool && I + 1 != NumObjects) {
+      LinkContext *Next = Contexts[I + 1].get();
+      std::shared_future<void> NextLoaded = Loaded[I + 1];
+      NextAnalyzed = Pool->async([this, Next, NextLoaded] {
+        NextLoaded.wait();
+        // Anything but a Mach-O object gets a warning, which has to come
+        // from the link.
+        if (!Next->EC && isa<object::MachOObjectFile>(*Next->Object.Object))
+          analyzeLinkContext(*Next);
+      });
+    }
 
     // The calls to applyValidRelocs inside cloneDIE will walk the
     // reloc array again (in the same way findValidRelocsInDebugInfo()
@@ -3484,11 +3660,12 @@ bool DwarfLinker::link(const DebugMap &Map) {
       DIECloner(*this, RelocMgr, DIEAlloc, Units, Options)
           .cloneAllCompileUnits(DwarfContext);
     if (!Options.NoOutput && !Units.empty())
-      patchFrameInfoForObject(*Obj, DwarfContext,
+      patchFrameInfoForObject(Context.DMO, DwarfContext,
                               Units[0].getOrigUnit().getAddressByteSize());
 
     // Clean-up before starting working on the next object.
     endDebugObject();
+    Contexts[I].reset();
   }
 
   // Emit everything that's global.
@@ -3505,6 +3682,7 @@ bool DwarfLinker::link(const DebugMap &Map) {
 /// can insert a new element or return the offset of a preexisitng
 /// one.
 uint32_t NonRelocatableStringpool::getStringOffset(StringRef S) {
+  std::lock_guard<std::mutex> Guard(Lock);
   if (S.empty() && !Strings.empty())
     return 0;
 
@@ -3530,6 +3708,7 @@ uint32_t NonRelocatableStringpool::getStringOffset(StringRef S) {
 /// that go into the output section. A latter call to
 /// getStringOffset() with the same string will chain it though.
 StringRef NonRelocatableStringpool::internString(StringRef S) {
+  std::lock_guard<std::mutex> Guard(Lock);
   std::pair<uint32_t, StringMapEntryBase *> Entry(0, nullptr);
   auto InsertResult = Strings.insert(std::make_pair(S, Entry));
   return InsertResult.first->getKey();
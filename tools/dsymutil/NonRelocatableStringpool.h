@@ -10,6 +10,7 @@
 #define LLVM_TOOLS_DSYMUTIL_NONRELOCATABLESTRINGPOOL_H
 
 #include "llvm/ADT/StringMap.h"
+#include <mutex>
 
 namespace llvm {
 namespace dsymutil {
@@ -20,6 +21,11 @@ namespace dsymutil {
 /// has relocation entries for every reference to it. This class
 /// provides this ablitity by just associating offsets with
 /// strings.
+///
+/// The strings are interned while analyzing the next object, which can
+/// happen on another thread than the cloning of the current one, so the
+/// pool is locked. The offsets are still only assigned by the cloning, in
+/// link order.
 class NonRelocatableStringpool {
 public:
   /// \brief Entries are stored into the StringMap and simply linked
@@ -60,6 +66,7 @@ public:
   uint64_t getSize() { return CurrentEndOffset; }
 
 private:
+  std::mutex Lock;
   MapTy Strings;
   uint32_t CurrentEndOffset;
   MapTy::MapEntryTy Sentinel, *Last;
@@ -82,6 +82,14 @@ static opt<bool>
           desc("Do not use ODR (One Definition Rule) for type uniquing."),
           init(false), cat(DsymCategory));
 
+static opt<unsigned> NumThreads(
+    "num-threads",
+    desc("Specifies the maximum number of threads to use when linking DWARF "
+         "(0 = number of cores). The output doesn't depend on it."),
+    init(0), cat(DsymCategory));
+static alias NumThreadsA("j", desc("Alias for --num-threads"),
+                         aliasopt(NumThreads));
+
 static opt<bool> DumpDebugMap(
     "dump-debug-map",
     desc("Parse and dump the debug map to standard output. Not DWARF link "
@@ -265,6 +273,7 @@ int main(int argc, char **argv) {
   Options.NoOutput = NoOutput;
   Options.NoODR = NoODR;
   Options.PrependPath = OsoPrependPath;
+  Options.Threads = NumThreads;
 
   llvm::InitializeAllTargetInfos();
   llvm::InitializeAllTargetMCs();
@@ -29,8 +29,9 @@ struct LinkOptions {
   bool NoOutput; ///< Skip emitting output
   bool NoODR;    ///< Do not unique types according to ODR
   std::string PrependPath; ///< -oso-prepend-path
+  unsigned Threads;        ///< Number of threads, 0 for one per core
 
-  LinkOptions() : Verbose(false), NoOutput(false) {}
+  LinkOptions() : Verbose(false), NoOutput(false), Threads(0) {}
 };
 
 /// \brief Extract the DebugMaps from the given file.
@@ -15,6 +15,7 @@
 
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/CodeGen/CommandFlags.h"
@@ -23,6 +24,7 @@
 #include "llvm/CodeGen/MIRParser/MIRParser.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/ParallelCG.h"
 #include "llvm/CodeGen/TargetPassConfig.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DiagnosticInfo.h"
@@ -51,7 +53,10 @@
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetSubtargetInfo.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include <atomic>
+#include <list>
 #include <memory>
+#include <mutex>
 using namespace llvm;
 
 // General options for llc.  Other pass-specific options are specified
@@ -108,6 +113,12 @@ static cl::opt<bool>
                           "manager and verify the result is the same."),
                  cl::init(false));
 
+static cl::opt<unsigned> SplitCodeGen(
+    "split-codegen", cl::init(1), cl::value_desc("N"),
+    cl::desc("Split the module into N partitions and generate code for them "
+             "on N threads. The output for partition I is written to "
+             "<output>.I"));
+
 static cl::opt<bool> DiscardValueNames(
     "discard-value-names",
     cl::desc("Discard names from Value (other than GlobalValue)."),
@@ -206,10 +217,14 @@ GetOutputStream(const char *TargetName, Triple::OSType OS,
 }
 
 static void DiagnosticHandler(const DiagnosticInfo &DI, void *Context) {
-  bool *HasError = static_cast<bool *>(Context);
+  // With -split-codegen, the partitions report their diagnostics here from
+  // several threads at once.
+  static std::mutex PrintMutex;
+  auto *HasError = static_cast<std::atomic<bool> *>(Context);
   if (DI.getSeverity() == DS_Error)
     *HasError = true;
 
+  std::lock_guard<std::mutex> Lock(PrintMutex);
   DiagnosticPrinterRawOStream DP(errs());
   errs() << LLVMContext::getDiagnosticMessagePrefix(DI.getSeverity()) << ": ";
   DI.print(DP);
@@ -251,7 +266,7 @@ int main(int argc, char **argv) {
   Context.setDiscardValueNames(DiscardValueNames);
 
   // Set a diagnostic handler that doesn't exit on the first error
-  bool HasError = false;
+  std::atomic<bool> HasError(false);
   Context.setDiagnosticHandler(DiagnosticHandler, &HasError);
 
   // Compile the module TimeCompilations times to give better compile time
@@ -349,10 +364,25 @@ static int compileModule(char **argv, LLVMContext &Context) {
   if (FloatABIForCalls != FloatABI::Default)
     Options.FloatABIType = FloatABIForCalls;
 
-  // Figure out where we are going to send the output.
-  std::unique_ptr<tool_output_file> Out =
-      GetOutputStream(TheTarget->getName(), TheTriple.getOS(), argv[0]);
-  if (!Out) return 1;
+  // Figure out where we are going to send the output. When the module is
+  // split, each partition goes to its own file, named after the -o one.
+  std::unique_ptr<tool_output_file> Out;
+  if (SplitCodeGen > 1) {
+    if (OutputFilename.empty() || OutputFilename == "-") {
+      errs() << argv[0] << ": -split-codegen must be specified with -o.\n";
+      return 1;
+    }
+    if (MIR || !RunPassNames->empty() || !StartAfter.empty() ||
+        !StopAfter.empty() || CompileTwice) {
+      errs() << argv[0] << ": -split-codegen cannot be used with a .mir input, "
+                           "run-pass, start-after, stop-after or "
+                           "compile-twice.\n";
+      return 1;
+    }
+  } else {
+    Out = GetOutputStream(TheTarget->getName(), TheTriple.getOS(), argv[0]);
+    if (!Out) return 1;
+  }
 
   // Build up all of the passes that we want to do to the module.
   legacy::PassManager PM;
@@ -377,6 +407,52 @@ static int compileModule(char **argv, LLVMContext &Context) {
     errs() << argv[0]
              << ": warning: ignoring -mc-relax-all because filetype != obj";
 
+  if (SplitCodeGen > 1) {
+    std::list<tool_output_file> Outs;
+    std::vector<raw_pwrite_stream *> OSs;
+    sys::fs::OpenFlags OpenFlags = FileType == TargetMachine::CGFT_AssemblyFile
+                                       ? sys::fs::F_Text
+                                       : sys::fs::F_None;
+    for (unsigned I = 0; I != SplitCodeGen; ++I) {
+      std::string PartFilename = OutputFilename + "." + utostr(I);
+      std::error_code EC;
+      Outs.emplace_back(PartFilename, EC, OpenFlags);
+      if (EC) {
+        errs() << argv[0] << ": " << PartFilename << ": " << EC.message()
+               << '\n';
+        return 1;
+      }
+      OSs.push_back(&Outs.back().os());
+    }
+
+    // Each partition is code generated in its own context, with its own
+    // target machine, library info and pass manager. The contexts report
+    // their diagnostics to the handler of this one.
+    cl::PrintOptionValues();
+    splitCodeGen(std::move(M), OSs, {},
+                 [&]() {
+                   return std::unique_ptr<TargetMachine>(
+                       TheTarget->createTargetMachine(
+                           TheTriple.getTriple(), CPUStr, FeaturesStr, Options,
+                           getRelocModel(), CMModel, OLvl));
+                 },
+                 FileType, /*PreserveLocals=*/false,
+                 [&](legacy::PassManagerBase &PartPM) {
+                   PartPM.add(new TargetLibraryInfoWrapperPass(TLII));
+                 },
+                 Context.getDiagnosticHandler(),
+                 Context.getDiagnosticContext());
+
+    auto &HasError =
+        *static_cast<std::atomic<bool> *>(Context.getDiagnosticContext());
+    if (HasError)
+      return 1;
+
+    for (tool_output_file &Out : Outs)
+      Out.keep();
+    return 0;
+  }
+
   {
     raw_pwrite_stream *OS = &Out->os();
 
@@ -480,7 +556,8 @@ static int compileModule(char **argv, LLVMContext &Context) {
 
     PM.run(*M);
 
-    auto HasError = *static_cast<bool *>(Context.getDiagnosticContext());
+    auto &HasError =
+        *static_cast<std::atomic<bool> *>(Context.getDiagnosticContext());
     if (HasError)
       return 1;
 
@@ -508,5 +585,8 @@ static int compileModule(char **argv, LLVMContext &Context) {
   // Declare success.
   Out->keep();
 
+  // Nothing needs the IR any more, unless the module is compiled again.
+  if (TimeCompilations == 1)
+    Context.enableFastTeardown();
   return 0;
 }
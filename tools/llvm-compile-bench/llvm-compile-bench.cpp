@@ -0,0 +1,837 @@
+//===-- llvm-compile-bench.cpp - Compile-time benchmark of the pipelines --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program measures the compile time of the opt -O2, opt -O3 and llc
+// pipelines, pass by pass, over a corpus of IR that it generates: modules from
+// llvm-stress and synthetic modules with deep loop nests, a huge switch, a
+// long chain of switches, a big basic block, many globals and many functions
+// of mixed sizes.  It also times llc -split-codegen, and llvm-mc on generated
+// assembly files whose branches need relaxing.  Every pipeline is run several
+// times on every module, and the medians can be compared against those of an
+// earlier run to catch the passes whose compile time regressed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TimeValue.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/YAMLParser.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+    CorpusDir("corpus-dir", cl::init("compile-bench-corpus"),
+              cl::desc("Directory to generate the corpus into"),
+              cl::value_desc("directory"));
+
+static cl::opt<unsigned>
+    Scale("scale", cl::init(100),
+          cl::desc("Size of the generated modules, as a percentage of the "
+                   "default sizes"));
+
+static cl::opt<unsigned>
+    NumStressModules("stress-modules", cl::init(4),
+                     cl::desc("Number of modules to generate with llvm-stress"));
+
+static cl::opt<unsigned>
+    Repeats("repeats", cl::init(5),
+            cl::desc("Number of times to run each pipeline on each module"));
+
+static cl::opt<std::string>
+    OutputFilename("o", cl::init("-"),
+                   cl::desc("Write the results as JSON to <filename>"),
+                   cl::value_desc("filename"));
+
+static cl::opt<std::string>
+    BaselineFilename("baseline",
+                     cl::desc("Compare the results with those of an earlier "
+                              "run, read from <filename>"),
+                     cl::value_desc("filename"));
+
+static cl::opt<double>
+    Threshold("threshold", cl::init(10),
+              cl::desc("Report a regression when a median time grows by more "
+                       "than this percentage over the baseline"));
+
+static cl::opt<double>
+    MinTime("min-time", cl::init(0.01),
+            cl::desc("Don't compare the median times below this many seconds, "
+                     "which are mostly noise"));
+
+static cl::opt<std::string>
+    ToolsDir("tools-dir",
+             cl::desc("Directory containing opt, llc, llvm-mc and llvm-stress "
+                      "(defaults to the one containing this program)"),
+             cl::value_desc("directory"));
+
+static const char *ProgName;
+
+static void warning(const Twine &Message) {
+  errs() << ProgName << ": warning: " << Message << '\n';
+}
+
+LLVM_ATTRIBUTE_NORETURN static void fail(const Twine &Message) {
+  errs() << ProgName << ": " << Message << '\n';
+  exit(1);
+}
+
+//===----------------------------------------------------------------------===//
+// Corpus generation
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// The linear congruential generator of the sample rand() in the C standard,
+/// which makes the generated modules the same on every host.
+class PseudoRandom {
+  uint32_t Seed = 1;
+
+public:
+  /// Returns a number below \p Limit.
+  unsigned operator()(unsigned Limit) {
+    Seed = Seed * 1103515245 + 12345;
+    return (Seed >> 16) % Limit;
+  }
+};
+} // end anonymous namespace
+
+/// Nests of counted loops, from 1 to 8 deep, updating an array in the
+/// innermost body.  \p Size is the number of nests.
+static void generateLoopNests(raw_ostream &OS, unsigned Size) {
+  for (unsigned N = 0; N != Size; ++N) {
+    unsigned Depth = 1 + N % 8;
+    OS << "define void @nest" << N << "(i32* %p, i32 %n) {\n"
+       << "entry:\n"
+       << "  br label %h0\n";
+    for (unsigned L = 0; L != Depth; ++L) {
+      OS << "h" << L << ":\n"
+         << "  %i" << L << " = phi i32 [ 0, %"
+         << (L ? "h" + utostr(L - 1) : "entry") << " ], [ %i" << L
+         << ".next, %latch" << L << " ]\n";
+      if (L + 1 != Depth)
+        OS << "  br label %h" << L + 1 << '\n';
+    }
+    OS << "  %s0 = mul i32 %i0, 3\n";
+    for (unsigned L = 1; L != Depth; ++L)
+      OS << "  %s" << L << " = add i32 %s" << L - 1 << ", %i" << L << '\n';
+    OS << "  %addr = getelementptr i32, i32* %p, i32 %s" << Depth - 1 << '\n'
+       << "  %v = load i32, i32* %addr\n"
+       << "  %v.next = add i32 %v, %i" << Depth - 1 << '\n'
+       << "  store i32 %v.next, i32* %addr\n"
+       << "  br label %latch" << Depth - 1 << '\n';
+    for (unsigned L = Depth; L-- != 0;)
+      OS << "latch" << L << ":\n"
+         << "  %i" << L << ".next = add nsw i32 %i" << L << ", 1\n"
+         << "  %c" << L << " = icmp slt i32 %i" << L << ".next, %n\n"
+         << "  br i1 %c" << L << ", label %h" << L << ", label %"
+         << (L ? "latch" + utostr(L - 1) : "exit") << '\n';
+    OS << "exit:\n"
+       << "  ret void\n"
+       << "}\n\n";
+  }
+}
+
+/// A switch with \p Size cases, each doing a little arithmetic before joining
+/// the others in a phi.
+static void generateSwitch(raw_ostream &OS, unsigned Size) {
+  OS << "define i32 @switch(i32 %x, i32 %y) {\n"
+     << "entry:\n"
+     << "  switch i32 %x, label %default [\n";
+  for (unsigned C = 0; C != Size; ++C)
+    OS << "    i32 " << C * 3 << ", label %case" << C << '\n';
+  OS << "  ]\n";
+  for (unsigned C = 0; C != Size; ++C)
+    OS << "case" << C << ":\n"
+       << "  %a" << C << " = mul i32 %y, " << C + 1 << '\n'
+       << "  %b" << C << " = xor i32 %a" << C << ", " << C << '\n'
+       << "  br label %exit\n";
+  OS << "default:\n"
+     << "  br label %exit\n"
+     << "exit:\n"
+     << "  %r = phi i32 [ 0, %default ]";
+  for (unsigned C = 0; C != Size; ++C)
+    OS << ", [ %b" << C << ", %case" << C << " ]";
+  OS << "\n"
+     << "  ret i32 %r\n"
+     << "}\n";
+}
+
+/// A chain of \p Size switches, each on its own value computed at the entry,
+/// with a few cases that store to memory before joining the next switch.
+/// Queries about the value of a switch's condition walk back through the
+/// whole chain above it.
+static void generateSwitchChain(raw_ostream &OS, unsigned Size) {
+  OS << "define void @switches(i32 %x, i32* %p) {\n"
+     << "entry:\n";
+  for (unsigned S = 0; S != Size; ++S)
+    OS << "  %v" << S << " = add i32 %x, " << S << '\n';
+  OS << "  br label %s0\n";
+  for (unsigned S = 0; S != Size; ++S) {
+    OS << "s" << S << ":\n"
+       << "  switch i32 %v" << S << ", label %s" << S + 1 << " [\n";
+    for (unsigned C = 0; C != 8; ++C)
+      OS << "    i32 " << C * 3 << ", label %c" << S << '_' << C << '\n';
+    OS << "  ]\n";
+    for (unsigned C = 0; C != 8; ++C)
+      OS << "c" << S << '_' << C << ":\n"
+         << "  %p" << S << '_' << C << " = getelementptr i32, i32* %p, i32 "
+         << C << '\n'
+         << "  store i32 %v" << S << ", i32* %p" << S << '_' << C << '\n'
+         << "  br label %s" << S + 1 << '\n';
+  }
+  OS << "s" << Size << ":\n"
+     << "  ret void\n"
+     << "}\n";
+}
+
+/// A single basic block of \p Size arithmetic instructions, loads and stores,
+/// whose operands are picked pseudo-randomly among the earlier results.
+static void generateBigBlock(raw_ostream &OS, unsigned Size) {
+  static const char *const Ops[] = {"add", "mul", "xor", "sub"};
+  OS << "define i32 @block(i32* %p, i32 %a, i32 %b) {\n"
+     << "entry:\n"
+     << "  %v0 = add i32 %a, %b\n";
+  PseudoRandom Pick;
+  for (unsigned I = 1; I <= Size; ++I) {
+    unsigned LHS = Pick(I), RHS = Pick(I);
+    switch (Pick(6)) {
+    case 0:
+      OS << "  %p" << I << " = getelementptr i32, i32* %p, i32 " << Pick(64)
+         << '\n'
+         << "  %v" << I << " = load i32, i32* %p" << I << '\n';
+      break;
+    case 1:
+      OS << "  %p" << I << " = getelementptr i32, i32* %p, i32 " << Pick(64)
+         << '\n'
+         << "  store i32 %v" << LHS << ", i32* %p" << I << '\n'
+         << "  %v" << I << " = add i32 %v" << RHS << ", 1\n";
+      break;
+    default:
+      OS << "  %v" << I << " = " << Ops[Pick(array_lengthof(Ops))] << " i32 %v"
+         << LHS << ", %v" << RHS << '\n';
+      break;
+    }
+  }
+  OS << "  ret i32 %v" << Size << '\n'
+     << "}\n";
+}
+
+/// \p Size globals of various linkages, a table of their addresses and a
+/// function adding up their values.
+static void generateGlobals(raw_ostream &OS, unsigned Size) {
+  static const char *const Linkages[] = {"", "internal ", "linkonce_odr ",
+                                         "private "};
+  for (unsigned G = 0; G != Size; ++G)
+    OS << "@g" << G << " = " << Linkages[G % array_lengthof(Linkages)]
+       << (G % 3 ? "global" : "constant") << " i32 " << G << '\n';
+  OS << "@table = global [" << Size << " x i32*] [";
+  for (unsigned G = 0; G != Size; ++G)
+    OS << (G ? ", " : "") << "i32* @g" << G;
+  OS << "]\n\n"
+     << "define i32 @sum() {\n"
+     << "entry:\n"
+     << "  %s0 = add i32 0, 0\n";
+  for (unsigned G = 0; G != Size; ++G)
+    OS << "  %l" << G << " = load i32, i32* @g" << G << '\n'
+       << "  %s" << G + 1 << " = add i32 %s" << G << ", %l" << G << '\n';
+  OS << "  ret i32 %s" << Size << '\n'
+     << "}\n";
+}
+
+/// \p Size functions calling the ones before them, like those of a module
+/// merged for LTO.  Most have a few dozen instructions and one in eight has up
+/// to 400, so splitting them into partitions of as many functions leaves the
+/// partitions unbalanced.
+static void generateFunctions(raw_ostream &OS, unsigned Size) {
+  static const char *const Ops[] = {"add", "mul", "xor", "sub"};
+  PseudoRandom Pick;
+  for (unsigned F = 0; F != Size; ++F) {
+    unsigned NumInsts = Pick(8) ? 2 + Pick(40) : 40 + Pick(360);
+    OS << "define i32 @f" << F << "(i32 %a, i32 %b) {\n"
+       << "entry:\n"
+       << "  %v0 = add i32 %a, %b\n";
+    for (unsigned I = 1; I != NumInsts; ++I) {
+      unsigned LHS = Pick(I), RHS = Pick(I);
+      if (F && !Pick(16))
+        OS << "  %v" << I << " = call i32 @f" << Pick(F) << "(i32 %v" << LHS
+           << ", i32 %v" << RHS << ")\n";
+      else
+        OS << "  %v" << I << " = " << Ops[Pick(array_lengthof(Ops))]
+           << " i32 %v" << LHS << ", %v" << RHS << '\n';
+    }
+    OS << "  ret i32 %v" << NumInsts - 1 << '\n'
+       << "}\n\n";
+  }
+}
+
+/// A single x86-64 function of \p Size blocks, each ending in a conditional
+/// branch to a pseudo-random block before or after it.  All the branches
+/// start out short, and relaxing one of them may push others out of range.
+static void generateAsmBranches(raw_ostream &OS, unsigned Size) {
+  PseudoRandom Pick;
+  OS << "  .text\n"
+     << "  .globl branches\n"
+     << "branches:\n";
+  for (unsigned B = 0; B != Size; ++B) {
+    OS << ".Lb" << B << ":\n";
+    for (unsigned I = 0, N = Pick(8); I != N; ++I)
+      OS << "  addl $" << Pick(100000) << ", %eax\n";
+    // Mostly nearby blocks, sometimes anywhere in the function.
+    unsigned Distance = 1 + (Pick(8) ? Pick(16) : Pick(Size));
+    unsigned Target = Pick(2) ? std::min(B + Distance, Size)
+                              : B - std::min(B, Distance);
+    OS << "  jne .Lb" << Target << '\n';
+  }
+  OS << ".Lb" << Size << ":\n"
+     << "  retq\n";
+}
+
+/// \p Size x86-64 functions, each in a section of its own as with
+/// -ffunction-sections and with a line table, made of loops of various
+/// lengths.  The backward branches of the longer loops need relaxing.
+static void generateAsmFunctions(raw_ostream &OS, unsigned Size) {
+  PseudoRandom Pick;
+  unsigned Line = 1;
+  OS << "  .file 1 \"functions.c\"\n";
+  for (unsigned F = 0; F != Size; ++F) {
+    OS << "  .section .text.f" << F << ",\"ax\",@progbits\n"
+       << "  .globl f" << F << '\n'
+       << "  .p2align 4, 0x90\n"
+       << "f" << F << ":\n"
+       << "  .loc 1 " << Line++ << '\n';
+    for (unsigned L = 0; L != 4; ++L) {
+      OS << ".Lf" << F << '_' << L << ":\n";
+      for (unsigned I = 0, N = Pick(48); I != N; ++I) {
+        if (I % 8 == 0)
+          OS << "  .loc 1 " << Line++ << '\n';
+        OS << "  movl " << 4 * Pick(64) << "(%rdi), %eax\n"
+           << "  addl %eax, " << 4 * Pick(64) << "(%rsi)\n";
+      }
+      OS << "  decl %ecx\n"
+         << "  jne .Lf" << F << '_' << L << '\n';
+    }
+    if (F)
+      OS << "  jmp f" << F - 1 << '\n';
+    else
+      OS << "  retq\n";
+  }
+}
+
+namespace {
+struct Generator {
+  const char *Name;
+  void (*Generate)(raw_ostream &OS, unsigned Size);
+  /// The size at -scale=100.
+  unsigned DefaultSize;
+  /// Whether this generates assembly rather than IR.
+  bool IsAssembly;
+};
+} // end anonymous namespace
+
+static const Generator Generators[] = {
+    {"loops", generateLoopNests, 64, false},
+    {"switch", generateSwitch, 2000, false},
+    {"switch-chain", generateSwitchChain, 1000, false},
+    {"block", generateBigBlock, 20000, false},
+    {"globals", generateGlobals, 10000, false},
+    {"functions", generateFunctions, 1000, false},
+    {"asm-branches", generateAsmBranches, 100000, true},
+    {"asm-functions", generateAsmFunctions, 2000, true},
+};
+
+static unsigned getScaledSize(unsigned DefaultSize) {
+  return std::max(1u, unsigned(uint64_t(DefaultSize) * Scale / 100));
+}
+
+static std::string findTool(StringRef Name) {
+  ErrorOr<std::string> Path = sys::findProgramByName(Name, {ToolsDir});
+  if (!Path)
+    fail("cannot find " + Name + " in " + ToolsDir);
+  return *Path;
+}
+
+/// Run \p Program with \p Args, its output discarded, and return the wall
+/// time it took.
+static double run(StringRef Program, ArrayRef<std::string> Args) {
+  std::vector<const char *> Argv;
+  Argv.push_back(Program.data());
+  for (const std::string &Arg : Args)
+    Argv.push_back(Arg.c_str());
+  Argv.push_back(nullptr);
+
+  StringRef Null("");
+  const StringRef *Redirects[] = {&Null, &Null, &Null};
+  std::string ErrMsg;
+  sys::TimeValue Start = sys::TimeValue::now();
+  int Result = sys::ExecuteAndWait(Program, Argv.data(), nullptr, Redirects, 0,
+                                   0, &ErrMsg);
+  sys::TimeValue Elapsed = sys::TimeValue::now() - Start;
+  if (Result) {
+    std::string Command = Program;
+    for (const std::string &Arg : Args)
+      Command += " " + Arg;
+    warning("'" + Command + "' failed" +
+            (ErrMsg.empty() ? "" : ": " + ErrMsg));
+    return -1;
+  }
+  return Elapsed.seconds() + Elapsed.microseconds() / 1000000.0;
+}
+
+namespace {
+struct CorpusModule {
+  std::string Name;
+  std::string Path;
+  /// The output of opt -O2, which llc compiles.
+  std::string OptimizedPath;
+  /// Whether Path is an assembly file for llvm-mc rather than IR.
+  bool IsAssembly;
+};
+} // end anonymous namespace
+
+static std::vector<CorpusModule> generateCorpus(StringRef Opt,
+                                                StringRef Stress) {
+  if (std::error_code EC = sys::fs::create_directories(CorpusDir))
+    fail("cannot create " + CorpusDir + ": " + EC.message());
+
+  std::vector<CorpusModule> Corpus;
+  auto getPath = [](StringRef Name, StringRef Extension) {
+    SmallString<128> Path(CorpusDir);
+    sys::path::append(Path, Name + Extension);
+    return Path.str().str();
+  };
+
+  for (const Generator &G : Generators) {
+    std::string Path = getPath(G.Name, G.IsAssembly ? ".s" : ".ll");
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC, sys::fs::F_Text);
+    if (EC)
+      fail("cannot write " + Path + ": " + EC.message());
+    G.Generate(OS, getScaledSize(G.DefaultSize));
+    Corpus.push_back({G.Name, Path, "", G.IsAssembly});
+  }
+
+  for (unsigned I = 0; I != NumStressModules; ++I) {
+    std::string Name = "stress" + utostr(I);
+    std::string Path = getPath(Name, ".ll");
+    if (run(Stress, {"-seed=" + utostr(I),
+                     "-size=" + utostr(getScaledSize(1000)), "-o", Path}) < 0)
+      continue;
+    Corpus.push_back({Name, Path, "", false});
+  }
+
+  for (CorpusModule &M : Corpus) {
+    if (M.IsAssembly)
+      continue;
+    std::string OptimizedPath = getPath(M.Name, ".O2.bc");
+    if (run(Opt, {"-O2", M.Path, "-o", OptimizedPath}) >= 0)
+      M.OptimizedPath = OptimizedPath;
+  }
+  return Corpus;
+}
+
+//===----------------------------------------------------------------------===//
+// Measurements
+//===----------------------------------------------------------------------===//
+
+static StringRef getScalar(yaml::Node *N, SmallVectorImpl<char> &Storage) {
+  if (auto *S = dyn_cast_or_null<yaml::ScalarNode>(N))
+    return S->getValue(Storage);
+  return StringRef();
+}
+
+static double getNumber(yaml::Node *N) {
+  SmallString<32> Storage;
+  return std::strtod(getScalar(N, Storage).str().c_str(), nullptr);
+}
+
+/// Add up the wall time of each pass in the -pass-report file \p Path.
+static bool readPassReport(StringRef Path, StringMap<double> &Times) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer)
+    return false;
+
+  SourceMgr SM;
+  yaml::Stream Stream((*Buffer)->getBuffer(), SM);
+  auto *Root = dyn_cast_or_null<yaml::MappingNode>(Stream.begin()->getRoot());
+  if (!Root)
+    return false;
+  for (yaml::KeyValueNode &KV : *Root) {
+    SmallString<16> KeyStorage;
+    auto *Passes = dyn_cast_or_null<yaml::SequenceNode>(KV.getValue());
+    if (getScalar(KV.getKey(), KeyStorage) != "passes" || !Passes) {
+      KV.skip();
+      continue;
+    }
+    for (yaml::Node &Run : *Passes) {
+      auto *Record = dyn_cast<yaml::MappingNode>(&Run);
+      if (!Record)
+        return false;
+      std::string Pass;
+      double Wall = 0;
+      for (yaml::KeyValueNode &Field : *Record) {
+        SmallString<16> FieldStorage;
+        StringRef Key = getScalar(Field.getKey(), FieldStorage);
+        SmallString<64> ValueStorage;
+        if (Key == "pass")
+          Pass = getScalar(Field.getValue(), ValueStorage);
+        else if (Key == "wall")
+          Wall = getNumber(Field.getValue());
+        else
+          Field.skip();
+      }
+      Times[Pass] += Wall;
+    }
+  }
+  return !Stream.failed();
+}
+
+namespace {
+struct Pipeline {
+  const char *Name;
+  const char *Tool;
+  std::vector<const char *> Flags;
+  /// The number of partitions llc -split-codegen splits the module into, or 0
+  /// if the pipeline compiles it whole.
+  unsigned Partitions;
+};
+
+/// The times of every repeat of one pipeline on one module of the corpus.
+struct Benchmark {
+  std::string Input;
+  std::string Pipeline;
+  std::vector<double> Total;
+  std::map<std::string, std::vector<double>> Passes;
+};
+
+struct Summary {
+  double Median, Min, Mean, StdDev;
+};
+} // end anonymous namespace
+
+static const Pipeline Pipelines[] = {
+    {"opt -O2", "opt", {"-O2"}},
+    {"opt -O3", "opt", {"-O3"}},
+    {"llc -O2", "llc", {"-O2"}},
+    // Code generation of balanced partitions on threads of their own, without
+    // a pass report, which isn't kept across threads.
+    {"llc -O2 -split-codegen=4", "llc", {"-O2", "-split-codegen=4"}, 4},
+    // Little more than reading, verifying and freeing the module, to measure
+    // the cost of building and tearing down the IR.
+    {"opt -verify", "opt", {"-verify"}},
+    {"opt -verify -instruction-arena", "opt",
+     {"-verify", "-instruction-arena"}},
+    // Only run on the assembly files of the corpus, and without a pass report.
+    {"llvm-mc -filetype=obj", "llvm-mc",
+     {"-triple=x86_64-unknown-linux-gnu", "-filetype=obj"}},
+};
+
+static Summary summarize(std::vector<double> Samples) {
+  Summary S = {0, 0, 0, 0};
+  if (Samples.empty())
+    return S;
+  std::sort(Samples.begin(), Samples.end());
+  unsigned N = Samples.size();
+  S.Median = N % 2 ? Samples[N / 2] : (Samples[N / 2 - 1] + Samples[N / 2]) / 2;
+  S.Min = Samples.front();
+  for (double X : Samples)
+    S.Mean += X / N;
+  for (double X : Samples)
+    S.StdDev += (X - S.Mean) * (X - S.Mean) / N;
+  S.StdDev = std::sqrt(S.StdDev);
+  return S;
+}
+
+static bool runBenchmark(const CorpusModule &M, const Pipeline &P,
+                         StringRef Tool, Benchmark &B) {
+  bool IsLLC = StringRef(P.Tool) == "llc";
+  bool IsMC = StringRef(P.Tool) == "llvm-mc";
+  if (IsMC != M.IsAssembly || (IsLLC && M.OptimizedPath.empty()))
+    return false;
+
+  SmallString<128> ReportPath;
+  if (std::error_code EC = sys::fs::createTemporaryFile(
+          "compile-bench", IsMC ? "o" : "json", ReportPath))
+    fail("cannot create a temporary file: " + EC.message());
+  FileRemover RemoveReport(ReportPath);
+
+  // The partitions are written next to the -o file, named after it.
+  std::list<FileRemover> RemoveParts;
+  for (unsigned I = 0; I != P.Partitions; ++I)
+    RemoveParts.emplace_back(Twine(ReportPath) + "." + Twine(I));
+
+  std::vector<std::string> Args(P.Flags.begin(), P.Flags.end());
+  if (IsMC) {
+    // llvm-mc has no pass report; the object file goes in its place.
+    Args.push_back("-o");
+    Args.push_back(ReportPath.str());
+    Args.push_back(M.Path);
+  } else if (P.Partitions) {
+    Args.push_back("-filetype=null");
+    Args.push_back("-o");
+    Args.push_back(ReportPath.str());
+    Args.push_back(M.OptimizedPath);
+  } else if (IsLLC) {
+    Args.push_back("-pass-report=" + ReportPath.str().str());
+    Args.push_back("-filetype=null");
+    Args.push_back(M.OptimizedPath);
+  } else {
+    Args.push_back("-pass-report=" + ReportPath.str().str());
+    Args.push_back("-disable-output");
+    Args.push_back(M.Path);
+  }
+
+  B.Input = M.Name;
+  B.Pipeline = P.Name;
+  for (unsigned R = 0; R != Repeats; ++R) {
+    double Total = run(Tool, Args);
+    StringMap<double> Times;
+    if (Total < 0)
+      return false;
+    if (!IsMC && !P.Partitions && !readPassReport(ReportPath, Times)) {
+      warning("cannot read the pass report of '" + B.Pipeline + "' on " +
+              B.Input);
+      return false;
+    }
+    B.Total.push_back(Total);
+    for (const auto &T : Times)
+      B.Passes[T.getKey()].push_back(T.getValue());
+  }
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Results
+//===----------------------------------------------------------------------===//
+
+static void writeSummary(raw_ostream &OS, const Summary &S) {
+  OS << format("\"median\": %.6f, \"min\": %.6f, \"mean\": %.6f, "
+               "\"stddev\": %.6f",
+               S.Median, S.Min, S.Mean, S.StdDev);
+}
+
+static void writeResults(raw_ostream &OS, ArrayRef<Benchmark> Benchmarks) {
+  OS << "{\n"
+     << "  \"repeats\": " << Repeats << ",\n"
+     << "  \"benchmarks\": [";
+  for (unsigned I = 0, E = Benchmarks.size(); I != E; ++I) {
+    const Benchmark &B = Benchmarks[I];
+    OS << (I ? ",\n" : "\n") << "    {\n"
+       << "      \"input\": ";
+    PrintJSONString(B.Input, OS);
+    OS << ",\n"
+       << "      \"pipeline\": ";
+    PrintJSONString(B.Pipeline, OS);
+    OS << ",\n"
+       << "      \"total\": {";
+    writeSummary(OS, summarize(B.Total));
+    OS << "},\n"
+       << "      \"passes\": [";
+    bool First = true;
+    for (const auto &P : B.Passes) {
+      OS << (First ? "\n" : ",\n") << "        {\"pass\": ";
+      PrintJSONString(P.first, OS);
+      OS << ", ";
+      writeSummary(OS, summarize(P.second));
+      OS << '}';
+      First = false;
+    }
+    OS << "\n      ]\n"
+       << "    }";
+  }
+  OS << "\n  ]\n"
+     << "}\n";
+}
+
+/// The name the total time of a benchmark is compared under.
+static const char TotalName[] = "<total>";
+
+static std::string getBaselineKey(StringRef Input, StringRef Pipeline,
+                                  StringRef Pass) {
+  return (Input + "|" + Pipeline + "|" + Pass).str();
+}
+
+/// Read the median times of the results in \p Path, keyed by
+/// getBaselineKey().
+static void readBaseline(StringRef Path, StringMap<double> &Medians) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer)
+    fail("cannot read " + Path + ": " + Buffer.getError().message());
+
+  auto getMedian = [](yaml::Node *N) {
+    double Median = 0;
+    if (auto *Times = dyn_cast_or_null<yaml::MappingNode>(N))
+      for (yaml::KeyValueNode &KV : *Times) {
+        SmallString<16> Storage;
+        if (getScalar(KV.getKey(), Storage) == "median")
+          Median = getNumber(KV.getValue());
+        else
+          KV.skip();
+      }
+    return Median;
+  };
+
+  SourceMgr SM;
+  yaml::Stream Stream((*Buffer)->getBuffer(), SM);
+  auto *Root = dyn_cast_or_null<yaml::MappingNode>(Stream.begin()->getRoot());
+  if (!Root)
+    fail("invalid baseline " + Path);
+  for (yaml::KeyValueNode &KV : *Root) {
+    SmallString<16> KeyStorage;
+    auto *Benchmarks = dyn_cast_or_null<yaml::SequenceNode>(KV.getValue());
+    if (getScalar(KV.getKey(), KeyStorage) != "benchmarks" || !Benchmarks) {
+      KV.skip();
+      continue;
+    }
+    for (yaml::Node &BN : *Benchmarks) {
+      auto *B = dyn_cast<yaml::MappingNode>(&BN);
+      if (!B)
+        fail("invalid baseline " + Path);
+      std::string Input, Pipeline;
+      std::vector<std::pair<std::string, double>> Times;
+      for (yaml::KeyValueNode &Field : *B) {
+        SmallString<16> FieldStorage;
+        StringRef Key = getScalar(Field.getKey(), FieldStorage);
+        SmallString<64> ValueStorage;
+        if (Key == "input") {
+          Input = getScalar(Field.getValue(), ValueStorage);
+        } else if (Key == "pipeline") {
+          Pipeline = getScalar(Field.getValue(), ValueStorage);
+        } else if (Key == "total") {
+          Times.push_back({TotalName, getMedian(Field.getValue())});
+        } else if (Key == "passes") {
+          auto *Passes = dyn_cast_or_null<yaml::SequenceNode>(Field.getValue());
+          if (!Passes)
+            fail("invalid baseline " + Path);
+          for (yaml::Node &PN : *Passes) {
+            auto *P = dyn_cast<yaml::MappingNode>(&PN);
+            if (!P)
+              fail("invalid baseline " + Path);
+            std::string Pass;
+            double Median = 0;
+            for (yaml::KeyValueNode &PF : *P) {
+              SmallString<16> PFStorage;
+              StringRef PKey = getScalar(PF.getKey(), PFStorage);
+              SmallString<64> PValueStorage;
+              if (PKey == "pass")
+                Pass = getScalar(PF.getValue(), PValueStorage);
+              else if (PKey == "median")
+                Median = getNumber(PF.getValue());
+              else
+                PF.skip();
+            }
+            Times.push_back({Pass, Median});
+          }
+        } else {
+          Field.skip();
+        }
+      }
+      for (const auto &T : Times)
+        Medians[getBaselineKey(Input, Pipeline, T.first)] = T.second;
+    }
+  }
+  if (Stream.failed())
+    fail("invalid baseline " + Path);
+}
+
+/// Print the median times that regressed compared to \p Baseline, and return
+/// how many did.
+static unsigned compareWithBaseline(ArrayRef<Benchmark> Benchmarks,
+                                    const StringMap<double> &Baseline) {
+  unsigned NumRegressions = 0;
+  auto compare = [&](const Benchmark &B, StringRef Pass,
+                     ArrayRef<double> Samples) {
+    auto I = Baseline.find(getBaselineKey(B.Input, B.Pipeline, Pass));
+    double Median = summarize(Samples).Median;
+    if (I == Baseline.end() || Median < MinTime ||
+        Median <= I->getValue() * (1 + Threshold / 100))
+      return;
+    ++NumRegressions;
+    errs() << "regression: " << B.Input << ", " << B.Pipeline << ", " << Pass
+           << format(": %.6fs -> %.6fs", I->getValue(), Median);
+    if (I->getValue() > 0)
+      errs() << format(" (+%.1f%%)", (Median / I->getValue() - 1) * 100);
+    errs() << '\n';
+  };
+
+  for (const Benchmark &B : Benchmarks) {
+    compare(B, TotalName, B.Total);
+    for (const auto &P : B.Passes)
+      compare(B, P.first, P.second);
+  }
+  return NumRegressions;
+}
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y; // Call llvm_shutdown() on exit.
+  cl::ParseCommandLineOptions(argc, argv, "LLVM compile-time benchmark\n");
+  ProgName = argv[0];
+
+  if (ToolsDir.empty())
+    ToolsDir = sys::path::parent_path(
+        sys::fs::getMainExecutable(argv[0], (void *)&main));
+  std::string Opt = findTool("opt");
+  std::string LLC = findTool("llc");
+  std::string MC = findTool("llvm-mc");
+  std::string Stress = findTool("llvm-stress");
+
+  StringMap<double> Baseline;
+  if (!BaselineFilename.empty())
+    readBaseline(BaselineFilename, Baseline);
+
+  std::vector<CorpusModule> Corpus = generateCorpus(Opt, Stress);
+  std::vector<Benchmark> Benchmarks;
+  for (const CorpusModule &M : Corpus)
+    for (const Pipeline &P : Pipelines) {
+      StringRef Tool = StringSwitch<StringRef>(P.Tool)
+                           .Case("llc", LLC)
+                           .Case("llvm-mc", MC)
+                           .Default(Opt);
+      Benchmark B;
+      if (runBenchmark(M, P, Tool, B))
+        Benchmarks.push_back(std::move(B));
+    }
+
+  std::error_code EC;
+  tool_output_file Out(OutputFilename, EC, sys::fs::F_Text);
+  if (EC)
+    fail("cannot write " + OutputFilename + ": " + EC.message());
+  writeResults(Out.os(), Benchmarks);
+  Out.keep();
+
+  if (BaselineFilename.empty())
+    return 0;
+  unsigned NumRegressions = compareWithBaseline(Benchmarks, Baseline);
+  errs() << NumRegressions << " regression(s) against " << BaselineFilename
+         << '\n';
+  return NumRegressions ? 1 : 0;
+}
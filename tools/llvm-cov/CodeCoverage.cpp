@@ -19,6 +19,7 @@
 #include "RenderingSupport.h"
 #include "SourceCoverageView.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/ProfileData/Coverage/CoverageMapping.h"
@@ -28,7 +29,10 @@
 #include "llvm/Support/Format.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/ThreadPool.h"
+#include <atomic>
 #include <functional>
+#include <mutex>
 #include <system_error>
 
 using namespace llvm;
@@ -67,6 +71,11 @@ public:
   std::unique_ptr<SourceCoverageView>
   createSourceFileView(StringRef SourceFile, CoverageMapping &Coverage);
 
+  /// \brief Render the main source view of \p SourceFile to its view file.
+  /// \returns false if the view file couldn't be created.
+  bool renderSourceFile(StringRef SourceFile, CoverageMapping &Coverage,
+                        CoveragePrinter &Printer, bool ShowFilenames);
+
   /// \brief Load the coverage mapping data. Return true if an error occured.
   std::unique_ptr<CoverageMapping> load();
 
@@ -87,6 +96,10 @@ public:
   std::vector<StringRef> SourceFiles;
   std::vector<std::pair<std::string, std::unique_ptr<MemoryBuffer>>>
       LoadedSourceFiles;
+  /// Guards LoadedSourceFiles when source files are rendered concurrently.
+  std::mutex LoadedSourceFilesLock;
+  /// Serializes diagnostics when source files are rendered concurrently.
+  std::mutex ErrsLock;
   bool CompareFilenamesOnly;
   StringMap<std::string> RemappedFilenames;
   std::string CoverageArch;
@@ -97,6 +110,7 @@ private:
 }
 
 void CodeCoverageTool::error(const Twine &Message, StringRef Whence) {
+  std::unique_lock<std::mutex> Guard(ErrsLock);
   errs() << "error: ";
   if (!Whence.empty())
     errs() << Whence << ": ";
@@ -116,11 +130,13 @@ CodeCoverageTool::getSourceFile(StringRef SourceFile) {
     if (Loc != RemappedFilenames.end())
       SourceFile = Loc->second;
   }
+  std::unique_lock<std::mutex> Guard(LoadedSourceFilesLock);
   for (const auto &Files : LoadedSourceFiles)
     if (sys::fs::equivalent(SourceFile, Files.first))
       return *Files.second;
   auto Buffer = MemoryBuffer::getFile(SourceFile);
   if (auto EC = Buffer.getError()) {
+    Guard.unlock();
     error(EC.message(), SourceFile);
     return EC;
   }
@@ -204,6 +220,31 @@ CodeCoverageTool::createSourceFileView(StringRef SourceFile,
   return View;
 }
 
+bool CodeCoverageTool::renderSourceFile(StringRef SourceFile,
+                                        CoverageMapping &Coverage,
+                                        CoveragePrinter &Printer,
+                                        bool ShowFilenames) {
+  auto mainView = createSourceFileView(SourceFile, Coverage);
+  if (!mainView) {
+    std::unique_lock<std::mutex> Guard(ErrsLock);
+    ViewOpts.colored_ostream(errs(), raw_ostream::RED)
+        << "warning: The file '" << SourceFile << "' isn't covered.";
+    errs() << "\n";
+    return true;
+  }
+
+  auto OSOrErr = Printer.createViewFile(SourceFile, /*InToplevel=*/false);
+  if (Error E = OSOrErr.takeError()) {
+    error(toString(std::move(E)));
+    return false;
+  }
+  auto OS = std::move(OSOrErr.get());
+  mainView->print(*OS.get(), /*Wholefile=*/true,
+                  /*ShowSourceName=*/ShowFilenames);
+  Printer.closeViewFile(std::move(OS));
+  return true;
+}
+
 static bool modifiedTimeGT(StringRef LHS, StringRef RHS) {
   sys::fs::file_status Status;
   if (sys::fs::status(LHS, Status))
@@ -323,9 +364,18 @@ int CodeCoverageTool::run(Command Cmd, int argc, const char **argv) {
       "use-color", cl::desc("Emit colored output (default=autodetect)"),
       cl::init(cl::BOU_UNSET));
 
+  cl::opt<unsigned> NumThreads(
+      "num-threads", cl::init(0),
+      cl::desc("Number of threads to use to render source files with "
+               "-output-dir, and to compute file summaries "
+               "(0 = number of cores)"));
+  cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
+                        cl::aliasopt(NumThreads));
+
   auto commandLineParser = [&, this](int argc, const char **argv) -> int {
     cl::ParseCommandLineOptions(argc, argv, "LLVM code coverage tool\n");
     ViewOpts.Debug = DebugDump;
+    ViewOpts.NumThreads = NumThreads;
     CompareFilenamesOnly = FilenameEquivalence;
 
     ViewOpts.Format = Format;
@@ -497,32 +547,42 @@ int CodeCoverageTool::show(int argc, const char **argv,
     for (StringRef Filename : Coverage->getUniqueSourceFiles())
       SourceFiles.push_back(Filename);
 
-  // Create an index out of the source files.
-  if (ViewOpts.hasOutputDirectory()) {
-    if (Error E = Printer->createIndexFile(SourceFiles)) {
-      error(toString(std::move(E)));
-      return 1;
+  // In -output-dir mode, each source file gets its own view file, so they can
+  // be rendered concurrently. Otherwise they are all printed to stdout, in
+  // order.
+  unsigned ThreadCount = 1;
+  if (ViewOpts.hasOutputDirectory())
+    ThreadCount = ViewOpts.getThreadCount();
+
+  if (ThreadCount > 1) {
+    std::atomic<bool> Failed(false);
+    ThreadPool Pool(ThreadCount);
+    // Rendering a file twice at the same time would clobber its view file.
+    StringSet<> Scheduled;
+    for (StringRef SourceFile : SourceFiles) {
+      if (!Scheduled.insert(SourceFile).second)
+        continue;
+      Pool.async([this, SourceFile, &Coverage, &Printer, ShowFilenames,
+                  &Failed] {
+        if (!renderSourceFile(SourceFile, *Coverage, *Printer, ShowFilenames))
+          Failed = true;
+      });
     }
+    Pool.wait();
+    if (Failed)
+      return 1;
+  } else {
+    for (StringRef SourceFile : SourceFiles)
+      if (!renderSourceFile(SourceFile, *Coverage, *Printer, ShowFilenames))
+        return 1;
   }
 
-  for (const auto &SourceFile : SourceFiles) {
-    auto mainView = createSourceFileView(SourceFile, *Coverage);
-    if (!mainView) {
-      ViewOpts.colored_ostream(errs(), raw_ostream::RED)
-          << "warning: The file '" << SourceFile << "' isn't covered.";
-      errs() << "\n";
-      continue;
-    }
-
-    auto OSOrErr = Printer->createViewFile(SourceFile, /*InToplevel=*/false);
-    if (Error E = OSOrErr.takeError()) {
+  // Create an index out of the source files, once all of them are rendered.
+  if (ViewOpts.hasOutputDirectory()) {
+    if (Error E = Printer->createIndexFile(SourceFiles)) {
       error(toString(std::move(E)));
       return 1;
     }
-    auto OS = std::move(OSOrErr.get());
-    mainView->print(*OS.get(), /*Wholefile=*/true,
-                    /*ShowSourceName=*/ShowFilenames);
-    Printer->closeViewFile(std::move(OS));
   }
 
   return 0;
@@ -15,6 +15,8 @@
 #include "RenderingSupport.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/ThreadPool.h"
+#include <functional>
 
 using namespace llvm;
 namespace {
@@ -219,14 +221,29 @@ void CoverageReport::renderFileReports(raw_ostream &OS) {
   renderDivider(FileReportColumns, OS);
   OS << "\n";
 
+  // Compute the summaries of the files concurrently, then render them in
+  // order.
+  std::vector<StringRef> Files = Coverage->getUniqueSourceFiles();
+  std::vector<FileCoverageSummary> Summaries(Files.begin(), Files.end());
+  auto Summarize = [this](FileCoverageSummary &Summary) {
+    for (const auto &F : Coverage->getCoveredFunctions(Summary.Name))
+      Summary.addFunction(FunctionCoverageSummary::get(F));
+  };
+  unsigned ThreadCount = std::min<size_t>(Options.getThreadCount(),
+                                          Summaries.size());
+  if (ThreadCount > 1) {
+    ThreadPool Pool(ThreadCount);
+    for (FileCoverageSummary &Summary : Summaries)
+      Pool.async(Summarize, std::ref(Summary));
+    Pool.wait();
+  } else {
+    for (FileCoverageSummary &Summary : Summaries)
+      Summarize(Summary);
+  }
+
   FileCoverageSummary Totals("TOTAL");
-  for (StringRef Filename : Coverage->getUniqueSourceFiles()) {
-    FileCoverageSummary Summary(Filename);
-    for (const auto &F : Coverage->getCoveredFunctions(Filename)) {
-      FunctionCoverageSummary Function = FunctionCoverageSummary::get(F);
-      Summary.addFunction(Function);
-      Totals.addFunction(Function);
-    }
+  for (const FileCoverageSummary &Summary : Summaries) {
+    Totals.add(Summary);
     render(Summary, OS);
   }
   renderDivider(FileReportColumns, OS);
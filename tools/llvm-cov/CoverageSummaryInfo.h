@@ -110,6 +110,12 @@ struct FunctionCoverageInfo {
     ++NumFunctions;
   }
 
+  FunctionCoverageInfo &operator+=(const FunctionCoverageInfo &RHS) {
+    Executed += RHS.Executed;
+    NumFunctions += RHS.NumFunctions;
+    return *this;
+  }
+
   bool isFullyCovered() const { return Executed == NumFunctions; }
 
   double getPercentCovered() const {
@@ -155,6 +161,12 @@ struct FileCoverageSummary {
     LineCoverage += Function.LineCoverage;
     FunctionCoverage.addFunction(/*Covered=*/Function.ExecutionCount > 0);
   }
+
+  void add(const FileCoverageSummary &File) {
+    RegionCoverage += File.RegionCoverage;
+    LineCoverage += File.LineCoverage;
+    FunctionCoverage += File.FunctionCoverage;
+  }
 };
 
 } // namespace llvm
@@ -11,6 +11,8 @@
 #define LLVM_COV_COVERAGEVIEWOPTIONS_H
 
 #include "RenderingSupport.h"
+#include <algorithm>
+#include <thread>
 
 namespace llvm {
 
@@ -32,6 +34,7 @@ struct CoverageViewOptions {
   bool ShowFullFilenames;
   OutputFormat Format;
   std::string ShowOutputDirectory;
+  unsigned NumThreads;
 
   /// \brief Change the output's stream color if the colors are enabled.
   ColoredRawOstream colored_ostream(raw_ostream &OS,
@@ -41,6 +44,14 @@ struct CoverageViewOptions {
 
   /// \brief Check if an output directory has been specified.
   bool hasOutputDirectory() const { return ShowOutputDirectory != ""; }
+
+  /// \brief Return the number of threads to use, resolving the default of 0
+  /// to the number of cores.
+  unsigned getThreadCount() const {
+    if (NumThreads)
+      return NumThreads;
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
 };
 }
 
@@ -120,6 +120,15 @@ static cl::opt<std::string> ThinLTOModuleId(
 static cl::opt<std::string>
     ThinLTOCacheDir("thinlto-cache-dir", cl::desc("Enable ThinLTO caching."));
 
+static cl::opt<unsigned long long> ThinLTOCacheMaxSizeBytes(
+    "thinlto-cache-max-size-bytes", cl::init(0),
+    cl::desc("Maximum size of the ThinLTO cache, in bytes (0 for no limit)."));
+
+static cl::opt<unsigned long long> ThinLTOMemoryBudget(
+    "thinlto-memory-budget", cl::init(0),
+    cl::desc("Estimated memory, in bytes, the ThinLTO backends running in "
+             "parallel may use (0 for no limit)."));
+
 static cl::opt<bool>
     SaveModuleFile("save-merged-module", cl::init(false),
                    cl::desc("Write merged LTO module to file before CodeGen"));
@@ -393,6 +402,8 @@ public:
     ThinGenerator.setCodePICModel(getRelocModel());
     ThinGenerator.setTargetOptions(Options);
     ThinGenerator.setCacheDir(ThinLTOCacheDir);
+    ThinGenerator.setMaxCacheSizeBytes(ThinLTOCacheMaxSizeBytes);
+    ThinGenerator.setMemoryBudget(ThinLTOMemoryBudget);
 
     // Add all the exported symbols to the table of symbols to preserve.
     for (unsigned i = 0; i < ExportedSymbols.size(); ++i)
@@ -69,6 +69,17 @@ CompressDebugSections("compress-debug-sections", cl::ValueOptional,
       "Use zlib-gnu compression (depricated)"),
     clEnumValEnd));
 
+static cl::opt<zlib::CompressionLevel> CompressDebugSectionsLevel(
+    "compress-debug-sections-level", cl::init(zlib::DefaultCompression),
+    cl::desc("Choose the zlib level of DWARF debug sections compression:"),
+    cl::values(clEnumValN(zlib::BestSpeedCompression, "fast",
+                          "Compress fast"),
+               clEnumValN(zlib::DefaultCompression, "default",
+                          "Use the default zlib level"),
+               clEnumValN(zlib::BestSizeCompression, "best",
+                          "Compress best"),
+               clEnumValEnd));
+
 static cl::opt<bool>
 ShowInst("show-inst", cl::desc("Show internal instruction representation"));
 
@@ -429,6 +440,7 @@ int main(int argc, char **argv) {
       return 1;
     }
     MAI->setCompressDebugSections(CompressDebugSections);
+    MAI->setCompressDebugSectionsLevel(CompressDebugSectionsLevel);
   }
 
   // FIXME: This is not pretty. MCContext has a ptr to MCObjectFileInfo and
@@ -13,6 +13,7 @@
 
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/ProfileData/InstrProfReader.h"
@@ -29,8 +30,10 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
+#include <mutex>
 
 using namespace llvm;
 
@@ -117,9 +120,110 @@ struct WeightedFile {
 };
 typedef SmallVector<WeightedFile, 5> WeightedFileVector;
 
+/// A context for a merge task: a writer to accumulate records into, and the
+/// first fatal error encountered while loading its inputs.
+struct WriterContext {
+  InstrProfWriter Writer;
+  Error Err;
+  std::string ErrWhence;
+
+  /// When contexts are merged with each other, the first input each function
+  /// was read from, to report the records that fail to merge.
+  bool TrackOrigins = false;
+  StringMap<StringRef> FuncOrigins;
+
+  /// Shared by all contexts: serializes the printing of per-record merge
+  /// errors and makes sure a hint is only shown the first time an error
+  /// code is seen.
+  std::mutex &ErrLock;
+  SmallSet<instrprof_error, 4> &WriterErrorCodes;
+
+  WriterContext(bool IsSparse, std::mutex &ErrLock,
+                SmallSet<instrprof_error, 4> &WriterErrorCodes)
+      : Writer(IsSparse), Err(Error::success()), ErrLock(ErrLock),
+        WriterErrorCodes(WriterErrorCodes) {}
+};
+
+/// Report a per-record merge error, showing the hint only the first time
+/// an error code is seen.
+static void reportMergeRecordError(WriterContext *WC, Error E,
+                                   StringRef WhenceFile,
+                                   StringRef WhenceFunction) {
+  instrprof_error IPE = InstrProfError::take(std::move(E));
+  std::lock_guard<std::mutex> ErrGuard(WC->ErrLock);
+  bool FirstTime = WC->WriterErrorCodes.insert(IPE).second;
+  handleMergeWriterError(make_error<InstrProfError>(IPE), WhenceFile,
+                         WhenceFunction, FirstTime);
+}
+
+/// Load an input into a writer context.
+static void loadInput(const WeightedFile &Input, WriterContext *WC) {
+  // Once an error has been recorded, the remaining inputs of this context
+  // are skipped: the merge is going to fail anyway.
+  if (WC->Err)
+    return;
+
+  WC->ErrWhence = Input.Filename;
+
+  auto ReaderOrErr = InstrProfReader::create(Input.Filename);
+  if ((WC->Err = ReaderOrErr.takeError()))
+    return;
+
+  auto Reader = std::move(ReaderOrErr.get());
+  bool IsIRProfile = Reader->isIRLevelProfile();
+  if (Error E = WC->Writer.setIsIRLevelProfile(IsIRProfile)) {
+    consumeError(std::move(E));
+    WC->Err = make_error<StringError>(
+        "Merge IR generated profile with Clang generated profile.",
+        inconvertibleErrorCode());
+    WC->ErrWhence.clear();
+    return;
+  }
+
+  for (auto &I : *Reader) {
+    if (WC->TrackOrigins)
+      WC->FuncOrigins.insert(std::make_pair(I.Name, Input.Filename));
+    if (Error E = WC->Writer.addRecord(std::move(I), Input.Weight))
+      reportMergeRecordError(WC, std::move(E), Input.Filename, I.Name);
+  }
+  if (Reader->hasError())
+    WC->Err = Reader->getError();
+}
+
+/// Merge the records of \p Src into \p Dst, leaving \p Src empty. The inputs
+/// of \p Src must all come after the ones of \p Dst, so that the records
+/// that win a conflict are the same as in a serial merge.
+static void mergeWriterContexts(WriterContext *Dst, WriterContext *Src) {
+  if (Dst->Err)
+    return;
+  if (Src->Err) {
+    Dst->Err = std::move(Src->Err);
+    Dst->ErrWhence = std::move(Src->ErrWhence);
+    return;
+  }
+
+  if (Error E = Dst->Writer.mergeRecordsFromWriter(
+          std::move(Src->Writer), [&](Error E, StringRef Func) {
+            reportMergeRecordError(Dst, std::move(E),
+                                   Src->FuncOrigins.lookup(Func), Func);
+          })) {
+    consumeError(std::move(E));
+    Dst->Err = make_error<StringError>(
+        "Merge IR generated profile with Clang generated profile.",
+        inconvertibleErrorCode());
+    Dst->ErrWhence.clear();
+    return;
+  }
+
+  for (const auto &I : Src->FuncOrigins)
+    Dst->FuncOrigins.insert(std::make_pair(I.getKey(), I.getValue()));
+  Src->FuncOrigins.clear();
+}
+
 static void mergeInstrProfile(const WeightedFileVector &Inputs,
                               StringRef OutputFilename,
-                              ProfileFormat OutputFormat, bool OutputSparse) {
+                              ProfileFormat OutputFormat, bool OutputSparse,
+                              unsigned NumThreads) {
   if (OutputFilename.compare("-") == 0)
     exitWithError("Cannot write indexed profdata format to stdout.");
 
@@ -131,34 +235,61 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
   if (EC)
     exitWithErrorCode(EC, OutputFilename);
 
-  InstrProfWriter Writer(OutputSparse);
+  std::mutex ErrorLock;
   SmallSet<instrprof_error, 4> WriterErrorCodes;
-  for (const auto &Input : Inputs) {
-    auto ReaderOrErr = InstrProfReader::create(Input.Filename);
-    if (Error E = ReaderOrErr.takeError())
-      exitWithError(std::move(E), Input.Filename);
-
-    auto Reader = std::move(ReaderOrErr.get());
-    bool IsIRProfile = Reader->isIRLevelProfile();
-    if (Writer.setIsIRLevelProfile(IsIRProfile))
-      exitWithError("Merge IR generated profile with Clang generated profile.");
-
-    for (auto &I : *Reader) {
-      if (Error E = Writer.addRecord(std::move(I), Input.Weight)) {
-        // Only show hint the first time an error occurs.
-        instrprof_error IPE = InstrProfError::take(std::move(E));
-        bool firstTime = WriterErrorCodes.insert(IPE).second;
-        handleMergeWriterError(make_error<InstrProfError>(IPE), Input.Filename,
-                               I.Name, firstTime);
-      }
+
+  // If NumThreads is not specified, auto-detect a good default. There is no
+  // point in using more threads than there are pairs of inputs to merge.
+  if (NumThreads == 0)
+    NumThreads = std::max(1U, std::min(std::thread::hardware_concurrency(),
+                                       unsigned((Inputs.size() + 1) / 2)));
+  NumThreads = std::min(NumThreads, unsigned(Inputs.size()));
+
+  // Initialize the writer contexts.
+  SmallVector<std::unique_ptr<WriterContext>, 4> Contexts;
+  for (unsigned I = 0; I < NumThreads; ++I)
+    Contexts.emplace_back(llvm::make_unique<WriterContext>(
+        OutputSparse, ErrorLock, WriterErrorCodes));
+
+  if (NumThreads == 1) {
+    for (const auto &Input : Inputs)
+      loadInput(Input, Contexts[0].get());
+  } else {
+    ThreadPool Pool(NumThreads);
+
+    // Each context loads a contiguous range of the inputs, in order.
+    for (unsigned Ctx = 0; Ctx < NumThreads; ++Ctx) {
+      Contexts[Ctx]->TrackOrigins = true;
+      Pool.async([&Inputs, &Contexts, Ctx, NumThreads] {
+        size_t Begin = Inputs.size() * Ctx / NumThreads;
+        size_t End = Inputs.size() * (Ctx + 1) / NumThreads;
+        for (size_t I = Begin; I < End; ++I)
+          loadInput(Inputs[I], Contexts[Ctx].get());
+      });
+    }
+    Pool.wait();
+
+    // Reduce the writer contexts pairwise (~ lg(NumThreads) serial steps).
+    // Only neighbouring ranges are merged, the later one into the earlier
+    // one. Conflicting records are then resolved as in a serial merge: the
+    // record of the first input wins, and the first fatal error in input
+    // order is reported.
+    for (unsigned Step = 1; Step < NumThreads; Step *= 2) {
+      for (unsigned I = 0; I + Step < NumThreads; I += 2 * Step)
+        Pool.async(mergeWriterContexts, Contexts[I].get(),
+                   Contexts[I + Step].get());
+      Pool.wait();
     }
-    if (Reader->hasError())
-      exitWithError(Reader->getError(), Input.Filename);
   }
+
+  WriterContext *WC = Contexts[0].get();
+  if (WC->Err)
+    exitWithError(std::move(WC->Err), WC->ErrWhence);
+
   if (OutputFormat == PF_Text)
-    Writer.writeText(Output);
+    WC->Writer.writeText(Output);
   else
-    Writer.write(Output);
+    WC->Writer.write(Output);
 }
 
 static sampleprof::SampleProfileFormat FormatMap[] = {
@@ -288,6 +419,12 @@ static int merge_main(int argc, const char *argv[]) {
                  clEnumValEnd));
   cl::opt<bool> OutputSparse("sparse", cl::init(false),
       cl::desc("Generate a sparse profile (only meaningful for -instr)"));
+  cl::opt<unsigned> NumThreads(
+      "num-threads", cl::init(0),
+      cl::desc("Number of merge threads to use (default: autodetect, only "
+               "meaningful for -instr)"));
+  cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
+                        cl::aliasopt(NumThreads));
 
   cl::ParseCommandLineOptions(argc, argv, "LLVM profile data merger\n");
 
@@ -314,7 +451,7 @@ static int merge_main(int argc, const char *argv[]) {
 
   if (ProfileKind == instr)
     mergeInstrProfile(WeightedInputs, OutputFilename, OutputFormat,
-                      OutputSparse);
+                      OutputSparse, NumThreads);
   else
     mergeSampleProfile(WeightedInputs, OutputFilename, OutputFormat);
 
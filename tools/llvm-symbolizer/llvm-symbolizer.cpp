@@ -15,6 +15,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/DebugInfo/Symbolize/DIPrinter.h"
 #include "llvm/DebugInfo/Symbolize/Symbolize.h"
@@ -30,6 +31,7 @@
 #include <cstdio>
 #include <cstring>
 #include <string>
+#include <vector>
 
 using namespace llvm;
 using namespace symbolize;
@@ -86,6 +88,22 @@ static cl::opt<int> ClPrintSourceContextLines(
     "print-source-context-lines", cl::init(0),
     cl::desc("Print N number of source file context"));
 
+static cl::opt<unsigned long long> ClCacheSize(
+    "cache-size", cl::init(0),
+    cl::desc("Approximate maximum size in bytes of the loaded modules to keep "
+             "cached. Least recently used modules are evicted first. 0 means "
+             "no limit"));
+
+static cl::opt<bool>
+    ClPrintCacheStats("print-cache-stats", cl::init(false),
+                      cl::desc("Print module cache statistics to stderr on "
+                               "exit"));
+
+static cl::opt<bool>
+    ClBatch("batch", cl::init(false),
+            cl::desc("Read all the input before symbolizing it, and symbolize "
+                     "the addresses of each module in a single pass"));
+
 template<typename T>
 static bool error(Expected<T> &ResOrErr) {
   if (ResOrErr)
@@ -148,7 +166,8 @@ int main(int argc, char **argv) {
 
   cl::ParseCommandLineOptions(argc, argv, "llvm-symbolizer\n");
   LLVMSymbolizer::Options Opts(ClPrintFunctions, ClUseSymbolTable, ClDemangle,
-                               ClUseRelativeAddress, ClDefaultArch);
+                               ClUseRelativeAddress, ClDefaultArch,
+                               ClCacheSize);
 
   for (const auto &hint : ClDsymHint) {
     if (sys::path::extension(hint) == ".dSYM") {
@@ -166,7 +185,96 @@ int main(int argc, char **argv) {
   const int kMaxInputStringLength = 1024;
   char InputString[kMaxInputStringLength];
 
-  while (true) {
+  auto PrintAddress = [&](uint64_t ModuleOffset) {
+    if (ClPrintAddress) {
+      outs() << "0x";
+      outs().write_hex(ModuleOffset);
+      StringRef Delimiter = (ClPrettyPrint == true) ? ": " : "\n";
+      outs() << Delimiter;
+    }
+  };
+
+  if (ClBatch) {
+    struct Query {
+      std::string Line;
+      bool Valid;
+      bool IsData;
+      std::string ModuleName;
+      uint64_t ModuleOffset;
+    };
+    std::vector<Query> Queries;
+    while (fgets(InputString, sizeof(InputString), stdin)) {
+      Query Q;
+      Q.Line = InputString;
+      Q.Valid = parseCommand(StringRef(InputString), Q.IsData, Q.ModuleName,
+                             Q.ModuleOffset);
+      Queries.push_back(std::move(Q));
+    }
+
+    // Group the code queries by module, in order of first appearance.
+    StringMap<std::vector<size_t>> QueriesForModule;
+    std::vector<StringRef> ModuleOrder;
+    std::vector<DIGlobal> DataResults(Queries.size());
+    for (size_t I = 0, E = Queries.size(); I != E; ++I) {
+      const Query &Q = Queries[I];
+      if (!Q.Valid)
+        continue;
+      if (Q.IsData) {
+        auto ResOrErr = Symbolizer.symbolizeData(Q.ModuleName, Q.ModuleOffset);
+        DataResults[I] = error(ResOrErr) ? DIGlobal() : ResOrErr.get();
+        continue;
+      }
+      auto R = QueriesForModule.insert(
+          std::make_pair(Q.ModuleName, std::vector<size_t>()));
+      if (R.second)
+        ModuleOrder.push_back(R.first->getKey());
+      R.first->second.push_back(I);
+    }
+
+    std::vector<DIInliningInfo> InliningResults;
+    std::vector<DILineInfo> LineResults;
+    if (ClPrintInlining)
+      InliningResults.resize(Queries.size());
+    else
+      LineResults.resize(Queries.size());
+    for (StringRef ModuleName : ModuleOrder) {
+      const std::vector<size_t> &Indices = QueriesForModule[ModuleName];
+      std::vector<uint64_t> Offsets;
+      for (size_t I : Indices)
+        Offsets.push_back(Queries[I].ModuleOffset);
+      if (ClPrintInlining) {
+        auto ResOrErr =
+            Symbolizer.symbolizeInlinedCodeBatch(ModuleName, Offsets);
+        if (!error(ResOrErr))
+          for (size_t J = 0, E = Indices.size(); J != E; ++J)
+            InliningResults[Indices[J]] = std::move(ResOrErr.get()[J]);
+      } else {
+        auto ResOrErr = Symbolizer.symbolizeCodeBatch(ModuleName, Offsets);
+        if (!error(ResOrErr))
+          for (size_t J = 0, E = Indices.size(); J != E; ++J)
+            LineResults[Indices[J]] = std::move(ResOrErr.get()[J]);
+      }
+    }
+
+    for (size_t I = 0, E = Queries.size(); I != E; ++I) {
+      const Query &Q = Queries[I];
+      if (!Q.Valid) {
+        outs() << Q.Line;
+        continue;
+      }
+      PrintAddress(Q.ModuleOffset);
+      if (Q.IsData)
+        Printer << DataResults[I];
+      else if (ClPrintInlining)
+        Printer << InliningResults[I];
+      else
+        Printer << LineResults[I];
+      outs() << "\n";
+    }
+    outs().flush();
+  }
+
+  while (!ClBatch) {
     if (!fgets(InputString, sizeof(InputString), stdin))
       break;
 
@@ -179,12 +287,7 @@ int main(int argc, char **argv) {
       continue;
     }
 
-    if (ClPrintAddress) {
-      outs() << "0x";
-      outs().write_hex(ModuleOffset);
-      StringRef Delimiter = (ClPrettyPrint == true) ? ": " : "\n";
-      outs() << Delimiter;
-    }
+    PrintAddress(ModuleOffset);
     if (IsData) {
       auto ResOrErr = Symbolizer.symbolizeData(ModuleName, ModuleOffset);
       Printer << (error(ResOrErr) ? DIGlobal() : ResOrErr.get());
@@ -200,5 +303,13 @@ int main(int argc, char **argv) {
     outs().flush();
   }
 
+  if (ClPrintCacheStats) {
+    const LLVMSymbolizer::CacheStats &Stats = Symbolizer.getCacheStats();
+    errs() << "Module cache hits: " << Stats.Hits << "\n"
+           << "Module cache misses: " << Stats.Misses << "\n"
+           << "Module cache evictions: " << Stats.Evictions << "\n"
+           << "Cached binaries: " << Symbolizer.getNumCachedBinaries() << "\n";
+  }
+
   return 0;
 }
@@ -486,6 +486,11 @@ void thinlto_codegen_set_codegen_only(thinlto_code_gen_t cg,
   unwrap(cg)->setCodeGenOnly(CodeGenOnly);
 }
 
+void thinlto_codegen_set_memory_budget(thinlto_code_gen_t cg,
+                                       unsigned long long Bytes) {
+  unwrap(cg)->setMemoryBudget(Bytes);
+}
+
 void thinlto_debug_options(const char *const *options, int number) {
   // if options were requested, set them
   if (number && options) {
@@ -534,6 +539,11 @@ void thinlto_codegen_set_final_cache_size_relative_to_available_space(
   return unwrap(cg)->setMaxCacheSizeRelativeToAvailableSpace(Percentage);
 }
 
+void thinlto_codegen_set_cache_size_bytes(thinlto_code_gen_t cg,
+                                          unsigned long long bytes) {
+  return unwrap(cg)->setMaxCacheSizeBytes(bytes);
+}
+
 void thinlto_codegen_set_savetemps_dir(thinlto_code_gen_t cg,
                                        const char *save_temps_dir) {
   return unwrap(cg)->setSaveTempsDir(save_temps_dir);
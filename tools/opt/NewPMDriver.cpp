@@ -47,6 +47,11 @@ static cl::opt<std::string>
                         "pipeline for handling managed aliasing queries"),
                cl::Hidden);
 
+static cl::opt<unsigned> FunctionPassThreads(
+    "function-pass-threads", cl::init(1), cl::value_desc("N"),
+    cl::desc("Run the function pipelines of the \"passes\" flag over N "
+             "functions at once (0 = one per hardware thread)"));
+
 bool llvm::runPassPipeline(StringRef Arg0, LLVMContext &Context, Module &M,
                            TargetMachine *TM, tool_output_file *Out,
                            StringRef PassPipeline, OutputKind OK,
@@ -78,6 +83,8 @@ bool llvm::runPassPipeline(StringRef Arg0, LLVMContext &Context, Module &M,
   PB.registerLoopAnalyses(LAM);
   PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
 
+  PB.setFunctionPassThreads(FunctionPassThreads, AAPipeline);
+
   ModulePassManager MPM(DebugPM);
   if (VK > VK_NoVerifier)
     MPM.addPass(VerifierPass());
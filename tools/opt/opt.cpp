@@ -15,6 +15,7 @@
 #include "BreakpointPrinter.h"
 #include "NewPMDriver.h"
 #include "PassPrinters.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Analysis/CallGraphSCCPass.h"
@@ -27,6 +28,7 @@
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/IRPrintingPasses.h"
+#include "llvm/IR/InstructionArena.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/LegacyPassNameParser.h"
@@ -215,6 +217,16 @@ static cl::opt<bool> DiscardValueNames(
     cl::desc("Discard names from Value (other than GlobalValue)."),
     cl::init(false), cl::Hidden);
 
+static cl::opt<bool> UseInstructionArena(
+    "instruction-arena",
+    cl::desc("Allocate the instructions of the module in an arena"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> FastTeardown(
+    "fast-teardown",
+    cl::desc("Free the IR without keeping it consistent when done with it"),
+    cl::init(true), cl::Hidden);
+
 static inline void addPass(legacy::PassManagerBase &PM, Pass *P) {
   // Add the pass to the pass manager...
   PM.add(P);
@@ -384,6 +396,12 @@ int main(int argc, char **argv) {
   if (!DisableDITypeMap)
     Context.enableDebugTypeODRUniquing();
 
+  // The arena must outlive the module, whose instructions are placed in it.
+  InstructionArena Arena;
+  Optional<InstructionArena::Scope> ArenaScope;
+  if (UseInstructionArena)
+    ArenaScope.emplace(Arena);
+
   // Load the input module...
   std::unique_ptr<Module> M = parseIRFile(InputFilename, Err, Context);
 
@@ -466,11 +484,13 @@ int main(int argc, char **argv) {
     // The user has asked to use the new pass manager and provided a pipeline
     // string. Hand off the rest of the functionality to the new code for that
     // layer.
-    return runPassPipeline(argv[0], Context, *M, TM.get(), Out.get(),
-                           PassPipeline, OK, VK, PreserveAssemblyUseListOrder,
-                           PreserveBitcodeUseListOrder)
-               ? 0
-               : 1;
+    bool Success =
+        runPassPipeline(argv[0], Context, *M, TM.get(), Out.get(),
+                        PassPipeline, OK, VK, PreserveAssemblyUseListOrder,
+                        PreserveBitcodeUseListOrder);
+    if (FastTeardown)
+      Context.enableFastTeardown();
+    return Success ? 0 : 1;
   }
 
   // Create a PassManager to hold and optimize the collection of passes we are
@@ -691,5 +711,7 @@ int main(int argc, char **argv) {
   if (!NoOutput || PrintBreakpoints)
     Out->keep();
 
+  if (FastTeardown)
+    Context.enableFastTeardown();
   return 0;
 }
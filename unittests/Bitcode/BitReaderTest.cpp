@@ -21,6 +21,7 @@
 #include "llvm/Support/DataStream.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/StreamingMemoryObject.h"
 #include "gtest/gtest.h"
@@ -272,4 +273,121 @@ TEST(BitReaderTest, MaterializeFunctionsForBlockAddrInFunctionAfter) {
   EXPECT_FALSE(verifyModule(*M, &dbgs()));
 }
 
+// Builds a module whose functions come in pairs sharing an attachment, which
+// keeps the attachments in the module-level Metadata block, with enough of them
+// for the block to get an index and be loaded lazily.
+static std::string getSharedAttachmentsAssembly(unsigned NumPairs) {
+  std::string Assembly;
+  raw_string_ostream OS(Assembly);
+  for (unsigned I = 0; I != NumPairs; ++I) {
+    OS << "define void @f" << I << "() !attach !" << I << " {\n"
+       << "  ret void\n"
+       << "}\n";
+    OS << "define void @g" << I << "() !attach !" << I << " {\n"
+       << "  ret void\n"
+       << "}\n";
+    OS << "!" << I << " = !{!\"string" << I << "\"}\n";
+  }
+  return OS.str();
+}
+
+static void checkSharedAttachment(Module &M, StringRef Name, unsigned I) {
+  Function *F = M.getFunction(Name);
+  ASSERT_FALSE(F->materialize());
+  MDNode *Attach = F->getMetadata("attach");
+  ASSERT_TRUE(Attach);
+  ASSERT_EQ(1u, Attach->getNumOperands());
+  EXPECT_EQ("string" + std::to_string(I),
+            cast<MDString>(Attach->getOperand(0))->getString());
+}
+
+TEST(BitReaderTest, MaterializeLazyMetadataStrings) {
+  SmallString<1024> Mem;
+  std::string Assembly = getSharedAttachmentsAssembly(64);
+
+  LLVMContext Context;
+  std::unique_ptr<Module> M =
+      getLazyModuleFromAssembly(Context, Mem, Assembly.c_str());
+  ASSERT_FALSE(M->materializeMetadata());
+  checkSharedAttachment(*M, "g40", 40);
+  checkSharedAttachment(*M, "f3", 3);
+  checkSharedAttachment(*M, "f40", 40);
+  ASSERT_FALSE(M->materializeAll());
+  for (unsigned I = 0; I != 64; ++I)
+    checkSharedAttachment(*M, "g" + std::to_string(I), I);
+  EXPECT_FALSE(verifyModule(*M, &dbgs()));
+}
+
+TEST(BitReaderTest, MaterializeLazyMetadataStringsWithStream) {
+  SmallString<1024> Mem;
+  std::string Assembly = getSharedAttachmentsAssembly(64);
+
+  LLVMContext Context;
+  std::unique_ptr<Module> M =
+      getStreamedModuleFromAssembly(Context, Mem, Assembly.c_str());
+  checkSharedAttachment(*M, "f7", 7);
+  ASSERT_FALSE(M->materializeAll());
+  for (unsigned I = 0; I != 64; ++I)
+    checkSharedAttachment(*M, "f" + std::to_string(I), I);
+  EXPECT_FALSE(verifyModule(*M, &dbgs()));
+}
+
+// With the module-level Metadata block loaded lazily, the MDStrings point into
+// the bitcode buffer as long as the module holds it, instead of copying it to
+// the heap.
+TEST(BitReaderTest, LazyMetadataStringsStayInBuffer) {
+  const unsigned NumPairs = 64;
+  const std::string Padding(16 * 1024, 'x');
+  std::string Assembly;
+  raw_string_ostream OS(Assembly);
+  for (unsigned I = 0; I != NumPairs; ++I) {
+    OS << "define void @f" << I << "() !attach !" << I << " {\n"
+       << "  ret void\n"
+       << "}\n";
+    OS << "define void @g" << I << "() !attach !" << I << " {\n"
+       << "  ret void\n"
+       << "}\n";
+    OS << "!" << I << " = !{!\"" << Padding << I << "\"}\n";
+  }
+  OS.flush();
+
+  // Write the bitcode from another context, which keeps its own strings.
+  SmallString<1024> Mem;
+  {
+    LLVMContext WriteContext;
+    writeModuleToBuffer(parseAssembly(WriteContext, Assembly.c_str()), Mem);
+  }
+  StringRef Buf = Mem.str();
+  auto InBuffer = [&](StringRef Str) {
+    return Str.begin() >= Buf.begin() && Str.end() <= Buf.end();
+  };
+
+  LLVMContext Context;
+  ErrorOr<std::unique_ptr<Module>> ModuleOrErr = getLazyBitcodeModule(
+      MemoryBuffer::getMemBuffer(Buf, "test", false), Context,
+      /* ShouldLazyLoadMetadata */ true);
+  ASSERT_TRUE(bool(ModuleOrErr));
+  std::unique_ptr<Module> M = std::move(ModuleOrErr.get());
+  ASSERT_FALSE(M->materializeMetadata());
+
+  size_t HeapBefore = sys::Process::GetMallocUsage();
+  std::vector<MDString *> Strings;
+  for (unsigned I = 0; I != NumPairs; ++I) {
+    Function *F = M->getFunction("f" + std::to_string(I));
+    ASSERT_FALSE(F->materialize());
+    Strings.push_back(cast<MDString>(F->getMetadata("attach")->getOperand(0)));
+    EXPECT_TRUE(InBuffer(Strings.back()->getString()));
+  }
+  size_t HeapAfter = sys::Process::GetMallocUsage();
+  // Copying the strings would have taken over a megabyte.
+  EXPECT_LT(HeapAfter, HeapBefore + NumPairs * Padding.size() / 4);
+
+  // Once the module is gone, the strings have their own copy.
+  M.reset();
+  for (unsigned I = 0; I != NumPairs; ++I) {
+    EXPECT_FALSE(InBuffer(Strings[I]->getString()));
+    EXPECT_EQ(Padding + std::to_string(I), Strings[I]->getString());
+  }
+}
+
 } // end namespace
@@ -0,0 +1,173 @@
+//===- llvm/unittest/DebugInfo/DWARFContextTest.cpp -----------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Dwarf.h"
+#include "gtest/gtest.h"
+#include <thread>
+using namespace llvm;
+using namespace dwarf;
+
+namespace {
+
+/// A little-endian, 64-bit context whose .debug_info holds one compile unit
+/// per function. The units don't describe their own address ranges, so the
+/// address lookups have to collect them from the subprogram DIEs.
+class TestContext : public DWARFContext {
+  std::string Abbrev;
+  std::string InfoData;
+  DWARFSection Info;
+  DWARFSection Empty;
+  TypeSectionMap NoTypes;
+  std::vector<uint32_t> UnitOffsets;
+
+  template <typename T> static void write(std::string &S, T Value) {
+    for (unsigned I = 0; I != sizeof(T); ++I)
+      S.push_back(char(uint64_t(Value) >> (8 * I)));
+  }
+
+public:
+  explicit TestContext(unsigned NumUnits) {
+    // Abbreviation 1: a compile unit with a name and children.
+    // Abbreviation 2: a subprogram with a name and an address range.
+    const uint8_t Abbrevs[] = {
+        1, DW_TAG_compile_unit, DW_CHILDREN_yes, DW_AT_name, DW_FORM_string,
+        0, 0,
+        2, DW_TAG_subprogram, DW_CHILDREN_no, DW_AT_name, DW_FORM_string,
+        DW_AT_low_pc, DW_FORM_addr, DW_AT_high_pc, DW_FORM_data4, 0, 0,
+        0};
+    Abbrev.assign(reinterpret_cast<const char *>(Abbrevs), sizeof(Abbrevs));
+
+    for (unsigned I = 0; I != NumUnits; ++I) {
+      std::string Unit;
+      write<uint16_t>(Unit, 4); // Version
+      write<uint32_t>(Unit, 0); // Abbreviation offset
+      write<uint8_t>(Unit, 8);  // Address size
+      write<uint8_t>(Unit, 1);
+      Unit += "cu" + utostr(I) + '\0';
+      write<uint8_t>(Unit, 2);
+      Unit += "f" + utostr(I) + '\0';
+      write<uint64_t>(Unit, getFunctionAddress(I));
+      write<uint32_t>(Unit, 0x100);
+      write<uint8_t>(Unit, 0);
+      UnitOffsets.push_back(InfoData.size());
+      write<uint32_t>(InfoData, Unit.size());
+      InfoData += Unit;
+    }
+    Info.Data = InfoData;
+  }
+
+  static uint64_t getFunctionAddress(unsigned I) { return 0x1000 * (I + 1); }
+  uint32_t getUnitOffset(unsigned I) const { return UnitOffsets[I]; }
+
+  bool isLittleEndian() const override { return true; }
+  uint8_t getAddressSize() const override { return 8; }
+  const DWARFSection &getInfoSection() override { return Info; }
+  const TypeSectionMap &getTypesSections() override { return NoTypes; }
+  StringRef getAbbrevSection() override { return Abbrev; }
+  const DWARFSection &getLocSection() override { return Empty; }
+  StringRef getARangeSection() override { return ""; }
+  StringRef getDebugFrameSection() override { return ""; }
+  StringRef getEHFrameSection() override { return ""; }
+  const DWARFSection &getLineSection() override { return Empty; }
+  StringRef getStringSection() override { return ""; }
+  StringRef getRangeSection() override { return ""; }
+  StringRef getMacinfoSection() override { return ""; }
+  StringRef getPubNamesSection() override { return ""; }
+  StringRef getPubTypesSection() override { return ""; }
+  StringRef getGnuPubNamesSection() override { return ""; }
+  StringRef getGnuPubTypesSection() override { return ""; }
+  const DWARFSection &getInfoDWOSection() override { return Empty; }
+  const TypeSectionMap &getTypesDWOSections() override { return NoTypes; }
+  StringRef getAbbrevDWOSection() override { return ""; }
+  const DWARFSection &getLineDWOSection() override { return Empty; }
+  const DWARFSection &getLocDWOSection() override { return Empty; }
+  StringRef getStringDWOSection() override { return ""; }
+  StringRef getStringOffsetDWOSection() override { return ""; }
+  StringRef getRangeDWOSection() override { return ""; }
+  StringRef getAddrSection() override { return ""; }
+  const DWARFSection &getAppleNamesSection() override { return Empty; }
+  const DWARFSection &getAppleTypesSection() override { return Empty; }
+  const DWARFSection &getAppleNamespacesSection() override { return Empty; }
+  const DWARFSection &getAppleObjCSection() override { return Empty; }
+  StringRef getCUIndexSection() override { return ""; }
+  StringRef getTUIndexSection() override { return ""; }
+};
+
+TEST(DWARFContextTest, LazyLookup) {
+  TestContext Ctx(8);
+  DILineInfoSpecifier Spec(DILineInfoSpecifier::FileLineInfoKind::None,
+                           DINameKind::ShortName);
+  EXPECT_EQ("f5", Ctx.getLineInfoForAddress(
+                         TestContext::getFunctionAddress(5) + 0x10, Spec)
+                      .FunctionName);
+  EXPECT_EQ(DILineInfo().FunctionName,
+            Ctx.getLineInfoForAddress(0x10, Spec).FunctionName);
+
+  DWARFCompileUnit *CU = Ctx.getCompileUnitAtOffset(0);
+  ASSERT_NE(nullptr, CU);
+  EXPECT_EQ(0U, CU->getOffset());
+  EXPECT_EQ(3U, CU->getNumDIEs());
+  EXPECT_EQ(8U, Ctx.getNumCompileUnits());
+  EXPECT_EQ(CU, Ctx.getCompileUnitAtIndex(0));
+}
+
+#if LLVM_ENABLE_THREADS
+TEST(DWARFContextTest, ConcurrentParse) {
+  const unsigned NumUnits = 64;
+  const unsigned NumThreads = 8;
+  TestContext Ctx(NumUnits);
+  DILineInfoSpecifier Spec(DILineInfoSpecifier::FileLineInfoKind::None,
+                           DINameKind::ShortName);
+
+  // Half of the threads look addresses up, which builds the address ranges
+  // from the DIEs of every unit. The other half parse units and their DIEs
+  // directly, either all at once or one at a time, each starting from a
+  // different unit.
+  std::vector<std::string> Names[NumThreads];
+  unsigned NumDIEs[NumThreads] = {};
+  std::vector<std::thread> Threads;
+  for (unsigned T = 0; T != NumThreads; ++T)
+    Threads.emplace_back([&, T] {
+      for (unsigned I = 0; I != NumUnits; ++I) {
+        unsigned Unit = (I + T * NumUnits / NumThreads) % NumUnits;
+        if (T % 2 == 0) {
+          uint64_t Address = TestContext::getFunctionAddress(Unit) + 0x10;
+          Names[T].push_back(Ctx.getLineInfoForAddress(Address, Spec)
+                                 .FunctionName);
+        } else if (I % 2 == 0) {
+          DWARFCompileUnit *Want = Ctx.getCompileUnitAtIndex(Unit);
+          for (const auto &CU : Ctx.compile_units())
+            if (CU.get() == Want)
+              NumDIEs[T] += CU->getNumDIEs();
+        } else if (DWARFCompileUnit *CU =
+                       Ctx.getCompileUnitAtOffset(Ctx.getUnitOffset(Unit))) {
+          NumDIEs[T] += CU->getNumDIEs();
+        }
+      }
+    });
+  for (std::thread &Thread : Threads)
+    Thread.join();
+
+  for (unsigned T = 0; T != NumThreads; ++T) {
+    if (T % 2) {
+      EXPECT_EQ(3 * NumUnits, NumDIEs[T]);
+      continue;
+    }
+    ASSERT_EQ(NumUnits, Names[T].size());
+    for (unsigned I = 0; I != NumUnits; ++I)
+      EXPECT_EQ("f" + utostr((I + T * NumUnits / NumThreads) % NumUnits),
+                Names[T][I]);
+  }
+}
+#endif
+
+} // end anonymous namespace
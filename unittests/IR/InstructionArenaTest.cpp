@@ -0,0 +1,101 @@
+//===- llvm/unittest/IR/InstructionArenaTest.cpp - Arena unit tests -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/InstructionArena.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/SourceMgr.h"
+#include "gtest/gtest.h"
+using namespace llvm;
+
+namespace {
+
+const char *ModuleString = "declare void @g(i32)\n"
+                           "define i32 @f(i32 %x, i1 %c) {\n"
+                           "entry:\n"
+                           "  %a = add i32 %x, 1\n"
+                           "  call void @g(i32 %a) [ \"deopt\"(i32 %x) ]\n"
+                           "  br i1 %c, label %then, label %exit\n"
+                           "then:\n"
+                           "  %b = mul i32 %a, %a\n"
+                           "  br label %exit\n"
+                           "exit:\n"
+                           "  %r = phi i32 [ %a, %entry ], [ %b, %then ]\n"
+                           "  ret i32 %r\n"
+                           "}\n";
+
+TEST(InstructionArenaTest, Scope) {
+  InstructionArena Outer, Inner;
+  EXPECT_EQ(nullptr, InstructionArena::getCurrent());
+  {
+    InstructionArena::Scope OuterScope(Outer);
+    EXPECT_EQ(&Outer, InstructionArena::getCurrent());
+    {
+      InstructionArena::Scope InnerScope(Inner);
+      EXPECT_EQ(&Inner, InstructionArena::getCurrent());
+    }
+    EXPECT_EQ(&Outer, InstructionArena::getCurrent());
+  }
+  EXPECT_EQ(nullptr, InstructionArena::getCurrent());
+}
+
+TEST(InstructionArenaTest, Allocate) {
+  InstructionArena Arena;
+  InstructionArena::Scope S(Arena);
+  void *A = Arena.allocate(24);
+  void *B = Arena.allocate(20);
+  EXPECT_NE(A, B);
+  EXPECT_EQ(nullptr, Arena.allocate(1 << 20));
+
+  // Freed memory is reused by allocations of the same size class only.
+  InstructionArena::deallocate(A);
+  EXPECT_NE(A, Arena.allocate(32));
+  EXPECT_EQ(A, Arena.allocate(17));
+}
+
+TEST(InstructionArenaTest, ParseAndModify) {
+  LLVMContext C;
+  InstructionArena Arena;
+  std::unique_ptr<Module> M;
+  {
+    InstructionArena::Scope S(Arena);
+    SMDiagnostic Err;
+    M = parseAssemblyString(ModuleString, Err, C);
+    ASSERT_TRUE(M != nullptr);
+  }
+  EXPECT_FALSE(verifyModule(*M, &errs()));
+  size_t Used = Arena.getTotalMemory();
+  EXPECT_NE(0u, Used);
+
+  // Instructions created with no arena in scope are not placed in it.
+  Function *F = M->getFunction("f");
+  Instruction *Add = &F->getEntryBlock().front();
+  Instruction *Clone = Add->clone();
+  Clone->insertAfter(Add);
+  EXPECT_EQ(Used, Arena.getTotalMemory());
+  Clone->eraseFromParent();
+
+  // An instruction erased in scope leaves its memory to the next one of the
+  // same size.
+  InstructionArena::Scope S(Arena);
+  Add->replaceAllUsesWith(UndefValue::get(Add->getType()));
+  Add->eraseFromParent();
+  Argument *X = &*F->arg_begin();
+  Instruction *Sub = BinaryOperator::CreateSub(
+      X, ConstantInt::get(X->getType(), 1), "s", &F->getEntryBlock().front());
+  EXPECT_EQ(static_cast<void *>(Add), static_cast<void *>(Sub));
+  EXPECT_FALSE(verifyModule(*M, &errs()));
+}
+
+} // end anonymous namespace
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/DebugInfoMetadata.h"
@@ -21,6 +22,7 @@
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/raw_ostream.h"
 #include "gtest/gtest.h"
+#include <thread>
 using namespace llvm;
 
 namespace {
@@ -143,6 +145,25 @@ TEST_F(MDStringTest, CreateSame) {
   EXPECT_EQ(s1, s2);
 }
 
+// Test that an MDString from getUncopied() points to the characters it was
+// created from until copyToContext(), and is uniqued like any other.
+TEST_F(MDStringTest, Uncopied) {
+  char x[3] = { 'a', 'b', 'c' };
+  MDString *s1 = MDString::getUncopied(Context, StringRef(&x[0], 3));
+  EXPECT_EQ(&x[0], s1->getString().data());
+  EXPECT_EQ(s1, MDString::get(Context, "abc"));
+
+  s1->copyToContext(Context);
+  x[0] = 'z';
+  EXPECT_EQ("abc", s1->getString());
+  EXPECT_EQ(s1, MDString::get(Context, "abc"));
+
+  // An existing string is returned as is.
+  MDString *s2 = MDString::get(Context, "zbc");
+  EXPECT_EQ(s2, MDString::getUncopied(Context, StringRef(&x[0], 3)));
+  EXPECT_NE(&x[0], s2->getString().data());
+}
+
 // Test that MDString prints out the string we fed it.
 TEST_F(MDStringTest, PrintingSimple) {
   char *str = new char[13];
@@ -2380,4 +2401,66 @@ TEST_F(DistinctMDOperandPlaceholderTest, TrackingMDRefAndDistinctMDNode) {
 #endif
 #endif
 
+#if LLVM_ENABLE_THREADS
+TEST(ThreadSafeContextTest, ConcurrentUniquing) {
+  LLVMContext Context;
+  Context.setThreadSafe(true);
+  EXPECT_TRUE(Context.isThreadSafe());
+
+  const unsigned NumThreads = 4;
+  const unsigned NumKeys = 200;
+  DISubprogram *Scope = DISubprogram::getDistinct(
+      Context, nullptr, "", "", nullptr, 0, nullptr, false, false, 0, nullptr,
+      0, 0, 0, 0, false, nullptr);
+
+  // Every thread uniques the same keys, in a different order.
+  struct Results {
+    std::vector<ConstantInt *> Ints;
+    std::vector<ConstantFP *> FPs;
+    std::vector<MDString *> Strings;
+    std::vector<MDNode *> Tuples;
+    std::vector<DILocation *> Locations;
+  } PerThread[NumThreads];
+
+  std::vector<std::thread> Threads;
+  for (unsigned T = 0; T != NumThreads; ++T)
+    Threads.emplace_back([&, T] {
+      Results &R = PerThread[T];
+      for (unsigned I = 0; I != NumKeys; ++I) {
+        unsigned K = (I * 7 + T * 13) % NumKeys;
+        R.Ints.push_back(ConstantInt::get(Type::getInt64Ty(Context), K));
+        R.FPs.push_back(
+            cast<ConstantFP>(ConstantFP::get(Type::getDoubleTy(Context), K)));
+        R.Strings.push_back(MDString::get(Context, ("s" + Twine(K)).str()));
+        Metadata *Ops[] = {R.Strings.back(),
+                           ConstantAsMetadata::get(R.Ints.back())};
+        R.Tuples.push_back(MDTuple::get(Context, Ops));
+        R.Locations.push_back(DILocation::get(Context, K, 1, Scope));
+      }
+    });
+  for (std::thread &Thread : Threads)
+    Thread.join();
+
+  Context.setThreadSafe(false);
+  EXPECT_FALSE(Context.isThreadSafe());
+
+  for (unsigned T = 1; T != NumThreads; ++T)
+    for (unsigned I = 0; I != NumKeys; ++I) {
+      unsigned K = (I * 7 + T * 13) % NumKeys;
+      unsigned J = 0;
+      while ((J * 7) % NumKeys != K)
+        ++J;
+      EXPECT_EQ(PerThread[0].Ints[J], PerThread[T].Ints[I]);
+      EXPECT_EQ(PerThread[0].FPs[J], PerThread[T].FPs[I]);
+      EXPECT_EQ(PerThread[0].Strings[J], PerThread[T].Strings[I]);
+      EXPECT_EQ(PerThread[0].Tuples[J], PerThread[T].Tuples[I]);
+      EXPECT_EQ(PerThread[0].Locations[J], PerThread[T].Locations[I]);
+    }
+
+  // The nodes are still uniqued once the context is no longer thread-safe.
+  EXPECT_EQ(PerThread[0].Locations[0], DILocation::get(Context, 0, 1, Scope));
+  EXPECT_EQ(PerThread[0].Strings[0], MDString::get(Context, "s0"));
+}
+#endif
+
 } // end namespace
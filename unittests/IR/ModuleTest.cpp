@@ -0,0 +1,82 @@
+//===- llvm/unittest/IR/ModuleTest.cpp - Module unit tests ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Support/SourceMgr.h"
+#include "gtest/gtest.h"
+using namespace llvm;
+
+namespace {
+
+// Values used by instructions, constants, globals and metadata, named and
+// unnamed, in two functions.
+const char *ModuleString =
+    "@g = global i32 ptrtoint (i32 (i32)* @f to i32)\n"
+    "@a = alias i32, i32* @g\n"
+    "@ba = global i8* blockaddress(@f, %then)\n"
+    "declare void @llvm.foo(metadata)\n"
+    "define i32 @f(i32 %x) {\n"
+    "entry:\n"
+    "  %v = load i32, i32* @a\n"
+    "  %c = icmp eq i32 %v, 7\n"
+    "  call void @llvm.foo(metadata i32 %x)\n"
+    "  br i1 %c, label %then, label %exit\n"
+    "then:\n"
+    "  %0 = add i32 %x, 1\n"
+    "  br label %exit\n"
+    "exit:\n"
+    "  %r = phi i32 [ 7, %entry ], [ %0, %then ]\n"
+    "  ret i32 %r\n"
+    "}\n"
+    "define i32 @h() {\n"
+    "  %r = call i32 @f(i32 7)\n"
+    "  ret i32 %r\n"
+    "}\n";
+
+std::unique_ptr<Module> parse(LLVMContext &C) {
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseAssemblyString(ModuleString, Err, C);
+  if (!M)
+    Err.print("ModuleTest", errs());
+  return M;
+}
+
+TEST(ModuleTest, FastTeardown) {
+  auto C = llvm::make_unique<LLVMContext>();
+  std::unique_ptr<Module> M = parse(*C);
+  ASSERT_TRUE(M != nullptr);
+
+  Function *F = M->getFunction("f");
+  WeakVH Load = &F->getEntryBlock().front();
+  WeakVH Global = M->getNamedValue("g");
+  C->enableFastTeardown();
+
+  // Value handles still see the values go.
+  M.reset();
+  EXPECT_EQ(nullptr, Load);
+  EXPECT_EQ(nullptr, Global);
+  C.reset();
+}
+
+TEST(ModuleTest, FastTeardownOfOwnedModules) {
+  auto C = llvm::make_unique<LLVMContext>();
+  Module *M1 = parse(*C).release();
+  Module *M2 = parse(*C).release();
+  ASSERT_TRUE(M1 && M2);
+
+  // The context destroys the modules it still owns the fast way too.
+  C->enableFastTeardown();
+  C.reset();
+}
+
+} // end anonymous namespace
@@ -0,0 +1,117 @@
+//===- ArchiveTest.cpp - Tests for the archive reader ---------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Object/Archive.h"
+#include "llvm/Config/llvm-config.h"
+#include "gtest/gtest.h"
+#include <thread>
+using namespace llvm;
+using namespace object;
+
+namespace {
+
+/// Appends a GNU archive member header for \p Name, holding \p Size bytes.
+void appendHeader(std::string &Archive, StringRef Name, size_t Size) {
+  std::string Header = Name;
+  Header.resize(16, ' ');
+  Header += "0           0     0     644     ";
+  std::string SizeField = std::to_string(Size);
+  SizeField.resize(10, ' ');
+  Header += SizeField + "`\n";
+  Archive += Header;
+}
+
+void appendBE32(std::string &S, uint32_t Value) {
+  for (int Shift = 24; Shift >= 0; Shift -= 8)
+    S.push_back(char(Value >> Shift));
+}
+
+/// A GNU archive with the members a.o and b.o, and a symbol table where
+/// "first" and "dup" are defined by a.o, and "dup" and "second" by b.o.
+std::string makeArchive() {
+  const char *Names[] = {"first", "dup", "dup", "second"};
+  const unsigned Members[] = {0, 0, 1, 1};
+
+  std::string NameTable;
+  for (const char *Name : Names)
+    NameTable += std::string(Name) + '\0';
+  size_t SymTabSize = 4 + 4 * array_lengthof(Names) + NameTable.size();
+  SymTabSize += SymTabSize % 2;
+
+  // Each member holds 4 bytes of data.
+  uint32_t MemberOffsets[2];
+  MemberOffsets[0] = 8 + 60 + SymTabSize;
+  MemberOffsets[1] = MemberOffsets[0] + 60 + 4;
+
+  std::string Archive = "!<arch>\n";
+  appendHeader(Archive, "/", SymTabSize);
+  std::string SymTab;
+  appendBE32(SymTab, array_lengthof(Names));
+  for (unsigned Member : Members)
+    appendBE32(SymTab, MemberOffsets[Member]);
+  SymTab += NameTable;
+  SymTab.resize(SymTabSize, '\n');
+  Archive += SymTab;
+  appendHeader(Archive, "a.o/", 4);
+  Archive += "aaaa";
+  appendHeader(Archive, "b.o/", 4);
+  Archive += "bbbb";
+  return Archive;
+}
+
+/// Returns the name of the member defining \p Symbol, or "" if there is none.
+std::string findMemberName(const Archive &A, StringRef Symbol) {
+  Archive::child_iterator I = A.findSym(Symbol);
+  if (I == A.child_end())
+    return "";
+  const ErrorOr<Archive::Child> &C = *I;
+  if (!C)
+    return "<error>";
+  ErrorOr<StringRef> Name = C->getName();
+  return Name ? Name->str() : "<error>";
+}
+
+TEST(ArchiveTest, FindSym) {
+  std::string Data = makeArchive();
+  Expected<std::unique_ptr<Archive>> A =
+      Archive::create(MemoryBufferRef(Data, "test.a"));
+  ASSERT_TRUE(!!A);
+  EXPECT_EQ(4U, (*A)->getNumberOfSymbols());
+
+  EXPECT_EQ("a.o", findMemberName(**A, "first"));
+  EXPECT_EQ("b.o", findMemberName(**A, "second"));
+  // Like a scan of the symbol table, the lookup finds the first definition.
+  EXPECT_EQ("a.o", findMemberName(**A, "dup"));
+  EXPECT_EQ("", findMemberName(**A, "missing"));
+}
+
+#if LLVM_ENABLE_THREADS
+TEST(ArchiveTest, ConcurrentFindSym) {
+  std::string Data = makeArchive();
+  Expected<std::unique_ptr<Archive>> A =
+      Archive::create(MemoryBufferRef(Data, "test.a"));
+  ASSERT_TRUE(!!A);
+
+  // The first lookups of all the threads race to build the index.
+  const unsigned NumThreads = 8;
+  std::string Found[NumThreads];
+  std::vector<std::thread> Threads;
+  for (unsigned T = 0; T != NumThreads; ++T)
+    Threads.emplace_back([&, T] {
+      Found[T] = findMemberName(**A, T % 2 ? "second" : "dup");
+    });
+  for (std::thread &Thread : Threads)
+    Thread.join();
+
+  for (unsigned T = 0; T != NumThreads; ++T)
+    EXPECT_EQ(T % 2 ? "b.o" : "a.o", Found[T]);
+}
+#endif
+
+} // end anonymous namespace
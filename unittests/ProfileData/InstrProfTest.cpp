@@ -826,6 +826,57 @@ TEST_P(MaybeSparseInstrProfTest, get_weighted_function_counts) {
   ASSERT_EQ(20U, Counts[1]);
 }
 
+TEST_P(MaybeSparseInstrProfTest, merge_records_from_writer) {
+  InstrProfRecord Record1("foo", 0x1234, {1, 2});
+  InstrProfRecord Record2("foo", 0x1234, {3, 4});
+  InstrProfRecord Record3("bar", 0x5678, {5});
+  InstrProfRecord Record4("foo", 0x1234, {1});
+  ASSERT_TRUE(NoError(Writer.addRecord(std::move(Record1))));
+
+  InstrProfWriter Writer2;
+  ASSERT_TRUE(NoError(Writer2.addRecord(std::move(Record2), 2)));
+  ASSERT_TRUE(NoError(Writer2.addRecord(std::move(Record3))));
+
+  unsigned NumWarnings = 0;
+  auto Warn = [&](Error E, StringRef Func) {
+    ++NumWarnings;
+    EXPECT_EQ("foo", Func);
+    EXPECT_TRUE(ErrorEquals(instrprof_error::count_mismatch, std::move(E)));
+  };
+  ASSERT_TRUE(NoError(Writer.mergeRecordsFromWriter(std::move(Writer2), Warn)));
+  ASSERT_EQ(0U, NumWarnings);
+
+  // On a conflict, the record that was in the writer first is kept.
+  InstrProfWriter Writer3;
+  ASSERT_TRUE(NoError(Writer3.addRecord(std::move(Record4))));
+  ASSERT_TRUE(NoError(Writer.mergeRecordsFromWriter(std::move(Writer3), Warn)));
+  ASSERT_EQ(1U, NumWarnings);
+
+  auto Profile = Writer.writeBuffer();
+  readProfile(std::move(Profile));
+
+  std::vector<uint64_t> Counts;
+  ASSERT_TRUE(NoError(Reader->getFunctionCounts("foo", 0x1234, Counts)));
+  ASSERT_EQ(2U, Counts.size());
+  ASSERT_EQ(7U, Counts[0]);
+  ASSERT_EQ(10U, Counts[1]);
+
+  ASSERT_TRUE(NoError(Reader->getFunctionCounts("bar", 0x5678, Counts)));
+  ASSERT_EQ(1U, Counts.size());
+  ASSERT_EQ(5U, Counts[0]);
+}
+
+TEST_P(MaybeSparseInstrProfTest, merge_records_from_writer_kind_mismatch) {
+  InstrProfWriter Writer2;
+  ASSERT_TRUE(NoError(Writer.setIsIRLevelProfile(false)));
+  ASSERT_TRUE(NoError(Writer2.setIsIRLevelProfile(true)));
+  ASSERT_TRUE(ErrorEquals(instrprof_error::unsupported_version,
+                          Writer.mergeRecordsFromWriter(
+                              std::move(Writer2), [](Error E, StringRef) {
+                                consumeError(std::move(E));
+                              })));
+}
+
 // Testing symtab creator interface used by indexed profile reader.
 TEST_P(MaybeSparseInstrProfTest, instr_prof_symtab_test) {
   std::vector<StringRef> FuncNames;
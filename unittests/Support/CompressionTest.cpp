@@ -13,8 +13,10 @@
 
 #include "llvm/Support/Compression.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Config/config.h"
+#include "llvm/Support/ThreadPool.h"
 #include "gtest/gtest.h"
 
 using namespace llvm;
@@ -59,6 +61,39 @@ TEST(CompressionTest, Zlib) {
   TestZlibCompression(BinaryDataStr, zlib::DefaultCompression);
 }
 
+void TestParallelZlibCompression(StringRef Input,
+                                 zlib::CompressionLevel Level) {
+  ThreadPool Pool(4);
+  SmallString<32> Compressed;
+  SmallString<32> Uncompressed;
+  EXPECT_EQ(zlib::StatusOK,
+            zlib::compressParallel(Input, Compressed, &Pool, Level));
+  // The blocks form a single stream that zlib inflates in one go.
+  EXPECT_EQ(zlib::StatusOK,
+            zlib::uncompress(Compressed, Uncompressed, Input.size()));
+  EXPECT_EQ(Input, Uncompressed);
+
+  // Without a pool, the blocks are deflated in turn into the same stream.
+  SmallString<32> SerialCompressed;
+  EXPECT_EQ(zlib::StatusOK,
+            zlib::compressParallel(Input, SerialCompressed, nullptr, Level));
+  EXPECT_EQ(Compressed, SerialCompressed);
+}
+
+TEST(CompressionTest, ZlibParallel) {
+  TestParallelZlibCompression("", zlib::DefaultCompression);
+  TestParallelZlibCompression("hello, world!", zlib::DefaultCompression);
+
+  // Several blocks, the last of which is partial.
+  std::string Text;
+  for (unsigned i = 0; Text.size() < 1000000; ++i)
+    Text += "line " + utostr(i % 1000) + " of the input\n";
+  TestParallelZlibCompression(Text, zlib::NoCompression);
+  TestParallelZlibCompression(Text, zlib::BestSizeCompression);
+  TestParallelZlibCompression(Text, zlib::BestSpeedCompression);
+  TestParallelZlibCompression(Text, zlib::DefaultCompression);
+}
+
 TEST(CompressionTest, ZlibCRC32) {
   EXPECT_EQ(
       0x414FA339U,
@@ -166,3 +166,100 @@ TEST_F(ThreadPoolTest, PoolDestruction) {
   }
   ASSERT_EQ(5, checked_in);
 }
+
+TEST_F(ThreadPoolTest, TaskGroupWait) {
+  CHECK_UNSUPPORTED();
+  // Test that a group only waits on its own tasks.
+  ThreadPool Pool{2};
+  std::atomic_int Outside{0};
+  std::atomic_int Inside{0};
+  Pool.async([this, &Outside] {
+    waitForMainThread();
+    ++Outside;
+  });
+  {
+    TaskGroup Group(Pool);
+    for (size_t i = 0; i < 5; ++i)
+      Group.async([&Inside] { ++Inside; });
+    Group.wait();
+    ASSERT_EQ(5, Inside);
+  }
+  ASSERT_EQ(0, Outside);
+  setMainThreadReady();
+  Pool.wait();
+  ASSERT_EQ(1, Outside);
+}
+
+TEST_F(ThreadPoolTest, TaskGroupArgs) {
+  CHECK_UNSUPPORTED();
+  // Test that TaskGroup::async works with a function requiring multiple
+  // parameters, and that the destructor waits for the group.
+  std::atomic_int checked_in{0};
+  ThreadPool Pool;
+  {
+    TaskGroup Group(Pool);
+    for (size_t i = 0; i < 5; ++i)
+      Group.async(TestFunc, std::ref(checked_in), i);
+  }
+  ASSERT_EQ(10, checked_in);
+}
+
+static void parallelSum(ThreadPool &Pool, std::atomic_int &Sum, int Begin,
+                        int End) {
+  if (End - Begin <= 4) {
+    for (int I = Begin; I < End; ++I)
+      Sum += I;
+    return;
+  }
+  int Mid = Begin + (End - Begin) / 2;
+  TaskGroup Group(Pool);
+  Group.async([&Pool, &Sum, Begin, Mid] { parallelSum(Pool, Sum, Begin, Mid); });
+  Group.async([&Pool, &Sum, Mid, End] { parallelSum(Pool, Sum, Mid, End); });
+  Group.wait();
+}
+
+TEST_F(ThreadPoolTest, NestedTaskGroups) {
+  CHECK_UNSUPPORTED();
+  // Test that tasks can wait on their subtasks without deadlocking the pool,
+  // even with far more nested waits than there are threads.
+  ThreadPool Pool{2};
+  std::atomic_int Sum{0};
+  Pool.async([&Pool, &Sum] { parallelSum(Pool, Sum, 0, 1000); });
+  Pool.wait();
+  ASSERT_EQ(999 * 1000 / 2, Sum);
+}
+
+TEST_F(ThreadPoolTest, ContentionManyProducers) {
+  CHECK_UNSUPPORTED();
+  // Several threads submitting many small tasks concurrently.
+  const int NumProducers = 4;
+  const int TasksPerProducer = 5000;
+  std::atomic_int checked_in{0};
+  ThreadPool Pool{4};
+  std::vector<llvm::thread> Producers;
+  for (int P = 0; P < NumProducers; ++P)
+    Producers.emplace_back([&Pool, &checked_in] {
+      for (int I = 0; I < TasksPerProducer; ++I)
+        Pool.async([&checked_in] { ++checked_in; });
+    });
+  for (auto &Producer : Producers)
+    Producer.join();
+  Pool.wait();
+  ASSERT_EQ(NumProducers * TasksPerProducer, checked_in);
+}
+
+TEST_F(ThreadPoolTest, ContentionStealing) {
+  CHECK_UNSUPPORTED();
+  // A single task spawning many small subtasks into its own queue, which the
+  // other workers have to steal from.
+  const int NumTasks = 20000;
+  std::atomic_int checked_in{0};
+  ThreadPool Pool{4};
+  Pool.async([&Pool, &checked_in] {
+    TaskGroup Group(Pool);
+    for (int I = 0; I < NumTasks; ++I)
+      Group.async([&checked_in] { ++checked_in; });
+  });
+  Pool.wait();
+  ASSERT_EQ(NumTasks, checked_in);
+}